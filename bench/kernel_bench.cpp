@@ -0,0 +1,549 @@
+/*
+  ---------------------------------------------------------------------------
+  kernel_bench.cpp
+  Microbenchmarks of the hot kernels of the library.
+
+  Usage: sgl_bench [--filter <substring>] [--min-time <seconds>] [--out <file>]
+
+  Every kernel is run in batches whose size is calibrated so that a batch
+  takes at least min-time / REPETITIONS seconds. The median batch is reported
+  in ns/op and ops/s as JSON, so that the output of two builds can be diffed.
+  ---------------------------------------------------------------------------
+*/
+#include "sgl.h"
+#include "context.h"
+#include "draw_utils.h"
+#include "lightingModels.h"
+#include "ray_tracing_utils.h"
+#include "triangle_raster.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+using std::string;
+using std::vector;
+
+#ifndef SGL_BUILD_TYPE
+#define SGL_BUILD_TYPE ""
+#endif
+
+namespace {
+
+const int REPETITIONS = 5;
+
+struct BenchOptions {
+    string filter;
+    double minTime = 1.0;
+};
+
+struct BenchResult {
+    string name;
+    unsigned long long iterations;
+    double nsPerOp;
+    double nsPerOpMin;
+};
+
+// Keeps the compiler from removing the computation of value
+template <typename T>
+inline void doNotOptimize(const T& value) {
+#if defined(__GNUC__)
+    asm volatile("" : : "r,m"(value) : "memory");
+#else
+    static volatile const void* sink;
+    sink = &value;
+#endif
+}
+
+double seconds(std::chrono::steady_clock::duration d) {
+    return std::chrono::duration<double>(d).count();
+}
+
+template <typename Op>
+double timeBatch(Op& op, unsigned long long iterations) {
+    auto start = std::chrono::steady_clock::now();
+    for (unsigned long long i = 0; i < iterations; i++) {
+        op();
+    }
+    return seconds(std::chrono::steady_clock::now() - start);
+}
+
+template <typename Op>
+void runBenchmark(const BenchOptions& options, vector<BenchResult>& results, const string& name, Op op) {
+    if (!options.filter.empty() && name.find(options.filter) == string::npos) {
+        return;
+    }
+
+    // grow the batch until it is long enough to be timed reliably
+    const double batchTime = options.minTime / REPETITIONS;
+    unsigned long long iterations = 1;
+    double elapsed = timeBatch(op, iterations);
+    while (elapsed < batchTime) {
+        double factor = elapsed > 0 ? 1.4 * batchTime / elapsed : 10.0;
+        iterations = static_cast<unsigned long long>(iterations * std::min(std::max(factor, 2.0), 100.0));
+        elapsed = timeBatch(op, iterations);
+    }
+
+    vector<double> perOp;
+    for (int r = 0; r < REPETITIONS; r++) {
+        perOp.push_back(timeBatch(op, iterations) * 1e9 / iterations);
+    }
+    std::sort(perOp.begin(), perOp.end());
+    results.push_back({ name, iterations, perOp[REPETITIONS / 2], perOp.front() });
+    fprintf(stderr, "%-40s %12.1f ns/op\n", name.c_str(), perOp[REPETITIONS / 2]);
+}
+
+// Creates a context of the given size and makes it current
+int makeContext(int width, int height) {
+    int id = sglCreateContext(width, height);
+    sglSetContext(id);
+    sglViewport(0, 0, width, height);
+    sglMatrixMode(SGL_PROJECTION);
+    sglLoadIdentity();
+    sglMatrixMode(SGL_MODELVIEW);
+    sglLoadIdentity();
+    sglClearColor(0, 0, 0, 1);
+    sglClear(SGL_COLOR_BUFFER_BIT | SGL_DEPTH_BUFFER_BIT);
+    return id;
+}
+
+void benchRayTracingKernels(const BenchOptions& options, vector<BenchResult>& results) {
+    Sphere sphere(0.0f, 0.0f, -5.0f, 1.0f);
+    Triangle triangle(Vertex(-1.0f, -1.0f, -5.0f), Vertex(1.0f, -1.0f, -5.0f), Vertex(0.0f, 1.0f, -5.0f));
+    const Ray hitRay(Vertex(0.0f, 0.0f, 0.0f), Vertex(0.05f, 0.02f, -1.0f));
+    const Ray missRay(Vertex(0.0f, 0.0f, 0.0f), Vertex(0.0f, 1.0f, 0.0f));
+
+    runBenchmark(options, results, "Sphere::IntersectWithRay/hit", [&] {
+        float t = 0.0f;
+        doNotOptimize(sphere.IntersectWithRay(hitRay, t));
+        doNotOptimize(t);
+    });
+    runBenchmark(options, results, "Sphere::IntersectWithRay/miss", [&] {
+        float t = 0.0f;
+        doNotOptimize(sphere.IntersectWithRay(missRay, t));
+    });
+    runBenchmark(options, results, "Triangle::IntersectWithRay/hit", [&] {
+        float t = 0.0f;
+        doNotOptimize(triangle.IntersectWithRay(hitRay, t));
+        doNotOptimize(t);
+    });
+    runBenchmark(options, results, "Triangle::IntersectWithRay/miss", [&] {
+        float t = 0.0f;
+        doNotOptimize(triangle.IntersectWithRay(missRay, t));
+    });
+
+    const PointLight light(2.0f, 5.0f, 0.0f, 1.0f, 1.0f, 1.0f);
+    const Material material(0.8f, 0.3f, 0.2f, 0.6f, 0.4f, 32.0f, 0.0f, 1.0f);
+    const Vertex point(0.1f, 0.2f, -4.0f);
+    const Vertex normal(0.1f, 0.2f, 1.0f);
+    const Vertex origin(0.0f, 0.0f, 0.0f);
+    runBenchmark(options, results, "lightingPhong", [&] {
+        doNotOptimize(lightingPhong(light, point, normal, origin, material));
+    });
+
+    Matrix invPVM;
+    invPVM.data[0] = 1.2f;
+    invPVM.data[5] = 0.9f;
+    invPVM.data[11] = -1.0f;
+    invPVM.data[14] = -0.5f;
+    const RayCamera camera(invPVM, 640, 480);
+    float x = 0.0f;
+    runBenchmark(options, results, "generatePrimaryRay", [&] {
+        doNotOptimize(generatePrimaryRay(camera, x, 240.5f));
+        x = x < 639.0f ? x + 1.0f : 0.0f;
+    });
+}
+
+void benchMatrixKernels(const BenchOptions& options, vector<BenchResult>& results) {
+    const Matrix a({ 1.0f, 0.5f, 0.0f, 2.0f,
+                     0.0f, 2.0f, 0.3f, -1.0f,
+                     0.2f, 0.0f, 1.5f, 4.0f,
+                     0.0f, 0.0f, 0.0f, 1.0f });
+    const Matrix b({ 0.9f, 0.0f, -0.4f, 0.0f,
+                     0.1f, 1.1f, 0.0f, 3.0f,
+                     0.4f, 0.0f, 0.9f, -2.0f,
+                     0.0f, 0.0f, 0.0f, 1.0f });
+
+    runBenchmark(options, results, "Matrix::operator*", [&] {
+        Matrix product = a * b;
+        doNotOptimize(product.data[0]);
+    });
+    // Invert() works in place, so the measured time includes copying the matrix
+    runBenchmark(options, results, "Matrix::Invert", [&] {
+        Matrix inverse = a;
+        doNotOptimize(inverse.Invert());
+        doNotOptimize(inverse.data[0]);
+    });
+}
+
+// Regular n-gon of the given radius centered in the context
+void setPolygon(SGLContext& context, int sides, float radius) {
+    auto& vertices = *context.screenVertices;
+    vertices.clear();
+    const float cx = context.width / 2.0f;
+    const float cy = context.height / 2.0f;
+    for (int i = 0; i < sides; i++) {
+        float angle = 2.0f * static_cast<float>(M_PI) * i / sides;
+        vertices.emplace_back(static_cast<int>(cx + radius * cosf(angle)),
+                              static_cast<int>(cy + radius * sinf(angle)),
+                              0.5f);
+    }
+}
+
+// Star of the given number of points centered in the context, concave with
+// many edges active on every row like the outlines of GIS polygons
+void setStar(SGLContext& context, int points, float inner, float outer) {
+    auto& vertices = *context.screenVertices;
+    vertices.clear();
+    const float cx = context.width / 2.0f;
+    const float cy = context.height / 2.0f;
+    for (int i = 0; i < 2 * points; i++) {
+        float angle = static_cast<float>(M_PI) * i / points;
+        float radius = i % 2 ? inner : outer;
+        vertices.emplace_back(static_cast<int>(cx + radius * cosf(angle)),
+                              static_cast<int>(cy + radius * sinf(angle)),
+                              0.5f);
+    }
+}
+
+void benchRasterKernels(const BenchOptions& options, vector<BenchResult>& results) {
+    makeContext(1920, 1080);
+    sglEnable(SGL_DEPTH_TEST);
+    SGLContext& context = sceneManager->getCurrentContext();
+    RasterState state = rasterState(context);
+    state.color = Pixel(1.0f, 0.5f, 0.25f);
+
+    for (int length : { 16, 256, 1024 }) {
+        int y = 0;
+        runBenchmark(options, results, "plotLine/" + std::to_string(length), [&] {
+            plotLine(context, state, y, 100, 100 + length - 1, 0.5f, 0.6f);
+            y = y < context.height - 1 ? y + 1 : 0;
+        });
+    }
+
+    for (int length : { 16, 256, 1024 }) {
+        int y = 0;
+        runBenchmark(options, results, "drawBresenhamLine/" + std::to_string(length), [&] {
+            drawBresenhamLine(context, state, ScreenVertex(100, y, 0.5f), ScreenVertex(100 + length, y + length / 4, 0.6f));
+            y = y < context.height - length / 4 - 1 ? y + 1 : 0;
+        });
+    }
+
+    // radius in pixels, the filled area grows with its square
+    for (int radius : { 4, 32, 128, 512 }) {
+        setPolygon(context, 12, static_cast<float>(radius));
+        runBenchmark(options, results, "fillPolygon/r" + std::to_string(radius), [&] {
+            fillPolygon(context, state, context.screenVertices->data(), context.screenVertices->size());
+        });
+    }
+
+    // the 40-gons of sglEllipse(), through the edge table and the two chains
+    for (int radius : { 4, 32, 128 }) {
+        setPolygon(context, 40, static_cast<float>(radius));
+        runBenchmark(options, results, "fillPolygon/ellipse" + std::to_string(radius), [&] {
+            fillPolygon(context, state, context.screenVertices->data(), context.screenVertices->size());
+        });
+        runBenchmark(options, results, "fillMonotonePolygon/ellipse" + std::to_string(radius), [&] {
+            fillMonotonePolygon(context, state, context.screenVertices->data(), context.screenVertices->size());
+        });
+    }
+
+    // vertices of a star of radius 500, the edge table dominates the fill
+    for (int points : { 500, 5000, 50000 }) {
+        setStar(context, points, 250.0f, 500.0f);
+        runBenchmark(options, results, "fillPolygon/star" + std::to_string(2 * points), [&] {
+            fillPolygon(context, state, context.screenVertices->data(), context.screenVertices->size());
+        });
+    }
+
+    // map-like grid of adjacent regions, filled one by one and as one path
+    for (int cells : { 8, 64 }) {
+        vector<ScreenVertex> grid;
+        vector<uint32_t> contours;
+        const int side = 1024 / cells;
+        for (int row = 0; row < cells; row++) {
+            for (int column = 0; column < cells; column++) {
+                const int x = 400 + column * side;
+                const int y = 20 + row * side;
+                grid.emplace_back(x, y, 0.5f);
+                grid.emplace_back(x + side, y, 0.5f);
+                grid.emplace_back(x + side, y + side, 0.5f);
+                grid.emplace_back(x, y + side, 0.5f);
+                contours.push_back(4);
+            }
+        }
+        const string name = std::to_string(cells) + "x" + std::to_string(cells);
+        runBenchmark(options, results, "fillPolygon/grid" + name, [&] {
+            for (size_t i = 0; i < grid.size(); i += 4) {
+                fillPolygon(context, state, grid.data() + i, 4);
+            }
+        });
+        runBenchmark(options, results, "fillPath/grid" + name, [&] {
+            fillPath(context, state, grid.data(), contours.data(), contours.size(), SGL_NONZERO);
+        });
+    }
+
+    // triangles of about the given side in pixels, moving over the canvas
+    for (int side : { 2, 8, 64, 512 }) {
+        int i = 0;
+        runBenchmark(options, results, "fillTriangle/" + std::to_string(side), [&] {
+            const float x = 10.0f + (i * 37) % (context.width - side - 20);
+            const float y = 10.0f + (i * 23) % (context.height - side - 20);
+            fillTriangle(context, state, Vertex(x, y, 0.5f), Vertex(x + side, y + 0.3f * side, 0.5f),
+                         Vertex(x + 0.4f * side, y + side, 0.6f));
+            i++;
+        });
+    }
+
+    // a list of 10000 small triangles, transformed as by sglEnd()
+    vector<Vertex> vertices;
+    vector<Vertex> windowVertices;
+    for (int i = 0; i < 10000; i++) {
+        const float x = -0.95f + 1.9f * ((i * 37) % 997) / 997.0f;
+        const float y = -0.95f + 1.9f * ((i * 53) % 991) / 991.0f;
+        vertices.emplace_back(x, y, 0.0f);
+        vertices.emplace_back(x + 0.006f, y + 0.002f, 0.0f);
+        vertices.emplace_back(x + 0.002f, y + 0.008f, 0.0f);
+    }
+    runBenchmark(options, results, "fillTriangles/10000x5px", [&] {
+        windowVertices.clear();
+        for (const Vertex& v : vertices) {
+            windowVertices.push_back(transformPoint(context, v));
+        }
+        fillTriangles(context, state, windowVertices.data(), windowVertices.size());
+    });
+}
+
+// A frame of overlapping polygons through the public API, drawn directly and
+// by the binned rasterizer
+void benchBinnedRaster(const BenchOptions& options, vector<BenchResult>& results) {
+    makeContext(1920, 1080);
+    sglEnable(SGL_DEPTH_TEST);
+    SGLContext& context = sceneManager->getCurrentContext();
+
+    auto drawFrame = [&] {
+        sglClear(SGL_COLOR_BUFFER_BIT | SGL_DEPTH_BUFFER_BIT);
+        for (int i = 0; i < 2000; i++) {
+            const float x = -0.95f + 1.8f * ((i * 37) % 997) / 997.0f;
+            const float y = -0.95f + 1.8f * ((i * 53) % 991) / 991.0f;
+            const float z = -0.5f + ((i * 71) % 101) / 101.0f;
+            sglColor3f((i % 7) / 7.0f, (i % 5) / 5.0f, (i % 3) / 3.0f);
+            sglBegin(SGL_POLYGON);
+            sglVertex3f(x, y, z);
+            sglVertex3f(x + 0.15f, y + 0.02f, z);
+            sglVertex3f(x + 0.12f, y + 0.14f, z);
+            sglVertex3f(x - 0.01f, y + 0.1f, z);
+            sglEnd();
+        }
+        flushBinnedRaster(context);
+    };
+
+    runBenchmark(options, results, "frame/serial/2000polygons", drawFrame);
+    sglEnable(SGL_BINNED_RASTER);
+    runBenchmark(options, results, "frame/binned/2000polygons", drawFrame);
+    sglDisable(SGL_BINNED_RASTER);
+}
+
+// A static overlay of grid lines and markers, submitted vertex by vertex
+// and called as a display list
+void benchDisplayList(const BenchOptions& options, vector<BenchResult>& results) {
+    makeContext(1920, 1080);
+    SGLContext& context = sceneManager->getCurrentContext();
+
+    auto drawOverlay = [] {
+        sglColor3f(0.3f, 0.3f, 0.3f);
+        sglBegin(SGL_LINES);
+        for (int i = 0; i <= 100; i++) {
+            const float t = -1.0f + i / 50.0f;
+            sglVertex2f(t, -1.0f);
+            sglVertex2f(t, 1.0f);
+            sglVertex2f(-1.0f, t);
+            sglVertex2f(1.0f, t);
+        }
+        sglEnd();
+        sglColor3f(1.0f, 0.8f, 0.2f);
+        for (int i = 0; i < 500; i++) {
+            const float x = -0.95f + 1.9f * ((i * 37) % 997) / 997.0f;
+            const float y = -0.95f + 1.9f * ((i * 53) % 991) / 991.0f;
+            sglBegin(SGL_POLYGON);
+            sglVertex2f(x, y);
+            sglVertex2f(x + 0.01f, y + 0.004f);
+            sglVertex2f(x + 0.006f, y + 0.012f);
+            sglVertex2f(x - 0.003f, y + 0.008f);
+            sglEnd();
+        }
+    };
+
+    runBenchmark(options, results, "overlay/immediate", [&] {
+        drawOverlay();
+        flushBinnedRaster(context);
+    });
+    sglNewList(1);
+    drawOverlay();
+    sglEndList();
+    runBenchmark(options, results, "overlay/displayList", [&] {
+        sglCallList(1);
+        flushBinnedRaster(context);
+    });
+}
+
+void benchVertexArrays(const BenchOptions& options, vector<BenchResult>& results) {
+    makeContext(1920, 1080);
+
+    // a scatter plot of a million points
+    const int count = 1000000;
+    vector<float> points(2 * count);
+    for (int i = 0; i < count; i++) {
+        points[2 * i] = -1.0f + 2.0f * ((i * 7919LL) % 100003) / 100003.0f;
+        points[2 * i + 1] = -1.0f + 2.0f * ((i * 104729LL) % 99991) / 99991.0f;
+    }
+
+    runBenchmark(options, results, "scatter/sglVertex2f", [&] {
+        sglBegin(SGL_POINTS);
+        for (int i = 0; i < count; i++) {
+            sglVertex2f(points[2 * i], points[2 * i + 1]);
+        }
+        sglEnd();
+    });
+    sglVertexPointer(2, 0, points.data());
+    runBenchmark(options, results, "scatter/sglDrawArrays", [&] {
+        sglDrawArrays(SGL_POINTS, 0, count);
+    });
+
+    // the transform stage alone, as sglEnd() runs it on a polyline
+    const SGLContext& context = sceneManager->getCurrentContext();
+    vector<Vertex> polyline(4096);
+    for (size_t i = 0; i < polyline.size(); i++) {
+        polyline[i] = Vertex(points[2 * i], points[2 * i + 1], 0.5f);
+    }
+    const VertexArray array = { reinterpret_cast<const float*>(polyline.data()), 4, sizeof(Vertex) };
+    vector<ScreenVertex> screenVertices(polyline.size());
+    runBenchmark(options, results, "transformVertexArray/4096", [&] {
+        transformVertexArray(context, array, nullptr, 0, polyline.size(), screenVertices.data());
+        doNotOptimize(screenVertices[0].x);
+    });
+}
+
+void benchClear(const BenchOptions& options, vector<BenchResult>& results) {
+    const int sizes[][2] = { { 1920, 1080 }, { 3840, 2160 } };
+    for (const auto& size : sizes) {
+        int id = makeContext(size[0], size[1]);
+        runBenchmark(options, results,
+                     "sglClear/" + std::to_string(size[0]) + "x" + std::to_string(size[1]), [&] {
+            sglClear(SGL_COLOR_BUFFER_BIT | SGL_DEPTH_BUFFER_BIT);
+        });
+        // the clear only marks tiles, reading the buffer back writes them
+        runBenchmark(options, results,
+                     "sglClear+resolve/" + std::to_string(size[0]) + "x" + std::to_string(size[1]), [&] {
+            sglClear(SGL_COLOR_BUFFER_BIT | SGL_DEPTH_BUFFER_BIT);
+            sglGetColorBufferPointer();
+        });
+        sglDestroyContext(id);
+    }
+}
+
+void benchContextCreation(const BenchOptions& options, vector<BenchResult>& results) {
+    const int sizes[][2] = { { 64, 64 }, { 1920, 1080 }, { 7680, 4320 } };
+    for (const auto& size : sizes) {
+        runBenchmark(options, results,
+                     "sglCreateContext/" + std::to_string(size[0]) + "x" + std::to_string(size[1]), [&] {
+            sglDestroyContext(sglCreateContext(size[0], size[1]));
+        });
+    }
+}
+
+void benchReadPixels(const BenchOptions& options, vector<BenchResult>& results) {
+    const int width = 1920;
+    const int height = 1080;
+    const struct {
+        sglEPixelFormat format;
+        const char* name;
+        int bytesPerPixel;
+    } formats[] = {
+        { SGL_RGBA8_SRGB, "RGBA8_SRGB", 4 },
+        { SGL_RGB10_A2, "RGB10_A2", 4 },
+        { SGL_RGBA16F, "RGBA16F", 8 },
+    };
+    int id = makeContext(width, height);
+    // a gradient with values above 1, so the tone mapping is not trivial
+    float* pixels = sglGetColorBufferPointer();
+    for (int i = 0; i < width * height * 3; i++) {
+        pixels[i] = (i % 4099) / 2048.0f;
+    }
+    vector<uint8_t> image(static_cast<size_t>(width) * height * 8);
+    sglToneMap(SGL_TONEMAP_ACES, 1.0f);
+    for (const auto& format : formats) {
+        runBenchmark(options, results, string("sglReadPixels/") + format.name + "/1920x1080", [&] {
+            sglReadPixels(format.format, image.data(), width * format.bytesPerPixel);
+        });
+    }
+    sglDestroyContext(id);
+}
+
+void writeResults(FILE* file, const vector<BenchResult>& results) {
+#ifdef SGL_RENDER_STATS
+    const bool renderStats = true;
+#else
+    const bool renderStats = false;
+#endif
+    fprintf(file, "{\n  \"context\": {\"build_type\": \"%s\", \"render_stats\": %s, \"repetitions\": %d},\n",
+            SGL_BUILD_TYPE, renderStats ? "true" : "false", REPETITIONS);
+    fprintf(file, "  \"benchmarks\": [");
+    for (size_t i = 0; i < results.size(); i++) {
+        const BenchResult& r = results[i];
+        fprintf(file, "%s\n    {\"name\": \"%s\", \"iterations\": %llu, \"ns_per_op\": %.3f, "
+                      "\"ns_per_op_min\": %.3f, \"ops_per_sec\": %.1f}",
+                i ? "," : "", r.name.c_str(), r.iterations, r.nsPerOp, r.nsPerOpMin, 1e9 / r.nsPerOp);
+    }
+    fprintf(file, "\n  ]\n}\n");
+}
+
+}
+
+int main(int argc, char** argv) {
+    BenchOptions options;
+    const char* outPath = nullptr;
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "--filter") && i + 1 < argc) {
+            options.filter = argv[++i];
+        }
+        else if (!strcmp(argv[i], "--min-time") && i + 1 < argc) {
+            options.minTime = atof(argv[++i]);
+        }
+        else if (!strcmp(argv[i], "--out") && i + 1 < argc) {
+            outPath = argv[++i];
+        }
+        else {
+            fprintf(stderr, "usage: %s [--filter <substring>] [--min-time <seconds>] [--out <file>]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    sglInit();
+    vector<BenchResult> results;
+    benchRayTracingKernels(options, results);
+    benchMatrixKernels(options, results);
+    benchRasterKernels(options, results);
+    benchBinnedRaster(options, results);
+    benchDisplayList(options, results);
+    benchVertexArrays(options, results);
+    benchClear(options, results);
+    benchContextCreation(options, results);
+    benchReadPixels(options, results);
+    sglFinish();
+
+    FILE* out = outPath ? fopen(outPath, "w") : stdout;
+    if (!out) {
+        fprintf(stderr, "cannot open %s\n", outPath);
+        return 1;
+    }
+    writeResults(out, results);
+    if (outPath) {
+        fclose(out);
+    }
+    return 0;
+}
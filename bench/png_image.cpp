@@ -0,0 +1,118 @@
+#include "png_image.h"
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <zlib.h>
+
+namespace {
+
+unsigned readU32(const unsigned char* p) {
+    return (unsigned(p[0]) << 24) | (unsigned(p[1]) << 16) | (unsigned(p[2]) << 8) | unsigned(p[3]);
+}
+
+int paeth(int a, int b, int c) {
+    int p = a + b - c;
+    int pa = abs(p - a);
+    int pb = abs(p - b);
+    int pc = abs(p - c);
+    if (pa <= pb && pa <= pc) {
+        return a;
+    }
+    return pb <= pc ? b : c;
+}
+
+// Reverses the per-row filters in place, rows are stride bytes long
+bool unfilter(vector<unsigned char>& data, int height, size_t stride, int bpp) {
+    vector<unsigned char> zero(stride, 0);
+    for (int y = 0; y < height; y++) {
+        unsigned char* row = &data[y * (stride + 1)];
+        const unsigned char filter = row[0];
+        unsigned char* cur = row + 1;
+        const unsigned char* prev = y > 0 ? &data[(y - 1) * (stride + 1) + 1] : zero.data();
+        for (size_t i = 0; i < stride; i++) {
+            const int a = i >= size_t(bpp) ? cur[i - bpp] : 0;
+            const int b = prev[i];
+            const int c = i >= size_t(bpp) ? prev[i - bpp] : 0;
+            switch (filter) {
+                case 0: break;
+                case 1: cur[i] += a; break;
+                case 2: cur[i] += b; break;
+                case 3: cur[i] += (a + b) / 2; break;
+                case 4: cur[i] += paeth(a, b, c); break;
+                default: return false;
+            }
+        }
+    }
+    return true;
+}
+
+}
+
+bool readPng(const string& path, Image8& image, string& error) {
+    std::ifstream file(path, std::ios::binary);
+    if (!file) {
+        error = "cannot open " + path;
+        return false;
+    }
+    const vector<unsigned char> bytes((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    static const unsigned char signature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n' };
+    if (bytes.size() < 8 || memcmp(bytes.data(), signature, 8) != 0) {
+        error = path + " is not a PNG file";
+        return false;
+    }
+
+    int channels = 0;
+    vector<unsigned char> compressed;
+    size_t pos = 8;
+    while (pos + 12 <= bytes.size()) {
+        const unsigned length = readU32(&bytes[pos]);
+        const string type(reinterpret_cast<const char*>(&bytes[pos + 4]), 4);
+        const unsigned char* chunk = &bytes[pos + 8];
+        if (pos + 12 + length > bytes.size()) {
+            break;
+        }
+        if (type == "IHDR") {
+            image.width = static_cast<int>(readU32(chunk));
+            image.height = static_cast<int>(readU32(chunk + 4));
+            const int bitDepth = chunk[8];
+            const int colorType = chunk[9];
+            const int interlace = chunk[12];
+            channels = colorType == 2 ? 3 : colorType == 6 ? 4 : 0;
+            if (bitDepth != 8 || channels == 0 || interlace != 0) {
+                error = path + ": only non-interlaced 8-bit RGB and RGBA images are supported";
+                return false;
+            }
+        }
+        else if (type == "IDAT") {
+            compressed.insert(compressed.end(), chunk, chunk + length);
+        }
+        else if (type == "IEND") {
+            break;
+        }
+        pos += 12 + length;
+    }
+    if (channels == 0 || compressed.empty()) {
+        error = path + ": missing image header or data";
+        return false;
+    }
+
+    const size_t stride = size_t(image.width) * channels;
+    vector<unsigned char> raw((stride + 1) * image.height);
+    uLongf rawSize = static_cast<uLongf>(raw.size());
+    if (uncompress(raw.data(), &rawSize, compressed.data(), static_cast<uLong>(compressed.size())) != Z_OK ||
+        rawSize != raw.size() || !unfilter(raw, image.height, stride, channels)) {
+        error = path + ": corrupted image data";
+        return false;
+    }
+
+    image.rgb.resize(size_t(image.width) * image.height * 3);
+    for (int y = 0; y < image.height; y++) {
+        const unsigned char* src = &raw[y * (stride + 1) + 1];
+        unsigned char* dst = &image.rgb[size_t(y) * image.width * 3];
+        for (int x = 0; x < image.width; x++) {
+            memcpy(dst + 3 * x, src + channels * x, 3);
+        }
+    }
+    return true;
+}
@@ -0,0 +1,29 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+using std::string;
+using std::vector;
+
+/**
+ * @file png_image.h
+ * @brief Minimal PNG reader for the reference images of the scene benchmark
+ */
+
+struct Image8 {
+    int width = 0;
+    int height = 0;
+    // RGB triplets, top row first
+    vector<unsigned char> rgb;
+};
+
+/**
+ * @brief Reads a non-interlaced 8-bit RGB or RGBA PNG file.
+ *
+ * @param path The file to read.
+ * @param image [out] The decoded image, alpha is dropped.
+ * @param error [out] Reason of the failure.
+ * @return true on success.
+ */
+bool readPng(const string& path, Image8& image, string& error);
@@ -0,0 +1,428 @@
+/*
+  ---------------------------------------------------------------------------
+  scene_bench.cpp
+  End-to-end ray tracing benchmark through the public API.
+
+  Usage: sgl_scene_bench [--scenes <substring>] [--threads 1,2,4] [--frames n]
+                         [--size WxH] [--sweep <scene>]
+                         [--check <scene.nff> <reference.png>]... [--tolerance t]
+                         [--out <file>]
+
+  - Procedural scaling scenes (N spheres, M lights, K triangles, reflective and
+    refractive materials of increasing recursion depth) are rendered with all
+    the threads, reporting the frame time, traced rays per second and the
+    primitive count.
+  - The sweep scene is rendered with every thread count of --threads, the
+    parallel efficiency is relative to the smallest count.
+  - --check renders an NFF scene and compares the image with a reference PNG:
+    the mean absolute difference of 8-bit channels must not exceed the
+    tolerance (default 2.0). The process exits with 2 if any check fails.
+
+  The number of threads is set through SGL_NUM_THREADS, see sglInit().
+  Ray counts come from sglGetRenderStats() and are zero when the library is
+  built with SGL_RENDER_STATS=OFF.
+  ---------------------------------------------------------------------------
+*/
+#include "sgl.h"
+#include "scene_description.h"
+#include "png_image.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <string>
+#include <thread>
+#include <vector>
+
+using std::string;
+using std::vector;
+
+namespace {
+
+struct BenchOptions {
+    string scenes;
+    vector<int> threads;
+    int frames = 3;
+    int width = 512;
+    int height = 512;
+    string sweepScene = "spheres/256";
+    vector<std::pair<string, string>> checks;
+    double tolerance = 2.0;
+};
+
+struct FrameResult {
+    // median over the measured frames, in milliseconds
+    double frameTime;
+    double traceTime;
+    unsigned long long rays;
+};
+
+//---------------------------------------------------------------------------
+// Procedural scenes
+//---------------------------------------------------------------------------
+
+void floorQuad(SceneDescription& scene, float size, float y) {
+    const float a[3] = { -size, y, -size };
+    const float b[3] = { -size, y, size };
+    const float c[3] = { size, y, size };
+    const float d[3] = { size, y, -size };
+    scene.Triangle(a, b, c);
+    scene.Triangle(a, c, d);
+}
+
+SceneDescription room(const string& name, const BenchOptions& options) {
+    SceneDescription scene;
+    scene.name = name;
+    scene.width = options.width;
+    scene.height = options.height;
+    scene.camera.from[1] = 4.0f;
+    scene.camera.from[2] = 9.0f;
+    scene.camera.at[1] = 0.5f;
+    scene.camera.at[2] = 0.0f;
+    scene.background[0] = 0.1f;
+    scene.background[1] = 0.1f;
+    scene.background[2] = 0.15f;
+    scene.Material(0.7f, 0.7f, 0.7f, 0.8f, 0.0f, 1.0f, 0.0f, 1.0f);
+    floorQuad(scene, 6.0f, 0.0f);
+    return scene;
+}
+
+// g x g spheres of the current material covering the floor
+void sphereGrid(SceneDescription& scene, int g, float ks, float T) {
+    const float spacing = 8.0f / g;
+    const float radius = 0.4f * spacing;
+    for (int i = 0; i < g; i++) {
+        for (int j = 0; j < g; j++) {
+            scene.Material(0.3f + 0.6f * i / g, 0.4f, 0.3f + 0.6f * j / g, 0.7f, ks, 20.0f, T, 1.5f);
+            scene.Sphere(-4.0f + spacing * (i + 0.5f), radius, -4.0f + spacing * (j + 0.5f), radius);
+        }
+    }
+}
+
+SceneDescription spheresScene(int count, const BenchOptions& options) {
+    SceneDescription scene = room("spheres/" + std::to_string(count), options);
+    scene.Light(-5.0f, 8.0f, 5.0f, 0.8f, 0.8f, 0.8f);
+    scene.Light(5.0f, 6.0f, 2.0f, 0.4f, 0.4f, 0.5f);
+    sphereGrid(scene, static_cast<int>(std::lround(sqrt(count))), 0.0f, 0.0f);
+    return scene;
+}
+
+SceneDescription lightsScene(int count, const BenchOptions& options) {
+    SceneDescription scene = room("lights/" + std::to_string(count), options);
+    for (int i = 0; i < count; i++) {
+        const float angle = 2.0f * static_cast<float>(M_PI) * i / count;
+        const float intensity = 1.2f / count;
+        scene.Light(6.0f * cosf(angle), 7.0f, 6.0f * sinf(angle), intensity, intensity, intensity);
+    }
+    sphereGrid(scene, 4, 0.0f, 0.0f);
+    return scene;
+}
+
+// height field of about count triangles
+SceneDescription trianglesScene(int count, const BenchOptions& options) {
+    SceneDescription scene = room("triangles/" + std::to_string(count), options);
+    scene.Light(-5.0f, 8.0f, 5.0f, 0.8f, 0.8f, 0.8f);
+    scene.Material(0.3f, 0.6f, 0.9f, 0.8f, 0.0f, 1.0f, 0.0f, 1.0f);
+    const int g = std::max(1, static_cast<int>(std::lround(sqrt(count / 2.0))));
+    auto height = [](float x, float z) { return 1.0f + 0.5f * sinf(1.5f * x) * cosf(1.5f * z); };
+    const float step = 8.0f / g;
+    for (int i = 0; i < g; i++) {
+        for (int j = 0; j < g; j++) {
+            const float x0 = -4.0f + i * step, x1 = x0 + step;
+            const float z0 = -4.0f + j * step, z1 = z0 + step;
+            const float a[3] = { x0, height(x0, z0), z0 };
+            const float b[3] = { x0, height(x0, z1), z1 };
+            const float c[3] = { x1, height(x1, z1), z1 };
+            const float d[3] = { x1, height(x1, z0), z0 };
+            scene.Triangle(a, b, c);
+            scene.Triangle(a, c, d);
+        }
+    }
+    return scene;
+}
+
+// Secondary rays are spawned by reflective (ks > 0) and transmitting (T > 0)
+// materials; the variants increase the average recursion depth up to
+// the renderer's limit in the mirror corridor
+SceneDescription recursionScene(const string& variant, const BenchOptions& options) {
+    SceneDescription scene = room("recursion/" + variant, options);
+    scene.Light(-5.0f, 8.0f, 5.0f, 0.8f, 0.8f, 0.8f);
+    if (variant == "diffuse") {
+        sphereGrid(scene, 3, 0.0f, 0.0f);
+    }
+    else if (variant == "mirror") {
+        sphereGrid(scene, 3, 0.6f, 0.0f);
+    }
+    else if (variant == "glass") {
+        sphereGrid(scene, 3, 0.1f, 0.8f);
+    }
+    else {
+        sphereGrid(scene, 3, 0.3f, 0.0f);
+        scene.Material(0.9f, 0.9f, 0.9f, 0.1f, 0.9f, 50.0f, 0.0f, 1.0f);
+        // triangles are one-sided, both walls face the inside of the corridor
+        for (float side : { -1.0f, 1.0f }) {
+            const float x = 3.5f * side;
+            const float a[3] = { x, 0.0f, -6.0f * side };
+            const float b[3] = { x, 0.0f, 6.0f * side };
+            const float c[3] = { x, 6.0f, 6.0f * side };
+            const float d[3] = { x, 6.0f, -6.0f * side };
+            scene.Triangle(a, b, c);
+            scene.Triangle(a, c, d);
+        }
+    }
+    return scene;
+}
+
+vector<SceneDescription> scalingScenes(const BenchOptions& options) {
+    vector<SceneDescription> scenes;
+    for (int count : { 16, 256, 4096 }) {
+        scenes.push_back(spheresScene(count, options));
+    }
+    for (int count : { 1, 8, 32 }) {
+        scenes.push_back(lightsScene(count, options));
+    }
+    for (int count : { 1000, 16000, 128000 }) {
+        scenes.push_back(trianglesScene(count, options));
+    }
+    for (const char* variant : { "diffuse", "mirror", "glass", "corridor" }) {
+        scenes.push_back(recursionScene(variant, options));
+    }
+    return scenes;
+}
+
+//---------------------------------------------------------------------------
+// Measurement
+//---------------------------------------------------------------------------
+
+// Starts the library with the given number of rendering threads and makes a
+// context of the scene's size current
+void startLibrary(int threads, const SceneDescription& scene) {
+    sglFinish();
+    const string value = std::to_string(threads);
+    setenv("SGL_NUM_THREADS", value.c_str(), 1);
+    sglInit();
+    sglSetContext(sglCreateContext(scene.width, scene.height));
+}
+
+double elapsedMs(std::chrono::steady_clock::time_point since) {
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - since).count();
+}
+
+double median(vector<double> values) {
+    std::sort(values.begin(), values.end());
+    return values[values.size() / 2];
+}
+
+// Renders one warm-up frame and the measured ones, a frame covers the scene
+// definition, its compilation and the ray tracing
+FrameResult measureScene(const SceneDescription& scene, int frames) {
+    vector<double> frameTimes;
+    vector<double> traceTimes;
+    SGLRenderStats stats = {};
+    for (int frame = 0; frame <= frames; frame++) {
+        const auto start = std::chrono::steady_clock::now();
+        scene.Submit();
+        sglRayTraceScene();
+        const double time = elapsedMs(start);
+        sglGetRenderStats(&stats);
+        if (frame > 0) {
+            frameTimes.push_back(time);
+            traceTimes.push_back(stats.traceTime + stats.antialiasingTime);
+        }
+    }
+    const unsigned long long rays = stats.primaryRays + stats.shadowRays + stats.reflectionRays + stats.refractionRays;
+    return { median(frameTimes), median(traceTimes), rays };
+}
+
+//---------------------------------------------------------------------------
+// Reference images
+//---------------------------------------------------------------------------
+
+struct CheckResult {
+    string scene;
+    string reference;
+    double meanError;
+    int maxError;
+    bool passed;
+    string error;
+};
+
+CheckResult checkReference(const string& nffPath, const string& pngPath, const BenchOptions& options, int threads) {
+    CheckResult result = { nffPath, pngPath, 0.0, 0, false, "" };
+    SceneDescription scene;
+    Image8 reference;
+    if (!loadNff(nffPath, scene, result.error) || !readPng(pngPath, reference, result.error)) {
+        return result;
+    }
+    scene.width = reference.width;
+    scene.height = reference.height;
+
+    startLibrary(threads, scene);
+    scene.Submit();
+    sglRayTraceScene();
+    const float* pixels = sglGetColorBufferPointer();
+
+    // the color buffer starts with the bottom row, the PNG with the top one
+    unsigned long long sum = 0;
+    for (int y = 0; y < scene.height; y++) {
+        const float* row = pixels + size_t(scene.height - 1 - y) * scene.width * 3;
+        const unsigned char* expected = &reference.rgb[size_t(y) * scene.width * 3];
+        for (int i = 0; i < scene.width * 3; i++) {
+            const int value = static_cast<int>(std::min(1.0f, std::max(0.0f, row[i])) * 255.0f + 0.5f);
+            const int difference = abs(value - expected[i]);
+            sum += difference;
+            result.maxError = std::max(result.maxError, difference);
+        }
+    }
+    result.meanError = static_cast<double>(sum) / (size_t(scene.width) * scene.height * 3);
+    result.passed = result.meanError <= options.tolerance;
+    return result;
+}
+
+//---------------------------------------------------------------------------
+// Command line and report
+//---------------------------------------------------------------------------
+
+bool parseOptions(int argc, char** argv, BenchOptions& options, const char*& outPath) {
+    for (int i = 1; i < argc; i++) {
+        const bool hasValue = i + 1 < argc;
+        if (!strcmp(argv[i], "--scenes") && hasValue) {
+            options.scenes = argv[++i];
+        }
+        else if (!strcmp(argv[i], "--threads") && hasValue) {
+            options.threads.clear();
+            for (char* token = strtok(argv[++i], ","); token; token = strtok(nullptr, ",")) {
+                options.threads.push_back(std::max(1, atoi(token)));
+            }
+        }
+        else if (!strcmp(argv[i], "--frames") && hasValue) {
+            options.frames = std::max(1, atoi(argv[++i]));
+        }
+        else if (!strcmp(argv[i], "--size") && hasValue) {
+            if (sscanf(argv[++i], "%dx%d", &options.width, &options.height) != 2) {
+                return false;
+            }
+        }
+        else if (!strcmp(argv[i], "--sweep") && hasValue) {
+            options.sweepScene = argv[++i];
+        }
+        else if (!strcmp(argv[i], "--check") && i + 2 < argc) {
+            options.checks.emplace_back(argv[i + 1], argv[i + 2]);
+            i += 2;
+        }
+        else if (!strcmp(argv[i], "--tolerance") && hasValue) {
+            options.tolerance = atof(argv[++i]);
+        }
+        else if (!strcmp(argv[i], "--out") && hasValue) {
+            outPath = argv[++i];
+        }
+        else {
+            return false;
+        }
+    }
+    if (options.threads.empty()) {
+        // the default of the library is one worker per hardware thread plus the caller
+        const int maxThreads = static_cast<int>(std::max(1u, std::thread::hardware_concurrency())) + 1;
+        for (int threads = 1; threads < maxThreads; threads *= 2) {
+            options.threads.push_back(threads);
+        }
+        options.threads.push_back(maxThreads);
+    }
+    return true;
+}
+
+double raysPerSecond(const FrameResult& result) {
+    return result.frameTime > 0 ? result.rays / (result.frameTime / 1000.0) : 0.0;
+}
+
+}
+
+int main(int argc, char** argv) {
+    BenchOptions options;
+    const char* outPath = nullptr;
+    if (!parseOptions(argc, argv, options, outPath)) {
+        fprintf(stderr, "usage: %s [--scenes <substring>] [--threads 1,2,4] [--frames n] [--size WxH]\n"
+                        "       [--sweep <scene>] [--check <scene.nff> <reference.png>]... [--tolerance t]\n"
+                        "       [--out <file>]\n", argv[0]);
+        return 1;
+    }
+    FILE* out = outPath ? fopen(outPath, "w") : stdout;
+    if (!out) {
+        fprintf(stderr, "cannot open %s\n", outPath);
+        return 1;
+    }
+    const int maxThreads = *std::max_element(options.threads.begin(), options.threads.end());
+
+    const vector<SceneDescription> scenes = scalingScenes(options);
+    fprintf(out, "{\n  \"size\": [%d, %d], \"frames\": %d, \"threads\": %d,\n  \"scenes\": [",
+            options.width, options.height, options.frames, maxThreads);
+    bool first = true;
+    for (const SceneDescription& scene : scenes) {
+        if (!options.scenes.empty() && scene.name.find(options.scenes) == string::npos) {
+            continue;
+        }
+        startLibrary(maxThreads, scene);
+        const FrameResult result = measureScene(scene, options.frames);
+        fprintf(stderr, "%-24s %10.2f ms %14.0f rays/s\n", scene.name.c_str(), result.frameTime, raysPerSecond(result));
+        fprintf(out, "%s\n    {\"name\": \"%s\", \"primitives\": %d, \"frame_ms\": %.3f, \"trace_ms\": %.3f, "
+                     "\"rays\": %llu, \"rays_per_sec\": %.0f}",
+                first ? "" : ",", scene.name.c_str(), scene.PrimitiveCount(), result.frameTime,
+                result.traceTime, result.rays, raysPerSecond(result));
+        first = false;
+    }
+    fprintf(out, "\n  ],\n");
+
+    // thread sweep of a single scene
+    auto sweep = std::find_if(scenes.begin(), scenes.end(),
+                              [&](const SceneDescription& scene) { return scene.name == options.sweepScene; });
+    fprintf(out, "  \"sweep\": {\"scene\": \"%s\", \"runs\": [", options.sweepScene.c_str());
+    if (sweep != scenes.end()) {
+        vector<int> threads = options.threads;
+        std::sort(threads.begin(), threads.end());
+        double baseTime = 0.0;
+        for (size_t i = 0; i < threads.size(); i++) {
+            startLibrary(threads[i], *sweep);
+            const FrameResult result = measureScene(*sweep, options.frames);
+            if (i == 0) {
+                baseTime = result.frameTime * threads[0];
+            }
+            const double efficiency = baseTime / (threads[i] * result.frameTime);
+            fprintf(stderr, "%-24s %2d threads %10.2f ms  efficiency %.2f\n",
+                    sweep->name.c_str(), threads[i], result.frameTime, efficiency);
+            fprintf(out, "%s\n    {\"threads\": %d, \"frame_ms\": %.3f, \"rays_per_sec\": %.0f, \"efficiency\": %.3f}",
+                    i ? "," : "", threads[i], result.frameTime, raysPerSecond(result), efficiency);
+        }
+    }
+    else {
+        fprintf(stderr, "unknown sweep scene %s\n", options.sweepScene.c_str());
+    }
+    fprintf(out, "\n  ]},\n");
+
+    // reference images
+    bool allPassed = true;
+    fprintf(out, "  \"checks\": [");
+    for (size_t i = 0; i < options.checks.size(); i++) {
+        const CheckResult check = checkReference(options.checks[i].first, options.checks[i].second, options, maxThreads);
+        allPassed = allPassed && check.passed;
+        if (!check.error.empty()) {
+            fprintf(stderr, "%s\n", check.error.c_str());
+        }
+        else {
+            fprintf(stderr, "%-24s mean error %.3f, max %d: %s\n", check.scene.c_str(),
+                    check.meanError, check.maxError, check.passed ? "passed" : "FAILED");
+        }
+        fprintf(out, "%s\n    {\"scene\": \"%s\", \"reference\": \"%s\", \"mean_error\": %.4f, \"max_error\": %d, \"passed\": %s}",
+                i ? "," : "", check.scene.c_str(), check.reference.c_str(), check.meanError, check.maxError,
+                check.passed ? "true" : "false");
+    }
+    fprintf(out, "\n  ]\n}\n");
+    sglFinish();
+
+    if (outPath) {
+        fclose(out);
+    }
+    return allPassed ? 0 : 2;
+}
@@ -0,0 +1,241 @@
+#include "scene_description.h"
+#include "sgl.h"
+#include <cmath>
+#include <fstream>
+#include <sstream>
+
+void SceneDescription::Material(float r, float g, float b, float kd, float ks, float shine, float T, float ior) {
+    commands.push_back({ SceneCommand::MATERIAL, { r, g, b, kd, ks, shine, T, ior } });
+}
+
+void SceneDescription::Light(float x, float y, float z, float r, float g, float b) {
+    commands.push_back({ SceneCommand::LIGHT, { x, y, z, r, g, b } });
+}
+
+void SceneDescription::Sphere(float x, float y, float z, float radius) {
+    commands.push_back({ SceneCommand::SPHERE, { x, y, z, radius } });
+}
+
+void SceneDescription::Triangle(const float a[3], const float b[3], const float c[3]) {
+    commands.push_back({ SceneCommand::TRIANGLE, { a[0], a[1], a[2], b[0], b[1], b[2], c[0], c[1], c[2] } });
+}
+
+int SceneDescription::PrimitiveCount() const {
+    int count = 0;
+    for (const SceneCommand& command : commands) {
+        count += command.type == SceneCommand::SPHERE || command.type == SceneCommand::TRIANGLE;
+    }
+    return count;
+}
+
+namespace {
+
+void normalize(float v[3]) {
+    const float length = sqrtf(v[0] * v[0] + v[1] * v[1] + v[2] * v[2]);
+    v[0] /= length;
+    v[1] /= length;
+    v[2] /= length;
+}
+
+void cross(const float a[3], const float b[3], float out[3]) {
+    out[0] = a[1] * b[2] - a[2] * b[1];
+    out[1] = a[2] * b[0] - a[0] * b[2];
+    out[2] = a[0] * b[1] - a[1] * b[0];
+}
+
+float dot(const float a[3], const float b[3]) {
+    return a[0] * b[0] + a[1] * b[1] + a[2] * b[2];
+}
+
+// Perspective projection and look-at view transform, as gluPerspective()
+// and gluLookAt() would set them up
+void applyCamera(const BenchCamera& camera, int width, int height) {
+    const float aspect = static_cast<float>(width) / height;
+    const float top = camera.hither * tanf(camera.angle * static_cast<float>(M_PI) / 360.0f);
+    sglViewport(0, 0, width, height);
+    sglMatrixMode(SGL_PROJECTION);
+    sglLoadIdentity();
+    sglFrustum(-top * aspect, top * aspect, -top, top, camera.hither, camera.hither * 10000.0f);
+
+    float forward[3] = { camera.at[0] - camera.from[0], camera.at[1] - camera.from[1], camera.at[2] - camera.from[2] };
+    normalize(forward);
+    float side[3];
+    cross(forward, camera.up, side);
+    normalize(side);
+    float up[3];
+    cross(side, forward, up);
+
+    const float view[16] = {
+        side[0], up[0], -forward[0], 0.0f,
+        side[1], up[1], -forward[1], 0.0f,
+        side[2], up[2], -forward[2], 0.0f,
+        -dot(side, camera.from), -dot(up, camera.from), dot(forward, camera.from), 1.0f
+    };
+    sglMatrixMode(SGL_MODELVIEW);
+    sglLoadMatrix(view);
+}
+
+}
+
+void SceneDescription::Submit() const {
+    applyCamera(camera, width, height);
+    sglClearColor(background[0], background[1], background[2], 1.0f);
+    sglClear(SGL_COLOR_BUFFER_BIT | SGL_DEPTH_BUFFER_BIT);
+
+    sglBeginScene();
+    for (const SceneCommand& command : commands) {
+        const float* v = command.values.data();
+        switch (command.type) {
+            case SceneCommand::MATERIAL:
+                sglMaterial(v[0], v[1], v[2], v[3], v[4], v[5], v[6], v[7]);
+                break;
+            case SceneCommand::LIGHT:
+                sglPointLight(v[0], v[1], v[2], v[3], v[4], v[5]);
+                break;
+            case SceneCommand::SPHERE:
+                sglSphere(v[0], v[1], v[2], v[3]);
+                break;
+            case SceneCommand::TRIANGLE:
+                sglBegin(SGL_POLYGON);
+                sglVertex3f(v[0], v[1], v[2]);
+                sglVertex3f(v[3], v[4], v[5]);
+                sglVertex3f(v[6], v[7], v[8]);
+                sglEnd();
+                break;
+        }
+    }
+    sglEndScene();
+}
+
+//---------------------------------------------------------------------------
+// NFF loading
+//---------------------------------------------------------------------------
+
+namespace {
+
+bool readPolygon(std::istream& in, int count, bool withNormals, SceneDescription& scene) {
+    vector<float> vertices(3 * count);
+    for (int i = 0; i < count; i++) {
+        string line;
+        if (!std::getline(in, line)) {
+            return false;
+        }
+        std::istringstream values(line);
+        float normal[3];
+        if (!(values >> vertices[3 * i] >> vertices[3 * i + 1] >> vertices[3 * i + 2])) {
+            return false;
+        }
+        if (withNormals && !(values >> normal[0] >> normal[1] >> normal[2])) {
+            return false;
+        }
+    }
+    // the renderer takes triangles only
+    for (int i = 1; i + 1 < count; i++) {
+        scene.Triangle(&vertices[0], &vertices[3 * i], &vertices[3 * (i + 1)]);
+    }
+    return true;
+}
+
+bool readViewpoint(std::istream& in, SceneDescription& scene) {
+    BenchCamera& camera = scene.camera;
+    for (int i = 0; i < 6; i++) {
+        string line;
+        if (!std::getline(in, line)) {
+            return false;
+        }
+        std::istringstream values(line);
+        string key;
+        values >> key;
+        if (key == "from") {
+            values >> camera.from[0] >> camera.from[1] >> camera.from[2];
+        }
+        else if (key == "at") {
+            values >> camera.at[0] >> camera.at[1] >> camera.at[2];
+        }
+        else if (key == "up") {
+            values >> camera.up[0] >> camera.up[1] >> camera.up[2];
+        }
+        else if (key == "angle") {
+            values >> camera.angle;
+        }
+        else if (key == "hither") {
+            values >> camera.hither;
+        }
+        else if (key == "resolution") {
+            values >> scene.width >> scene.height;
+        }
+        else {
+            return false;
+        }
+        if (values.fail()) {
+            return false;
+        }
+    }
+    return true;
+}
+
+}
+
+bool loadNff(const string& path, SceneDescription& scene, string& error) {
+    std::ifstream in(path);
+    if (!in) {
+        error = "cannot open " + path;
+        return false;
+    }
+
+    int lineNumber = 0;
+    string line;
+    while (std::getline(in, line)) {
+        lineNumber++;
+        std::istringstream values(line);
+        string key;
+        if (!(values >> key) || key[0] == '#') {
+            continue;
+        }
+
+        bool ok = true;
+        if (key == "v") {
+            ok = readViewpoint(in, scene);
+            lineNumber += 6;
+        }
+        else if (key == "b") {
+            ok = static_cast<bool>(values >> scene.background[0] >> scene.background[1] >> scene.background[2]);
+        }
+        else if (key == "l") {
+            float p[3];
+            float c[3] = { 1.0f, 1.0f, 1.0f };
+            ok = static_cast<bool>(values >> p[0] >> p[1] >> p[2]);
+            values >> c[0] >> c[1] >> c[2];
+            scene.Light(p[0], p[1], p[2], c[0], c[1], c[2]);
+        }
+        else if (key == "f") {
+            float m[8];
+            for (float& value : m) {
+                values >> value;
+            }
+            ok = !values.fail();
+            scene.Material(m[0], m[1], m[2], m[3], m[4], m[5], m[6], m[7]);
+        }
+        else if (key == "s") {
+            float s[4];
+            ok = static_cast<bool>(values >> s[0] >> s[1] >> s[2] >> s[3]);
+            scene.Sphere(s[0], s[1], s[2], s[3]);
+        }
+        else if (key == "p" || key == "pp") {
+            int count = 0;
+            ok = (values >> count) && count >= 3 && readPolygon(in, count, key == "pp", scene);
+            lineNumber += count;
+        }
+        else {
+            error = path + ":" + std::to_string(lineNumber) + ": unsupported entry '" + key + "'";
+            return false;
+        }
+
+        if (!ok) {
+            error = path + ":" + std::to_string(lineNumber) + ": malformed '" + key + "' entry";
+            return false;
+        }
+    }
+    scene.name = path;
+    return true;
+}
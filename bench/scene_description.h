@@ -0,0 +1,66 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+using std::string;
+using std::vector;
+
+/**
+ * @file scene_description.h
+ * @brief Ray tracing scenes of the scene benchmark, submitted through the public API
+ */
+
+struct BenchCamera {
+    float from[3] = { 0.0f, 0.0f, 0.0f };
+    float at[3] = { 0.0f, 0.0f, -1.0f };
+    float up[3] = { 0.0f, 1.0f, 0.0f };
+    // vertical field of view in degrees
+    float angle = 45.0f;
+    float hither = 1.0f;
+};
+
+struct SceneCommand {
+    enum Type { MATERIAL, LIGHT, SPHERE, TRIANGLE } type;
+    // MATERIAL: r g b kd ks shine T ior, LIGHT: x y z r g b,
+    // SPHERE: x y z radius, TRIANGLE: three vertices
+    vector<float> values;
+};
+
+struct SceneDescription {
+    string name;
+    int width = 512;
+    int height = 512;
+    BenchCamera camera;
+    float background[3] = { 0.0f, 0.0f, 0.0f };
+    vector<SceneCommand> commands;
+
+    void Material(float r, float g, float b, float kd, float ks, float shine, float T, float ior);
+    void Light(float x, float y, float z, float r, float g, float b);
+    void Sphere(float x, float y, float z, float radius);
+    void Triangle(const float a[3], const float b[3], const float c[3]);
+
+    /// Number of spheres and triangles.
+    int PrimitiveCount() const;
+
+    /**
+     * @brief Sets up the camera of the current context and defines the scene.
+     *
+     * Clears the buffers and calls sglBeginScene() ... sglEndScene(), the
+     * scene is ready for sglRayTraceScene() afterwards.
+     */
+    void Submit() const;
+};
+
+/**
+ * @brief Loads a scene in the Neutral File Format (NFF).
+ *
+ * Supports the viewpoint (v), background (b), light (l), material (f),
+ * sphere (s) and polygon (p, pp) entries; polygons are triangulated as fans.
+ *
+ * @param path The file to read.
+ * @param scene [out] The loaded scene.
+ * @param error [out] Reason of the failure.
+ * @return true on success.
+ */
+bool loadNff(const string& path, SceneDescription& scene, string& error);
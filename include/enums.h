@@ -75,5 +75,50 @@ typedef enum {
 /// Enum for sglEnable() / sglDisable()
 typedef enum {
   /// enable/disable depth test
-  SGL_DEPTH_TEST = 1
+  SGL_DEPTH_TEST = 1,
+  /// enable/disable drawing the primitives in screen tiles, in parallel
+  SGL_BINNED_RASTER = 2
 } sglEEnableFlags;
+
+/// Rules deciding which pixels the contours of a path cover. Passed to sglBeginPath().
+typedef enum {
+  /// Pixels the contours wind around a nonzero number of times, default
+  SGL_NONZERO = 0,
+  /// Pixels inside an odd number of the contours
+  SGL_EVEN_ODD
+} sglEFillRule;
+
+/// Enum for ray tracing output modes. Passed to sglRenderMode().
+typedef enum {
+  /// Shaded image, default.
+  SGL_RENDER_NORMAL = 0,
+  /// Heatmap of ray-primitive intersection tests per pixel
+  SGL_HEATMAP_INTERSECTION_TESTS,
+  /// Heatmap of rays (primary, shadow and secondary) spawned per pixel
+  SGL_HEATMAP_RAYS,
+  /// Heatmap of the deepest recursion level reached per pixel
+  SGL_HEATMAP_RECURSION_DEPTH,
+  /// Heatmap of wall-clock time spent per pixel
+  SGL_HEATMAP_TIME
+} sglERenderMode;
+
+/// Pixel formats of sglReadPixels()
+typedef enum {
+  /// 8-bit sRGB encoded red, green, blue and alpha, one byte each
+  SGL_RGBA8_SRGB = 0,
+  /// 10-bit sRGB encoded red, green and blue and 2-bit alpha packed into
+  /// a 32-bit word, red in the lowest bits
+  SGL_RGB10_A2,
+  /// Linear red, green, blue and alpha as 16-bit half floats
+  SGL_RGBA16F
+} sglEPixelFormat;
+
+/// Tone mapping operators. Passed to sglToneMap().
+typedef enum {
+  /// Clamp to [0, 1], default
+  SGL_TONEMAP_CLAMP = 0,
+  /// Reinhard operator c / (1 + c)
+  SGL_TONEMAP_REINHARD,
+  /// Filmic curve fitted to the ACES reference transform
+  SGL_TONEMAP_ACES
+} sglEToneMapOperator;
@@ -25,12 +25,17 @@
     triplets with each component stored as a float value.
 
   - No memory leaking is acceptable and will be checked.
+
+  - The current context and the error flag are kept per thread. Different
+    threads may render into different contexts at the same time; a single
+    context must not be used by two threads simultaneously.
   ---------------------------------------------------------------------------
 */
 #ifndef SGL_H
 #define SGL_H
 
 #include "enums.h"
+#include <stddef.h>
 
 
 #ifdef __cplusplus
@@ -78,6 +83,11 @@ const char *sglGetErrorString(sglEErrorCode error);
 /**
   Initializes the SGL and allocates the internal data structures.
 
+  Ray tracing uses the calling thread plus one worker thread per hardware
+  thread. The environment variable SGL_NUM_THREADS, read here, sets the
+  total number of threads rendering a frame instead (1 renders on the
+  calling thread only).
+
   ERRORS:
    - SGL_OUT_OF_MEMORY
     Not enough memory.
@@ -86,7 +96,9 @@ void sglInit(void);
 
 /// Library finalization.
 /**
-  Finalizes the SGL and disposes the internal data structures.
+  Finalizes the SGL and disposes the internal data structures. The command
+  buffers submitted to the contexts (see sglBeginCommandBuffer()) are
+  executed first.
 
   ERRORS:
    - none
@@ -113,6 +125,157 @@ void sglFinish(void);
 */
 int sglCreateContext(int width, int height);
 
+/// Drawing context creation with a color buffer of the application.
+/**
+  Creates a new context like sglCreateContext() which renders directly into
+  memory owned by the application, e.g. a frame of a video encoder, so the
+  frames do not have to be copied out of the library. The memory holds
+  [height] rows of [width] RGB (float, float, float) pixels, the bottom row
+  first, and must remain valid until the context is destroyed. The pixels
+  are not initialized. sglGetColorBufferPointer() returns color for the
+  context.
+
+  @param width [in] desired canvas width
+  @param height [in] desired canvas height
+  @param color [in] address of the bottom row, aligned for floats
+  @param stride [in] distance between the starts of consecutive rows in
+                     bytes, a multiple of 4; 0 for tightly packed rows
+  @return unique identifier of the drawing context
+
+  ERRORS:
+   - SGL_INVALID_VALUE
+    width or height is not positive, color is NULL or not aligned for
+    floats, or stride is not a multiple of 4 or smaller than a row of pixels.
+   - SGL_OUT_OF_MEMORY
+    Not enough memory.
+*/
+int sglCreateContextWithBuffer(int width, int height, void *color, size_t stride);
+
+/// Magic number of SGLSharedFrameHeader, "SGLF" in memory order.
+#define SGL_SHARED_FRAME_MAGIC 0x464C4753u
+
+/// Header at the start of the shared memory segment of sglCreateSharedContext().
+typedef struct {
+  /// SGL_SHARED_FRAME_MAGIC
+  unsigned int magic;
+  /// sizeof(SGLSharedFrameHeader) of the library which created the segment
+  unsigned int headerSize;
+  /// canvas width
+  int width;
+  /// canvas height
+  int height;
+  /// distance between the starts of consecutive rows in bytes
+  unsigned long long stride;
+  /// offset of the bottom row from the start of the segment in bytes
+  unsigned long long offset;
+  /// frame sequence number, odd while a frame is being rendered
+  unsigned long long sequence;
+} SGLSharedFrameHeader;
+
+/// Drawing context creation in shared memory.
+/**
+  Creates a new context like sglCreateContext() whose color buffer is placed
+  in a newly created POSIX shared memory segment, so that other processes
+  on the machine can map it (shm_open() and mmap() with the same name) and
+  read the frames without copying. The segment starts with an
+  SGLSharedFrameHeader, the pixels follow at its offset. The segment is
+  removed when the context is destroyed.
+
+  The sequence number of the header tells the readers which frame they see.
+  sglClear() of the color buffer makes it odd, sglPublishFrame() makes it
+  even again, so it is twice the number of published frames. A reader loads
+  the sequence number (acquire), skips the frame while it is odd, reads the
+  pixels and loads the number again; the frame is complete if both numbers
+  are equal.
+
+  @param width [in] desired canvas width
+  @param height [in] desired canvas height
+  @param name [in] name of the segment as for shm_open(), e.g. "/sgl-frames"
+  @return unique identifier of the drawing context
+
+  ERRORS:
+   - SGL_INVALID_VALUE
+    width or height is not positive or name is NULL.
+   - SGL_OUT_OF_RESOURCES
+    The segment could not be created (e.g. it already exists) or shared
+    memory is not supported on the platform.
+*/
+int sglCreateSharedContext(int width, int height, const char *name);
+
+/// Publishing a finished frame.
+/**
+  Marks the contents of the color buffer of the current context as a
+  complete frame. For a context created by sglCreateSharedContext() the
+  sequence number of the segment is advanced, so that waiting readers pick
+  the frame up. For other contexts the call has no effect.
+
+  ERRORS:
+   - SGL_INVALID_OPERATION
+    No context has been allocated yet or sglPublishFrame() is called within
+    a sglBegin() / sglEnd() sequence.
+*/
+void sglPublishFrame(void);
+
+/// Starting a command buffer.
+/**
+  Starts recording the drawing calls of the calling thread for the current
+  context instead of drawing them. Any number of threads which selected the
+  same context may record at the same time. The recording starts from the
+  state of a newly created context (identity matrices including the
+  viewport, default color, area mode and point size, no vertex array), the
+  state calls of the thread change the state of the recording only and do
+  not reach the context. sglClear(), sglBegin() / sglEnd(), sglDrawArrays(),
+  sglDrawElements(), sglCircle(), sglEllipse() and sglArc() are recorded
+  with the state they are called in.
+
+  sglEndCommandBuffer() submits the recording to the context. The submitted
+  buffers are executed by sglFlush() or sglFinish(), in the increasing order
+  of their keys and in the order of submission for equal keys, so the image
+  does not depend on which thread finished its recording first. The pixels
+  are drawn in parallel if the context has SGL_BINNED_RASTER enabled.
+
+  While recording, sglSetContext(), sglReadPixels(), sglPublishFrame(),
+  sglToneMap(), sglBeginScene(), sglRayTraceScene(), sglRenderMode(),
+  sglEnvironmentMap(), sglGetRenderStats(), sglFlush(), the display list
+  calls, sglEnable() and sglDisable() of SGL_BINNED_RASTER generate
+  SGL_INVALID_OPERATION, and
+  sglGetColorBufferPointer() returns NULL.
+
+  @param order [in] key ordering the execution of the submitted buffers
+
+  ERRORS:
+   - SGL_INVALID_OPERATION
+    No context has been allocated yet, the thread is already recording or
+    sglBeginCommandBuffer() is called within a sglBegin() / sglEnd() sequence.
+*/
+void sglBeginCommandBuffer(unsigned order);
+
+/// Submitting a command buffer.
+/**
+  Ends the recording started by sglBeginCommandBuffer() and submits it to
+  the context it was started for. The thread draws into the context directly
+  again, with the state the context had before the recording.
+
+  ERRORS:
+   - SGL_INVALID_OPERATION
+    The thread is not recording or sglEndCommandBuffer() is called within a
+    sglBegin() / sglEnd() sequence.
+*/
+void sglEndCommandBuffer(void);
+
+/// Executing the submitted command buffers.
+/**
+  Executes the command buffers submitted to the current context, in the
+  order of their keys, and drops them. The state of the context is not
+  changed. Buffers still being recorded are not affected.
+
+  ERRORS:
+   - SGL_INVALID_OPERATION
+    No context has been allocated yet, the thread is recording or sglFlush()
+    is called within a sglBegin() / sglEnd() sequence.
+*/
+void sglFlush(void);
+
 /// Drawing context destruction.
 /**
   Destroys the context along with its' internal structures.
@@ -123,13 +286,14 @@ int sglCreateContext(int width, int height);
    - SGL_INVALID_VALUE
     Invalid context id (such context doesn't exist).
    - SGL_INVALID_OPERATION
-    Context is currently in use.
+    Context is currently in use (selected by any thread).
 */
 void sglDestroyContext(int id);
 
 /// Current drawing context selection.
 /**
-  Selects the current context for subsequent drawing operations.
+  Selects the current context for subsequent drawing operations issued by
+  the calling thread.
 
   @param id [in] identifier of the context to be selected
 
@@ -152,13 +316,53 @@ int sglGetContext(void);
 /// Address of the current drawing context color buffer.
 /**
   Returns the pointer to the color buffer of the current context or NULL if no
-  context has been allocated yet (no error code set).
+  context has been allocated yet (no error code set). For a context created
+  by sglCreateContextWithBuffer() it is the memory of the application with
+  its row stride, for sglCreateSharedContext() the pixels in the segment.
+
+  sglClear() writes the clear color only into the parts of the buffer which
+  are drawn into, the rest is written by this call (as well as by
+  sglReadPixels() and sglPublishFrame()). Call it again after drawing a frame
+  before reading the pixels through a pointer kept from an earlier call. The
+  memory of sglCreateContextWithBuffer() is always cleared immediately.
 
   ERRORS:
    - none
 */
 float *sglGetColorBufferPointer(void);
 
+/// Reading the color buffer in a packed format.
+/**
+  Converts the color buffer of the current context to the given format and
+  writes it to dst. Every pixel is multiplied by the exposure and mapped to
+  [0, 1] by the tone mapping operator set by sglToneMap(), then encoded with
+  the sRGB transfer function and quantized. SGL_RGBA16F skips the tone
+  mapping and the encoding and stores the exposed linear values. Alpha is
+  always opaque. The conversion is a single pass over the color buffer,
+  split between the rendering threads.
+
+  Rows are written in the order of the color buffer, the bottom row first.
+  A negative stride writes them upwards, so passing the address of the last
+  row of an image with a negative stride stores the image top row first.
+
+  @param format [in] SGL_RGBA8_SRGB (4 bytes per pixel), SGL_RGB10_A2
+                     (4 bytes per pixel) or SGL_RGBA16F (8 bytes per pixel)
+  @param dst [out] address of the first row written, need not be aligned
+  @param stride [in] distance between the starts of consecutive rows in
+                     bytes, 0 for tightly packed rows
+
+  ERRORS:
+   - SGL_INVALID_ENUM
+    format is not an accepted value.
+   - SGL_INVALID_VALUE
+    dst is NULL or the absolute value of a non-zero stride is smaller than
+    a row of pixels.
+   - SGL_INVALID_OPERATION
+    No context has been allocated yet or sglReadPixels() is called within a
+    sglBegin() / sglEnd() sequence.
+*/
+void sglReadPixels(sglEPixelFormat format, void *dst, int stride);
+
 //---------------------------------------------------------------------------
 // Drawing functions
 //---------------------------------------------------------------------------
@@ -239,6 +443,113 @@ void sglVertex3f(float x, float y, float z);
  */
 void sglVertex2f(float x, float y);
 
+/// Specification of a vertex array.
+/**
+  Sets the array of the application the vertices of sglDrawArrays() and
+  sglDrawElements() are read from. The array is not copied, it is read by
+  the drawing calls and must stay valid until then.
+
+  @param size [in] number of the components of a vertex, 2 (x, y), 3 (x,
+                   y, z) or 4 (x, y, z, w); a missing z is 0, a missing w 1
+  @param stride [in] distance between the starts of consecutive vertices in
+                     bytes, 0 for tightly packed vertices
+  @param pointer [in] the first component of the first vertex
+
+  ERRORS:
+   - SGL_INVALID_VALUE
+    The size is not 2, 3 or 4 or the stride is negative.
+   - SGL_INVALID_OPERATION
+    No context has been allocated yet or sglVertexPointer() is called within
+    a sglBegin() / sglEnd() sequence.
+*/
+void sglVertexPointer(int size, int stride, const float *pointer);
+
+/// Drawing vertices of the vertex array.
+/**
+  Draws the vertices first to first + count - 1 of the array given by
+  sglVertexPointer() as an element of the mode, with the same result as
+  passing them to sglVertex4f() between sglBegin(mode) and sglEnd(). The
+  vertices are transformed four at a time straight into window coordinates.
+
+  Within a display list or a ray tracing scene the vertices are copied, as
+  sglVertex4f() would store them.
+
+  @param mode [in] element type, as of sglBegin()
+  @param first [in] index of the first vertex
+  @param count [in] number of the vertices
+
+  ERRORS:
+   - SGL_INVALID_ENUM
+    mode is set to an unacceptable value.
+   - SGL_INVALID_VALUE
+    first or count is negative.
+   - SGL_INVALID_OPERATION
+    No context has been allocated yet, no vertex array has been specified
+    or sglDrawArrays() is called within a sglBegin() / sglEnd() sequence.
+*/
+void sglDrawArrays(sglEElementType mode, int first, int count);
+
+/// Drawing indexed vertices of the vertex array.
+/**
+  Draws the vertices of the array given by sglVertexPointer() at the
+  indices as an element of the mode, the same as sglDrawArrays() draws
+  consecutive vertices.
+
+  @param mode [in] element type, as of sglBegin()
+  @param count [in] number of the indices
+  @param indices [in] indices of the vertices to draw
+
+  ERRORS:
+   - SGL_INVALID_ENUM
+    mode is set to an unacceptable value.
+   - SGL_INVALID_VALUE
+    count is negative or indices is NULL for a positive count.
+   - SGL_INVALID_OPERATION
+    No context has been allocated yet, no vertex array has been specified
+    or sglDrawElements() is called within a sglBegin() / sglEnd() sequence.
+*/
+void sglDrawElements(sglEElementType mode, int count, const unsigned *indices);
+
+/// Starting a path.
+/**
+  Starts a path of the current context. Until sglEndPath(), the filled
+  polygons of sglBegin() / sglEnd() blocks, sglDrawArrays(),
+  sglDrawElements(), sglEllipse() and sglArc() are not drawn but added to
+  the path as its contours, transformed as usual. All other calls, and the
+  polygons drawn in the SGL_POINT and SGL_LINE area modes, are executed as
+  usual.
+
+  sglEndPath() fills the contours together in one scan, the pixels inside
+  are given by the rule: with SGL_NONZERO the pixels the contours wind
+  around in total a nonzero number of times, so a contour in the opposite
+  direction cuts a hole; with SGL_EVEN_ODD the pixels inside an odd number
+  of the contours, so any contour inside another cuts a hole. Every pixel
+  inside is drawn once, also along the borders the contours share.
+
+  @param rule [in] the fill rule
+
+  ERRORS:
+   - SGL_INVALID_ENUM
+    rule is set to an unacceptable value.
+   - SGL_INVALID_OPERATION
+    No context has been allocated yet, a path is already started, a display
+    list is being compiled, a scene is being specified or sglBeginPath() is
+    called within a sglBegin() / sglEnd() sequence.
+*/
+void sglBeginPath(sglEFillRule rule);
+
+/// Ending a path.
+/**
+  Fills the contours of the path started by sglBeginPath() with the
+  current color and depth test.
+
+  ERRORS:
+   - SGL_INVALID_OPERATION
+    No context has been allocated yet, no path is started or sglEndPath() is
+    called within a sglBegin() / sglEnd() sequence.
+*/
+void sglEndPath(void);
+
 /// Drawing a circle.
 /**
   Draws a circle to the current context color buffer.
@@ -330,6 +641,64 @@ void sglEllipse(float x, float y, float z, float a, float b);
  */
 void sglArc(float x, float y, float z, float radius, float from, float to);
 
+/// Starting a display list.
+/**
+  Starts compiling the display list with the given name for the current
+  context. Until sglEndList(), the sglBegin() / sglEnd() blocks,
+  sglDrawArrays(), sglDrawElements(), sglCircle(), sglEllipse(), sglArc()
+  and sglColor3f() are stored in the
+  list instead of being drawn or changing the color. All
+  other calls are executed as usual. A list of the same name is replaced
+  at sglEndList().
+
+  @param list [in] name of the list
+
+  ERRORS:
+   - SGL_INVALID_OPERATION
+    No context has been allocated yet, a list is already being compiled,
+    the thread records a command buffer or sglNewList() is called within a
+    sglBegin() / sglEnd() sequence.
+*/
+void sglNewList(unsigned list);
+
+/// Ending a display list.
+/**
+  Finishes the display list started by sglNewList().
+
+  ERRORS:
+   - SGL_INVALID_OPERATION
+    No list is being compiled, the thread records a command buffer or
+    sglEndList() is called within a sglBegin() / sglEnd() sequence.
+*/
+void sglEndList(void);
+
+/// Drawing a display list.
+/**
+  Draws the contents of the display list with the current transformation,
+  area mode, point size and depth test, the same as the compiled calls
+  would. The colors of the list change the current color.
+
+  The vertices are transformed at the first call and kept in window
+  coordinates, together with the edge tables of the filled polygons, until
+  the list is called with a different viewport, projection or modelview
+  transformation. Calling an unchanged list draws without any per-vertex
+  work besides the rasterization.
+
+  Called while compiling another list, the contents are added to that list.
+  Between sglBeginScene() and sglEndScene() the compiled calls are repeated,
+  adding the polygons to the scene.
+
+  @param list [in] name of the list
+
+  ERRORS:
+   - SGL_INVALID_VALUE
+    No list of the name has been compiled.
+   - SGL_INVALID_OPERATION
+    No context has been allocated yet, the thread records a command buffer
+    or sglCallList() is called within a sglBegin() / sglEnd() sequence.
+*/
+void sglCallList(unsigned list);
+
 //---------------------------------------------------------------------------
 // Transform functions
 //---------------------------------------------------------------------------
@@ -351,11 +720,13 @@ void sglMatrixMode(sglEMatrixMode mode);
 
 /// Matrix storage on a stack.
 /**
-  Duplicates the current transform matrix on top of the current stack.
+  Duplicates the current transform matrix on top of the current stack. Each
+  stack holds up to 32 matrices, the bottom one included.
 
   ERRORS:
    - SGL_STACK_OVERFLOW
-    The current matrix stack capacity has been exhausted.
+    The current matrix stack capacity has been exhausted, the stack is left
+    unchanged.
    - SGL_INVALID_OPERATION
     No context has been allocated yet or sglPushMatrix() is called within a
     sglBegin() / sglEnd() sequence.
@@ -620,12 +991,44 @@ void sglAreaMode(sglEAreaMode mode);
 */
 void sglPointSize(float size);
 
+/// Tone mapping specification.
+/**
+  Sets how sglReadPixels() maps the color buffer of the current context to
+  displayable values. Colors are first multiplied by the exposure, then
+  mapped by the operator: SGL_TONEMAP_CLAMP (default) clamps to [0, 1],
+  SGL_TONEMAP_REINHARD and SGL_TONEMAP_ACES compress high values smoothly.
+  The color buffer itself is not changed.
+
+  @param op [in] SGL_TONEMAP_CLAMP, SGL_TONEMAP_REINHARD or SGL_TONEMAP_ACES
+  @param exposure [in] linear scale applied before the operator, 1 by default
+
+  ERRORS:
+   - SGL_INVALID_ENUM
+    op is not an accepted value.
+   - SGL_INVALID_VALUE
+    exposure is negative or not finite.
+   - SGL_INVALID_OPERATION
+    No context has been allocated yet or sglToneMap() is called within a
+    sglBegin() / sglEnd() sequence.
+*/
+void sglToneMap(sglEToneMapOperator op, float exposure);
+
 
 /// Enabling SGL capabilities.
 /**
   Enables SGL capabilities given as a bitmask.
 
- @param cap [in] capabilities bitmask; only SGL_DEPTH_TEST so far (off by default)
+ @param cap [in] SGL_DEPTH_TEST or SGL_BINNED_RASTER (both off by default)
+
+  With SGL_BINNED_RASTER the primitives are not drawn when submitted. They
+  are transformed and recorded into 64x64 pixel screen tiles, and the tiles
+  are drawn in parallel by the threads of the library once the pixels are
+  needed: by sglReadPixels(), sglGetColorBufferPointer(), sglPublishFrame(),
+  sglRayTraceScene(), sglGetRenderStats(), a sglClear() of only one of the
+  buffers or sglDisable(SGL_BINNED_RASTER). The image is the same as without
+  binning. A buffer of the application passed to sglCreateContextWithBuffer()
+  is therefore updated only at these calls. The recorded primitives are
+  dropped by a sglClear() of both buffers, which would overwrite them anyway.
 
   ERRORS:
    - SGL_INVALID_ENUM
@@ -640,7 +1043,8 @@ void sglEnable(sglEEnableFlags cap);
 /**
   Disables SGL capabilities given as a bitmask.
 
- @param cap [in] capabilities bitmask; only SGL_DEPTH_TEST so far (off by default)
+ @param cap [in] SGL_DEPTH_TEST or SGL_BINNED_RASTER; disabling the latter
+                  draws the recorded primitives
 
   ERRORS:
    - SGL_INVALID_ENUM
@@ -768,6 +1172,28 @@ void sglPointLight(const float x,
 */
 void sglRayTraceScene();
 
+/// Ray tracing output mode specification.
+/**
+  Selects what sglRayTraceScene() writes to the color buffer of the current
+  context. SGL_RENDER_NORMAL (default) produces the shaded image. The heatmap
+  modes trace the image the same way, distributed over the threads in the
+  same tiles, but store a false-colour map of the per-pixel cost instead: blue
+  for the cheapest pixels through green and yellow to red for the most
+  expensive pixel of the frame. Antialiasing is skipped in the heatmap modes.
+
+  @param mode [in] SGL_RENDER_NORMAL, SGL_HEATMAP_INTERSECTION_TESTS,
+                   SGL_HEATMAP_RAYS, SGL_HEATMAP_RECURSION_DEPTH or
+                   SGL_HEATMAP_TIME
+
+  ERRORS:
+   - SGL_INVALID_ENUM
+    mode is not an accepted value.
+   - SGL_INVALID_OPERATION
+    No context has been allocated yet or sglRenderMode() is called within a
+    sglBegin() / sglEnd() sequence.
+*/
+void sglRenderMode(sglERenderMode mode);
+
 /// Rendering the image (ray tracing).
 /**
   Computes an image of the scene using rasterization.
@@ -830,6 +1256,141 @@ void sglEnvironmentMap(const int width,
                        const int height,
                        float *texels);
 
+//---------------------------------------------------------------------------
+// Statistics functions
+//---------------------------------------------------------------------------
+
+/// Rendering statistics of a frame.
+/**
+  A frame starts with sglClear() of the color buffer; the counters
+  accumulate over all rendering calls issued since then. Times are in
+  milliseconds of wall-clock time.
+*/
+typedef struct {
+  /// Rays cast through pixel centers and antialiasing sub-pixel samples
+  unsigned long long primaryRays;
+  unsigned long long shadowRays;
+  unsigned long long reflectionRays;
+  unsigned long long refractionRays;
+  /// Ray-primitive intersection tests
+  unsigned long long primitiveTests;
+  /// Intersection tests which found an intersection
+  unsigned long long primitiveHits;
+  /// Rays which left the scene and sampled the environment map
+  unsigned long long envMapLookups;
+  /// Pixels written by the rasterizer (points, lines, areas)
+  unsigned long long pixelsFilled;
+  /// Filled polygons passed to the rasterizer
+  unsigned long long polygonsRasterized;
+
+  /// Time spent tracing the image tiles in sglRayTraceScene()
+  double traceTime;
+  /// Time spent in the antialiasing pass of sglRayTraceScene()
+  double antialiasingTime;
+  /// Time spent rasterizing primitives
+  double rasterTime;
+  /// Time spent in sglClear()
+  double clearTime;
+
+  /// Number of ray traced image tiles
+  unsigned tiles;
+  /// Median, 99th percentile and maximum of the tile tracing times
+  double tileLatencyP50;
+  double tileLatencyP99;
+  double tileLatencyMax;
+} SGLRenderStats;
+
+/// Rendering statistics of the current context.
+/**
+  Fills the structure with the statistics of the current frame of the
+  current context. The counters are kept per thread while rendering, so
+  collecting them costs no synchronization. If the library was built
+  without statistics (SGL_RENDER_STATS=OFF), all the fields are zero.
+
+  @param stats [out] the structure to be filled
+
+  ERRORS:
+   - SGL_INVALID_VALUE
+    stats is NULL.
+   - SGL_INVALID_OPERATION
+    No context has been allocated yet.
+*/
+void sglGetRenderStats(SGLRenderStats *stats);
+
+//---------------------------------------------------------------------------
+// Tracing functions
+//---------------------------------------------------------------------------
+
+/// Start recording a trace.
+/**
+  Starts recording timed spans of the library: scene definition and
+  compilation, buffer clears, polygon filling, and the ray tracing tiles and
+  antialiasing pass of every worker thread. The trace is written to the file
+  by sglTraceEnd() in the Chrome trace-event JSON format, which can be opened
+  in chrome://tracing or Perfetto.
+
+  Tracing is global, it covers all the contexts and threads. Each thread
+  keeps its most recent spans in its own ring buffer, so very long traces
+  lose their oldest spans.
+
+  @param path [in] name of the file the trace is written to
+
+  ERRORS:
+   - SGL_INVALID_VALUE
+    path is NULL or the file cannot be opened for writing.
+   - SGL_INVALID_OPERATION
+    A trace is already being recorded.
+*/
+void sglTraceBegin(const char *path);
+
+/// Stop recording and write the trace.
+/**
+  ERRORS:
+   - SGL_INVALID_OPERATION
+    No trace is being recorded.
+   - SGL_INVALID_VALUE
+    Writing the trace file failed.
+*/
+void sglTraceEnd(void);
+
+//---------------------------------------------------------------------------
+// Capture functions
+//---------------------------------------------------------------------------
+
+/// Start capturing API calls.
+/**
+  Records every subsequent call of the public state-changing and drawing
+  functions, with all its arguments including matrices and environment map
+  texels, into a compact binary file. The capture can be replayed by the
+  sgl_replay tool, which turns an application workload into a repeatable
+  benchmark. Query functions (sglGet*), statistics, tracing and capture
+  functions are not recorded.
+
+  Calls from all threads are recorded in the order they enter the library,
+  together with the thread that made them; the time between calls is
+  recorded for paced replay. Starting the capture before sglInit() gives a
+  complete, self-contained trace.
+
+  @param path [in] name of the capture file
+
+  ERRORS:
+   - SGL_INVALID_VALUE
+    path is NULL or the file cannot be opened for writing.
+   - SGL_INVALID_OPERATION
+    A capture is already in progress.
+*/
+void sglCaptureBegin(const char *path);
+
+/// Stop capturing and close the capture file.
+/**
+  ERRORS:
+   - SGL_INVALID_OPERATION
+    No capture is in progress.
+   - SGL_INVALID_VALUE
+    Writing the capture file failed.
+*/
+void sglCaptureEnd(void);
+
 #ifdef __cplusplus
 }
 #endif
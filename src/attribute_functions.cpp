@@ -2,12 +2,19 @@
 #error This file must be compiled as C++
 #endif
 #include "context.h"
+#include "raster_bins.h"
+#include "display_list.h"
+#include <cmath>
+#include <memory>
+
+using std::make_unique;
 
 //---------------------------------------------------------------------------
 // Attribute functions
 //---------------------------------------------------------------------------
 
 void sglClearColor(float r, float g, float b, float alpha) {
+	SGL_CAPTURE(CAPTURE_CLEAR_COLOR, r, g, b, alpha);
 	if (contextNotInitialized() || calledWithinBeginEnd()) {
 		return;
 	}
@@ -15,13 +22,21 @@ void sglClearColor(float r, float g, float b, float alpha) {
 }
 
 void sglColor3f(float r, float g, float b) {
+	SGL_CAPTURE(CAPTURE_COLOR3F, r, g, b);
 	if (contextNotInitialized() || calledWithinBeginEnd()) {
 		return;
 	}
-    sceneManager->getCurrentContext().currentColor = Pixel(r, g, b);
+	SGLContext& context = sceneManager->getCurrentContext();
+	if (context.compilingList) {
+		// set by sglCallList()
+		context.compilingList->AddColor(Pixel(r, g, b));
+		return;
+	}
+	context.currentColor = Pixel(r, g, b);
 }
 
 void sglAreaMode(sglEAreaMode mode) {
+	SGL_CAPTURE(CAPTURE_AREA_MODE, mode);
 	if (contextNotInitialized() || 
         calledWithinBeginEnd()  || 
         isInvalidEnumValue(mode)) {
@@ -31,6 +46,7 @@ void sglAreaMode(sglEAreaMode mode) {
 }
 
 void sglPointSize(float size) {
+	SGL_CAPTURE(CAPTURE_POINT_SIZE, size);
 	if (contextNotInitialized() || calledWithinBeginEnd()) {
 		return;
 	}
@@ -43,30 +59,72 @@ void sglPointSize(float size) {
     sceneManager->getCurrentContext().pointSize = size;
 }
 
-void sglEnable(sglEEnableFlags cap) {
-	if (contextNotInitialized() || calledWithinBeginEnd()) {
+void sglToneMap(sglEToneMapOperator op, float exposure) {
+	SGL_CAPTURE(CAPTURE_TONE_MAP, op, exposure);
+	if (contextNotInitialized() || calledWithinBeginEnd() || calledWhileRecording()) {
 		return;
 	}
 
-	if (cap != SGL_DEPTH_TEST) {
+	if (op < SGL_TONEMAP_CLAMP || op > SGL_TONEMAP_ACES) {
 		setErrCode(SGL_INVALID_ENUM);
 		return;
 	}
-	else {
-        sceneManager->getCurrentContext().enabledDepthTest = true;
+	if (!(exposure >= 0) || std::isinf(exposure)) {
+		setErrCode(SGL_INVALID_VALUE);
+		return;
 	}
+
+	SGLContext& context = sceneManager->getCurrentContext();
+	context.toneMapOperator = op;
+	context.exposure = exposure;
 }
 
-void sglDisable(sglEEnableFlags cap) {
+void sglEnable(sglEEnableFlags cap) {
+	SGL_CAPTURE(CAPTURE_ENABLE, cap);
 	if (contextNotInitialized() || calledWithinBeginEnd()) {
 		return;
 	}
 
-	if (cap != SGL_DEPTH_TEST) {
-		setErrCode(SGL_INVALID_ENUM);
+	SGLContext& context = sceneManager->getCurrentContext();
+	switch (cap) {
+		case SGL_DEPTH_TEST:
+			context.enabledDepthTest = true;
+			break;
+		case SGL_BINNED_RASTER:
+			if (calledWhileRecording()) {
+				break;
+			}
+			if (!context.rasterBins) {
+				context.rasterBins = make_unique<RasterBins>(context.width, context.height);
+			}
+			break;
+		default:
+			setErrCode(SGL_INVALID_ENUM);
+			break;
+	}
+}
+
+void sglDisable(sglEEnableFlags cap) {
+	SGL_CAPTURE(CAPTURE_DISABLE, cap);
+	if (contextNotInitialized() || calledWithinBeginEnd()) {
 		return;
 	}
-	else {
-        sceneManager->getCurrentContext().enabledDepthTest = false;
+
+	SGLContext& context = sceneManager->getCurrentContext();
+	switch (cap) {
+		case SGL_DEPTH_TEST:
+			context.enabledDepthTest = false;
+			break;
+		case SGL_BINNED_RASTER:
+			if (calledWhileRecording()) {
+				break;
+			}
+			// the recorded primitives are drawn before binning stops
+			flushBinnedRaster(context);
+			context.rasterBins.reset();
+			break;
+		default:
+			setErrCode(SGL_INVALID_ENUM);
+			break;
 	}
 }
@@ -0,0 +1,147 @@
+#include "bvh.h"
+#include <algorithm>
+
+namespace {
+
+const int SAH_BINS = 12;
+const int MAX_LEAF_SIZE = 4;
+
+struct Builder {
+    const vector<AABB>& bounds;
+    vector<Vertex> centroids;
+    BVH& bvh;
+
+    Builder(const vector<AABB>& bounds, BVH& bvh) : bounds(bounds), bvh(bvh) {
+        centroids.reserve(bounds.size());
+        for (const AABB& box : bounds) {
+            centroids.push_back(box.Center());
+        }
+    }
+
+    // returns the index of the created node
+    int Build(int first, int count, int depth) {
+        int nodeIndex = static_cast<int>(bvh.nodes.size());
+        bvh.nodes.emplace_back();
+
+        AABB nodeBounds;
+        AABB centroidBounds;
+        for (int i = first; i < first + count; i++) {
+            nodeBounds.Extend(bounds[bvh.order[i]]);
+            centroidBounds.Extend(centroids[bvh.order[i]]);
+        }
+        bvh.nodes[nodeIndex].bounds = nodeBounds;
+
+        int axis = centroidBounds.LongestAxis();
+        float axisMin = VertexAxis(centroidBounds.min, axis);
+        float axisExtent = VertexAxis(centroidBounds.max, axis) - axisMin;
+
+        if (count <= MAX_LEAF_SIZE || axisExtent <= 0.0f) {
+            MakeLeaf(nodeIndex, first, count);
+            return nodeIndex;
+        }
+
+        int mid;
+        if (depth < BVH_SAH_MAX_DEPTH) {
+            mid = SplitSAH(first, count, axis, axisMin, axisExtent, nodeBounds.SurfaceArea());
+            if (mid < 0) {
+                MakeLeaf(nodeIndex, first, count);
+                return nodeIndex;
+            }
+        }
+        else {
+            mid = first + count / 2;
+            std::nth_element(
+                bvh.order.begin() + first,
+                bvh.order.begin() + mid,
+                bvh.order.begin() + first + count,
+                [this, axis](int a, int b) {
+                    return VertexAxis(centroids[a], axis) < VertexAxis(centroids[b], axis);
+                });
+        }
+
+        Build(first, mid - first, depth + 1);
+        int right = Build(mid, first + count - mid, depth + 1);
+        bvh.nodes[nodeIndex].offset = right;
+        bvh.nodes[nodeIndex].count = 0;
+        bvh.nodes[nodeIndex].axis = axis;
+        return nodeIndex;
+    }
+
+    void MakeLeaf(int nodeIndex, int first, int count) {
+        bvh.nodes[nodeIndex].offset = first;
+        bvh.nodes[nodeIndex].count = count;
+        bvh.nodes[nodeIndex].axis = 0;
+    }
+
+    int BinOf(int primitive, int axis, float axisMin, float axisExtent) const {
+        int bin = static_cast<int>(SAH_BINS * (VertexAxis(centroids[primitive], axis) - axisMin) / axisExtent);
+        return std::min(bin, SAH_BINS - 1);
+    }
+
+    // partitions the range by the cheapest bin boundary, returns the index of
+    // the first primitive of the right half or -1 if a leaf is cheaper
+    int SplitSAH(int first, int count, int axis, float axisMin, float axisExtent, float nodeArea) {
+        AABB binBounds[SAH_BINS];
+        int binCounts[SAH_BINS] = {};
+        for (int i = first; i < first + count; i++) {
+            int bin = BinOf(bvh.order[i], axis, axisMin, axisExtent);
+            binBounds[bin].Extend(bounds[bvh.order[i]]);
+            binCounts[bin]++;
+        }
+
+        // sweep from the right to get the cost of the right halves
+        float rightArea[SAH_BINS];
+        int rightCount[SAH_BINS];
+        AABB accumulated;
+        int accumulatedCount = 0;
+        for (int i = SAH_BINS - 1; i > 0; i--) {
+            accumulated.Extend(binBounds[i]);
+            accumulatedCount += binCounts[i];
+            rightArea[i] = accumulated.SurfaceArea();
+            rightCount[i] = accumulatedCount;
+        }
+
+        float bestCost = INFINITY;
+        int bestSplit = -1;
+        accumulated = AABB();
+        accumulatedCount = 0;
+        for (int i = 1; i < SAH_BINS; i++) {
+            accumulated.Extend(binBounds[i - 1]);
+            accumulatedCount += binCounts[i - 1];
+            if (accumulatedCount == 0 || rightCount[i] == 0) {
+                continue;
+            }
+            float cost = accumulated.SurfaceArea() * accumulatedCount + rightArea[i] * rightCount[i];
+            if (cost < bestCost) {
+                bestCost = cost;
+                bestSplit = i;
+            }
+        }
+
+        if (bestSplit < 0 || (count <= 2 * MAX_LEAF_SIZE && bestCost >= nodeArea * count)) {
+            return -1;
+        }
+
+        auto middle = std::partition(
+            bvh.order.begin() + first,
+            bvh.order.begin() + first + count,
+            [&](int primitive) { return BinOf(primitive, axis, axisMin, axisExtent) < bestSplit; });
+        return static_cast<int>(middle - bvh.order.begin());
+    }
+};
+
+}
+
+void BVH::Build(const vector<AABB>& bounds) {
+    nodes.clear();
+    order.resize(bounds.size());
+    for (size_t i = 0; i < bounds.size(); i++) {
+        order[i] = static_cast<int>(i);
+    }
+    if (bounds.empty()) {
+        return;
+    }
+    nodes.reserve(2 * bounds.size());
+    Builder builder(bounds, *this);
+    builder.Build(0, static_cast<int>(bounds.size()), 0);
+}
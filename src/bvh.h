@@ -0,0 +1,100 @@
+#pragma once
+
+#include "structures.h"
+#include <vector>
+
+using std::vector;
+
+// Depth of the hierarchy after which nodes are split at the object median,
+// which keeps the traversal stack bounded for degenerate inputs
+const int BVH_SAH_MAX_DEPTH = 64;
+const int BVH_MAX_DEPTH = 128;
+
+/**
+ * @file bvh.h
+ * @brief Bounding volume hierarchy used as the spatial index of the ray tracer
+ */
+
+struct BVHNode {
+    AABB bounds;
+    // leaf: index of the first primitive, inner node: index of the right child
+    // (the left child always directly follows its parent)
+    int offset;
+    // number of primitives in a leaf, 0 for inner nodes
+    int count;
+    // split axis of inner nodes, the left child holds the lower half
+    int axis;
+
+    bool IsLeaf() const { return count > 0; }
+};
+
+struct BVH {
+    vector<BVHNode> nodes;
+    // permutation of the primitive indices, leaves reference ranges of it
+    vector<int> order;
+
+    /**
+     * @brief Builds the hierarchy over the given primitive bounds.
+     *
+     * Nodes are split using the surface area heuristic evaluated on a fixed
+     * number of bins along the longest axis of the centroid bounds.
+     *
+     * @param bounds Bounding boxes of the primitives.
+     */
+    void Build(const vector<AABB>& bounds);
+
+    /**
+     * @brief Visits all leaf primitives whose nodes are hit by the ray.
+     *
+     * Children are visited front to back. The visitor may shrink tMax to cull
+     * farther nodes, and stops the traversal by returning true.
+     *
+     * @param origin Ray origin.
+     * @param direction Ray direction.
+     * @param tMax The farthest accepted ray parameter, updated by the visitor.
+     * @param visit Callable with signature bool(int primitiveIndex, float& tMax).
+     */
+    template <typename Visitor>
+    void Traverse(const Vertex& origin, const Vertex& direction, float tMax, Visitor&& visit) const;
+};
+
+template <typename Visitor>
+void BVH::Traverse(const Vertex& origin, const Vertex& direction, float tMax, Visitor&& visit) const {
+    if (nodes.empty()) {
+        return;
+    }
+    const Vertex invDir(1.0f / direction.x, 1.0f / direction.y, 1.0f / direction.z);
+    const bool dirNegative[3] = { direction.x < 0, direction.y < 0, direction.z < 0 };
+
+    int stack[BVH_MAX_DEPTH];
+    int stackSize = 0;
+    int current = 0;
+
+    while (true) {
+        const BVHNode& node = nodes[current];
+        if (node.bounds.IntersectWithRay(origin, invDir, tMax)) {
+            if (node.IsLeaf()) {
+                for (int i = node.offset; i < node.offset + node.count; i++) {
+                    if (visit(order[i], tMax)) {
+                        return;
+                    }
+                }
+            }
+            else {
+                if (dirNegative[node.axis]) {
+                    stack[stackSize++] = current + 1;
+                    current = node.offset;
+                }
+                else {
+                    stack[stackSize++] = node.offset;
+                    current = current + 1;
+                }
+                continue;
+            }
+        }
+        if (stackSize == 0) {
+            return;
+        }
+        current = stack[--stackSize];
+    }
+}
@@ -0,0 +1,141 @@
+#include "capture.h"
+#include "context.h"
+#include "vertex_array.h"
+#include <chrono>
+#include <cstdio>
+#include <mutex>
+
+std::atomic<bool> captureEnabled(false);
+thread_local int captureNesting = 0;
+
+namespace {
+
+// Records are buffered and written in blocks of this size
+const size_t CAPTURE_FLUSH_SIZE = 1 << 20;
+
+// guards everything below
+std::mutex captureMutex;
+FILE* captureFile = nullptr;
+vector<uint8_t> captureBuffer;
+std::chrono::steady_clock::time_point lastRecordTime;
+// incremented by every sglCaptureBegin(), invalidates the thread indices
+unsigned captureSession = 0;
+unsigned nextThreadIndex = 0;
+unsigned currentThreadIndex = 0;
+
+struct CaptureThread {
+    unsigned session = 0;
+    unsigned index = 0;
+};
+thread_local CaptureThread captureThread;
+
+void appendVarint(vector<uint8_t>& out, uint64_t value) {
+    while (value >= 0x80) {
+        out.push_back(static_cast<uint8_t>(value | 0x80));
+        value >>= 7;
+    }
+    out.push_back(static_cast<uint8_t>(value));
+}
+
+void appendRecordHeader(CaptureOpcode opcode) {
+    const auto now = std::chrono::steady_clock::now();
+    const auto delta = std::chrono::duration_cast<std::chrono::microseconds>(now - lastRecordTime).count();
+    lastRecordTime = now;
+    captureBuffer.push_back(opcode);
+    appendVarint(captureBuffer, static_cast<uint64_t>(delta));
+}
+
+bool flushCapture() {
+    const bool ok = fwrite(captureBuffer.data(), 1, captureBuffer.size(), captureFile) == captureBuffer.size();
+    captureBuffer.clear();
+    return ok;
+}
+
+}
+
+void captureArgument(vector<uint8_t>& out, const CaptureVertices& vertices) {
+    captureArgument(out, static_cast<int32_t>(vertices.count));
+    const bool readable = vertices.array && vertices.array->pointer && vertices.first >= 0 &&
+                          vertices.count > 0;
+    const uint32_t floatCount = readable ? static_cast<uint32_t>(vertices.count) * 4 : 0;
+    captureArgument(out, floatCount);
+    for (uint32_t i = 0; i < floatCount / 4; i++) {
+        const size_t index = vertices.indices ? vertices.indices[i] : vertices.first + i;
+        const Vertex v = readVertex(*vertices.array, index);
+        const float components[4] = { v.x, v.y, v.z, v.w };
+        captureAppend(out, components, sizeof(components));
+    }
+}
+
+void captureRecord(CaptureOpcode opcode, const vector<uint8_t>& arguments) {
+    std::lock_guard<std::mutex> lock(captureMutex);
+    if (!captureFile) {
+        return;
+    }
+
+    if (captureThread.session != captureSession) {
+        captureThread.session = captureSession;
+        captureThread.index = nextThreadIndex++;
+    }
+    if (captureThread.index != currentThreadIndex) {
+        currentThreadIndex = captureThread.index;
+        appendRecordHeader(CAPTURE_THREAD);
+        captureArgument(captureBuffer, static_cast<uint32_t>(currentThreadIndex));
+    }
+
+    appendRecordHeader(opcode);
+    captureBuffer.insert(captureBuffer.end(), arguments.begin(), arguments.end());
+    if (captureBuffer.size() >= CAPTURE_FLUSH_SIZE) {
+        flushCapture();
+    }
+}
+
+//---------------------------------------------------------------------------
+// Capture functions
+//---------------------------------------------------------------------------
+
+void sglCaptureBegin(const char *path) {
+    if (!path) {
+        setErrCode(SGL_INVALID_VALUE);
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(captureMutex);
+    if (captureFile) {
+        setErrCode(SGL_INVALID_OPERATION);
+        return;
+    }
+    captureFile = fopen(path, "wb");
+    if (!captureFile) {
+        setErrCode(SGL_INVALID_VALUE);
+        return;
+    }
+
+    captureBuffer.clear();
+    captureBuffer.reserve(CAPTURE_FLUSH_SIZE + 4096);
+    captureAppend(captureBuffer, CAPTURE_MAGIC, sizeof(CAPTURE_MAGIC));
+    lastRecordTime = std::chrono::steady_clock::now();
+    captureSession++;
+    // the thread starting the capture gets index 0
+    captureThread.session = captureSession;
+    captureThread.index = 0;
+    nextThreadIndex = 1;
+    currentThreadIndex = 0;
+    captureEnabled.store(true, std::memory_order_relaxed);
+}
+
+void sglCaptureEnd() {
+    std::lock_guard<std::mutex> lock(captureMutex);
+    if (!captureFile) {
+        setErrCode(SGL_INVALID_OPERATION);
+        return;
+    }
+    captureEnabled.store(false, std::memory_order_relaxed);
+
+    const bool written = flushCapture();
+    if (fclose(captureFile) != 0 || !written) {
+        setErrCode(SGL_INVALID_VALUE);
+    }
+    captureFile = nullptr;
+    captureBuffer.shrink_to_fit();
+}
@@ -0,0 +1,255 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+#include <vector>
+
+using std::vector;
+
+/**
+ * @file capture.h
+ * @brief Recording of public API calls into a binary trace, see sglCaptureBegin()
+ *
+ * The file starts with CAPTURE_MAGIC followed by records. A record is the
+ * opcode byte, the time since the previous record in microseconds (unsigned
+ * LEB128) and the arguments in the order of the signature in CAPTURE_CALLS:
+ *   i  32-bit signed integer (ints, enums, context ids)
+ *   u  32-bit unsigned integer
+ *   f  32-bit float
+ *   F  32-bit element count followed by that many floats
+ * All values are little-endian. CAPTURE_THREAD records (signature "u") mark
+ * that the following calls were made by another application thread.
+ *
+ * Calls made by the library itself (e.g. sglBegin() inside sglEllipse()) are
+ * not recorded, replaying the outer call repeats them.
+ */
+
+const char CAPTURE_MAGIC[8] = { 'S', 'G', 'L', 'C', 'A', 'P', '0', '1' };
+
+enum CaptureOpcode : uint8_t {
+    CAPTURE_THREAD,
+    CAPTURE_INIT,
+    CAPTURE_FINISH,
+    CAPTURE_CREATE_CONTEXT,
+    CAPTURE_DESTROY_CONTEXT,
+    CAPTURE_SET_CONTEXT,
+    CAPTURE_CLEAR,
+    CAPTURE_BEGIN,
+    CAPTURE_END,
+    CAPTURE_VERTEX4F,
+    CAPTURE_VERTEX3F,
+    CAPTURE_VERTEX2F,
+    CAPTURE_CIRCLE,
+    CAPTURE_ELLIPSE,
+    CAPTURE_ARC,
+    CAPTURE_MATRIX_MODE,
+    CAPTURE_PUSH_MATRIX,
+    CAPTURE_POP_MATRIX,
+    CAPTURE_LOAD_IDENTITY,
+    CAPTURE_LOAD_MATRIX,
+    CAPTURE_MULT_MATRIX,
+    CAPTURE_TRANSLATE,
+    CAPTURE_SCALE,
+    CAPTURE_ROTATE_2D,
+    CAPTURE_ROTATE_Y,
+    CAPTURE_ORTHO,
+    CAPTURE_FRUSTUM,
+    CAPTURE_VIEWPORT,
+    CAPTURE_CLEAR_COLOR,
+    CAPTURE_COLOR3F,
+    CAPTURE_AREA_MODE,
+    CAPTURE_POINT_SIZE,
+    CAPTURE_ENABLE,
+    CAPTURE_DISABLE,
+    CAPTURE_BEGIN_SCENE,
+    CAPTURE_END_SCENE,
+    CAPTURE_SPHERE,
+    CAPTURE_MATERIAL,
+    CAPTURE_POINT_LIGHT,
+    CAPTURE_RAY_TRACE_SCENE,
+    CAPTURE_RENDER_MODE,
+    CAPTURE_RASTERIZE_SCENE,
+    CAPTURE_EMISSIVE_MATERIAL,
+    CAPTURE_ENVIRONMENT_MAP,
+    CAPTURE_TONE_MAP,
+    CAPTURE_READ_PIXELS,
+    CAPTURE_CREATE_CONTEXT_WITH_BUFFER,
+    CAPTURE_CREATE_SHARED_CONTEXT,
+    CAPTURE_PUBLISH_FRAME,
+    CAPTURE_BEGIN_COMMAND_BUFFER,
+    CAPTURE_END_COMMAND_BUFFER,
+    CAPTURE_FLUSH,
+    CAPTURE_NEW_LIST,
+    CAPTURE_END_LIST,
+    CAPTURE_CALL_LIST,
+    CAPTURE_VERTEX_POINTER,
+    CAPTURE_DRAW_ARRAYS,
+    CAPTURE_DRAW_ELEMENTS,
+    CAPTURE_BEGIN_PATH,
+    CAPTURE_END_PATH,
+    CAPTURE_OPCODE_COUNT
+};
+
+struct CaptureCallInfo {
+    const char* name;
+    const char* signature;
+};
+
+// Indexed by CaptureOpcode
+const CaptureCallInfo CAPTURE_CALLS[CAPTURE_OPCODE_COUNT] = {
+    { "<thread>", "u" },
+    { "sglInit", "" },
+    { "sglFinish", "" },
+    { "sglCreateContext", "ii" },
+    { "sglDestroyContext", "i" },
+    { "sglSetContext", "i" },
+    { "sglClear", "u" },
+    { "sglBegin", "i" },
+    { "sglEnd", "" },
+    { "sglVertex4f", "ffff" },
+    { "sglVertex3f", "fff" },
+    { "sglVertex2f", "ff" },
+    { "sglCircle", "ffff" },
+    { "sglEllipse", "fffff" },
+    { "sglArc", "ffffff" },
+    { "sglMatrixMode", "i" },
+    { "sglPushMatrix", "" },
+    { "sglPopMatrix", "" },
+    { "sglLoadIdentity", "" },
+    { "sglLoadMatrix", "F" },
+    { "sglMultMatrix", "F" },
+    { "sglTranslate", "fff" },
+    { "sglScale", "fff" },
+    { "sglRotate2D", "fff" },
+    { "sglRotateY", "f" },
+    { "sglOrtho", "ffffff" },
+    { "sglFrustum", "ffffff" },
+    { "sglViewport", "iiii" },
+    { "sglClearColor", "ffff" },
+    { "sglColor3f", "fff" },
+    { "sglAreaMode", "i" },
+    { "sglPointSize", "f" },
+    { "sglEnable", "i" },
+    { "sglDisable", "i" },
+    { "sglBeginScene", "" },
+    { "sglEndScene", "" },
+    { "sglSphere", "ffff" },
+    { "sglMaterial", "ffffffff" },
+    { "sglPointLight", "ffffff" },
+    { "sglRayTraceScene", "" },
+    { "sglRenderMode", "i" },
+    { "sglRasterizeScene", "" },
+    { "sglEmissiveMaterial", "ffffff" },
+    { "sglEnvironmentMap", "iiF" },
+    { "sglToneMap", "if" },
+    { "sglReadPixels", "ii" },
+    // the buffer of the application and the segment name are not recorded
+    { "sglCreateContextWithBuffer", "iiu" },
+    { "sglCreateSharedContext", "ii" },
+    { "sglPublishFrame", "" },
+    { "sglBeginCommandBuffer", "u" },
+    { "sglEndCommandBuffer", "" },
+    { "sglFlush", "" },
+    { "sglNewList", "u" },
+    { "sglEndList", "" },
+    { "sglCallList", "u" },
+    // the pointer is not recorded, the vertices drawn are
+    { "sglVertexPointer", "ii" },
+    { "sglDrawArrays", "iiiF" },
+    { "sglDrawElements", "iiF" },
+    { "sglBeginPath", "i" },
+    { "sglEndPath", "" },
+};
+
+// Float array argument, a null pointer is recorded as an empty array
+struct CaptureFloats {
+    const float* data;
+    uint32_t count;
+};
+
+extern std::atomic<bool> captureEnabled;
+
+// Calls of the calling thread in progress while capturing, nested calls are not recorded
+extern thread_local int captureNesting;
+
+inline void captureAppend(vector<uint8_t>& out, const void* data, size_t size) {
+    if (size == 0) {
+        return;
+    }
+    const size_t offset = out.size();
+    out.resize(offset + size);
+    memcpy(out.data() + offset, data, size);
+}
+
+inline void captureArgument(vector<uint8_t>& out, int32_t value) { captureAppend(out, &value, 4); }
+inline void captureArgument(vector<uint8_t>& out, uint32_t value) { captureAppend(out, &value, 4); }
+inline void captureArgument(vector<uint8_t>& out, float value) { captureAppend(out, &value, 4); }
+
+inline void captureArgument(vector<uint8_t>& out, const CaptureFloats& floats) {
+    const uint32_t count = floats.data ? floats.count : 0;
+    captureAppend(out, &count, 4);
+    captureAppend(out, floats.data, count * sizeof(float));
+}
+
+struct VertexArray;
+
+/// Vertices drawn from an array of the application, see sglDrawArrays().
+/**
+  Recorded as the vertex count followed by an F argument of four floats
+  (x, y, z, w) per vertex, read from the array only while capturing. No
+  vertices are recorded if the array is missing or the range is invalid.
+*/
+struct CaptureVertices {
+    const VertexArray* array;
+    // nullptr for the consecutive vertices from first
+    const unsigned* indices;
+    int first;
+    int count;
+};
+
+void captureArgument(vector<uint8_t>& out, const CaptureVertices& vertices);
+
+template <typename E, typename = typename std::enable_if<std::is_enum<E>::value>::type>
+inline void captureArgument(vector<uint8_t>& out, E value) {
+    captureArgument(out, static_cast<int32_t>(value));
+}
+
+/// Appends the encoded record to the trace, called with the arguments already encoded.
+void captureRecord(CaptureOpcode opcode, const vector<uint8_t>& arguments);
+
+// Records the call of a public function unless it was made by the library itself
+class CaptureCall {
+public:
+    template <typename... Args>
+    explicit CaptureCall(CaptureOpcode opcode, const Args&... args) :
+      active(captureEnabled.load(std::memory_order_relaxed)) {
+        if (active && captureNesting++ == 0) {
+            // reused, records are only made outside of nested calls
+            static thread_local vector<uint8_t> arguments;
+            arguments.clear();
+            int expand[] = { 0, (captureArgument(arguments, args), 0)... };
+            (void)expand;
+            captureRecord(opcode, arguments);
+        }
+    }
+
+    ~CaptureCall() {
+        if (active) {
+            captureNesting--;
+        }
+    }
+
+    CaptureCall(const CaptureCall&) = delete;
+    CaptureCall& operator=(const CaptureCall&) = delete;
+
+private:
+    bool active;
+};
+
+#define SGL_CAPTURE_CONCAT_(a, b) a##b
+#define SGL_CAPTURE_CONCAT(a, b) SGL_CAPTURE_CONCAT_(a, b)
+
+/// Records the call of the enclosing public function with the given arguments.
+#define SGL_CAPTURE(...) CaptureCall SGL_CAPTURE_CONCAT(captureCall, __LINE__)(__VA_ARGS__)
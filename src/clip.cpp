@@ -0,0 +1,317 @@
+#include "clip.h"
+#include "context.h"
+#include <algorithm>
+
+using std::max;
+using std::min;
+
+namespace {
+
+// The near plane and the guard band are clipped against, the edges of the
+// canvas only cull what lies outside of them
+const int CLIP_PLANE_COUNT = 5;
+const int PLANE_COUNT = 9;
+const unsigned CLIP_PLANES = (1u << CLIP_PLANE_COUNT) - 1;
+
+// Window depth the near plane is clipped at, the rasterizer interpolates
+// 1 / z and the depth 0 of the near plane itself would be infinite there
+const float NEAR_DEPTH = 1.0f / 1024;
+
+// Batches of more vertices are classified by their bounding box
+const size_t CLIP_BOX_THRESHOLD = 16;
+
+// The planes of the context in homogeneous window coordinates, the bits of
+// the clip codes in their order
+struct ClipVolume {
+    // the guard band, then the canvas
+    float left[2];
+    float right[2];
+    float bottom[2];
+    float top[2];
+
+    explicit ClipVolume(const SGLContext& context) {
+        // pixels of a primitive lie less far out of its vertices: the points
+        // reach by their size, and the truncated vertices and the rounded
+        // spans of the polygons by a pixel or two
+        const float margin = float(std::max(static_cast<int>(context.pointSize), 2) + 1);
+        const float reach[2] = { float(CLIP_GUARD_BAND), margin };
+        for (int k = 0; k < 2; k++) {
+            left[k] = -reach[k];
+            right[k] = float(context.width - 1) + reach[k];
+            bottom[k] = -reach[k];
+            top[k] = float(context.height - 1) + reach[k];
+        }
+    }
+
+    // signed distance of the vertex from the plane, negative outside
+    float Distance(int plane, const Vertex& v) const {
+        if (plane == 0) {
+            return v.z + v.w - 2 * NEAR_DEPTH * v.w;
+        }
+        const int k = plane < CLIP_PLANE_COUNT ? 0 : 1;
+        switch ((plane - 1) % 4) {
+            case 0:
+                return v.x - left[k] * v.w;
+            case 1:
+                return right[k] * v.w - v.x;
+            case 2:
+                return v.y - bottom[k] * v.w;
+            default:
+                return top[k] * v.w - v.y;
+        }
+    }
+
+    // the bits of the planes the vertex lies outside of, as Distance() tells
+    unsigned Code(const Vertex& v) const {
+        unsigned code = v.z + v.w - 2 * NEAR_DEPTH * v.w < 0 ? 1u : 0u;
+        for (int k = 0; k < 2; k++) {
+            const int shift = 1 + 4 * k;
+            code |= unsigned(v.x - left[k] * v.w < 0) << shift;
+            code |= unsigned(right[k] * v.w - v.x < 0) << (shift + 1);
+            code |= unsigned(v.y - bottom[k] * v.w < 0) << (shift + 2);
+            code |= unsigned(top[k] * v.w - v.y < 0) << (shift + 3);
+        }
+        return code;
+    }
+};
+
+inline Vertex interpolate(const Vertex& a, const Vertex& b, float t) {
+    return Vertex(a.x + (b.x - a.x) * t, a.y + (b.y - a.y) * t,
+                  a.z + (b.z - a.z) * t, a.w + (b.w - a.w) * t);
+}
+
+// The point where the edge crosses the plane, always computed from the
+// vertex inside so that the polygons sharing the edge agree on it
+inline Vertex intersect(const Vertex& inside, const Vertex& outside, float dInside, float dOutside) {
+    return interpolate(inside, outside, dInside / (dInside - dOutside));
+}
+
+inline ScreenVertex toScreen(const Vertex& v) {
+    const Vertex window = projectVertex(v);
+    return ScreenVertex(static_cast<int>(window.x), static_cast<int>(window.y), window.z);
+}
+
+// The vertices multiplied by the VPM matrix and their clip codes
+void transformHomogeneous(const SGLContext& context, const ClipVolume& volume, const VertexArray& array,
+                          const unsigned* indices, size_t first, size_t count,
+                          vector<Vertex>& vertices, vector<unsigned>& codes) {
+    vertices.resize(count);
+    codes.resize(count);
+    for (size_t i = 0; i < count; i++) {
+        vertices[i] = context.VPMmatrix * readVertex(array, indices ? first + indices[i] : first + i);
+        codes[i] = volume.Code(vertices[i]);
+    }
+}
+
+// Liang-Barsky clipping of the segment by the planes, false if nothing is left
+bool clipSegment(const ClipVolume& volume, unsigned planes, Vertex& a, Vertex& b) {
+    float t0 = 0.0f;
+    float t1 = 1.0f;
+    for (int plane = 0; plane < CLIP_PLANE_COUNT; plane++) {
+        if (!(planes & (1u << plane))) {
+            continue;
+        }
+        const float da = volume.Distance(plane, a);
+        const float db = volume.Distance(plane, b);
+        if (da < 0 && db < 0) {
+            return false;
+        }
+        if (da < 0) {
+            t0 = max(t0, da / (da - db));
+        }
+        else if (db < 0) {
+            t1 = min(t1, da / (da - db));
+        }
+    }
+    if (t0 > t1) {
+        return false;
+    }
+
+    const Vertex start = a;
+    if (t0 > 0) {
+        a = interpolate(start, b, t0);
+    }
+    if (t1 < 1) {
+        b = interpolate(start, b, t1);
+    }
+    return true;
+}
+
+// Sutherland-Hodgman clipping of the polygon by the planes, in place
+void clipPolygon(const ClipVolume& volume, unsigned planes, vector<Vertex>& polygon, vector<Vertex>& scratch) {
+    for (int plane = 0; plane < CLIP_PLANE_COUNT && !polygon.empty(); plane++) {
+        if (!(planes & (1u << plane))) {
+            continue;
+        }
+        scratch.clear();
+        for (size_t i = 0; i < polygon.size(); i++) {
+            const Vertex& current = polygon[i];
+            const Vertex& next = polygon[i + 1 < polygon.size() ? i + 1 : 0];
+            const float dCurrent = volume.Distance(plane, current);
+            const float dNext = volume.Distance(plane, next);
+            if (dCurrent >= 0) {
+                scratch.push_back(current);
+                if (dNext < 0) {
+                    scratch.push_back(intersect(current, next, dCurrent, dNext));
+                }
+            }
+            else if (dNext >= 0) {
+                scratch.push_back(intersect(next, current, dNext, dCurrent));
+            }
+        }
+        polygon.swap(scratch);
+    }
+}
+
+} // namespace
+
+ClipResult classifyVertexArray(const SGLContext& context, const VertexArray& array, const unsigned* indices,
+                               size_t first, size_t count) {
+    if (count == 0) {
+        return ClipResult::Inside;
+    }
+
+    const ClipVolume volume(context);
+    // planes some vertex and all the vertices lie outside of
+    unsigned any = 0;
+    unsigned all = (1u << PLANE_COUNT) - 1;
+    auto classify = [&](const Vertex& v) {
+        const unsigned code = volume.Code(context.VPMmatrix * v);
+        any |= code;
+        all &= code;
+    };
+    auto result = [&]() {
+        if (all) {
+            return ClipResult::Outside;
+        }
+        return any & CLIP_PLANES ? ClipResult::Clipped : ClipResult::Inside;
+    };
+
+    if (count <= CLIP_BOX_THRESHOLD) {
+        for (size_t i = 0; i < count; i++) {
+            classify(readVertex(array, indices ? first + indices[i] : first + i));
+        }
+        return result();
+    }
+
+    // the transformation is linear and the planes are half-spaces, so all
+    // the vertices lie on the side of a plane all the corners lie on
+    Vertex lower;
+    Vertex upper;
+    boundVertexArray(array, indices, first, count, lower, upper);
+    const int corners = lower.w == upper.w ? 8 : 16;
+    for (int corner = 0; corner < corners; corner++) {
+        classify(Vertex(corner & 1 ? upper.x : lower.x, corner & 2 ? upper.y : lower.y,
+                        corner & 4 ? upper.z : lower.z, corner & 8 ? upper.w : lower.w));
+    }
+    return result();
+}
+
+PrimitiveKind clipPrimitive(const SGLContext& context, PrimitiveKind kind, const VertexArray& array,
+                            const unsigned* indices, size_t first, size_t count, vector<ScreenVertex>& out) {
+    const ClipVolume volume(context);
+    vector<Vertex> vertices;
+    vector<unsigned> codes;
+    transformHomogeneous(context, volume, array, indices, first, count, vertices, codes);
+    out.clear();
+
+    if (kind == PrimitiveKind::Points) {
+        for (size_t i = 0; i < count; i++) {
+            if (codes[i] == 0) {
+                out.push_back(toScreen(vertices[i]));
+            }
+        }
+        return kind;
+    }
+
+    if (kind == PrimitiveKind::Polygon) {
+        unsigned planes = 0;
+        unsigned all = ~0u;
+        for (unsigned code : codes) {
+            planes |= code;
+            all &= code;
+        }
+        if (count == 0 || all) {
+            return kind;
+        }
+        vector<Vertex> scratch;
+        clipPolygon(volume, planes & CLIP_PLANES, vertices, scratch);
+        for (const Vertex& v : vertices) {
+            out.push_back(toScreen(v));
+        }
+        return kind;
+    }
+
+    // the segments in the order the kind draws them
+    auto addSegment = [&](size_t i, size_t j) {
+        if (codes[i] & codes[j]) {
+            return;
+        }
+        Vertex a = vertices[i];
+        Vertex b = vertices[j];
+        const unsigned planes = (codes[i] | codes[j]) & CLIP_PLANES;
+        if (planes && !clipSegment(volume, planes, a, b)) {
+            return;
+        }
+        out.push_back(toScreen(a));
+        out.push_back(toScreen(b));
+    };
+    switch (kind) {
+        case PrimitiveKind::Lines:
+            for (size_t i = 0; i + 1 < count; i += 2) {
+                addSegment(i, i + 1);
+            }
+            break;
+        case PrimitiveKind::LineStrip:
+        case PrimitiveKind::LineLoop:
+            for (size_t i = 0; i + 1 < count; i++) {
+                addSegment(i, i + 1);
+            }
+            if (kind == PrimitiveKind::LineLoop && count >= 2) {
+                addSegment(count - 1, 0);
+            }
+            break;
+        case PrimitiveKind::TriangleOutlines:
+            for (size_t i = 0; i + 2 < count; i += 3) {
+                addSegment(i, i + 1);
+                addSegment(i + 1, i + 2);
+                addSegment(i + 2, i);
+            }
+            break;
+        default:
+            break;
+    }
+    return PrimitiveKind::Lines;
+}
+
+void clipTriangles(const SGLContext& context, const VertexArray& array, const unsigned* indices,
+                   size_t first, size_t count, vector<Vertex>& out) {
+    const ClipVolume volume(context);
+    vector<Vertex> vertices;
+    vector<unsigned> codes;
+    transformHomogeneous(context, volume, array, indices, first, count, vertices, codes);
+    out.clear();
+
+    vector<Vertex> polygon;
+    vector<Vertex> scratch;
+    for (size_t i = 0; i + 2 < count; i += 3) {
+        if (codes[i] & codes[i + 1] & codes[i + 2]) {
+            continue;
+        }
+        const unsigned planes = (codes[i] | codes[i + 1] | codes[i + 2]) & CLIP_PLANES;
+        if (planes == 0) {
+            out.push_back(projectVertex(vertices[i]));
+            out.push_back(projectVertex(vertices[i + 1]));
+            out.push_back(projectVertex(vertices[i + 2]));
+            continue;
+        }
+
+        polygon.assign(vertices.begin() + i, vertices.begin() + i + 3);
+        clipPolygon(volume, planes, polygon, scratch);
+        for (size_t k = 1; k + 1 < polygon.size(); k++) {
+            out.push_back(projectVertex(polygon[0]));
+            out.push_back(projectVertex(polygon[k]));
+            out.push_back(projectVertex(polygon[k + 1]));
+        }
+    }
+}
@@ -0,0 +1,79 @@
+#pragma once
+
+#include "draw_utils.h"
+#include "vertex_array.h"
+#include <cstdint>
+#include <vector>
+
+using std::vector;
+
+/**
+ * @file clip.h
+ * @brief Clipping of the primitives of sglBegin() / sglEnd() blocks before they are rasterized
+ *
+ * The vertices are clipped in homogeneous coordinates, multiplied by the VPM
+ * matrix but not divided by w, against the near plane and a guard band around
+ * the canvas. Nothing behind the eye reaches the rasterizer, and the window
+ * coordinates of what does fit its integers. Only the primitives crossing a
+ * plane are clipped, the rest are drawn as they are. Batches outside of the
+ * canvas are not drawn at all.
+ */
+
+/// Width of the guard band around the canvas, in pixels.
+/**
+  Primitives reaching less far out of the canvas are not clipped, the
+  rasterizer skips their pixels outside of it.
+*/
+const int CLIP_GUARD_BAND = 1024;
+
+/**
+ * @brief What a batch of vertices needs before it is rasterized.
+ */
+enum class ClipResult : uint8_t {
+    // inside of the clip planes, drawn as it is
+    Inside,
+    // crosses a clip plane, see clipPrimitive() and clipTriangles()
+    Clipped,
+    // outside of a clip plane or of an edge of the canvas, nothing is visible
+    Outside,
+};
+
+/**
+ * @brief Classifies vertices of the array against the clip planes and the
+ *        edges of the canvas.
+ *
+ * Large batches are classified by the corners of their bounding box instead
+ * of vertex by vertex, a batch then may be clipped although no vertex
+ * crosses a plane.
+ *
+ * @param context The context whose VPM matrix and canvas are used.
+ * @param array The vertices.
+ * @param indices The indices of the vertices, nullptr for the consecutive
+ *                vertices from first, see transformVertexArray().
+ * @param first The first index, or the one added to the indices.
+ * @param count The number of the vertices.
+ */
+ClipResult classifyVertexArray(const SGLContext& context, const VertexArray& array, const unsigned* indices,
+                               size_t first, size_t count);
+
+/**
+ * @brief Clips vertices of the array drawn as the kind of primitive says.
+ *
+ * Points outside are dropped, polygons are clipped by the Sutherland-Hodgman
+ * algorithm and the lines segment by segment.
+ *
+ * @param out Set to the screen vertices of the visible parts.
+ * @return The kind the vertices in out are drawn as, the lines of all kinds
+ *         become separate segments.
+ */
+PrimitiveKind clipPrimitive(const SGLContext& context, PrimitiveKind kind, const VertexArray& array,
+                            const unsigned* indices, size_t first, size_t count, vector<ScreenVertex>& out);
+
+/**
+ * @brief Clips a triangle list of vertices of the array, the clipped
+ *        triangles are split into fans of triangles again.
+ *
+ * @param out Set to the visible triangles in window coordinates.
+ */
+void clipTriangles(const SGLContext& context, const VertexArray& array, const unsigned* indices,
+                   size_t first, size_t count, vector<Vertex>& out);
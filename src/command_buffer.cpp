@@ -0,0 +1,173 @@
+#include "command_buffer.h"
+#include "raster_bins.h"
+#include <algorithm>
+
+using std::make_unique;
+
+CommandBuffer::CommandBuffer(SGLContext& target, unsigned order) :
+  target(target),
+  order(order),
+  state(make_unique<SGLContext>(target.width, target.height, this)) {
+}
+
+CommandBuffer::~CommandBuffer() = default;
+
+void CommandBuffer::AddPrimitive(const RasterState& state, PrimitiveKind kind,
+                                 const ScreenVertex* vertices, size_t count) {
+    Command command = {};
+    command.type = Type::Primitive;
+    command.kind = kind;
+    command.state = state;
+    command.first = static_cast<uint32_t>(screenVertices.size());
+    command.count = static_cast<uint32_t>(count);
+    screenVertices.insert(screenVertices.end(), vertices, vertices + count);
+    commands.push_back(command);
+}
+
+void CommandBuffer::AddTriangles(const RasterState& state, const Vertex* vertices, size_t count) {
+    Command command = {};
+    command.type = Type::Triangles;
+    command.state = state;
+    command.first = static_cast<uint32_t>(windowVertices.size());
+    command.count = static_cast<uint32_t>(count);
+    windowVertices.insert(windowVertices.end(), vertices, vertices + count);
+    commands.push_back(command);
+}
+
+void CommandBuffer::AddCircle(const RasterState& state, const WindowCircle& circle, bool filled) {
+    Command command = {};
+    command.type = filled ? Type::Circle : Type::CircleOutline;
+    command.state = state;
+    command.first = static_cast<uint32_t>(screenVertices.size());
+    command.count = static_cast<uint32_t>(circle.radius);
+    screenVertices.push_back(circle.center);
+    commands.push_back(command);
+}
+
+void CommandBuffer::AddPath(const RasterState& state, const ScreenVertex* vertices, const uint32_t* contours,
+                            size_t contourCount, sglEFillRule rule) {
+    size_t count = 0;
+    for (size_t i = 0; i < contourCount; i++) {
+        count += contours[i];
+    }
+    Path path;
+    path.firstContour = static_cast<uint32_t>(this->contours.size());
+    path.contourCount = static_cast<uint32_t>(contourCount);
+    path.rule = rule;
+    this->contours.insert(this->contours.end(), contours, contours + contourCount);
+
+    Command command = {};
+    command.type = Type::Path;
+    command.state = state;
+    command.first = static_cast<uint32_t>(screenVertices.size());
+    command.count = static_cast<uint32_t>(paths.size());
+    screenVertices.insert(screenVertices.end(), vertices, vertices + count);
+    paths.push_back(path);
+    commands.push_back(command);
+}
+
+void CommandBuffer::AddClear(bool color, bool depth, const Pixel& clearColor) {
+    Command command = {};
+    command.type = Type::Clear;
+    command.clearColor = color;
+    command.clearDepth = depth;
+    command.state.color = clearColor;
+    commands.push_back(command);
+}
+
+void CommandBuffer::Execute(SGLContext& context) const {
+    for (const Command& command : commands) {
+        if (command.type == Type::Clear) {
+            clearBuffers(context, command.clearColor, command.clearDepth, command.state.color);
+            continue;
+        }
+
+        SGL_STAT_PHASE(context, rasterTime);
+        const ScreenVertex* vertices = screenVertices.data() + command.first;
+        switch (command.type) {
+            case Type::Primitive:
+                submitPrimitive(context, command.state, command.kind, vertices, command.count);
+                break;
+            case Type::Triangles:
+                submitTriangles(context, command.state, windowVertices.data() + command.first, command.count);
+                break;
+            case Type::Circle:
+            case Type::CircleOutline: {
+                WindowCircle circle;
+                circle.center = vertices[0];
+                circle.radius = static_cast<int>(command.count);
+                submitCircle(context, command.state, circle, command.type == Type::Circle);
+                break;
+            }
+            case Type::Path: {
+                const Path& path = paths[command.count];
+                submitPath(context, command.state, vertices, contours.data() + path.firstContour,
+                           path.contourCount, path.rule);
+                break;
+            }
+            case Type::Clear:
+                break;
+        }
+    }
+}
+
+void executeCommandBuffers(SGLContext& context) {
+    vector<unique_ptr<CommandBuffer>> buffers;
+    {
+        std::lock_guard<std::mutex> lock(context.commandBuffersMutex);
+        buffers.swap(context.commandBuffers);
+    }
+    if (buffers.empty()) {
+        return;
+    }
+    SGL_TRACE_SCOPE("executeCommandBuffers", "buffers", static_cast<int64_t>(buffers.size()));
+
+    std::stable_sort(buffers.begin(), buffers.end(),
+        [](const unique_ptr<CommandBuffer>& a, const unique_ptr<CommandBuffer>& b) {
+            return a->Order() < b->Order();
+        });
+    for (const auto& buffer : buffers) {
+        buffer->Execute(context);
+    }
+}
+
+//---------------------------------------------------------------------------
+// Command buffer functions
+//---------------------------------------------------------------------------
+
+void sglBeginCommandBuffer(unsigned order) {
+    SGL_CAPTURE(CAPTURE_BEGIN_COMMAND_BUFFER, order);
+    if (contextNotInitialized() || calledWithinBeginEnd() || calledWhileRecording()) {
+        return;
+    }
+
+    SGLContext& target = sceneManager->getCurrentContext();
+    threadState.commandBuffer = make_unique<CommandBuffer>(target, order);
+    // the calls of the thread work on the state of the buffer from now on
+    threadState.currentContext = &threadState.commandBuffer->State();
+}
+
+void sglEndCommandBuffer(void) {
+    SGL_CAPTURE(CAPTURE_END_COMMAND_BUFFER);
+    if (contextNotInitialized() || calledWithinBeginEnd()) {
+        return;
+    }
+    if (!sceneManager->getCurrentContext().recording) {
+        setErrCode(SGL_INVALID_OPERATION);
+        return;
+    }
+
+    unique_ptr<CommandBuffer> buffer = std::move(threadState.commandBuffer);
+    SGLContext& target = buffer->Target();
+    threadState.currentContext = &target;
+    std::lock_guard<std::mutex> lock(target.commandBuffersMutex);
+    target.commandBuffers.push_back(std::move(buffer));
+}
+
+void sglFlush(void) {
+    SGL_CAPTURE(CAPTURE_FLUSH);
+    if (contextNotInitialized() || calledWithinBeginEnd() || calledWhileRecording()) {
+        return;
+    }
+    executeCommandBuffers(sceneManager->getCurrentContext());
+}
@@ -0,0 +1,100 @@
+#pragma once
+
+#include "context.h"
+#include "draw_utils.h"
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+using std::unique_ptr;
+using std::vector;
+
+/**
+ * @file command_buffer.h
+ * @brief Drawing calls recorded by a thread and executed later, see sglBeginCommandBuffer()
+ */
+
+/**
+ * @brief Drawing commands of one recording thread, with their state resolved.
+ *
+ * The recording thread works on a context of its own (State()), which has
+ * the state of a newly created context of the size of the target and no
+ * pixels. The state calls change it as usual, the drawing calls transform
+ * their primitives and record them together with the state they are drawn
+ * with, so that executing the buffer needs none of the recorded state calls
+ * and does not change the state of the target.
+ */
+class CommandBuffer {
+public:
+    /**
+     * @param target The context the buffer is recorded for.
+     * @param order The key the submitted buffers are executed by.
+     */
+    CommandBuffer(SGLContext& target, unsigned order);
+    ~CommandBuffer();
+
+    SGLContext& State() { return *state; }
+    SGLContext& Target() const { return target; }
+    unsigned Order() const { return order; }
+
+    void AddPrimitive(const RasterState& state, PrimitiveKind kind, const ScreenVertex* vertices, size_t count);
+    void AddTriangles(const RasterState& state, const Vertex* vertices, size_t count);
+    void AddCircle(const RasterState& state, const WindowCircle& circle, bool filled);
+    void AddPath(const RasterState& state, const ScreenVertex* vertices, const uint32_t* contours,
+                 size_t contourCount, sglEFillRule rule);
+    void AddClear(bool color, bool depth, const Pixel& clearColor);
+
+    /// Draws the recorded commands into the context in the recorded order.
+    void Execute(SGLContext& context) const;
+
+private:
+    enum class Type : uint8_t {
+        Primitive,
+        Triangles,
+        Circle,
+        CircleOutline,
+        Path,
+        Clear,
+    };
+
+    struct Command {
+        Type type;
+        PrimitiveKind kind;
+        // buffers of a clear
+        bool clearColor;
+        bool clearDepth;
+        // the state a primitive is drawn with, the clear color of a clear
+        RasterState state;
+        // first vertex in the arena of the type
+        uint32_t first;
+        // number of vertices, the radius for circles, the index in paths
+        // for paths
+        uint32_t count;
+    };
+
+    // the contours of a path, the numbers of their vertices are in contours
+    struct Path {
+        uint32_t firstContour;
+        uint32_t contourCount;
+        sglEFillRule rule;
+    };
+
+    SGLContext& target;
+    unsigned order;
+    // the context the recording thread works on
+    unique_ptr<SGLContext> state;
+
+    vector<Command> commands;
+    vector<ScreenVertex> screenVertices;
+    vector<Vertex> windowVertices;
+    vector<Path> paths;
+    vector<uint32_t> contours;
+};
+
+/**
+ * @brief Executes the command buffers submitted to the context and drops them.
+ *
+ * The buffers are executed in the increasing order of their keys, buffers
+ * with the same key in the order they were submitted.
+ */
+void executeCommandBuffers(SGLContext& context);
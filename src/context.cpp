@@ -1,5 +1,11 @@
 #include "context.h"
 #include "structures.h"
+#include "raster_bins.h"
+#include "command_buffer.h"
+#include "display_list.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
 #include <iostream>
 #include <memory>
 #include <vector>
@@ -9,9 +15,14 @@ using std::initializer_list;
 using std::vector;
 
 
-SGLContext::SGLContext(int width, int height) : 
+SGLContext::SGLContext(int width, int height) :
+  SGLContext(width, height, make_unique<FrameBuffer>(width, height)) {
+}
+
+SGLContext::SGLContext(int width, int height, unique_ptr<FrameBuffer> colorBuffer) : 
   width(width), 
   height(height), 
+  colorBuffer(move(colorBuffer)),
   currentPrimitiveMode(SGL_POINTS),
   currentAreaMode(SGL_FILL),
   currentMatrixMode(SGL_MODELVIEW),
@@ -19,27 +30,123 @@ SGLContext::SGLContext(int width, int height) :
   scaleFactor(1),
   insideBegin(false),
   enabledDepthTest(true),
-  insideBeginScene(false) {
-    colorBuffer = make_unique<vector<Pixel>>(width * height); 
-    depthBuffer = make_unique<vector<float>>(width * height, 1.0f);
-    transformationStack = make_unique<vector<vector<Matrix>>>(2);
-    transformationStack->at(0).push_back(Matrix());
-    transformationStack->at(1).push_back(Matrix());
+  transformDirty(true),
+  rayCameraDirty(true),
+  rayCameraValid(false),
+  insideBeginScene(false),
+  renderMode(SGL_RENDER_NORMAL),
+  toneMapOperator(SGL_TONEMAP_CLAMP),
+  exposure(1),
+  recording(nullptr),
+  compilingListId(0),
+  vertexArray{ nullptr, 4, 4 * sizeof(float) },
+  insidePath(false),
+  pathRule(SGL_NONZERO),
+  boundThreads(0) {
+    // the depth buffer starts at the far plane (1/z of 1), written as it is
+    // first used
+    if (this->colorBuffer) {
+        depthBuffer = make_unique<DepthBuffer>(width, height, 1.0f);
+    }
     screenVertices = make_unique<vector<ScreenVertex>>();
     verticesList = make_unique<vector<Vertex>>();
+    renderStats.Reset(sceneManager->threadPool->size());
 }
 
-SGLSceneManager::SGLSceneManager() :
-  currentContextId(-1), 
+SGLContext::SGLContext(int width, int height, CommandBuffer* recording) :
+  SGLContext(width, height, unique_ptr<FrameBuffer>()) {
+    this->recording = recording;
+}
+
+SGLContext::~SGLContext() = default;
+
+void flushBinnedRaster(SGLContext& context) {
+    if (context.rasterBins && !context.rasterBins->Empty()) {
+        SGL_STAT_PHASE(context, rasterTime);
+        context.rasterBins->Flush(context, *sceneManager->threadPool);
+    }
+}
+
+thread_local SGLThreadState threadState;
+
+SGLThreadState::SGLThreadState() :
+  currentContextId(-1),
+  currentContext(nullptr),
+  owner(nullptr),
   errorCode(SGL_NO_ERROR) {
 }
 
+SGLThreadState::~SGLThreadState() {
+    // an unfinished recording is dropped, the target stays selected
+    if (commandBuffer) {
+        currentContext = &commandBuffer->Target();
+        commandBuffer.reset();
+    }
+    if (sceneManager && sceneManager->hasCurrentContext()) {
+        sceneManager->selectContext(-1);
+    }
+}
+
+// Number of threads rendering a frame, the calling thread included. The
+// default is one worker per hardware thread, SGL_NUM_THREADS overrides it.
+static unsigned renderingThreadCount() {
+    const char* value = getenv("SGL_NUM_THREADS");
+    const int count = value ? atoi(value) : 0;
+    if (count > 0) {
+        return static_cast<unsigned>(count);
+    }
+    return std::max(1u, std::thread::hardware_concurrency()) + 1;
+}
+
+SGLSceneManager::SGLSceneManager() :
+  threadPool(make_unique<ThreadPool>(renderingThreadCount() - 1)) {
+}
+
+SGLSceneManager::~SGLSceneManager() {
+    if (threadState.owner == this) {
+        threadState.commandBuffer.reset();
+        threadState.currentContextId = -1;
+        threadState.currentContext = nullptr;
+        threadState.owner = nullptr;
+    }
+}
+
+bool SGLSceneManager::isValidContextId(int id) const {
+    return id >= 0 && id < (int)contexts.size() && contexts[id];
+}
+
+bool SGLSceneManager::selectContext(int id) {
+    std::lock_guard<std::mutex> lock(contextsMutex);
+    if (id != -1 && !isValidContextId(id)) {
+        return false;
+    }
+    SGLContext* context = id == -1 ? nullptr : contexts[id].get();
+    if (hasCurrentContext()) {
+        threadState.currentContext->boundThreads--;
+    }
+    if (context) {
+        context->boundThreads++;
+    }
+    threadState.currentContextId = id;
+    threadState.currentContext = context;
+    threadState.owner = this;
+    return true;
+}
+
 //---------------------------------------------------------------------------
 // Check utils
 //---------------------------------------------------------------------------
 
 bool contextNotInitialized() {
-    if (!sceneManager || !sceneManager->contexts[sceneManager->currentContextId]) {
+    if (!sceneManager || !sceneManager->hasCurrentContext()) {
+        setErrCode(SGL_INVALID_OPERATION);
+        return true;
+    }
+    return false;
+}
+
+bool calledWhileRecording() {
+    if (sceneManager->getCurrentContext().recording) {
         setErrCode(SGL_INVALID_OPERATION);
         return true;
     }
@@ -80,16 +187,43 @@ bool calledOutsideBeginSceneEndScene()
     return false;
 }
 
-void recalculateVPMMatrix() {
-    auto& context = sceneManager->getCurrentContext();
+void updateTransform(SGLContext& context) {
+    if (!context.transformDirty) {
+        return;
+    }
+
     Matrix PM = 
-        context.transformationStack->at(SGL_PROJECTION).back() *
-        context.transformationStack->at(SGL_MODELVIEW).back();
+        context.transformationStack[SGL_PROJECTION].Top() *
+        context.transformationStack[SGL_MODELVIEW].Top();
 
-    float w = PM.data.back();
-    if (w != 1) {
+    // scaled by a positive factor only, the vertices in front of the eye
+    // keep a positive w for clipping
+    float w = std::fabs(PM.data.back());
+    if (w != 0 && w != 1) {
         PM = PM / w;
     }
     context.VPMmatrix = context.viewportMatrix * PM;
+
+    const Matrix& VPM = context.VPMmatrix;
+    context.scaleFactor = 
+        sqrt(VPM.data[0] * VPM.data[5] - VPM.data[1] * VPM.data[4]);
+    context.transformDirty = false;
+}
+
+bool updateRayCamera(SGLContext& context) {
+    if (!context.rayCameraDirty) {
+        return context.rayCameraValid;
+    }
+
+    // the rays start in NDC, without the viewport
+    Matrix invPVM =
+        context.transformationStack[SGL_PROJECTION].Top() *
+        context.transformationStack[SGL_MODELVIEW].Top();
+    context.rayCameraValid = invPVM.Invert() == 0;
+    if (context.rayCameraValid) {
+        context.rayCamera = RayCamera(invPVM, context.width, context.height);
+    }
+    context.rayCameraDirty = false;
+    return context.rayCameraValid;
 }
 
@@ -4,10 +4,22 @@
 #include "structures.h"
 #include "scene.h"
 #include "ray_tracing_utils.h"
+#include "thread_pool.h"
+#include "render_stats.h"
+#include "trace.h"
+#include "capture.h"
+#include "frame_buffer.h"
+#include "page_buffer.h"
+#include "vertex_array.h"
+#include <algorithm>
+#include <array>
+#include <cstdint>
 #include <vector>
 #include <memory>
 #include <type_traits>
 #include <thread>
+#include <mutex>
+#include <map>
 
 #define M_PI       3.14159265358979323846   // pi
 
@@ -16,12 +28,16 @@ using std::is_enum;
 using std::vector;
 using std::move;
 
+class RasterBins;
+class CommandBuffer;
+class DisplayList;
+
 struct SGLContext {
     int width;
     int height;
 
-	unique_ptr<vector<Pixel>> colorBuffer;
-	unique_ptr<vector<float>> depthBuffer;
+	unique_ptr<FrameBuffer> colorBuffer;
+	unique_ptr<DepthBuffer> depthBuffer;
 
     sglEElementType currentPrimitiveMode;
     sglEAreaMode currentAreaMode;
@@ -35,30 +51,133 @@ struct SGLContext {
 	bool insideBegin;
 	bool enabledDepthTest;
 
-    unique_ptr<vector<vector<Matrix>>> transformationStack;
+    // indexed by sglEMatrixMode
+    std::array<MatrixStack, 2> transformationStack;
 	unique_ptr<vector<Vertex>> verticesList;
     unique_ptr<vector<ScreenVertex>> screenVertices;
     
     Matrix viewportMatrix;
     Matrix VPMmatrix;
 
+	// the VPM matrix with the scale factor and the ray tracing camera are
+	// derived from the matrix stacks and the viewport, the flags are set
+	// when these change and the values recomputed on their next use
+	bool transformDirty;
+	bool rayCameraDirty;
+	// false if the projection times modelview matrix has no inverse
+	bool rayCameraValid;
+	RayCamera rayCamera;
+
 	Scene scene;
 	bool insideBeginScene;
+	sglERenderMode renderMode;
+
+	// applied by sglReadPixels()
+	sglEToneMapOperator toneMapOperator;
+	float exposure;
+
+	RenderStats renderStats;
+
+	// primitives waiting for the binned rasterizer, nullptr unless
+	// SGL_BINNED_RASTER is enabled
+	unique_ptr<RasterBins> rasterBins;
+
+	// the buffer the drawing calls are recorded into, set for the context
+	// a recording thread works on, nullptr for the contexts which draw
+	CommandBuffer* recording;
+
+	// command buffers submitted by sglEndCommandBuffer() and executed by
+	// sglFlush(), the mutex guards only the list
+	std::mutex commandBuffersMutex;
+	vector<unique_ptr<CommandBuffer>> commandBuffers;
+
+	// display lists of sglEndList() by their names
+	std::map<unsigned, unique_ptr<DisplayList>> displayLists;
+	// the list between sglNewList() and sglEndList(), the drawing calls are
+	// compiled into it instead of being drawn
+	unique_ptr<DisplayList> compilingList;
+	unsigned compilingListId;
+
+	// set by sglVertexPointer(), drawn by sglDrawArrays() and sglDrawElements()
+	VertexArray vertexArray;
+
+	// the path between sglBeginPath() and sglEndPath(), the filled polygons
+	// are added to it in screen coordinates instead of being drawn
+	bool insidePath;
+	sglEFillRule pathRule;
+	vector<ScreenVertex> pathVertices;
+	// number of the vertices of every contour, in order
+	vector<uint32_t> pathContours;
+
+	// number of threads which have the context selected, guarded by
+	// SGLSceneManager::contextsMutex
+	int boundThreads;
 
 	SGLContext(int width, int height);
+	// renders into the given color buffer, e.g. memory of the application
+	SGLContext(int width, int height, unique_ptr<FrameBuffer> colorBuffer);
+	// the state of a thread recording into the command buffer, without pixels
+	SGLContext(int width, int height, CommandBuffer* recording);
+	~SGLContext();
 };
 
-struct SGLSceneManager {
+struct SGLSceneManager;
+
+/// Per-thread library state.
+/**
+  Every thread selects its own current context and has its own error flag,
+  so independent contexts can be driven from different threads at the same
+  time. A context must not be used by two threads simultaneously.
+*/
+struct SGLThreadState {
 	int currentContextId;
-	vector<unique_ptr<SGLContext>> contexts;
+	SGLContext* currentContext;
+	// the scene manager the selection belongs to, sglInit() invalidates older selections
+	const SGLSceneManager* owner;
 
 	sglEErrorCode errorCode;
 
+	// the buffer the thread records into, currentContext is its state while recording
+	unique_ptr<CommandBuffer> commandBuffer;
+
+	SGLThreadState();
+	// releases the selected context when the thread exits
+	~SGLThreadState();
+};
+
+extern thread_local SGLThreadState threadState;
+
+struct SGLSceneManager {
+	// shared by all contexts, outlives them
+	unique_ptr<ThreadPool> threadPool;
+
+	// guards creation, destruction and selection of contexts, never held while drawing
+	std::mutex contextsMutex;
+	// destroyed contexts leave an empty slot, so that ids of the others stay valid
+	vector<unique_ptr<SGLContext>> contexts;
+
 	SGLSceneManager();
+	// clears the selection of the calling thread, a later manager could reuse the address
+	~SGLSceneManager();
+
+	/// Returns the context selected by the calling thread.
+	SGLContext& getCurrentContext() {
+		return *threadState.currentContext;
+	}
 
-	auto& getCurrentContext() {
-		return *(contexts[currentContextId]);
+	/// Returns true if the calling thread has a context of this manager selected.
+	bool hasCurrentContext() const {
+		return threadState.owner == this && threadState.currentContext != nullptr;
 	}
+
+	/// Selects the context for the calling thread, -1 deselects.
+	/**
+	  Returns false if there is no context with the given id.
+	*/
+	bool selectContext(int id);
+
+	/// Checks whether a context with the given id exists, expects contextsMutex locked.
+	bool isValidContextId(int id) const;
 };
 
 extern unique_ptr<SGLSceneManager> sceneManager;
@@ -104,6 +223,13 @@ bool calledWithinBeginSceneEndScene();
 */
 bool calledOutsideBeginSceneEndScene();
 
+/// Checks if the calling thread records a command buffer.
+/**
+  Returns true and sets SGL_INVALID_OPERATION error if it does, the call
+  cannot be recorded. Otherwise returns false.
+*/
+bool calledWhileRecording();
+
 /// Checks if enum has an accepted value.
 /**
   Returns true if enum does not have an acepted value.
@@ -122,5 +248,24 @@ bool isInvalidEnumValue(EnumType value) {
 	return false;
 }
 
-void recalculateVPMMatrix();
+/// Marks the state derived from the matrices and the viewport as outdated.
+inline void invalidateTransform(SGLContext& context) {
+	context.transformDirty = true;
+	context.rayCameraDirty = true;
+}
+
+/// Computes the VPM matrix and the scale factor if they are outdated.
+void updateTransform(SGLContext& context);
+
+/// Computes the ray tracing camera if it is outdated.
+/**
+  @returns false if the projection times modelview matrix cannot be inverted
+*/
+bool updateRayCamera(SGLContext& context);
+
+/// Draws the primitives recorded for the binned rasterizer, if any.
+/**
+  Called before the buffers of the context are read or written otherwise.
+*/
+void flushBinnedRaster(SGLContext& context);
 
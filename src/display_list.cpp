@@ -0,0 +1,317 @@
+#include "display_list.h"
+#include "raster_bins.h"
+
+using std::make_unique;
+
+void DisplayList::AddBatch(sglEElementType mode, const Vertex* batchVertices, size_t count) {
+    Batch batch = {};
+    batch.type = Type::Vertices;
+    batch.mode = mode;
+    batch.first = static_cast<uint32_t>(vertices.size());
+    batch.count = static_cast<uint32_t>(count);
+    vertices.insert(vertices.end(), batchVertices, batchVertices + count);
+    batches.push_back(batch);
+    cacheValid = false;
+}
+
+void DisplayList::AddCircle(const Vertex& center, float radius) {
+    Batch batch = {};
+    batch.type = Type::Circle;
+    batch.first = static_cast<uint32_t>(vertices.size());
+    batch.count = 1;
+    batch.radius = radius;
+    vertices.push_back(center);
+    batches.push_back(batch);
+    cacheValid = false;
+}
+
+void DisplayList::addOutline(Type type, const Vertex& center, const Vertex* outline, size_t count) {
+    Batch batch = {};
+    batch.type = type;
+    batch.mode = type == Type::Ellipse ? SGL_POLYGON : SGL_LINE_STRIP;
+    vertices.push_back(center);
+    batch.first = static_cast<uint32_t>(vertices.size());
+    batch.count = static_cast<uint32_t>(count);
+    vertices.insert(vertices.end(), outline, outline + count);
+    batches.push_back(batch);
+    cacheValid = false;
+}
+
+void DisplayList::AddEllipse(const Vertex& center, const Vertex* outline, size_t count) {
+    addOutline(Type::Ellipse, center, outline, count);
+}
+
+void DisplayList::AddArc(const Vertex& center, const Vertex* points, size_t count) {
+    addOutline(Type::Arc, center, points, count);
+}
+
+void DisplayList::AddColor(const Pixel& color) {
+    Batch batch = {};
+    batch.type = Type::Color;
+    batch.first = static_cast<uint32_t>(colors.size());
+    colors.push_back(color);
+    batches.push_back(batch);
+}
+
+void DisplayList::Append(const DisplayList& list) {
+    const uint32_t vertexOffset = static_cast<uint32_t>(vertices.size());
+    const uint32_t colorOffset = static_cast<uint32_t>(colors.size());
+    for (Batch batch : list.batches) {
+        batch.first += batch.type == Type::Color ? colorOffset : vertexOffset;
+        batches.push_back(batch);
+    }
+    vertices.insert(vertices.end(), list.vertices.begin(), list.vertices.end());
+    colors.insert(colors.end(), list.colors.begin(), list.colors.end());
+    cacheValid = false;
+}
+
+void DisplayList::resolveBatch(const Batch& batch, sglEAreaMode areaMode,
+                               sglEElementType& mode, uint32_t& first, uint32_t& count) const {
+    mode = batch.mode;
+    first = batch.first;
+    count = batch.count;
+    if (batch.type == Type::Vertices) {
+        return;
+    }
+    if (areaMode == SGL_POINT) {
+        // only the center
+        mode = SGL_POINTS;
+        first--;
+        count = 1;
+    }
+    else if (batch.type == Type::Arc && areaMode == SGL_FILL) {
+        // a circular sector from the center
+        mode = SGL_POLYGON;
+        first--;
+        count++;
+    }
+}
+
+VertexArray DisplayList::vertexArray() const {
+    VertexArray array;
+    array.pointer = reinterpret_cast<const float*>(vertices.data());
+    array.size = 4;
+    array.stride = sizeof(Vertex);
+    return array;
+}
+
+void DisplayList::updateCache(const SGLContext& context) {
+    SGL_TRACE_SCOPE("DisplayList::updateCache", "vertices", static_cast<int64_t>(vertices.size()));
+    cacheValid = true;
+    cachedVPM = context.VPMmatrix;
+    cachedPointSize = context.pointSize;
+
+    // the same as sglEnd() does
+    const VertexArray array = vertexArray();
+    windowVertices.resize(vertices.size());
+    screenVertices.resize(vertices.size());
+    transformVertexArray(context, array, nullptr, 0, vertices.size(), windowVertices.data());
+    transformVertexArray(context, array, nullptr, 0, vertices.size(), screenVertices.data());
+
+    circles.assign(batches.size(), WindowCircle());
+    clipResults.assign(batches.size(), ClipResult::Inside);
+    edgeTables.resize(batches.size());
+    edgeTablesValid.assign(batches.size(), false);
+    monotonePolygons.assign(batches.size(), false);
+    for (size_t i = 0; i < batches.size(); i++) {
+        const Batch& batch = batches[i];
+        if (batch.type == Type::Circle) {
+            const Vertex& center = vertices[batch.first];
+            circles[i] = transformCircle(context, center.x, center.y, center.z, batch.radius);
+        }
+        else if (batch.type != Type::Color) {
+            // with the center of an ellipse or an arc, which the area mode may draw
+            const uint32_t begin = batch.type == Type::Vertices ? batch.first : batch.first - 1;
+            clipResults[i] = classifyVertexArray(context, array, nullptr, begin, batch.first + batch.count - begin);
+        }
+    }
+}
+
+void DisplayList::drawClipped(SGLContext& context, const RasterState& state, sglEElementType mode,
+                              uint32_t first, uint32_t count) const {
+    const VertexArray array = vertexArray();
+    if (mode == SGL_TRIANGLES && context.currentAreaMode == SGL_FILL) {
+        vector<Vertex> clipped;
+        clipTriangles(context, array, nullptr, first, count, clipped);
+        submitTriangles(context, state, clipped.data(), clipped.size());
+        return;
+    }
+    PrimitiveKind kind;
+    if (!resolvePrimitiveKind(mode, context.currentAreaMode, kind)) {
+        return;
+    }
+    auto& clipped = *context.screenVertices;
+    kind = clipPrimitive(context, kind, array, nullptr, first, count, clipped);
+    if (kind == PrimitiveKind::Polygon && isMonotonePolygon(clipped.data(), clipped.size())) {
+        kind = PrimitiveKind::MonotonePolygon;
+    }
+    submitPrimitive(context, state, kind, clipped.data(), clipped.size());
+}
+
+void DisplayList::Call(SGLContext& context) {
+    if (!cacheValid || cachedVPM.data != context.VPMmatrix.data || cachedPointSize != context.pointSize) {
+        updateCache(context);
+    }
+
+    RasterState state = rasterState(context);
+    for (size_t i = 0; i < batches.size(); i++) {
+        const Batch& batch = batches[i];
+        switch (batch.type) {
+            case Type::Color:
+                context.currentColor = colors[batch.first];
+                state.color = context.currentColor;
+                break;
+            case Type::Circle:
+                // drawn as sglCircle() draws it in the area mode
+                if (context.currentAreaMode == SGL_POINT) {
+                    submitPrimitive(context, state, PrimitiveKind::Points, screenVertices.data() + batch.first, 1);
+                }
+                else {
+                    submitCircle(context, state, circles[i], context.currentAreaMode != SGL_LINE);
+                }
+                break;
+            case Type::Vertices:
+            case Type::Ellipse:
+            case Type::Arc: {
+                sglEElementType mode;
+                uint32_t first;
+                uint32_t count;
+                resolveBatch(batch, context.currentAreaMode, mode, first, count);
+                if (clipResults[i] == ClipResult::Outside) {
+                    break;
+                }
+                if (clipResults[i] == ClipResult::Clipped) {
+                    drawClipped(context, state, mode, first, count);
+                    break;
+                }
+                if (mode == SGL_TRIANGLES && context.currentAreaMode == SGL_FILL) {
+                    submitTriangles(context, state, windowVertices.data() + first, count);
+                    break;
+                }
+                PrimitiveKind kind;
+                if (!resolvePrimitiveKind(mode, context.currentAreaMode, kind)) {
+                    break;
+                }
+                const ScreenVertex* batchVertices = screenVertices.data() + first;
+                // the binned rasterizer splits the polygons by tiles itself,
+                // a batch is filled from one range of its vertices only
+                if (kind == PrimitiveKind::Polygon && count > 0 && !context.rasterBins) {
+                    if (!edgeTablesValid[i]) {
+                        // the monotone polygons need no table
+                        monotonePolygons[i] = isMonotonePolygon(batchVertices, count);
+                        if (!monotonePolygons[i]) {
+                            buildPolygonEdges(context, batchVertices, count, edgeTables[i]);
+                        }
+                        edgeTablesValid[i] = true;
+                    }
+                    SGL_STAT_ADD(context, polygonsRasterized, 1);
+                    if (monotonePolygons[i]) {
+                        fillMonotonePolygon(context, state, batchVertices, count);
+                    }
+                    else {
+                        fillPolygonEdges(context, state, edgeTables[i]);
+                    }
+                }
+                else {
+                    if (kind == PrimitiveKind::Polygon && isMonotonePolygon(batchVertices, count)) {
+                        kind = PrimitiveKind::MonotonePolygon;
+                    }
+                    submitPrimitive(context, state, kind, batchVertices, count);
+                }
+                break;
+            }
+        }
+    }
+}
+
+void DisplayList::Replay() const {
+    const sglEAreaMode areaMode = sceneManager->getCurrentContext().currentAreaMode;
+    for (const Batch& batch : batches) {
+        switch (batch.type) {
+            case Type::Color: {
+                const Pixel& color = colors[batch.first];
+                sglColor3f(color.r, color.g, color.b);
+                break;
+            }
+            case Type::Circle: {
+                const Vertex& center = vertices[batch.first];
+                sglCircle(center.x, center.y, center.z, batch.radius);
+                break;
+            }
+            case Type::Vertices:
+            case Type::Ellipse:
+            case Type::Arc: {
+                sglEElementType mode;
+                uint32_t first;
+                uint32_t count;
+                resolveBatch(batch, areaMode, mode, first, count);
+                sglBegin(mode);
+                for (uint32_t k = first; k < first + count; k++) {
+                    sglVertex3f(vertices[k].x, vertices[k].y, vertices[k].z);
+                }
+                sglEnd();
+                break;
+            }
+        }
+    }
+}
+//---------------------------------------------------------------------------
+// Display list functions
+//---------------------------------------------------------------------------
+
+void sglNewList(unsigned list) {
+    SGL_CAPTURE(CAPTURE_NEW_LIST, list);
+    if (contextNotInitialized() || calledWithinBeginEnd() || calledWhileRecording()) {
+        return;
+    }
+    SGLContext& context = sceneManager->getCurrentContext();
+    if (context.compilingList) {
+        setErrCode(SGL_INVALID_OPERATION);
+        return;
+    }
+    context.compilingList = make_unique<DisplayList>();
+    context.compilingListId = list;
+}
+
+void sglEndList(void) {
+    SGL_CAPTURE(CAPTURE_END_LIST);
+    if (contextNotInitialized() || calledWithinBeginEnd() || calledWhileRecording()) {
+        return;
+    }
+    SGLContext& context = sceneManager->getCurrentContext();
+    if (!context.compilingList) {
+        setErrCode(SGL_INVALID_OPERATION);
+        return;
+    }
+    // replaces the list of the same name, if any
+    context.displayLists[context.compilingListId] = std::move(context.compilingList);
+}
+
+void sglCallList(unsigned list) {
+    SGL_CAPTURE(CAPTURE_CALL_LIST, list);
+    if (contextNotInitialized() || calledWithinBeginEnd() || calledWhileRecording()) {
+        return;
+    }
+    SGLContext& context = sceneManager->getCurrentContext();
+    auto found = context.displayLists.find(list);
+    if (found == context.displayLists.end()) {
+        setErrCode(SGL_INVALID_VALUE);
+        return;
+    }
+    DisplayList& displayList = *found->second;
+
+    if (context.compilingList) {
+        context.compilingList->Append(displayList);
+        return;
+    }
+    if (context.insideBeginScene) {
+        // the scene takes the vertices untransformed
+        displayList.Replay();
+        return;
+    }
+
+    SGL_STAT_PHASE(context, rasterTime);
+    SGL_TRACE_SCOPE("sglCallList", "list", static_cast<int64_t>(list));
+    updateTransform(context);
+    displayList.Call(context);
+}
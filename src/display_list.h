@@ -0,0 +1,119 @@
+#pragma once
+
+#include "context.h"
+#include "draw_utils.h"
+#include "clip.h"
+#include <cstdint>
+#include <vector>
+
+using std::vector;
+
+/**
+ * @file display_list.h
+ * @brief Geometry compiled by sglNewList() / sglEndList() and drawn by sglCallList()
+ */
+
+/**
+ * @brief The sglBegin() / sglEnd() blocks, circles and colors of a display list.
+ *
+ * The vertices of all blocks are kept in one array, the blocks refer to
+ * their ranges. Drawing the list transforms the vertices once and keeps
+ * them in window coordinates, together with the edge tables of the filled
+ * polygons, so that calling the list again with the same VPM matrix goes
+ * straight to the rasterizer. Only the batches crossing a clip plane are
+ * clipped on every call, those outside of one are skipped.
+ */
+class DisplayList {
+public:
+    /// Adds the vertices of a sglBegin() / sglEnd() block.
+    void AddBatch(sglEElementType mode, const Vertex* vertices, size_t count);
+    /// Adds a sglCircle() call.
+    void AddCircle(const Vertex& center, float radius);
+    /// Adds a sglEllipse() call, with the vertices of its outline.
+    void AddEllipse(const Vertex& center, const Vertex* outline, size_t count);
+    /// Adds a sglArc() call, with its vertices along the circle.
+    void AddArc(const Vertex& center, const Vertex* points, size_t count);
+    /// Adds a sglColor3f() call.
+    void AddColor(const Pixel& color);
+    /// Adds the contents of another list, for sglCallList() while compiling.
+    void Append(const DisplayList& list);
+
+    /**
+     * @brief Draws the list with the current state of the context.
+     *
+     * The window coordinates are taken from the cache unless the VPM matrix
+     * or the point size changed since the last call. The colors of the list become the
+     * current color of the context, as if sglColor3f() was called.
+     */
+    void Call(SGLContext& context);
+
+    /// Repeats the calls of the list, for a context which builds a ray tracing scene.
+    void Replay() const;
+
+private:
+    enum class Type : uint8_t {
+        Vertices,
+        Circle,
+        // the center followed by the outline, drawn by the area mode
+        Ellipse,
+        Arc,
+        Color,
+    };
+
+    struct Batch {
+        Type type;
+        sglEElementType mode;
+        // the range of the vertices (without the center of an ellipse or an
+        // arc), the center of a circle, the index of a color
+        uint32_t first;
+        uint32_t count;
+        float radius;
+    };
+
+    /**
+     * @brief The vertices a batch of vertices, an ellipse or an arc is drawn
+     *        from in the area mode, as the call it was compiled from would
+     *        choose them.
+     */
+    void resolveBatch(const Batch& batch, sglEAreaMode areaMode,
+                      sglEElementType& mode, uint32_t& first, uint32_t& count) const;
+
+    /// Adds a batch of the center and the vertices.
+    void addOutline(Type type, const Vertex& center, const Vertex* outline, size_t count);
+
+    /// The vertices of the list as a vertex array.
+    VertexArray vertexArray() const;
+
+    /// Transforms the vertices and the circles, drops the edge tables.
+    void updateCache(const SGLContext& context);
+
+    /**
+     * @brief Draws the vertices of a batch crossing a clip plane, clipped as
+     *        sglEnd() clips them instead of taken from the cache.
+     */
+    void drawClipped(SGLContext& context, const RasterState& state, sglEElementType mode,
+                     uint32_t first, uint32_t count) const;
+
+    vector<Batch> batches;
+    vector<Vertex> vertices;
+    vector<Pixel> colors;
+
+    // the VPM matrix the cache was built with, and the point size the
+    // batches were culled with
+    bool cacheValid = false;
+    Matrix cachedVPM;
+    float cachedPointSize = 0;
+    // in the order of vertices
+    vector<Vertex> windowVertices;
+    vector<ScreenVertex> screenVertices;
+    // indexed by batch, used by the circles and the polygons drawn filled,
+    // the edge tables are built when first needed
+    vector<WindowCircle> circles;
+    // indexed by batch, of all the vertices the batch may draw
+    vector<ClipResult> clipResults;
+    vector<PolygonEdges> edgeTables;
+    vector<bool> edgeTablesValid;
+    // whether the polygon of the batch is filled by fillMonotonePolygon()
+    // instead of its edge table, set with the table
+    vector<bool> monotonePolygons;
+};
@@ -1,6 +1,11 @@
 #include "context.h"
 #include "draw_utils.h"
-#include "draw_utils.h"
+#include "triangle_raster.h"
+#include "raster_bins.h"
+#include "command_buffer.h"
+#include "display_list.h"
+#include "vertex_array.h"
+#include "clip.h"
 #include "cmath"
 #include <memory>
 #include <iostream>
@@ -18,6 +23,7 @@ using std::endl;
 
 
 void sglClear(unsigned what) {  
+    SGL_CAPTURE(CAPTURE_CLEAR, what);
     if (contextNotInitialized() || calledWithinBeginEnd()) {
         return;
     }
@@ -32,24 +38,15 @@ void sglClear(unsigned what) {
         return;
     }
     
-	if (clearColor) {
-		std::fill(
-            context.colorBuffer->begin(), 
-            context.colorBuffer->end(), 
-            context.clearColor
-        );
-    }
-    if (clearDepth) {
-        std::fill(
-            context.depthBuffer->begin(), 
-            context.depthBuffer->end(), 
-            std::numeric_limits<float>::infinity()
-        );    
-
+    if (context.recording) {
+        context.recording->AddClear(clearColor, clearDepth, context.clearColor);
+        return;
     }
+    clearBuffers(context, clearColor, clearDepth, context.clearColor);
 }
 
 void sglBegin(sglEElementType mode) {
+    SGL_CAPTURE(CAPTURE_BEGIN, mode);
     if (calledWithinBeginEnd() || isInvalidEnumValue(mode)) {
         return;
     }    
@@ -59,83 +56,141 @@ void sglBegin(sglEElementType mode) {
     context.screenVertices->clear();
     context.verticesList->clear();
     if (!context.insideBeginScene) {
-        recalculateVPMMatrix();
-        setScaleFactor();
+        updateTransform(context);
     }
 }
 
-void sglEnd(void) {
-    if (calledOutsideBeginEnd()) {
-        return;
+// Keeps the vertices for the compiled display list or the ray traced scene
+// instead of drawing them, returns false if there is neither
+static bool storeVertexBlock(SGLContext& context, sglEElementType mode, const vector<Vertex>& vertices) {
+    if (context.compilingList) {
+        // drawn by sglCallList()
+        context.compilingList->AddBatch(mode, vertices.data(), vertices.size());
+        return true;
     }
 
-    SGLContext& context = sceneManager->getCurrentContext();
-    auto& vertList = *(context.verticesList);
-    context.insideBegin = false;
-
     if (context.insideBeginScene) {
-        if (vertList.size() >= 3) {
-            auto& scene = sceneManager->getCurrentContext().scene;
-            Vertex v0 = vertList[0];
-            Vertex v1 = vertList[1];
-            Vertex v2 = vertList[2];
+        if (vertices.size() >= 3) {
+            auto& scene = context.scene;
+            Vertex v0 = vertices[0];
+            Vertex v1 = vertices[1];
+            Vertex v2 = vertices[2];
             unique_ptr<Triangle> tri = make_unique<Triangle>(v0, v1, v2);
             tri->materialID = (int)scene.materialsList->size() - 1;
             scene.primitivesList.push_back(move(tri));
         }
+        return true;
+    }
+    return false;
+}
+
+// Draws the vertices of the array as a primitive of the mode, with the VPM
+// matrix of the context already computed
+static void drawVertexArray(SGLContext& context, sglEElementType mode, const VertexArray& array,
+                            const unsigned* indices, size_t first, size_t count) {
+    SGL_STAT_PHASE(context, rasterTime);
+    const RasterState state = rasterState(context);
+    CommandBuffer* recording = context.recording;
+
+    // batches outside of the canvas are dropped as a whole, only those
+    // crossing a clip plane are clipped
+    const ClipResult clip = classifyVertexArray(context, array, indices, first, count);
+    if (clip == ClipResult::Outside) {
         return;
     }
 
-    // transform vertices 
-    context.screenVertices->reserve(vertList.size());
-    for(const Vertex &v : vertList)
-    {
-        Vertex transformed = transformPoint(v);
-        context.screenVertices->emplace_back(
-            static_cast<int>(transformed.x), 
-            static_cast<int>(transformed.y), 
-            transformed.z
-        );
+    // filled triangles keep the subpixel positions
+    if (mode == SGL_TRIANGLES && context.currentAreaMode == SGL_FILL) {
+        vector<Vertex> windowVertices;
+        if (clip == ClipResult::Clipped) {
+            clipTriangles(context, array, indices, first, count, windowVertices);
+        }
+        else {
+            windowVertices.resize(count);
+            transformVertexArray(context, array, indices, first, count, windowVertices.data());
+        }
+        if (recording) {
+            recording->AddTriangles(state, windowVertices.data(), windowVertices.size());
+        }
+        else {
+            submitTriangles(context, state, windowVertices.data(), windowVertices.size());
+        }
+        return;
     }
 
     // process primitive mode
-    switch (context.currentPrimitiveMode) {
-        case SGL_POINTS:     
-            drawPoints();      
-            break;
-        case SGL_LINES:      
-            drawLines();       
-            break;
-        case SGL_LINE_STRIP: 
-            drawLineStrip();   
-            break;
-        case SGL_LINE_LOOP:  
-            drawLineLoop();    
-            break;
-        case SGL_POLYGON:    
-            switch (context.currentAreaMode) {
-                case SGL_POINT: 
-                    drawPoints();   
-                    break;
-                case SGL_LINE:  
-                    drawLineLoop(); 
-                    break;
-                case SGL_FILL:  
-                    fillPolygon();  
-                    break;
-            }
-            break;
-        default: 
-            break;
+    PrimitiveKind kind;
+    if (!resolvePrimitiveKind(mode, context.currentAreaMode, kind)) {
+        return;
+    }
+
+    // transform vertices 
+    auto& screenVertices = *context.screenVertices;
+    if (clip == ClipResult::Clipped) {
+        kind = clipPrimitive(context, kind, array, indices, first, count, screenVertices);
+    }
+    else {
+        screenVertices.resize(count);
+        transformVertexArray(context, array, indices, first, count, screenVertices.data());
+    }
+
+    // the filled polygons of a path are its contours, filled by sglEndPath()
+    if (context.insidePath && kind == PrimitiveKind::Polygon) {
+        if (!screenVertices.empty()) {
+            context.pathVertices.insert(context.pathVertices.end(), screenVertices.begin(), screenVertices.end());
+            context.pathContours.push_back(static_cast<uint32_t>(screenVertices.size()));
+        }
+        return;
+    }
+
+    // the convex polygons of sglEllipse(), sglArc() and most others need
+    // no edge table
+    if (kind == PrimitiveKind::Polygon && isMonotonePolygon(screenVertices.data(), screenVertices.size())) {
+        kind = PrimitiveKind::MonotonePolygon;
+    }
+
+    // drawn now, later by the binned rasterizer or recorded for sglFlush()
+    if (recording) {
+        recording->AddPrimitive(state, kind, screenVertices.data(), screenVertices.size());
+    }
+    else {
+        submitPrimitive(context, state, kind, screenVertices.data(), screenVertices.size());
+    }
+}
+
+void sglEnd(void) {
+    SGL_CAPTURE(CAPTURE_END);
+    if (calledOutsideBeginEnd()) {
+        return;
     }
+
+    SGLContext& context = sceneManager->getCurrentContext();
+    auto& vertList = *(context.verticesList);
+    context.insideBegin = false;
+
+    if (storeVertexBlock(context, context.currentPrimitiveMode, vertList)) {
+        return;
+    }
+
+    VertexArray array;
+    array.pointer = reinterpret_cast<const float*>(vertList.data());
+    array.size = 4;
+    array.stride = sizeof(Vertex);
+    drawVertexArray(context, context.currentPrimitiveMode, array, nullptr, 0, vertList.size());
 }
 
 void sglVertex4f(float x, float y, float z, float w) { 
-	// TODO: Implement
+    SGL_CAPTURE(CAPTURE_VERTEX4F, x, y, z, w);
+    if (!sceneManager->getCurrentContext().insideBegin) {
+        setErrCode(SGL_INVALID_OPERATION);
+        return;
+    }
 
+    sceneManager->getCurrentContext().verticesList->push_back(Vertex(x, y, z, w));
 }
 
 void sglVertex3f(float x, float y, float z) {
+    SGL_CAPTURE(CAPTURE_VERTEX3F, x, y, z);
     if (!sceneManager->getCurrentContext().insideBegin) {
         setErrCode(SGL_INVALID_OPERATION);
         return;
@@ -145,11 +200,13 @@ void sglVertex3f(float x, float y, float z) {
 }
 
 void sglVertex2f(float x, float y) {
+    SGL_CAPTURE(CAPTURE_VERTEX2F, x, y);
     sglVertex3f(x, y, 0);
 }
 
 void sglCircle(float x, float y, float z, float radius)
 {   
+    SGL_CAPTURE(CAPTURE_CIRCLE, x, y, z, radius);
     if (contextNotInitialized()) {
         return;
     }
@@ -157,6 +214,11 @@ void sglCircle(float x, float y, float z, float radius)
         setErrCode(SGL_INVALID_VALUE);
         return;
     }
+    if (sceneManager->getCurrentContext().compilingList) {
+        // drawn by sglCallList() in the area mode of the call
+        sceneManager->getCurrentContext().compilingList->AddCircle(Vertex(x, y, z), radius);
+        return;
+    }
     
     if (sceneManager->getCurrentContext().currentAreaMode == SGL_POINT) {
         sglBegin(SGL_POINTS);
@@ -164,45 +226,237 @@ void sglCircle(float x, float y, float z, float radius)
         sglEnd();
     }
     else{
-        recalculateVPMMatrix();
-        setScaleFactor();
-        drawBresenhamCircle(x, y, z, radius);
+        auto& context = sceneManager->getCurrentContext();
+        SGL_STAT_PHASE(context, rasterTime);
+        updateTransform(context);
+        const WindowCircle circle = transformCircle(context, x, y, z, radius);
+        const bool filled = context.currentAreaMode != SGL_LINE;
+        if (context.recording) {
+            context.recording->AddCircle(rasterState(context), circle, filled);
+        }
+        else {
+            submitCircle(context, rasterState(context), circle, filled);
+        }
     }
 }
 
-void sglEllipse(float cx, float cy, float cz, float a, float b)
-{
-    if (a <= 0 || b <= 0) {
+// Checks the state shared by sglDrawArrays() and sglDrawElements()
+static bool cannotDrawArrays(sglEElementType mode) {
+    if (contextNotInitialized() || calledWithinBeginEnd()) {
+        return true;
+    }
+    if (mode < SGL_POINTS || mode >= SGL_LAST_ELEMENT_TYPE) {
+        setErrCode(SGL_INVALID_ENUM);
+        return true;
+    }
+    if (!sceneManager->getCurrentContext().vertexArray.pointer) {
+        setErrCode(SGL_INVALID_OPERATION);
+        return true;
+    }
+    return false;
+}
+
+// Draws the vertices of the array as a sglBegin() / sglEnd() block would
+static void drawArrays(sglEElementType mode, const unsigned* indices, size_t first, size_t count) {
+    SGLContext& context = sceneManager->getCurrentContext();
+    const VertexArray& array = context.vertexArray;
+    if (context.compilingList || context.insideBeginScene) {
+        // copied, the application may change the array afterwards
+        vector<Vertex> vertices;
+        vertices.reserve(count);
+        for (size_t i = 0; i < count; i++) {
+            vertices.push_back(readVertex(array, indices ? indices[i] : first + i));
+        }
+        storeVertexBlock(context, mode, vertices);
+        return;
+    }
+
+    updateTransform(context);
+    drawVertexArray(context, mode, array, indices, first, count);
+}
+
+// The vertex array of the current context for the capture, if there is one
+static const VertexArray* capturedVertexArray() {
+    return sceneManager && sceneManager->hasCurrentContext()
+        ? &sceneManager->getCurrentContext().vertexArray : nullptr;
+}
+
+void sglVertexPointer(int size, int stride, const float* pointer) {
+    SGL_CAPTURE(CAPTURE_VERTEX_POINTER, size, stride);
+    if (contextNotInitialized() || calledWithinBeginEnd()) {
+        return;
+    }
+    if (size < 2 || size > 4 || stride < 0) {
         setErrCode(SGL_INVALID_VALUE);
         return;
     }
+
+    VertexArray& array = sceneManager->getCurrentContext().vertexArray;
+    array.pointer = pointer;
+    array.size = size;
+    array.stride = stride != 0 ? static_cast<size_t>(stride) : size * sizeof(float);
+}
+
+void sglDrawArrays(sglEElementType mode, int first, int count) {
+    SGL_CAPTURE(CAPTURE_DRAW_ARRAYS, mode, first,
+                CaptureVertices{ capturedVertexArray(), nullptr, first, count });
+    if (cannotDrawArrays(mode)) {
+        return;
+    }
+    if (first < 0 || count < 0) {
+        setErrCode(SGL_INVALID_VALUE);
+        return;
+    }
+    drawArrays(mode, nullptr, first, count);
+}
+
+void sglDrawElements(sglEElementType mode, int count, const unsigned* indices) {
+    SGL_CAPTURE(CAPTURE_DRAW_ELEMENTS, mode,
+                CaptureVertices{ indices ? capturedVertexArray() : nullptr, indices, 0, count });
+    if (cannotDrawArrays(mode)) {
+        return;
+    }
+    if (count < 0 || (count > 0 && !indices)) {
+        setErrCode(SGL_INVALID_VALUE);
+        return;
+    }
+    drawArrays(mode, indices, 0, count);
+}
+
+void sglBeginPath(sglEFillRule rule) {
+    SGL_CAPTURE(CAPTURE_BEGIN_PATH, rule);
     if (contextNotInitialized() || calledWithinBeginEnd()) {
         return;
     }
+    if (rule != SGL_NONZERO && rule != SGL_EVEN_ODD) {
+        setErrCode(SGL_INVALID_ENUM);
+        return;
+    }
 
-    if (sceneManager->getCurrentContext().currentAreaMode == SGL_POINT) {
-        sglBegin(SGL_POINTS);
-        sglVertex3f(cx, cy, cz);
-        sglEnd();
+    SGLContext& context = sceneManager->getCurrentContext();
+    // the contours are kept in screen coordinates, neither a list nor a
+    // scene could store them
+    if (context.insidePath || context.compilingList || context.insideBeginScene) {
+        setErrCode(SGL_INVALID_OPERATION);
+        return;
+    }
+    context.insidePath = true;
+    context.pathRule = rule;
+    context.pathVertices.clear();
+    context.pathContours.clear();
+}
+
+void sglEndPath(void) {
+    SGL_CAPTURE(CAPTURE_END_PATH);
+    if (contextNotInitialized() || calledWithinBeginEnd()) {
+        return;
+    }
+    SGLContext& context = sceneManager->getCurrentContext();
+    if (!context.insidePath) {
+        setErrCode(SGL_INVALID_OPERATION);
+        return;
+    }
+    context.insidePath = false;
+    if (context.pathContours.empty()) {
         return;
     }
 
+    SGL_STAT_PHASE(context, rasterTime);
+    const RasterState state = rasterState(context);
+    if (context.recording) {
+        context.recording->AddPath(state, context.pathVertices.data(), context.pathContours.data(),
+                                   context.pathContours.size(), context.pathRule);
+    }
+    else {
+        submitPath(context, state, context.pathVertices.data(), context.pathContours.data(),
+                   context.pathContours.size(), context.pathRule);
+    }
+    context.pathVertices.clear();
+    context.pathContours.clear();
+}
+
+// The outline of sglEllipse(), without the center
+static void ellipseVertices(float cx, float cy, float cz, float a, float b, vector<Vertex>& vertices) {
     const int numSegments = 40;
     const float angleStep = 2 * M_PI / (float)numSegments;
 
-
-    sglBegin(SGL_POLYGON);
     for (int i = 0; i < numSegments; i++)
     {
         float angle = i * angleStep;
         float x = cx + a * cosf(angle);
         float y = cy + b * sinf(angle);
-        sglVertex3f(x, y, cz);
+        vertices.emplace_back(x, y, cz);
+    }
+}
+
+// The points of sglArc() along the circle, without the center
+static void arcVertices(float cx, float cy, float cz, float r, float from, float to, vector<Vertex>& vertices) {
+    // make sure that the arc is drawn in the correct direction
+    from = fmod(from, 2 * M_PI);
+    if (from < 0) {
+        from += 2 * M_PI;
+    }
+    to = fmod(to, 2 * M_PI);
+    if (to < 0) {
+        to += 2 * M_PI;
+    }
+
+    if (from > to) {
+        to += 2 * M_PI;
+    }
+
+    const int numSegments = std::max(1, int(40 * fabs(to - from) / (2 * M_PI)));
+    const float angleStep = (to - from) / numSegments;
+
+    for (int i = 0; i <= numSegments; i++) {
+        // Use direct angle calculation instead of incremental
+        double angle = from + i * angleStep;
+        // Normalize angle periodically to prevent drift
+        if (i % 10 == 0) {
+            angle = fmod(angle, 2 * M_PI);
+        }
+        double x = cx + r * cos(angle);
+        double y = cy + r * sin(angle);
+        vertices.emplace_back(float(x), float(y), cz);
+    }
+}
+
+void sglEllipse(float cx, float cy, float cz, float a, float b)
+{
+    SGL_CAPTURE(CAPTURE_ELLIPSE, cx, cy, cz, a, b);
+    if (a <= 0 || b <= 0) {
+        setErrCode(SGL_INVALID_VALUE);
+        return;
+    }
+    if (contextNotInitialized() || calledWithinBeginEnd()) {
+        return;
+    }
+
+    vector<Vertex> outline;
+    if (sceneManager->getCurrentContext().compilingList) {
+        // drawn by sglCallList() in the area mode of the call
+        ellipseVertices(cx, cy, cz, a, b, outline);
+        sceneManager->getCurrentContext().compilingList->AddEllipse(Vertex(cx, cy, cz), outline.data(), outline.size());
+        return;
+    }
+
+    if (sceneManager->getCurrentContext().currentAreaMode == SGL_POINT) {
+        sglBegin(SGL_POINTS);
+        sglVertex3f(cx, cy, cz);
+        sglEnd();
+        return;
+    }
+
+    ellipseVertices(cx, cy, cz, a, b, outline);
+    sglBegin(SGL_POLYGON);
+    for (const Vertex& v : outline) {
+        sglVertex3f(v.x, v.y, v.z);
     }
     sglEnd();
 }
 
 void sglArc(float cx, float cy, float cz, float r, float from, float to) {   
+    SGL_CAPTURE(CAPTURE_ARC, cx, cy, cz, r, from, to);
     if (contextNotInitialized()) {
         return;
     }
@@ -212,6 +466,14 @@ void sglArc(float cx, float cy, float cz, float r, float from, float to) {
         return;
     }
 
+    vector<Vertex> points;
+    if (sceneManager->getCurrentContext().compilingList) {
+        // drawn by sglCallList() in the area mode of the call
+        arcVertices(cx, cy, cz, r, from, to, points);
+        sceneManager->getCurrentContext().compilingList->AddArc(Vertex(cx, cy, cz), points.data(), points.size());
+        return;
+    }
+
     auto areaMode = sceneManager->getCurrentContext().currentAreaMode;
     if (areaMode == SGL_POINT) {
         sglBegin(SGL_POINTS);
@@ -220,23 +482,6 @@ void sglArc(float cx, float cy, float cz, float r, float from, float to) {
         return;
     }
 
-    // make sure that the arc is drawn in the correct direction
-    from = fmod(from, 2 * M_PI);
-    if (from < 0) {
-        from += 2 * M_PI;
-    }
-    to = fmod(to, 2 * M_PI);
-    if (to < 0) {
-        to += 2 * M_PI;
-    }
-
-    if (from > to) {
-        to += 2 * M_PI;
-    }
-
-    const int numSegments = std::max(1, int(40 * fabs(to - from) / (2 * M_PI)));
-    const float angleStep = (to - from) / numSegments;
-
     if (areaMode == SGL_FILL) {
         sglBegin(SGL_POLYGON);
         // add center to make circular sector
@@ -246,16 +491,9 @@ void sglArc(float cx, float cy, float cz, float r, float from, float to) {
         sglBegin(SGL_LINE_STRIP);
     }
 
-    for (int i = 0; i <= numSegments; i++) {
-        // Use direct angle calculation instead of incremental
-        double angle = from + i * angleStep;
-        // Normalize angle periodically to prevent drift
-        if (i % 10 == 0) {
-            angle = fmod(angle, 2 * M_PI);
-        }
-        double x = cx + r * cos(angle);
-        double y = cy + r * sin(angle);
-        sglVertex3f(float(x), float(y), cz);
+    arcVertices(cx, cy, cz, r, from, to, points);
+    for (const Vertex& v : points) {
+        sglVertex3f(v.x, v.y, v.z);
     }
     sglEnd();    
 }
@@ -1,11 +1,13 @@
 #include "draw_utils.h"
+#include "raster_bins.h"
+#include "span_kernels.h"
 #include <math.h>
+#include <cstdlib>
 #include <algorithm>
 #include <functional>
 
 using std::cout;
 using std::endl;
-using std::make_unique;
 using std::max;
 using std::min;
 using std::swap;
@@ -16,110 +18,172 @@ inline float invZ(float z) {
     return 1.0f / z;
 }
 
-inline float interpolateZ(float z1, float z2, float t) {
-    return invZ(z1) + t * (invZ(z2) - invZ(z1));
-}
-
 inline int coord2DTo1D(int x, int y, int width) {
     return x + y * width;
 }
 
-inline float calculateZStep(float z1, float z2, int x1, int x2) {
+// Step of 1/z between the ends of a span
+inline float calculateInvZStep(float w1, float w2, int x1, int x2) {
     if (x2 == x1) {
         return 0;
     } 
 
-    return (invZ(z2) - invZ(z1)) / static_cast<float>(x2 - x1);
+    return (w2 - w1) / static_cast<float>(x2 - x1);
+}
+
+RasterState rasterState(const SGLContext& context) {
+    RasterState state;
+    state.color = context.currentColor;
+    state.depthTest = context.enabledDepthTest;
+    state.pointSize = static_cast<int>(context.pointSize);
+    state.minX = 0;
+    state.minY = 0;
+    state.maxX = context.width - 1;
+    state.maxY = context.height - 1;
+    return state;
 }
 
-inline bool depthCheck(ScreenVertex point, int width ) {
-    if (!sceneManager->getCurrentContext().enabledDepthTest) {
+inline bool depthCheck(SGLContext& context, const RasterState& state, ScreenVertex point, int width) {
+    if (!state.depthTest) {
         return true;
     }
     
-    auto& depthBuffer = *(sceneManager->getCurrentContext().depthBuffer);
-    int index = coord2DTo1D(point.x, point.y, width);
+    auto& depthBuffer = *(context.depthBuffer);
+    return depthTest(depthBuffer[coord2DTo1D(point.x, point.y, width)], invZ(point.z));
+}
 
-    if (depthBuffer[index] > point.z - EPSILON) {
-        depthBuffer[index] = point.z;  // Update with closer depth
-        return true;  // Draw the pixel
-    }
-    return false;
+// The pixel must lie inside the window of the state
+inline bool windowDepthCheck(SGLContext& context, const RasterState& state, ScreenVertex point) {
+    touchSpan(context, *context.colorBuffer, point.y, point.x, point.x);
+    return depthCheck(context, state, point, context.width);
 }
 
-inline bool boundsAndDepthCheck(ScreenVertex point, int width, int height) {
-    if (point.x < 0 || point.x >= width || point.y < 0 || point.y >= height) {
+// The window of the state is inside the canvas, so it bounds the pixels
+inline bool boundsAndDepthCheck(SGLContext& context, const RasterState& state, ScreenVertex point) {
+    if (point.x < state.minX || point.x > state.maxX || point.y < state.minY || point.y > state.maxY) {
         return false;
     }
-    if (!sceneManager->getCurrentContext().enabledDepthTest) {
-        return true;
-    }
-    return depthCheck(point, width);
+    return windowDepthCheck(context, state, point);
 }
 
-inline void plotLine(vector<Pixel>& colorBuffer, Pixel color, int y, int x1, int x2, float z1, float z2, int width) {
-    
-    if (x1 == x2) {
-        if (depthCheck({x1, y, z1}, width)) {
-            colorBuffer[coord2DTo1D(x1, y, width)] = color;
-        }
-        return;
-    }
-
-    const float invZStep = calculateZStep(z1, z2, x1, x2);
+// Specialized on checking the bounds, primitives drawn without the check
+// must lie inside the window of the state
+template <bool CLIP>
+inline bool pixelCheck(SGLContext& context, const RasterState& state, ScreenVertex point) {
+    return CLIP ? boundsAndDepthCheck(context, state, point) : windowDepthCheck(context, state, point);
+}
 
-    float currentInvZ = invZ(z1);
-    const int index_base = y * width;
+// Whether the box (inclusive, in pixels) lies inside the window of the state
+inline bool insideWindow(const RasterState& state, int64_t minX, int64_t minY, int64_t maxX, int64_t maxY) {
+    return minX >= state.minX && maxX <= state.maxX && minY >= state.minY && maxY <= state.maxY;
+}
 
-    for (int x = x1; x <= x2; x++) {
-        if (depthCheck({x, y, invZ(currentInvZ)}, width)) {
-            colorBuffer[index_base+ x] = color;
-        }
-        currentInvZ += invZStep;
-    }
+// Whether the box (inclusive, in pixels) misses the window of the state
+inline bool outsideWindow(const RasterState& state, int64_t minX, int64_t minY, int64_t maxX, int64_t maxY) {
+    return maxX < state.minX || minX > state.maxX || maxY < state.minY || minY > state.maxY;
 }
 
-inline void plotLineBoundsChecking(vector<Pixel>& colorBuffer, Pixel color, 
-                            int y, int x1, int x2, float z1, float z2, 
-                            int width ) {
-    if (x1 < 0) {
-        float currentInvZ = invZ(z1);
-        float invZStep = calculateZStep(z1, z2, x1, x2);
-        currentInvZ += invZStep * (-x1);
-        z1 = 1.0f / currentInvZ;
-        x1 = 0;
+/**
+ * @brief Fills the span [x1, x2] of row y, its depth given as 1/z at the ends.
+ *
+ * Specialized on the depth test and on clipping the span to the canvas,
+ * without clipping the span must lie inside it. The part outside the window
+ * of the state is skipped without changing the depth of the other pixels,
+ * so a span drawn tile by tile gives the same pixels as drawn at once.
+ */
+template <bool DEPTH_TEST, bool CLIP>
+inline void plotSpan(SGLContext& context, const RasterState& state,
+                     int y, int x1, int x2, float w1, float w2) {
+    const float wStep = calculateInvZStep(w1, w2, x1, x2);
+    if (CLIP) {
+        // rows outside of the canvas have no pixels, nor tiles to touch
+        if (y < 0 || y >= context.height) {
+            return;
+        }
+        if (x1 < 0) {
+            w1 += wStep * (-x1);
+            x1 = 0;
+        }
+        if (x2 >= context.width) {
+            x2 = context.width - 1;
+        }
     }
-    if (x2 >= width) {
-        x2 = width - 1;
+    if (y < state.minY || y > state.maxY) {
+        return;
     }
+    // pixels of the span skipped on the left of the window
+    const int skipped = max(state.minX - x1, 0);
+    const int first = x1 + skipped;
+    const int last = min(x2, state.maxX);
     // the whole line was outside of bounds
-    if (x1 > x2) {
+    if (first > last) {
         return;
     }
 
-    plotLine(colorBuffer, color, y, x1, x2, z1, z2, width);
+    FrameBuffer& colorBuffer = *context.colorBuffer;
+    touchSpan(context, colorBuffer, y, first, last);
+    float* depths = DEPTH_TEST ? context.depthBuffer->Row(y) + first : nullptr;
+    const int filled = fillSpan<DEPTH_TEST>(colorBuffer.Row(y) + first, depths, last - first + 1,
+                                            state.color, w1, wStep, skipped);
+    SGL_STAT_ADD(context, pixelsFilled, filled);
+    (void)filled;
 }
 
+void plotLine(SGLContext& context, const RasterState& state, int y, int x1, int x2, float z1, float z2) {
+    if (state.depthTest) {
+        plotSpan<true, false>(context, state, y, x1, x2, invZ(z1), invZ(z2));
+    }
+    else {
+        plotSpan<false, false>(context, state, y, x1, x2, invZ(z1), invZ(z2));
+    }
+}
 
-void drawPoints() {
-    auto& context = sceneManager->getCurrentContext();
-    auto& screenVertices = *(context.screenVertices);
+inline void plotLineBoundsChecking(SGLContext& context, const RasterState& state,
+                            int y, int x1, int x2, float z1, float z2) {
+    if (state.depthTest) {
+        plotSpan<true, true>(context, state, y, x1, x2, invZ(z1), invZ(z2));
+    }
+    else {
+        plotSpan<false, true>(context, state, y, x1, x2, invZ(z1), invZ(z2));
+    }
+}
+
+
+// Draws the square of one point, returns the number of the pixels written
+template <bool CLIP>
+static int plotPoint(SGLContext& context, const RasterState& state, const ScreenVertex& v) {
     auto& colorBuffer = *(context.colorBuffer);
-    int width = context.width;
-    int height = context.height;
-    Pixel color = context.currentColor;
-    int size = context.pointSize;
-
-    for (const ScreenVertex &v : screenVertices) {
-        for (int i = 0; i < size; i++) {
-            for (int j = 0; j < size; j++) {
-                ScreenVertex pixel = ScreenVertex(v.x + j, v.y + i, v.z);
-                if (boundsAndDepthCheck(pixel, width, height)) {
-                    colorBuffer[coord2DTo1D(pixel.x, pixel.y, width)] = color;
-                }
+    const int size = state.pointSize;
+    int filled = 0;
+
+    for (int i = 0; i < size; i++) {
+        for (int j = 0; j < size; j++) {
+            ScreenVertex pixel = ScreenVertex(v.x + j, v.y + i, v.z);
+            if (pixelCheck<CLIP>(context, state, pixel)) {
+                colorBuffer.At(pixel.x, pixel.y) = state.color;
+                filled++;
             }
         }
     }
+    return filled;
+}
+
+void drawPoints(SGLContext& context, const RasterState& state, const ScreenVertex* vertices, size_t count) {
+    const int size = state.pointSize;
+    int filled = 0;
+
+    for (size_t k = 0; k < count; k++) {
+        const ScreenVertex& v = vertices[k];
+        const int64_t maxX = int64_t(v.x) + size - 1;
+        const int64_t maxY = int64_t(v.y) + size - 1;
+        if (outsideWindow(state, v.x, v.y, maxX, maxY)) {
+            continue;
+        }
+        filled += insideWindow(state, v.x, v.y, maxX, maxY)
+            ? plotPoint<false>(context, state, v)
+            : plotPoint<true>(context, state, v);
+    }
+    SGL_STAT_ADD(context, pixelsFilled, filled);
 }
 
 int getIncrement(int start, int end) {
@@ -132,7 +196,8 @@ int getIncrement(int start, int end) {
     return 0;
 }
 
-void drawBresenhamLine(ScreenVertex start, ScreenVertex end) {
+template <bool CLIP>
+static void traceBresenhamLine(SGLContext& context, const RasterState& state, ScreenVertex start, ScreenVertex end) {
 
     // differences
     const int dX = abs(end.x - start.x); 
@@ -154,16 +219,16 @@ void drawBresenhamLine(ScreenVertex start, ScreenVertex end) {
 
     int tmp, error = ((dX > dY) ? dX : -dY) / 2;
     
-    const int width = sceneManager->getCurrentContext().width;
-    const int height = sceneManager->getCurrentContext().height;
-    auto& colorBuffer = *(sceneManager->getCurrentContext().colorBuffer);
-    const Pixel color = sceneManager->getCurrentContext().currentColor;
+    auto& colorBuffer = *(context.colorBuffer);
+    const Pixel color = state.color;
+    int filled = 0;
 
     while (start.x != end.x || start.y != end.y) {
         ScreenVertex pixel(start.x, start.y, invZ(currentInvZ));
 
-        if (boundsAndDepthCheck(start, width, height)) {
-            colorBuffer[coord2DTo1D(start.x, start.y, width)] = color;
+        if (pixelCheck<CLIP>(context, state, start)) {
+            colorBuffer.At(start.x, start.y) = color;
+            filled++;
         }
         tmp = error;
         if (tmp > -dX) {
@@ -179,52 +244,71 @@ void drawBresenhamLine(ScreenVertex start, ScreenVertex end) {
     }
 
     ScreenVertex pixel(start.x, start.y, invZ(currentInvZ));
-    if(boundsAndDepthCheck(pixel, width, height)) {
-        colorBuffer[coord2DTo1D(start.x, start.y, width)] = color;
+    if(pixelCheck<CLIP>(context, state, pixel)) {
+        colorBuffer.At(start.x, start.y) = color;
+        filled++;
     }
+    SGL_STAT_ADD(context, pixelsFilled, filled);
 }
 
-void drawLines() {
-    auto& screenVertices = *(sceneManager->getCurrentContext().screenVertices);
-    size_t size = screenVertices.size();
-
-    if (size % 2) {
-        screenVertices.pop_back();
+void drawBresenhamLine(SGLContext& context, const RasterState& state, ScreenVertex start, ScreenVertex end) {
+    // the line does not leave the box of its ends, the pixels of a line
+    // inside the window are not checked and a line outside is not walked
+    const int minX = min(start.x, end.x);
+    const int minY = min(start.y, end.y);
+    const int maxX = max(start.x, end.x);
+    const int maxY = max(start.y, end.y);
+    if (outsideWindow(state, minX, minY, maxX, maxY)) {
+        return;
+    }
+    if (insideWindow(state, minX, minY, maxX, maxY)) {
+        traceBresenhamLine<false>(context, state, start, end);
     }
+    else {
+        traceBresenhamLine<true>(context, state, start, end);
+    }
+}
 
-    for (size_t i = 0; i < size; i+=2) {
-        drawBresenhamLine(screenVertices[i], screenVertices[i+1]);
+void drawLines(SGLContext& context, const RasterState& state, const ScreenVertex* vertices, size_t count) {
+    // an odd vertex at the end is ignored
+    for (size_t i = 0; i + 1 < count; i += 2) {
+        drawBresenhamLine(context, state, vertices[i], vertices[i + 1]);
     }
 }
 
-void drawLineStrip() {
-    auto& screenVertices = *(sceneManager->getCurrentContext().screenVertices);
-    size_t primitivesCount = screenVertices.size();
-    if (primitivesCount < 2) {
+void drawLineStrip(SGLContext& context, const RasterState& state, const ScreenVertex* vertices, size_t count) {
+    if (count < 2) {
         return;
     }
 
-    for (size_t i = 0; i < primitivesCount - 1; i++) {
-        drawBresenhamLine(screenVertices[i], screenVertices[i+1]);
+    for (size_t i = 0; i < count - 1; i++) {
+        drawBresenhamLine(context, state, vertices[i], vertices[i + 1]);
     }
 }
 
-void drawLineLoop() {
-    auto& screenVertices = *(sceneManager->getCurrentContext().screenVertices);
-    size_t primitivesCount = screenVertices.size();
+void drawLineLoop(SGLContext& context, const RasterState& state, const ScreenVertex* vertices, size_t count) {
     // impossible to draw a loop with less than 2 vertices
-    if (primitivesCount < 2) {
+    if (count < 2) {
         return;
     }
 
-    for (size_t i = 0; i < primitivesCount - 1; i++) {
-        drawBresenhamLine(screenVertices[i], screenVertices[i+1]);
+    drawLineStrip(context, state, vertices, count);
+    drawBresenhamLine(context, state, vertices[count - 1], vertices[0]);
+}
+
+void drawTriangleOutlines(SGLContext& context, const RasterState& state, const ScreenVertex* vertices, size_t count) {
+    for (size_t i = 0; i + 2 < count; i += 3) {
+        drawBresenhamLine(context, state, vertices[i], vertices[i + 1]);
+        drawBresenhamLine(context, state, vertices[i + 1], vertices[i + 2]);
+        drawBresenhamLine(context, state, vertices[i + 2], vertices[i]);
     }
-    drawBresenhamLine(screenVertices.back(), screenVertices[0]);
 }
 
-Vertex transformPoint(const Vertex& v) {
-    Vertex result = sceneManager->getCurrentContext().VPMmatrix * v;
+Vertex transformPoint(const SGLContext& context, const Vertex& v) {
+    return projectVertex(context.VPMmatrix * v);
+}
+
+Vertex projectVertex(Vertex result) {
     if (result.w != 0.0f) {
         const float inv_w = 1.0f / result.w;
         result.x *= inv_w;
@@ -238,36 +322,36 @@ Vertex transformPoint(const Vertex& v) {
     return result;
 }
 
-void plotTransformedPoint(vector<Pixel>& colorBuffer, Pixel color, ScreenVertex point) {
-    int width = sceneManager->getCurrentContext().width;
-    int height = sceneManager->getCurrentContext().height;
-    
-    if (boundsAndDepthCheck(point, width, height)) {
-        colorBuffer[coord2DTo1D(point.x, point.y, width)] = color;
+void plotTransformedPoint(SGLContext& context, const RasterState& state, ScreenVertex point) {
+    if (boundsAndDepthCheck(context, state, point)) {
+        context.colorBuffer->At(point.x, point.y) = state.color;
+        SGL_STAT_ADD(context, pixelsFilled, 1);
     }
 }
 
-void setScaleFactor() {
-    Matrix VPM = sceneManager->getCurrentContext().VPMmatrix;
-    sceneManager->getCurrentContext().scaleFactor = 
-        sqrt(VPM.data[0] * VPM.data[5] - VPM.data[1] * VPM.data[4]);
-}
+WindowCircle transformCircle(const SGLContext& context, float cx, float cy, float cz, float radius) {
+    Vertex transformedCenter = transformPoint(context, Vertex(cx, cy, cz));
 
-void drawBresenhamCircle(float cx, float cy, float cz, float radius) {
-    Vertex transformedCenter = transformPoint(Vertex(cx, cy, cz));
-    auto& context = sceneManager->getCurrentContext();
-    auto width = context.width;
+    WindowCircle circle;
+    circle.center = ScreenVertex(round(transformedCenter.x), round(transformedCenter.y), transformedCenter.z);
+    circle.radius = round(radius * context.scaleFactor);
+    return circle;
+}
 
-    int centerX = round(transformedCenter.x);
-    int centerY = round(transformedCenter.y);
-    float depth = transformedCenter.z;
-    int r = round(radius * context.scaleFactor);
+void drawBresenhamCircle(SGLContext& context, const RasterState& state, const WindowCircle& circle, bool filled) {
+    const int centerX = circle.center.x;
+    const int centerY = circle.center.y;
+    const float depth = circle.center.z;
+    const int r = circle.radius;
 
-    auto& colorBuffer = *(context.colorBuffer);
-    Pixel color = context.currentColor;
+    // nothing of a circle outside of the window is drawn
+    const int64_t reach = std::abs(int64_t(r));
+    if (outsideWindow(state, centerX - reach, centerY - reach, centerX + reach, centerY + reach)) {
+        return;
+    }
 
     if (r == 0) {
-        plotTransformedPoint(colorBuffer, color, ScreenVertex(centerX, centerY, depth));
+        plotTransformedPoint(context, state, ScreenVertex(centerX, centerY, depth));
         return;
     }
 
@@ -277,14 +361,14 @@ void drawBresenhamCircle(float cx, float cy, float cz, float radius) {
     int d = 3 - 2 * r;
 
     auto plotCirclePoints = [&](int x, int y) {
-        plotTransformedPoint(colorBuffer, color, ScreenVertex(centerX + x, centerY + y, depth));
-        plotTransformedPoint(colorBuffer, color, ScreenVertex(centerX - x, centerY + y, depth));
-        plotTransformedPoint(colorBuffer, color, ScreenVertex(centerX + x, centerY - y, depth));
-        plotTransformedPoint(colorBuffer, color, ScreenVertex(centerX - x, centerY - y, depth));
-        plotTransformedPoint(colorBuffer, color, ScreenVertex(centerX + y, centerY + x, depth));
-        plotTransformedPoint(colorBuffer, color, ScreenVertex(centerX - y, centerY + x, depth));
-        plotTransformedPoint(colorBuffer, color, ScreenVertex(centerX + y, centerY - x, depth));
-        plotTransformedPoint(colorBuffer, color, ScreenVertex(centerX - y, centerY - x, depth));
+        plotTransformedPoint(context, state, ScreenVertex(centerX + x, centerY + y, depth));
+        plotTransformedPoint(context, state, ScreenVertex(centerX - x, centerY + y, depth));
+        plotTransformedPoint(context, state, ScreenVertex(centerX + x, centerY - y, depth));
+        plotTransformedPoint(context, state, ScreenVertex(centerX - x, centerY - y, depth));
+        plotTransformedPoint(context, state, ScreenVertex(centerX + y, centerY + x, depth));
+        plotTransformedPoint(context, state, ScreenVertex(centerX - y, centerY + x, depth));
+        plotTransformedPoint(context, state, ScreenVertex(centerX + y, centerY - x, depth));
+        plotTransformedPoint(context, state, ScreenVertex(centerX - y, centerY - x, depth));
     };
 
     auto plotCircleFilling = [&](int x, int y) {
@@ -292,41 +376,41 @@ void drawBresenhamCircle(float cx, float cy, float cz, float radius) {
 
         // Horizontal lines (y-offset)
         plotLineBoundsChecking(
-            colorBuffer, color,
+            context, state,
             centerY + y,  // upper line
             centerX - x, centerX + x,
-            z, z, width
+            z, z
         );
         
         plotLineBoundsChecking(
-            colorBuffer, color,
+            context, state,
             centerY - y,  // lower line
             centerX - x, centerX + x,
-            z, z, width
+            z, z
         );
 
         // Vertical lines (x-offset)
         plotLineBoundsChecking(
-            colorBuffer, color,
+            context, state,
             centerY + x,  // right line
             centerX - y, centerX + y,
-            z, z, width
+            z, z
         );
         
         plotLineBoundsChecking(
-            colorBuffer, color,
+            context, state,
             centerY - x,  // left line
             centerX - y, centerX + y,
-            z, z, width
+            z, z
         );
     };
 
     std::function<void(int, int)> plotFunction;
-    if (context.currentAreaMode == SGL_LINE) {
-        plotFunction = plotCirclePoints;
+    if (filled) {
+        plotFunction = plotCircleFilling;
     }
     else {
-        plotFunction = plotCircleFilling;
+        plotFunction = plotCirclePoints;
     }
 
     while (y >= x) {
@@ -342,7 +426,27 @@ void drawBresenhamCircle(float cx, float cy, float cz, float radius) {
 }
 
 
-void initFillingStruct(FillingStruct& filler, ScreenVertex c1, ScreenVertex c2, int *maxX, int *minX) {
+namespace {
+
+// Scratch storage of the polygon fill, every thread reuses its own for the
+// next polygon instead of allocating
+struct FillScratch {
+    // the edges before they are bucketed, and the starts of the buckets
+    vector<Edge> edges;
+    vector<int> buckets;
+    // the edge table of fillPolygon()
+    PolygonEdges polygon;
+    FillingStruct filler;
+};
+
+thread_local FillScratch fillScratch;
+
+// Buckets of at most this many edges are sorted by insertion
+const size_t EDGE_INSERTION_SORT_LIMIT = 16;
+
+} // namespace
+
+static void addPolygonEdge(PolygonEdges& polygon, vector<Edge>& edges, ScreenVertex c1, ScreenVertex c2) {
     // remove horizontal edges
     if (c1.y == c2.y) {
         return;
@@ -352,125 +456,556 @@ void initFillingStruct(FillingStruct& filler, ScreenVertex c1, ScreenVertex c2,
     ScreenVertex bottom = (c1.y > c2.y) ? c2 : c1;
 
     Edge edge = Edge(top, bottom);
+    edge.winding = c1.y < c2.y ? 1 : -1;
     // edge shortening
     edge.bottomY++;
-    filler.edges.push_back(edge);
+    edges.push_back(edge);
 
     // find extremes
-    if (top.y > filler.maxY) {
-        filler.maxY = top.y;
+    if (top.y > polygon.maxY) {
+        polygon.maxY = top.y;
     }
-    if (bottom.y < filler.minY) {
-        filler.minY = bottom.y;
+    if (bottom.y < polygon.minY) {
+        polygon.minY = bottom.y;
     }
-    if (top.x > *maxX || bottom.x > *maxX) {
-        *maxX = max(top.x, bottom.x);
+    if (top.x > polygon.maxX || bottom.x > polygon.maxX) {
+        polygon.maxX = max(top.x, bottom.x);
     }
-    if (top.x < *minX || bottom.x < *minX) {
-        *minX = min(top.x, bottom.x);
+    if (top.x < polygon.minX || bottom.x < polygon.minX) {
+        polygon.minX = min(top.x, bottom.x);
     }
 }
 
-void shakeSort(vector<Edge>& edges) {
-    bool swapped = true;
-    int start = 0;
-    int end = edges.size() - 1;
+// Stable insertion sort by currentX from the index on, the edges before it
+// are sorted already. Only the edges out of order are moved.
+static void insertionSort(vector<Edge>& edges, size_t from) {
+    for (size_t i = max<size_t>(from, 1); i < edges.size(); i++) {
+        if (edges[i - 1].currentX > edges[i].currentX) {
+            const Edge edge = edges[i];
+            size_t j = i;
+            do {
+                edges[j] = edges[j - 1];
+                j--;
+            } while (j > 0 && edges[j - 1].currentX > edge.currentX);
+            edges[j] = edge;
+        }
+    }
+}
 
-    while (swapped) {
-        swapped = false;
+static void updateActiveEdgeList(FillingStruct& filler, int y) {
+    vector<Edge>& active = filler.activeEdgeList;
+    // remove already processed edges
+    active.erase(
+        std::remove_if(active.begin(), active.end(),
+            [y](const Edge& e) { return y < e.bottomY; }),
+        active.end());
 
-        for (int i = start; i < end; ++i) {
-            if (edges[i].currentX > edges[i + 1].currentX) {
-                std::swap(edges[i], edges[i + 1]);
-                swapped = true;
-            }
+    // the edges stay in order unless they cross, then only the crossing ones move
+    insertionSort(active, 1);
+
+    // take the bucket of the row from the edge table
+    vector<Edge>& incoming = filler.incoming;
+    incoming.clear();
+    while (filler.nextEdge != filler.lastEdge && filler.nextEdge->topY >= y) {
+        incoming.push_back(*filler.nextEdge++);
+    }
+    if (incoming.empty()) {
+        return;
+    }
+    if (incoming.size() <= EDGE_INSERTION_SORT_LIMIT) {
+        insertionSort(incoming, 1);
+    }
+    else {
+        std::stable_sort(incoming.begin(), incoming.end(),
+            [](const Edge& e1, const Edge& e2) { return e1.currentX < e2.currentX; });
+    }
+
+    // merge the bucket in from the back, the active edges go first on ties
+    size_t i = active.size();
+    size_t j = incoming.size();
+    active.resize(i + j);
+    size_t k = active.size();
+    while (j > 0) {
+        if (i > 0 && active[i - 1].currentX > incoming[j - 1].currentX) {
+            active[--k] = active[--i];
         }
+        else {
+            active[--k] = incoming[--j];
+        }
+    }
+}
 
-        if (!swapped) {
+// Scans the polygon from the top row down, with the span kernel chosen once
+// for the whole polygon
+template <bool DEPTH_TEST, bool CLIP>
+static void scanPolygon(SGLContext& context, const RasterState& state, FillingStruct& filler) {
+    for (int y = filler.maxY; y > filler.minY; y--) {
+        // the rows below the window are not drawn, the rows above it only
+        // advance the edges
+        if (y < state.minY) {
             break;
         }
-        swapped = false;
+        // an odd edge left over from clipping the top rows has no pair
+        for (size_t i = 0; i + 1 < filler.activeEdgeList.size(); i+=2) {
+            float z1 = filler.activeEdgeList[i].currentZ;
+            float z2 = filler.activeEdgeList[i + 1].currentZ;
+
+            // draw lines
+            plotSpan<DEPTH_TEST, CLIP>(context, state, y,
+                round(filler.activeEdgeList[i].currentX),
+                round(filler.activeEdgeList[i + 1].currentX), invZ(z1), invZ(z2));
 
-        --end;
+            // update X coordinate
+            filler.activeEdgeList[i].currentX += filler.activeEdgeList[i].stepX;
+            filler.activeEdgeList[i].currentZ += filler.activeEdgeList[i].stepZ;
+            filler.activeEdgeList[i + 1].currentX += filler.activeEdgeList[i + 1].stepX;
+            filler.activeEdgeList[i + 1].currentZ += filler.activeEdgeList[i + 1].stepZ;
+        }
+        
+        updateActiveEdgeList(filler, y - 1);
+    }
+}
 
-        for (int i = end - 1; i >= start; --i) {
-            if (edges[i].currentX > edges[i + 1].currentX) {
-                std::swap(edges[i], edges[i + 1]);
-                swapped = true;
+// Scans the contours of a path from the top row down, a span runs from the
+// edge the winding number leaves 0 at to the edge it returns to 0 at
+template <bool DEPTH_TEST, bool CLIP, bool NONZERO>
+static void scanPath(SGLContext& context, const RasterState& state, FillingStruct& filler) {
+    const size_t none = static_cast<size_t>(-1);
+    vector<Edge>& active = filler.activeEdgeList;
+    for (int y = filler.maxY; y > filler.minY; y--) {
+        if (y < state.minY) {
+            break;
+        }
+        int winding = 0;
+        size_t start = none;
+        for (size_t i = 0; i < active.size(); i++) {
+            if (start == none) {
+                start = i;
+            }
+            winding = NONZERO ? winding + active[i].winding : winding ^ 1;
+            if (winding != 0) {
+                continue;
+            }
+            // the spans of the contours sharing a border are drawn as one,
+            // the pixels of the border only once
+            const double endX = round(active[i].currentX);
+            if (i + 1 < active.size() && round(active[i + 1].currentX) == endX) {
+                continue;
             }
+            plotSpan<DEPTH_TEST, CLIP>(context, state, y, round(active[start].currentX), endX,
+                                       invZ(active[start].currentZ), invZ(active[i].currentZ));
+            start = none;
         }
-        ++start;
+        for (Edge& edge : active) {
+            edge.currentX += edge.stepX;
+            edge.currentZ += edge.stepZ;
+        }
+
+        updateActiveEdgeList(filler, y - 1);
     }
 }
 
-void updateActiveEdgeList(FillingStruct& filler, int y) {
-    // remove already processed edges
-    filler.activeEdgeList.erase(
-        std::remove_if(filler.activeEdgeList.begin(), filler.activeEdgeList.end(),
-            [y](const Edge& e) { return y < e.bottomY; }),
-        filler.activeEdgeList.end());
+static void startEdgeTable(const SGLContext& context, PolygonEdges& polygon) {
+    fillScratch.edges.clear();
+    polygon.edges.clear();
+    polygon.minX = context.width;
+    polygon.maxX = 0;
+    polygon.minY = context.height;
+    polygon.maxY = 0;
+}
+
+static void addContourEdges(PolygonEdges& polygon, const ScreenVertex* vertices, size_t count) {
+    for (size_t i = 0; i + 1 < count; i++) {
+        addPolygonEdge(polygon, fillScratch.edges, vertices[i], vertices[i + 1]);
+    }
+    addPolygonEdge(polygon, fillScratch.edges, vertices[count - 1], vertices[0]);
+}
+
+// Buckets the edges added by addContourEdges() into the table
+static void finishEdgeTable(const SGLContext& context, PolygonEdges& polygon) {
+    vector<Edge>& edges = fillScratch.edges;
 
-    // add new intersecting edges
-    vector<Edge> filtered;
-    for (auto it = filler.edges.begin(); it != filler.edges.end();) {
-        if (y <= it->topY) {
-            it->currentX += (it->topY - y) * it->stepX;
-            filler.activeEdgeList.push_back(*it);
-            it = filler.edges.erase(it);  // Remove processed edge from filler.edges
+    // the rows fillPolygonEdges() scans
+    const int top = min(polygon.maxY, context.height - 1);
+    const int bottom = max(polygon.minY, 0);
+    if (top < bottom) {
+        return;
+    }
+    auto visible = [top, bottom](const Edge& edge) {
+        return edge.topY >= bottom && edge.bottomY <= top;
+    };
+
+    // bucket the edges by the row they become active in with a counting
+    // sort, the rows from the top are the buckets
+    vector<int>& buckets = fillScratch.buckets;
+    buckets.assign(top - bottom + 2, 0);
+    size_t visibleCount = 0;
+    for (Edge& edge : edges) {
+        if (!visible(edge)) {
+            continue;
         }
-        else {
-            ++it;
+        // an edge starting above the canvas is moved down to its top row
+        if (edge.topY > top) {
+            edge.currentX += (edge.topY - top) * edge.stepX;
+            edge.currentZ += (edge.topY - top) * edge.stepZ;
+            edge.topY = top;
+        }
+        buckets[top - edge.topY + 1]++;
+        visibleCount++;
+    }
+    for (size_t row = 1; row < buckets.size(); row++) {
+        buckets[row] += buckets[row - 1];
+    }
+    polygon.edges.resize(visibleCount);
+    for (const Edge& edge : edges) {
+        if (visible(edge)) {
+            polygon.edges[buckets[top - edge.topY]++] = edge;
         }
     }
 }
 
-void fillPolygon() {
-    auto& context = sceneManager->getCurrentContext();
-    auto& colorBuffer = *(context.colorBuffer);
-    auto& color = context.currentColor;
-    auto& width = context.width;
-    auto& screenVertices = *(context.screenVertices);
-    unique_ptr<FillingStruct> filler = make_unique<FillingStruct>(context.height);
-    int maxX = 0;
-    int minX = width;
-
-    // init phase
-    for (size_t i = 0; i < screenVertices.size() - 1; i++) {
-        initFillingStruct(*(filler), screenVertices[i], screenVertices[i + 1], &maxX, &minX);
-    }
-    initFillingStruct(*(filler), screenVertices.back(), screenVertices[0], &maxX, &minX);
-    updateActiveEdgeList(*(filler), filler->maxY);
-    // after init the edges are not partially sorted, so shake sort is not optimal
-    sort(filler->activeEdgeList.begin(), filler->activeEdgeList.end(),
-        [](const Edge& e1, const Edge& e2) { return e1.currentX < e2.currentX; });
+void buildPolygonEdges(const SGLContext& context, const ScreenVertex* vertices, size_t count, PolygonEdges& polygon) {
+    startEdgeTable(context, polygon);
+    addContourEdges(polygon, vertices, count);
+    finishEdgeTable(context, polygon);
+}
 
+// Prepares the scan of the table, the scan walks it and keeps it for the next one
+static FillingStruct& startScan(const SGLContext& context, const PolygonEdges& polygon) {
+    FillingStruct& filler = fillScratch.filler;
+    filler.activeEdgeList.clear();
+    filler.nextEdge = polygon.edges.data();
+    filler.lastEdge = polygon.edges.data() + polygon.edges.size();
     // clip scanning lines to canvas size
-    filler->maxY = min(filler->maxY, context.height - 1);
-    filler->minY = max(filler->minY, 0);
+    filler.maxY = min(polygon.maxY, context.height - 1);
+    filler.minY = max(polygon.minY, 0);
+
+    // the scan starts at the top row of the canvas, not of the polygon
+    updateActiveEdgeList(filler, filler.maxY);
+    return filler;
+}
+
+void fillPolygonEdges(SGLContext& context, const RasterState& state, const PolygonEdges& polygon) {
+    SGL_TRACE_SCOPE("fillPolygon", "edges", static_cast<int64_t>(polygon.edges.size()));
+    FillingStruct& filler = startScan(context, polygon);
 
     // decide, whether to use ploting with bounds checking or without
-    auto plotFunction = minX >= 0 && maxX < width ? 
-        *(plotLine) : *(plotLineBoundsChecking);
+    const bool clip = polygon.minX < 0 || polygon.maxX >= context.width;
+    if (state.depthTest) {
+        clip ? scanPolygon<true, true>(context, state, filler) : scanPolygon<true, false>(context, state, filler);
+    }
+    else {
+        clip ? scanPolygon<false, true>(context, state, filler) : scanPolygon<false, false>(context, state, filler);
+    }
+}
 
-    for (int y = filler->maxY; y > filler->minY; y--) {
-        for (size_t i = 0; i < filler->activeEdgeList.size(); i+=2) {
-            float z1 = filler->activeEdgeList[i].currentZ;
-            float z2 = filler->activeEdgeList[i + 1].currentZ;
+void fillPolygon(SGLContext& context, const RasterState& state, const ScreenVertex* vertices, size_t count) {
+    if (count == 0) {
+        return;
+    }
+    PolygonEdges& polygon = fillScratch.polygon;
+    buildPolygonEdges(context, vertices, count, polygon);
+    fillPolygonEdges(context, state, polygon);
+}
 
-            // draw lines
-            plotFunction(colorBuffer, color, y,
-                round(filler->activeEdgeList[i].currentX),
-                round(filler->activeEdgeList[i + 1].currentX), z1, z2, width);
+namespace {
+
+// One side of a monotone polygon, the edges from its top vertex down in one
+// direction around the outline
+struct PolygonChain {
+    const ScreenVertex* vertices;
+    size_t count;
+    bool forward;
+    // the upper vertex of the current edge
+    size_t vertex;
+    // the order of the current edge in the edge table of fillPolygon()
+    size_t index;
+    Edge edge;
+
+    size_t Next(size_t i) const {
+        if (forward) {
+            return i + 1 < count ? i + 1 : 0;
+        }
+        return i > 0 ? i - 1 : count - 1;
+    }
+
+    // Moves down the chain to the edge active on the row, the shortened
+    // edges above it and the horizontal ones are skipped. False if the
+    // chain turns up before it reaches the row.
+    bool Advance(int y) {
+        for (;;) {
+            const size_t next = Next(vertex);
+            const ScreenVertex& top = vertices[vertex];
+            const ScreenVertex& bottom = vertices[next];
+            if (bottom.y > top.y) {
+                return false;
+            }
+            if (bottom.y == top.y || bottom.y + 1 > y) {
+                vertex = next;
+                continue;
+            }
+            edge = Edge(top, bottom);
+            edge.bottomY++;
+            // an edge starting above the canvas is moved down to its top row
+            if (edge.topY > y) {
+                edge.currentX += (edge.topY - y) * edge.stepX;
+                edge.currentZ += (edge.topY - y) * edge.stepZ;
+                edge.topY = y;
+            }
+            index = forward ? vertex : next;
+            return true;
+        }
+    }
+};
 
-            // update X coordinate
-            filler->activeEdgeList[i].currentX += filler->activeEdgeList[i].stepX;
-            filler->activeEdgeList[i].currentZ += filler->activeEdgeList[i].stepZ;
-            filler->activeEdgeList[i + 1].currentX += filler->activeEdgeList[i + 1].stepX;
-            filler->activeEdgeList[i + 1].currentZ += filler->activeEdgeList[i + 1].stepZ;
+} // namespace
+
+bool isMonotonePolygon(const ScreenVertex* vertices, size_t count) {
+    // the directions of the edges going up or down change twice around the outline
+    int first = 0;
+    int previous = 0;
+    int changes = 0;
+    for (size_t i = 0; i < count; i++) {
+        const ScreenVertex& a = vertices[i];
+        const ScreenVertex& b = vertices[i + 1 < count ? i + 1 : 0];
+        if (a.y == b.y) {
+            continue;
         }
-        
-        updateActiveEdgeList(*(filler), y - 1);
-        // use shake sort
-        shakeSort(filler->activeEdgeList);
+        const int direction = b.y > a.y ? 1 : -1;
+        if (first == 0) {
+            first = direction;
+        }
+        else if (direction != previous && ++changes > 2) {
+            return false;
+        }
+        previous = direction;
+    }
+    if (previous != first) {
+        changes++;
+    }
+    return changes <= 2;
+}
+
+// Scans the rows the two chains cross, their edges are ordered and replaced
+// as the active edge list of scanPolygon() orders and replaces them
+template <bool DEPTH_TEST, bool CLIP>
+static void scanMonotonePolygon(SGLContext& context, const RasterState& state,
+                                PolygonChain* chains, int top, int bottom) {
+    // the chain whose edge goes first on the row
+    int left = chains[0].edge.currentX > chains[1].edge.currentX ? 1 : 0;
+    if (chains[0].edge.currentX == chains[1].edge.currentX) {
+        left = chains[0].index < chains[1].index ? 0 : 1;
+    }
+    for (int y = top; y > bottom; y--) {
+        if (y < state.minY) {
+            break;
+        }
+        Edge& first = chains[left].edge;
+        Edge& second = chains[1 - left].edge;
+        plotSpan<DEPTH_TEST, CLIP>(context, state, y, round(first.currentX), round(second.currentX),
+                                   invZ(first.currentZ), invZ(second.currentZ));
+        first.currentX += first.stepX;
+        first.currentZ += first.stepZ;
+        second.currentX += second.stepX;
+        second.currentZ += second.stepZ;
+        if (y - 1 <= bottom) {
+            break;
+        }
+
+        const bool firstEnds = y - 1 < first.bottomY;
+        const bool secondEnds = y - 1 < second.bottomY;
+        if (firstEnds && !chains[left].Advance(y - 1)) {
+            return;
+        }
+        if (secondEnds && !chains[1 - left].Advance(y - 1)) {
+            return;
+        }
+        if (firstEnds && secondEnds) {
+            // both new edges come from the table, in its order on ties
+            const PolygonChain& a = chains[left];
+            const PolygonChain& b = chains[1 - left];
+            const bool swap = a.index < b.index ? a.edge.currentX > b.edge.currentX
+                                                : b.edge.currentX <= a.edge.currentX;
+            left = swap ? 1 - left : left;
+        }
+        else if (firstEnds) {
+            // the edge staying active goes first on ties
+            left = second.currentX > first.currentX ? left : 1 - left;
+        }
+        else if (first.currentX > second.currentX) {
+            left = 1 - left;
+        }
+    }
+}
+
+void fillMonotonePolygon(SGLContext& context, const RasterState& state, const ScreenVertex* vertices, size_t count) {
+    SGL_TRACE_SCOPE("fillMonotonePolygon", "vertices", static_cast<int64_t>(count));
+    if (count == 0) {
+        return;
+    }
+    size_t topVertex = 0;
+    int minX = vertices[0].x;
+    int maxX = vertices[0].x;
+    int minY = vertices[0].y;
+    for (size_t i = 1; i < count; i++) {
+        if (vertices[i].y > vertices[topVertex].y) {
+            topVertex = i;
+        }
+        minX = min(minX, vertices[i].x);
+        maxX = max(maxX, vertices[i].x);
+        minY = min(minY, vertices[i].y);
+    }
+
+    // the rows fillPolygon() scans
+    const int top = min(vertices[topVertex].y, context.height - 1);
+    const int bottom = max(minY, 0);
+    if (top <= bottom) {
+        return;
+    }
+    PolygonChain chains[2];
+    for (int k = 0; k < 2; k++) {
+        chains[k].vertices = vertices;
+        chains[k].count = count;
+        chains[k].forward = k == 0;
+        chains[k].vertex = topVertex;
+        if (!chains[k].Advance(top)) {
+            return;
+        }
+    }
+
+    const bool clip = minX < 0 || maxX >= context.width;
+    if (state.depthTest) {
+        clip ? scanMonotonePolygon<true, true>(context, state, chains, top, bottom)
+             : scanMonotonePolygon<true, false>(context, state, chains, top, bottom);
+    }
+    else {
+        clip ? scanMonotonePolygon<false, true>(context, state, chains, top, bottom)
+             : scanMonotonePolygon<false, false>(context, state, chains, top, bottom);
+    }
+}
+
+template <bool NONZERO>
+static void scanPath(SGLContext& context, const RasterState& state, FillingStruct& filler, bool clip) {
+    if (state.depthTest) {
+        clip ? scanPath<true, true, NONZERO>(context, state, filler) : scanPath<true, false, NONZERO>(context, state, filler);
+    }
+    else {
+        clip ? scanPath<false, true, NONZERO>(context, state, filler) : scanPath<false, false, NONZERO>(context, state, filler);
+    }
+}
+
+void fillPath(SGLContext& context, const RasterState& state, const ScreenVertex* vertices,
+              const uint32_t* contours, size_t contourCount, sglEFillRule rule) {
+    // one edge table of all the contours
+    PolygonEdges& path = fillScratch.polygon;
+    startEdgeTable(context, path);
+    for (size_t i = 0; i < contourCount; i++) {
+        if (contours[i] > 0) {
+            addContourEdges(path, vertices, contours[i]);
+        }
+        vertices += contours[i];
+    }
+    finishEdgeTable(context, path);
+    SGL_TRACE_SCOPE("fillPath", "edges", static_cast<int64_t>(path.edges.size()));
+
+    FillingStruct& filler = startScan(context, path);
+    const bool clip = path.minX < 0 || path.maxX >= context.width;
+    if (rule == SGL_EVEN_ODD) {
+        scanPath<false>(context, state, filler, clip);
+    }
+    else {
+        scanPath<true>(context, state, filler, clip);
+    }
+}
+
+bool resolvePrimitiveKind(sglEElementType mode, sglEAreaMode areaMode, PrimitiveKind& kind) {
+    switch (mode) {
+        case SGL_POINTS:     
+            kind = PrimitiveKind::Points;
+            return true;
+        case SGL_LINES:      
+            kind = PrimitiveKind::Lines;
+            return true;
+        case SGL_LINE_STRIP: 
+            kind = PrimitiveKind::LineStrip;
+            return true;
+        case SGL_LINE_LOOP:  
+            kind = PrimitiveKind::LineLoop;
+            return true;
+        case SGL_TRIANGLES:
+            kind = areaMode == SGL_POINT ? PrimitiveKind::Points : PrimitiveKind::TriangleOutlines;
+            return true;
+        case SGL_POLYGON:    
+            switch (areaMode) {
+                case SGL_POINT: 
+                    kind = PrimitiveKind::Points;
+                    break;
+                case SGL_LINE:  
+                    kind = PrimitiveKind::LineLoop;
+                    break;
+                default:  
+                    kind = PrimitiveKind::Polygon;
+                    break;
+            }
+            return true;
+        default: 
+            return false;
+    }
+}
+
+void drawPrimitive(SGLContext& context, const RasterState& state, PrimitiveKind kind,
+                   const ScreenVertex* vertices, size_t count) {
+    switch (kind) {
+        case PrimitiveKind::Points:
+            drawPoints(context, state, vertices, count);
+            break;
+        case PrimitiveKind::Lines:
+            drawLines(context, state, vertices, count);
+            break;
+        case PrimitiveKind::LineStrip:
+            drawLineStrip(context, state, vertices, count);
+            break;
+        case PrimitiveKind::LineLoop:
+            drawLineLoop(context, state, vertices, count);
+            break;
+        case PrimitiveKind::TriangleOutlines:
+            drawTriangleOutlines(context, state, vertices, count);
+            break;
+        case PrimitiveKind::Polygon:
+            fillPolygon(context, state, vertices, count);
+            break;
+        case PrimitiveKind::MonotonePolygon:
+            fillMonotonePolygon(context, state, vertices, count);
+            break;
+    }
+}
+
+void clearBuffers(SGLContext& context, bool color, bool depth, const Pixel& clearColor) {
+    if (context.rasterBins) {
+        // primitives which the clear overwrites entirely are not drawn at all
+        if (color && depth) {
+            context.rasterBins->Discard();
+        }
+        else {
+            flushBinnedRaster(context);
+        }
+    }
+    if (color) {
+        // clearing the color buffer starts a new frame
+        SGL_STAT_FRAME_BEGIN(context);
+    }
+    SGL_STAT_PHASE(context, clearTime);
+    SGL_TRACE_SCOPE("sglClear", "buffers", (color ? SGL_COLOR_BUFFER_BIT : 0) | (depth ? SGL_DEPTH_BUFFER_BIT : 0));
+
+    if (color) {
+        // readers of a shared buffer skip the frame until it is published
+        context.colorBuffer->BeginFrame();
+        // only marks the tiles, the color is written as they are drawn
+        // into or read
+        context.colorBuffer->Clear(clearColor, *sceneManager->threadPool);
+    }
+    if (depth) {
+        // the buffer holds 1/z, this is an infinitely far plane
+        context.depthBuffer->Clear(0.0f);
     }
 }
@@ -3,27 +3,109 @@
 #include <iostream>
 
 /**
- * @brief Draws points based on the current context.
- * 
- * This function iterates through the primitives list in the current context
- * and draws points with the specified size and color.
+ * @brief The state a primitive is drawn with.
+ *
+ * Taken from the context when the primitive is submitted, so that it can be
+ * drawn later. Only the pixels of the window [minX, maxX] x [minY, maxY]
+ * (inside the canvas) are drawn, the others are skipped as if they failed
+ * the depth test.
+ */
+struct RasterState {
+    Pixel color;
+    bool depthTest;
+    int pointSize;
+    int minX;
+    int minY;
+    int maxX;
+    int maxY;
+};
+
+/**
+ * @brief The current state of the context, with the whole canvas as the window.
+ */
+RasterState rasterState(const SGLContext& context);
+
+/**
+ * @brief How the vertices of a sglBegin() / sglEnd() block are drawn, once
+ *        the primitive and area modes are resolved.
+ *
+ * Filled triangles and circles are kept apart, they are not drawn from
+ * screen vertices.
+ */
+enum class PrimitiveKind : uint8_t {
+    Points,
+    Lines,
+    LineStrip,
+    LineLoop,
+    TriangleOutlines,
+    Polygon,
+    // a polygon isMonotonePolygon() accepts, see fillMonotonePolygon()
+    MonotonePolygon,
+};
+
+/**
+ * @brief Resolves how the vertices of a sglBegin() / sglEnd() block are drawn.
+ *
+ * @param mode The primitive mode of the block.
+ * @param areaMode The area mode the block is drawn with.
+ * @param kind Set to the kind of primitive drawn.
+ * @return false if the block draws nothing. Filled triangles are not
+ *         resolved, the caller draws them with fillTriangles().
+ */
+bool resolvePrimitiveKind(sglEElementType mode, sglEAreaMode areaMode, PrimitiveKind& kind);
+
+/**
+ * @brief The edge table of a polygon, built once and scanned any number of times.
+ *
+ * The edges are bucketed by the row they become active in, from the top of
+ * the canvas down, so the scan activates them in order. Horizontal edges and
+ * the edges outside of the rows of the canvas are left out, the edges above
+ * it start at its top row. minX, maxX, minY and maxY bound all the edges
+ * before clipping to the canvas.
+ */
+struct PolygonEdges {
+    vector<Edge> edges;
+    int minX;
+    int maxX;
+    int minY;
+    int maxY;
+};
+
+/**
+ * @brief A circle in window coordinates.
+ */
+struct WindowCircle {
+    ScreenVertex center;
+    int radius;
+};
+
+/**
+ * @brief Draws points of the size of the state.
+ *
+ * @param context The context to draw into.
+ * @param state The state to draw with.
+ * @param vertices The points in window coordinates.
+ * @param count The number of the points.
  */
-void drawPoints();
+void drawPoints(SGLContext& context, const RasterState& state, const ScreenVertex* vertices, size_t count);
 
 /**
  * @brief Transforms a vertex using the current context's VPM matrix.
  * 
+ * @param context The context whose VPM matrix is used.
  * @param v The vertex to be transformed.
  * @return Vertex The transformed vertex.
  */
-Vertex transformPoint(const Vertex& v);
+Vertex transformPoint(const SGLContext& context, const Vertex& v);
 
 /**
- * @brief Sets the scale factor based on the current context's VPM matrix.
- * 
- * This function calculates and sets the scale factor used for transformations.
+ * @brief Divides a vertex already multiplied by the VPM matrix by its w and
+ *        maps its depth to [0, 1], the rest of transformPoint().
+ *
+ * @param v The vertex multiplied by the VPM matrix.
+ * @return Vertex The vertex in window coordinates.
  */
-void setScaleFactor();
+Vertex projectVertex(Vertex v);
 
 /**
  * @brief Determines the increment direction between two points.
@@ -34,44 +116,151 @@ void setScaleFactor();
  */
 int getIncrement(int start, int end);
 
+/**
+ * @brief Writes the pending clears of the color and depth buffers into the
+ *        tiles of the span [x1, x2] of row y, before it is drawn into.
+ */
+inline void touchSpan(SGLContext& context, FrameBuffer& colorBuffer, int y, int x1, int x2) {
+    colorBuffer.Touch(y, x1, x2);
+    context.depthBuffer->Touch(y, x1, x2);
+}
+
+/**
+ * @brief Fills one horizontal span with depth testing, without bounds checks.
+ *
+ * @param context The context to draw into.
+ * @param state The state to draw with.
+ * @param y The row of the span.
+ * @param x1 The first column of the span, inside the buffer.
+ * @param x2 The last column of the span, inside the buffer.
+ * @param z1 The depth at x1.
+ * @param z2 The depth at x2.
+ */
+void plotLine(SGLContext& context, const RasterState& state, int y, int x1, int x2, float z1, float z2);
+
 /**
  * @brief Draws a line using Bresenham's line algorithm.
  * 
+ * @param context The context to draw into.
+ * @param state The state to draw with.
  * @param v1 The starting vertex of the line.
  * @param v2 The ending vertex of the line.
  */
-void drawBresenhamLine(Vertex v1, Vertex v2);
+void drawBresenhamLine(SGLContext& context, const RasterState& state, ScreenVertex v1, ScreenVertex v2);
 
 /**
- * @brief Draws multiple lines based on the primitives list in the current context.
- * 
- * This function draws lines by connecting pairs of vertices in the primitives list.
+ * @brief Draws lines between the pairs of vertices, an odd vertex at the end is ignored.
  */
-void drawLines();
+void drawLines(SGLContext& context, const RasterState& state, const ScreenVertex* vertices, size_t count);
 
 /**
- * @brief Draws a line strip based on the primitives list in the current context.
- * 
- * This function draws connected lines by joining consecutive vertices in the primitives list.
+ * @brief Draws connected lines by joining consecutive vertices.
  */
-void drawLineStrip();
+void drawLineStrip(SGLContext& context, const RasterState& state, const ScreenVertex* vertices, size_t count);
 
 /**
- * @brief Draws a closed line loop based on the primitives list in the current context.
+ * @brief Draws a closed line loop.
  * 
- * This function draws connected lines by joining consecutive vertices and closing the loop
- * by connecting the last vertex to the first one.
+ * Joins consecutive vertices and closes the loop by connecting the last
+ * vertex to the first one.
  */
-void drawLineLoop();
+void drawLineLoop(SGLContext& context, const RasterState& state, const ScreenVertex* vertices, size_t count);
 
 /**
- * @brief Draws a circle using Bresenham's circle algorithm.
+ * @brief Transforms a circle into window coordinates.
  * 
+ * @param context The context whose VPM matrix and scale factor are used.
  * @param sX The x-coordinate of the circle's center.
  * @param sY The y-coordinate of the circle's center.
  * @param z The z-coordinate of the circle's center.
  * @param radius The radius of the circle.
  */
-void drawBresenhamCircle(float sX, float sY, float z, float radius);
+WindowCircle transformCircle(const SGLContext& context, float sX, float sY, float z, float radius);
 
-void fillPolygon();
+/**
+ * @brief Draws a circle using Bresenham's circle algorithm.
+ *
+ * @param context The context to draw into.
+ * @param state The state to draw with.
+ * @param circle The circle in window coordinates.
+ * @param filled Whether to fill the circle or draw its outline.
+ */
+void drawBresenhamCircle(SGLContext& context, const RasterState& state, const WindowCircle& circle, bool filled);
+
+/**
+ * @brief Draws the outlines of a triangle list.
+ *
+ * Every three consecutive vertices form a triangle, remaining vertices are ignored.
+ */
+void drawTriangleOutlines(SGLContext& context, const RasterState& state, const ScreenVertex* vertices, size_t count);
+
+/**
+ * @brief Fills the polygon of the vertices with the scanline algorithm.
+ */
+void fillPolygon(SGLContext& context, const RasterState& state, const ScreenVertex* vertices, size_t count);
+
+/**
+ * @brief Whether every row crosses the outline of the polygon at most twice,
+ *        the outline goes down once and up once.
+ *
+ * All the convex polygons are, and so are the sectors of sglArc(). Checked
+ * in one pass over the edges, the horizontal ones are skipped.
+ */
+bool isMonotonePolygon(const ScreenVertex* vertices, size_t count);
+
+/**
+ * @brief Fills a polygon isMonotonePolygon() accepts with the same pixels as
+ *        fillPolygon().
+ *
+ * Instead of an edge table and an active edge list, the two chains of edges
+ * from the top vertex down are walked, one edge of each at a time, and
+ * nothing is sorted.
+ */
+void fillMonotonePolygon(SGLContext& context, const RasterState& state, const ScreenVertex* vertices, size_t count);
+
+/**
+ * @brief Builds the edge table fillPolygonEdges() scans.
+ *
+ * @param context The context the polygon is drawn into.
+ * @param vertices The vertices of the polygon in window coordinates.
+ * @param count The number of the vertices, at least one.
+ * @param polygon Set to the edge table.
+ */
+void buildPolygonEdges(const SGLContext& context, const ScreenVertex* vertices, size_t count, PolygonEdges& polygon);
+
+/**
+ * @brief Fills the polygon of the edge table, the same as fillPolygon() does
+ *        for the vertices of the table.
+ */
+void fillPolygonEdges(SGLContext& context, const RasterState& state, const PolygonEdges& polygon);
+
+/**
+ * @brief Fills the contours of a path in one scan with an edge table shared
+ *        by all of them, see sglBeginPath().
+ *
+ * With SGL_EVEN_ODD a single contour covers the pixels fillPolygon() fills.
+ *
+ * @param vertices The vertices of the contours in window coordinates, one
+ *                 contour after another.
+ * @param contours The numbers of the vertices of the contours.
+ * @param contourCount The number of the contours.
+ * @param rule Which pixels are inside of the contours.
+ */
+void fillPath(SGLContext& context, const RasterState& state, const ScreenVertex* vertices,
+              const uint32_t* contours, size_t contourCount, sglEFillRule rule);
+
+/**
+ * @brief Draws the vertices as the kind of primitive says, see drawPoints() and the others.
+ */
+void drawPrimitive(SGLContext& context, const RasterState& state, PrimitiveKind kind,
+                   const ScreenVertex* vertices, size_t count);
+
+/**
+ * @brief Clears the buffers of the context, as sglClear() does after checking its arguments.
+ *
+ * @param context The context to clear.
+ * @param color Whether to clear the color buffer.
+ * @param depth Whether to clear the depth buffer.
+ * @param clearColor The color the color buffer is cleared to.
+ */
+void clearBuffers(SGLContext& context, bool color, bool depth, const Pixel& clearColor);
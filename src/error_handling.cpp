@@ -2,8 +2,9 @@
 
 void setErrCode(sglEErrorCode c)
 {
-  if (sceneManager->errorCode == SGL_NO_ERROR)
-      sceneManager->errorCode = c;
+  // the error flag is kept per thread, see SGLThreadState
+  if (threadState.errorCode == SGL_NO_ERROR)
+      threadState.errorCode = c;
 }
 
 //---------------------------------------------------------------------------
@@ -11,8 +12,8 @@ void setErrCode(sglEErrorCode c)
 //---------------------------------------------------------------------------
 sglEErrorCode sglGetError(void)
 {
-  sglEErrorCode ret = sceneManager->errorCode;
-  sceneManager->errorCode = SGL_NO_ERROR;
+  sglEErrorCode ret = threadState.errorCode;
+  threadState.errorCode = SGL_NO_ERROR;
   return ret;
 }
 
@@ -0,0 +1,162 @@
+#include "frame_buffer.h"
+#include <algorithm>
+
+using std::make_unique;
+
+#if defined(__unix__) || defined(__APPLE__)
+#define SGL_SHARED_MEMORY
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+// Offset of the pixels in a shared segment, keeps the rows cache line aligned
+static const size_t SHARED_FRAME_OFFSET = 64;
+static_assert(sizeof(SGLSharedFrameHeader) <= SHARED_FRAME_OFFSET, "header must fit before the pixels");
+
+FrameBuffer::FrameBuffer(int width, int height) :
+  width(width),
+  height(height),
+  stride(width * sizeof(Pixel)),
+  clearTiles(width, height),
+  deferClear(true),
+  pixels(make_unique<PageBuffer<Pixel>>(static_cast<size_t>(width) * height)),
+  header(nullptr),
+  mappingSize(0) {
+    data = reinterpret_cast<uint8_t*>(pixels->data());
+}
+
+FrameBuffer::FrameBuffer(int width, int height, void* memory, size_t stride) :
+  width(width),
+  height(height),
+  stride(stride),
+  data(static_cast<uint8_t*>(memory)),
+  clearTiles(width, height),
+  deferClear(false),
+  header(nullptr),
+  mappingSize(0) {
+}
+
+FrameBuffer::~FrameBuffer() {
+#ifdef SGL_SHARED_MEMORY
+    if (header) {
+        munmap(header, mappingSize);
+        shm_unlink(sharedName.c_str());
+    }
+#endif
+}
+
+unique_ptr<FrameBuffer> FrameBuffer::CreateShared(const char* name, int width, int height) {
+#ifdef SGL_SHARED_MEMORY
+    const size_t stride = width * sizeof(Pixel);
+    const size_t size = SHARED_FRAME_OFFSET + stride * height;
+
+    // exclusive, an existing segment may belong to another application
+    const int fd = shm_open(name, O_CREAT | O_EXCL | O_RDWR, 0600);
+    if (fd < 0) {
+        return nullptr;
+    }
+    void* mapping = MAP_FAILED;
+    if (ftruncate(fd, static_cast<off_t>(size)) == 0) {
+        mapping = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    }
+    // the mapping keeps the segment alive
+    close(fd);
+    if (mapping == MAP_FAILED) {
+        shm_unlink(name);
+        return nullptr;
+    }
+
+    // the new segment is zero filled, i.e. black and at sequence number 0
+    SGLSharedFrameHeader* header = static_cast<SGLSharedFrameHeader*>(mapping);
+    header->magic = SGL_SHARED_FRAME_MAGIC;
+    header->headerSize = sizeof(SGLSharedFrameHeader);
+    header->width = width;
+    header->height = height;
+    header->stride = stride;
+    header->offset = SHARED_FRAME_OFFSET;
+
+    unique_ptr<FrameBuffer> buffer(new FrameBuffer(width, height,
+                                                   static_cast<uint8_t*>(mapping) + SHARED_FRAME_OFFSET, stride));
+    // readers only look at published frames, which are resolved
+    buffer->deferClear = true;
+    buffer->header = header;
+    buffer->mappingSize = size;
+    buffer->sharedName = name;
+    return buffer;
+#else
+    (void)name;
+    (void)width;
+    (void)height;
+    return nullptr;
+#endif
+}
+
+void FrameBuffer::Clear(const Pixel& color, ThreadPool& pool) {
+    clearColor = color;
+    clearTiles.MarkAll();
+    if (!deferClear) {
+        Resolve(pool);
+    }
+}
+
+void FrameBuffer::Resolve(ThreadPool& pool) {
+    // the tiles nobody drew into are not read again soon, they bypass the caches
+    clearTiles.Resolve(pool, [this](int x0, int y0, int x1, int y1) {
+        fillRect(x0, y0, x1, y1, true);
+    });
+}
+
+void FrameBuffer::fillRect(int x0, int y0, int x1, int y1, bool stream) {
+    const float pattern[3] = { clearColor.r, clearColor.g, clearColor.b };
+    for (int y = y0; y < y1; y++) {
+        if (stream) {
+            streamFill(reinterpret_cast<float*>(Row(y) + x0), static_cast<size_t>(x1 - x0) * 3, pattern, 3);
+        }
+        else {
+            std::fill(Row(y) + x0, Row(y) + x1, clearColor);
+        }
+    }
+    if (stream) {
+        streamFence();
+    }
+}
+
+// The sequence number is a seqlock shared with the readers in other
+// processes, only the thread rendering the context changes it
+void FrameBuffer::BeginFrame() {
+#ifdef SGL_SHARED_MEMORY
+    if (!header) {
+        return;
+    }
+    const unsigned long long sequence = __atomic_load_n(&header->sequence, __ATOMIC_RELAXED);
+    if (sequence % 2 == 0) {
+        __atomic_store_n(&header->sequence, sequence + 1, __ATOMIC_RELAXED);
+        // the pixels must not change before the readers can see the odd number
+        __atomic_thread_fence(__ATOMIC_RELEASE);
+    }
+#endif
+}
+
+void FrameBuffer::PublishFrame() {
+#ifdef SGL_SHARED_MEMORY
+    if (!header) {
+        return;
+    }
+    const unsigned long long sequence = __atomic_load_n(&header->sequence, __ATOMIC_RELAXED);
+    __atomic_store_n(&header->sequence, sequence + (sequence % 2 ? 1 : 2), __ATOMIC_RELEASE);
+#endif
+}
+
+DepthBuffer::DepthBuffer(int width, int height, float initial) :
+  width(width),
+  values(static_cast<size_t>(width) * height),
+  clearTiles(width, height),
+  clearValue(initial) {
+    clearTiles.MarkAll();
+}
+
+void DepthBuffer::Clear(float value) {
+    clearValue = value;
+    clearTiles.MarkAll();
+}
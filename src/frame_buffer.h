@@ -0,0 +1,166 @@
+#pragma once
+
+#include "sgl.h"
+#include "structures.h"
+#include "page_buffer.h"
+#include "thread_pool.h"
+#include "tile_clear.h"
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+using std::string;
+using std::unique_ptr;
+
+/**
+ * @file frame_buffer.h
+ * @brief Color and depth buffers of a context
+ */
+
+/**
+ * @brief Rows of float RGB pixels, row 0 is the bottom row of the image.
+ *
+ * The memory is allocated by the buffer itself, provided by the application
+ * (sglCreateContextWithBuffer()) or placed in a named POSIX shared memory
+ * segment after an SGLSharedFrameHeader (sglCreateSharedContext()). Rows are
+ * Stride() bytes apart, which may be more than the pixels of a row take.
+ */
+class FrameBuffer {
+public:
+    /**
+     * @brief Allocates a buffer of tightly packed black rows owned by the buffer.
+     *
+     * The pages are committed as the rows are first written.
+     */
+    FrameBuffer(int width, int height);
+
+    /**
+     * @brief Wraps memory of the application, which must outlive the buffer.
+     *
+     * @param memory Address of the bottom row, aligned for floats.
+     * @param stride Distance between the starts of consecutive rows in bytes.
+     */
+    FrameBuffer(int width, int height, void* memory, size_t stride);
+
+    ~FrameBuffer();
+
+    FrameBuffer(const FrameBuffer&) = delete;
+    FrameBuffer& operator=(const FrameBuffer&) = delete;
+
+    /**
+     * @brief Creates the shared memory segment and maps the buffer into it.
+     *
+     * The segment is created exclusively and removed again when the buffer
+     * is destroyed.
+     *
+     * @param name Name of the segment as for shm_open(), e.g. "/sgl-frames".
+     * @return The buffer, or nullptr if the segment could not be created or
+     *         shared memory is not supported by the platform.
+     */
+    static unique_ptr<FrameBuffer> CreateShared(const char* name, int width, int height);
+
+    Pixel* Row(int y) {
+        return reinterpret_cast<Pixel*>(data + static_cast<size_t>(y) * stride);
+    }
+    const Pixel* Row(int y) const {
+        return reinterpret_cast<const Pixel*>(data + static_cast<size_t>(y) * stride);
+    }
+
+    Pixel& At(int x, int y) { return Row(y)[x]; }
+    const Pixel& At(int x, int y) const { return Row(y)[x]; }
+
+    /// Address of the bottom row, as returned by sglGetColorBufferPointer().
+    float* Data() { return reinterpret_cast<float*>(data); }
+
+    size_t Stride() const { return stride; }
+
+    /// Sets all the pixels to the color, deferred for the buffers which allow it.
+    void Clear(const Pixel& color, ThreadPool& pool);
+
+    /// Writes a pending clear into the span [x1, x2] of row y before it is drawn into.
+    void Touch(int y, int x1, int x2) {
+        clearTiles.Touch(y, x1, x2, [this](int x0, int y0, int x1, int y1) {
+            fillRect(x0, y0, x1, y1, false);
+        });
+    }
+
+    /// Writes all the pending clears, before the pixels are read.
+    void Resolve(ThreadPool& pool);
+
+    /// Drops the pending clears, the caller overwrites every pixel.
+    void DiscardClear() { clearTiles.Discard(); }
+
+    /**
+     * @brief Marks the start of a frame for the readers of a shared buffer.
+     *
+     * Makes the sequence number odd, so that readers know the pixels are
+     * being changed. Does nothing for buffers which are not shared.
+     */
+    void BeginFrame();
+
+    /**
+     * @brief Publishes the pixels as a complete frame.
+     *
+     * Makes the sequence number even again, a frame drawn without a
+     * BeginFrame() still advances it by one frame.
+     */
+    void PublishFrame();
+
+private:
+    // sets the pixels x0 <= x < x1, y0 <= y < y1 to the pending clear color
+    void fillRect(int x0, int y0, int x1, int y1, bool stream);
+
+    int width;
+    int height;
+    size_t stride;
+    uint8_t* data;
+
+    TileClear clearTiles;
+    Pixel clearColor;
+    // false for memory of the application
+    bool deferClear;
+
+    // storage of buffers allocated by the library, nullptr for the others
+    unique_ptr<PageBuffer<Pixel>> pixels;
+
+    // shared memory segment, header is nullptr for other buffers
+    SGLSharedFrameHeader* header;
+    size_t mappingSize;
+    string sharedName;
+};
+
+/**
+ * @brief Float depth values, one per pixel, packed row by row.
+ *
+ * The values are 1/z, see span_kernels.h.
+ * Clears are deferred per tile as for the FrameBuffer. The pages are
+ * committed as the tiles are first used.
+ */
+class DepthBuffer {
+public:
+    /// Starts with all the values pending as initial.
+    DepthBuffer(int width, int height, float initial);
+
+    float& operator[](size_t index) { return values[index]; }
+
+    float* Row(int y) { return values.data() + static_cast<size_t>(y) * width; }
+
+    void Clear(float value);
+
+    /// Writes a pending clear into the span [x1, x2] of row y before it is used.
+    void Touch(int y, int x1, int x2) {
+        clearTiles.Touch(y, x1, x2, [this](int x0, int y0, int x1, int y1) {
+            for (int y = y0; y < y1; y++) {
+                float* row = values.data() + static_cast<size_t>(y) * width;
+                std::fill(row + x0, row + x1, clearValue);
+            }
+        });
+    }
+
+private:
+    int width;
+    PageBuffer<float> values;
+    TileClear clearTiles;
+    float clearValue;
+};
@@ -1,58 +1,162 @@
 #include "context.h"
+#include "command_buffer.h"
+#include <cstdint>
 #include <iostream>
 #include <memory>
+#include <new>
 
 using std::unique_ptr;
 
 unique_ptr<SGLSceneManager> sceneManager;
 
 void sglInit(void) {
+    SGL_CAPTURE(CAPTURE_INIT);
     sceneManager = std::make_unique<SGLSceneManager>();
 }
 
 void sglFinish(void) {
+    SGL_CAPTURE(CAPTURE_FINISH);
+    if (sceneManager) {
+        // the submitted command buffers are drawn before the contexts go away
+        std::lock_guard<std::mutex> lock(sceneManager->contextsMutex);
+        for (auto& context : sceneManager->contexts) {
+            if (context) {
+                executeCommandBuffers(*context);
+                flushBinnedRaster(*context);
+            }
+        }
+    }
+    sceneManager.reset();
+}
+
+// Stores the context in the first free slot and returns its id
+static int registerContext(unique_ptr<SGLContext> context) {
+    std::lock_guard<std::mutex> lock(sceneManager->contextsMutex);
+    auto& contexts = sceneManager->contexts;
+    for (size_t id = 0; id < contexts.size(); id++) {
+        if (!contexts[id]) {
+            contexts[id] = std::move(context);
+            return id;
+        }
+    }
+    contexts.push_back(std::move(context));
+    return contexts.size() - 1;
 }
 
 int sglCreateContext(int width, int height) {
-    unique_ptr<SGLContext> context = std::make_unique<SGLContext>(width, height);
-    sceneManager->contexts.push_back(std::move(context));
-    return sceneManager->contexts.size() - 1;
+    SGL_CAPTURE(CAPTURE_CREATE_CONTEXT, width, height);
+    try {
+        return registerContext(std::make_unique<SGLContext>(width, height));
+    }
+    catch (const std::bad_alloc&) {
+        setErrCode(SGL_OUT_OF_MEMORY);
+        return -1;
+    }
 }
 
-bool isValidContextId(size_t id) {
-    return id >= 0 && id < sceneManager->contexts.size();
+int sglCreateContextWithBuffer(int width, int height, void *color, size_t stride) {
+    SGL_CAPTURE(CAPTURE_CREATE_CONTEXT_WITH_BUFFER, width, height, static_cast<uint32_t>(stride));
+    const size_t rowSize = static_cast<size_t>(width) * sizeof(Pixel);
+    if (stride == 0) {
+        stride = rowSize;
+    }
+    if (width <= 0 || height <= 0 || !color ||
+        reinterpret_cast<uintptr_t>(color) % alignof(float) != 0 ||
+        stride % alignof(float) != 0 || stride < rowSize) {
+        setErrCode(SGL_INVALID_VALUE);
+        return -1;
+    }
+    try {
+        return registerContext(std::make_unique<SGLContext>(
+            width, height, std::make_unique<FrameBuffer>(width, height, color, stride)));
+    }
+    catch (const std::bad_alloc&) {
+        setErrCode(SGL_OUT_OF_MEMORY);
+        return -1;
+    }
 }
 
-void sglDestroyContext(int id) {
-    if (!isValidContextId(id)) {
+int sglCreateSharedContext(int width, int height, const char *name) {
+    SGL_CAPTURE(CAPTURE_CREATE_SHARED_CONTEXT, width, height);
+    if (width <= 0 || height <= 0 || !name) {
         setErrCode(SGL_INVALID_VALUE);
-        return;
+        return -1;
     }
-    if (id == sceneManager->currentContextId) {
-        setErrCode(SGL_INVALID_OPERATION);
-        return;
+    unique_ptr<FrameBuffer> colorBuffer = FrameBuffer::CreateShared(name, width, height);
+    if (!colorBuffer) {
+        setErrCode(SGL_OUT_OF_RESOURCES);
+        return -1;
     }
-    sceneManager->contexts.erase(sceneManager->contexts.begin() + id);
+    try {
+        return registerContext(std::make_unique<SGLContext>(width, height, std::move(colorBuffer)));
+    }
+    catch (const std::bad_alloc&) {
+        setErrCode(SGL_OUT_OF_MEMORY);
+        return -1;
+    }
+}
+
+void sglDestroyContext(int id) {
+    SGL_CAPTURE(CAPTURE_DESTROY_CONTEXT, id);
+    unique_ptr<SGLContext> destroyed;
+    {
+        std::lock_guard<std::mutex> lock(sceneManager->contextsMutex);
+        if (!sceneManager->isValidContextId(id)) {
+            setErrCode(SGL_INVALID_VALUE);
+            return;
+        }
+        // selected by this or any other thread
+        if (sceneManager->contexts[id]->boundThreads > 0) {
+            setErrCode(SGL_INVALID_OPERATION);
+            return;
+        }
+        destroyed = std::move(sceneManager->contexts[id]);
+    }
+    // the buffers are released outside of the lock
 }
 
 void sglSetContext(int id) {
-    if (!isValidContextId(id)) {
-        setErrCode(SGL_INVALID_VALUE);
+    SGL_CAPTURE(CAPTURE_SET_CONTEXT, id);
+    if (sceneManager->hasCurrentContext() && calledWhileRecording()) {
         return;
     }
-    sceneManager->currentContextId = id;
+    if (id == -1 || !sceneManager->selectContext(id)) {
+        setErrCode(SGL_INVALID_VALUE);
+    }
 }
 
 int sglGetContext(void) {
-    if (sceneManager->currentContextId == -1) {
+    if (!sceneManager->hasCurrentContext()) {
         setErrCode(SGL_INVALID_OPERATION);
+        return -1;
     }
-    return sceneManager->currentContextId;
+    return threadState.currentContextId;
 }
 
 float *sglGetColorBufferPointer(void) {
-    if (!isValidContextId(sceneManager->currentContextId)) {
+    if (!sceneManager || !sceneManager->hasCurrentContext()) {
+        return nullptr;
+    }
+    SGLContext& context = sceneManager->getCurrentContext();
+    if (context.recording) {
+        // a recording context has no pixels
         return nullptr;
     }
-    return reinterpret_cast<float *>(sceneManager->getCurrentContext().colorBuffer->data());
+    flushBinnedRaster(context);
+    FrameBuffer& colorBuffer = *context.colorBuffer;
+    // the application reads the pixels through the pointer
+    colorBuffer.Resolve(*sceneManager->threadPool);
+    return colorBuffer.Data();
+}
+
+void sglPublishFrame(void) {
+    SGL_CAPTURE(CAPTURE_PUBLISH_FRAME);
+    if (contextNotInitialized() || calledWithinBeginEnd() || calledWhileRecording()) {
+        return;
+    }
+    SGLContext& context = sceneManager->getCurrentContext();
+    flushBinnedRaster(context);
+    FrameBuffer& colorBuffer = *context.colorBuffer;
+    colorBuffer.Resolve(*sceneManager->threadPool);
+    colorBuffer.PublishFrame();
 }
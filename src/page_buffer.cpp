@@ -0,0 +1,93 @@
+#include "page_buffer.h"
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+// Buffers of at least this size are placed on huge page boundaries, the
+// common huge page size of x86-64 and AArch64
+static const size_t HUGE_PAGE_SIZE = 2 << 20;
+
+// Smaller buffers come from the heap, a mapping costs more than zeroing them
+static const size_t SMALL_BUFFER_SIZE = 64 << 10;
+
+// Alignment of heap buffers, a cache line
+static const size_t SMALL_BUFFER_ALIGNMENT = 64;
+
+void* pageAllocate(size_t bytes) {
+    if (bytes == 0) {
+        return nullptr;
+    }
+#ifdef _WIN32
+    // committed pages are zero filled and backed on first touch as well
+    void* memory = VirtualAlloc(nullptr, bytes, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+    if (!memory) {
+        throw std::bad_alloc();
+    }
+    return memory;
+#else
+    if (bytes < SMALL_BUFFER_SIZE) {
+        void* memory = nullptr;
+        if (posix_memalign(&memory, SMALL_BUFFER_ALIGNMENT, bytes) != 0) {
+            throw std::bad_alloc();
+        }
+        memset(memory, 0, bytes);
+        return memory;
+    }
+    if (bytes < HUGE_PAGE_SIZE) {
+        void* memory = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (memory == MAP_FAILED) {
+            throw std::bad_alloc();
+        }
+        return memory;
+    }
+
+    // over-allocate by a huge page and cut off the unaligned ends, so that
+    // the whole buffer can be backed by huge pages
+    const size_t mapped = bytes + HUGE_PAGE_SIZE;
+    void* mapping = mmap(nullptr, mapped, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (mapping == MAP_FAILED) {
+        throw std::bad_alloc();
+    }
+    const uintptr_t start = reinterpret_cast<uintptr_t>(mapping);
+    const uintptr_t aligned = (start + HUGE_PAGE_SIZE - 1) & ~(uintptr_t)(HUGE_PAGE_SIZE - 1);
+    if (aligned > start) {
+        munmap(mapping, aligned - start);
+    }
+    // the buffer may end inside a page, only the pages after it are released
+    const uintptr_t end = aligned + bytes;
+    const uintptr_t mappingEnd = start + mapped;
+    const uintptr_t pageSize = static_cast<uintptr_t>(sysconf(_SC_PAGESIZE));
+    const uintptr_t tail = (end + pageSize - 1) & ~(pageSize - 1);
+    if (mappingEnd > tail) {
+        munmap(reinterpret_cast<void*>(tail), mappingEnd - tail);
+    }
+#ifdef MADV_HUGEPAGE
+    madvise(reinterpret_cast<void*>(aligned), bytes, MADV_HUGEPAGE);
+#endif
+    return reinterpret_cast<void*>(aligned);
+#endif
+}
+
+void pageFree(void* memory, size_t bytes) {
+    if (!memory) {
+        return;
+    }
+#ifdef _WIN32
+    (void)bytes;
+    VirtualFree(memory, 0, MEM_RELEASE);
+#else
+    if (bytes < SMALL_BUFFER_SIZE) {
+        free(memory);
+        return;
+    }
+    munmap(memory, bytes);
+#endif
+}
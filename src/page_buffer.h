@@ -0,0 +1,64 @@
+#pragma once
+
+#include <cstddef>
+#include <type_traits>
+
+/**
+ * @file page_buffer.h
+ * @brief Large buffers in lazily committed pages
+ */
+
+/**
+ * @brief Maps zero filled memory directly from the system.
+ *
+ * The pages are committed only when they are first touched, so the call
+ * takes the same time for any size. The memory is aligned to a page, large
+ * allocations to a huge page and advised to use transparent huge pages.
+ * Small allocations are zeroed heap blocks aligned to a cache line.
+ *
+ * @throws std::bad_alloc if the memory cannot be mapped.
+ */
+void* pageAllocate(size_t bytes);
+
+/**
+ * @brief Returns memory of pageAllocate() of the same size to the system.
+ */
+void pageFree(void* memory, size_t bytes);
+
+/**
+ * @brief Fixed size array in memory of pageAllocate().
+ *
+ * Elements start as all zero bits, e.g. 0.0f or a black Pixel, without the
+ * buffer writing them.
+ */
+template <typename T>
+class PageBuffer {
+    static_assert(std::is_trivially_copyable<T>::value, "elements are not constructed");
+
+public:
+    explicit PageBuffer(size_t count) :
+      elements(static_cast<T*>(pageAllocate(count * sizeof(T)))),
+      count(count) {
+    }
+
+    ~PageBuffer() {
+        pageFree(elements, count * sizeof(T));
+    }
+
+    PageBuffer(const PageBuffer&) = delete;
+    PageBuffer& operator=(const PageBuffer&) = delete;
+
+    T* data() { return elements; }
+    const T* data() const { return elements; }
+    size_t size() const { return count; }
+
+    T& operator[](size_t index) { return elements[index]; }
+    const T& operator[](size_t index) const { return elements[index]; }
+
+    T* begin() { return elements; }
+    T* end() { return elements + count; }
+
+private:
+    T* elements;
+    size_t count;
+};
@@ -0,0 +1,347 @@
+#include "raster_bins.h"
+#include "triangle_raster.h"
+#include <algorithm>
+#include <cmath>
+
+using std::max;
+using std::min;
+
+namespace {
+
+// Triangles reaching further are added to every tile, their boxes would not
+// fit the integers and fillTriangle() clips them anyway
+const float TRIANGLE_BOX_LIMIT = float(1 << 30);
+
+// The scanline filler rounds the positions of its edges, the spans may end
+// a pixel outside of the vertices
+const int POLYGON_MARGIN = 2;
+
+} // namespace
+
+RasterBins::RasterBins(int width, int height) :
+  width(width),
+  height(height),
+  tilesX((width + BIN_TILE_SIZE - 1) / BIN_TILE_SIZE),
+  tilesY((height + BIN_TILE_SIZE - 1) / BIN_TILE_SIZE),
+  bins(static_cast<size_t>(tilesX) * tilesY) {
+}
+
+void RasterBins::add(const RasterState& state, Kind kind, uint32_t first, uint32_t count,
+                     int64_t minX, int64_t minY, int64_t maxX, int64_t maxY) {
+    minX = max<int64_t>(minX, 0);
+    minY = max<int64_t>(minY, 0);
+    maxX = min<int64_t>(maxX, width - 1);
+    maxY = min<int64_t>(maxY, height - 1);
+    if (minX > maxX || minY > maxY) {
+        return;
+    }
+
+    const uint32_t index = static_cast<uint32_t>(commands.size());
+    Command command;
+    command.color = state.color;
+    command.kind = kind;
+    command.depthTest = state.depthTest;
+    command.pointSize = state.pointSize;
+    command.first = first;
+    command.count = count;
+    commands.push_back(command);
+
+    const int lastX = static_cast<int>(maxX) >> BIN_TILE_SHIFT;
+    const int lastY = static_cast<int>(maxY) >> BIN_TILE_SHIFT;
+    for (int tileY = static_cast<int>(minY) >> BIN_TILE_SHIFT; tileY <= lastY; tileY++) {
+        for (int tileX = static_cast<int>(minX) >> BIN_TILE_SHIFT; tileX <= lastX; tileX++) {
+            const int tile = tileY * tilesX + tileX;
+            vector<uint32_t>& bin = bins[tile];
+            if (bin.empty()) {
+                usedTiles.push_back(tile);
+            }
+            bin.push_back(index);
+        }
+    }
+}
+
+void RasterBins::Add(const RasterState& state, PrimitiveKind kind, const ScreenVertex* vertices, size_t count) {
+    switch (kind) {
+        case PrimitiveKind::Points:
+            AddPoints(state, vertices, count);
+            break;
+        case PrimitiveKind::Lines:
+            AddLines(state, vertices, count);
+            break;
+        case PrimitiveKind::LineStrip:
+            AddLineStrip(state, vertices, count);
+            break;
+        case PrimitiveKind::LineLoop:
+            AddLineLoop(state, vertices, count);
+            break;
+        case PrimitiveKind::TriangleOutlines:
+            AddTriangleOutlines(state, vertices, count);
+            break;
+        case PrimitiveKind::Polygon:
+            AddPolygon(state, vertices, count);
+            break;
+        case PrimitiveKind::MonotonePolygon:
+            AddMonotonePolygon(state, vertices, count);
+            break;
+    }
+}
+
+void RasterBins::AddPoints(const RasterState& state, const ScreenVertex* vertices, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        const ScreenVertex& v = vertices[i];
+        const uint32_t first = static_cast<uint32_t>(screenVertices.size());
+        screenVertices.push_back(v);
+        add(state, Kind::Point, first, 1,
+            v.x, v.y, int64_t(v.x) + state.pointSize - 1, int64_t(v.y) + state.pointSize - 1);
+    }
+}
+
+void RasterBins::addSegment(const RasterState& state, const ScreenVertex& a, const ScreenVertex& b) {
+    const uint32_t first = static_cast<uint32_t>(screenVertices.size());
+    screenVertices.push_back(a);
+    screenVertices.push_back(b);
+    add(state, Kind::Segment, first, 2, min(a.x, b.x), min(a.y, b.y), max(a.x, b.x), max(a.y, b.y));
+}
+
+// The segments are split in the order drawLines() and the others draw them
+
+void RasterBins::AddLines(const RasterState& state, const ScreenVertex* vertices, size_t count) {
+    for (size_t i = 0; i + 1 < count; i += 2) {
+        addSegment(state, vertices[i], vertices[i + 1]);
+    }
+}
+
+void RasterBins::AddLineStrip(const RasterState& state, const ScreenVertex* vertices, size_t count) {
+    for (size_t i = 0; i + 1 < count; i++) {
+        addSegment(state, vertices[i], vertices[i + 1]);
+    }
+}
+
+void RasterBins::AddLineLoop(const RasterState& state, const ScreenVertex* vertices, size_t count) {
+    if (count < 2) {
+        return;
+    }
+    AddLineStrip(state, vertices, count);
+    addSegment(state, vertices[count - 1], vertices[0]);
+}
+
+void RasterBins::AddTriangleOutlines(const RasterState& state, const ScreenVertex* vertices, size_t count) {
+    for (size_t i = 0; i + 2 < count; i += 3) {
+        addSegment(state, vertices[i], vertices[i + 1]);
+        addSegment(state, vertices[i + 1], vertices[i + 2]);
+        addSegment(state, vertices[i + 2], vertices[i]);
+    }
+}
+
+void RasterBins::AddPolygon(const RasterState& state, const ScreenVertex* vertices, size_t count) {
+    addPolygon(state, Kind::Polygon, vertices, count);
+}
+
+void RasterBins::AddMonotonePolygon(const RasterState& state, const ScreenVertex* vertices, size_t count) {
+    addPolygon(state, Kind::MonotonePolygon, vertices, count);
+}
+
+void RasterBins::addPolygon(const RasterState& state, Kind kind, const ScreenVertex* vertices, size_t count) {
+    if (count == 0) {
+        return;
+    }
+    int64_t minX = vertices[0].x;
+    int64_t minY = vertices[0].y;
+    int64_t maxX = vertices[0].x;
+    int64_t maxY = vertices[0].y;
+    for (size_t i = 1; i < count; i++) {
+        minX = min<int64_t>(minX, vertices[i].x);
+        minY = min<int64_t>(minY, vertices[i].y);
+        maxX = max<int64_t>(maxX, vertices[i].x);
+        maxY = max<int64_t>(maxY, vertices[i].y);
+    }
+
+    const uint32_t first = static_cast<uint32_t>(screenVertices.size());
+    screenVertices.insert(screenVertices.end(), vertices, vertices + count);
+    add(state, kind, first, static_cast<uint32_t>(count),
+        minX - POLYGON_MARGIN, minY, maxX + POLYGON_MARGIN, maxY);
+}
+
+void RasterBins::AddTriangles(const RasterState& state, const Vertex* vertices, size_t count) {
+    for (size_t i = 0; i + 2 < count; i += 3) {
+        int64_t minX = 0;
+        int64_t minY = 0;
+        int64_t maxX = width - 1;
+        int64_t maxY = height - 1;
+        bool bounded = true;
+        for (size_t k = i; k < i + 3; k++) {
+            // also false for NaN
+            bounded &= std::fabs(vertices[k].x) < TRIANGLE_BOX_LIMIT &&
+                        std::fabs(vertices[k].y) < TRIANGLE_BOX_LIMIT;
+        }
+        if (bounded) {
+            const Vertex& a = vertices[i];
+            const Vertex& b = vertices[i + 1];
+            const Vertex& c = vertices[i + 2];
+            minX = static_cast<int64_t>(std::floor(min({ a.x, b.x, c.x }))) - 1;
+            minY = static_cast<int64_t>(std::floor(min({ a.y, b.y, c.y }))) - 1;
+            maxX = static_cast<int64_t>(std::ceil(max({ a.x, b.x, c.x }))) + 1;
+            maxY = static_cast<int64_t>(std::ceil(max({ a.y, b.y, c.y }))) + 1;
+        }
+
+        const uint32_t first = static_cast<uint32_t>(windowVertices.size());
+        windowVertices.insert(windowVertices.end(), vertices + i, vertices + i + 3);
+        add(state, Kind::Triangle, first, 3, minX, minY, maxX, maxY);
+    }
+}
+
+void RasterBins::AddCircle(const RasterState& state, const WindowCircle& circle, bool filled) {
+    const uint32_t first = static_cast<uint32_t>(screenVertices.size());
+    screenVertices.push_back(circle.center);
+    const int64_t reach = std::abs(int64_t(circle.radius)) + 1;
+    add(state, filled ? Kind::Circle : Kind::CircleOutline, first, static_cast<uint32_t>(circle.radius),
+        circle.center.x - reach, circle.center.y - reach, circle.center.x + reach, circle.center.y + reach);
+}
+
+void RasterBins::AddPath(const RasterState& state, const ScreenVertex* vertices, const uint32_t* contours,
+                         size_t contourCount, sglEFillRule rule) {
+    size_t count = 0;
+    for (size_t i = 0; i < contourCount; i++) {
+        count += contours[i];
+    }
+    if (count == 0) {
+        return;
+    }
+    int64_t minX = vertices[0].x;
+    int64_t minY = vertices[0].y;
+    int64_t maxX = vertices[0].x;
+    int64_t maxY = vertices[0].y;
+    for (size_t i = 1; i < count; i++) {
+        minX = min<int64_t>(minX, vertices[i].x);
+        minY = min<int64_t>(minY, vertices[i].y);
+        maxX = max<int64_t>(maxX, vertices[i].x);
+        maxY = max<int64_t>(maxY, vertices[i].y);
+    }
+
+    Path path;
+    path.firstContour = static_cast<uint32_t>(this->contours.size());
+    path.contourCount = static_cast<uint32_t>(contourCount);
+    path.rule = rule;
+    this->contours.insert(this->contours.end(), contours, contours + contourCount);
+    const uint32_t first = static_cast<uint32_t>(screenVertices.size());
+    screenVertices.insert(screenVertices.end(), vertices, vertices + count);
+    const uint32_t index = static_cast<uint32_t>(paths.size());
+    paths.push_back(path);
+    add(state, Kind::Path, first, index, minX - POLYGON_MARGIN, minY, maxX + POLYGON_MARGIN, maxY);
+}
+
+void RasterBins::Discard() {
+    for (int tile : usedTiles) {
+        bins[tile].clear();
+    }
+    usedTiles.clear();
+    commands.clear();
+    screenVertices.clear();
+    windowVertices.clear();
+    paths.clear();
+    contours.clear();
+}
+
+void RasterBins::draw(SGLContext& context, const Command& command, const RasterState& window) const {
+    RasterState state = window;
+    state.color = command.color;
+    state.depthTest = command.depthTest;
+    state.pointSize = command.pointSize;
+
+    const ScreenVertex* vertices = screenVertices.data() + command.first;
+    switch (command.kind) {
+        case Kind::Point:
+            drawPoints(context, state, vertices, 1);
+            break;
+        case Kind::Segment:
+            drawBresenhamLine(context, state, vertices[0], vertices[1]);
+            break;
+        case Kind::Polygon:
+            fillPolygon(context, state, vertices, command.count);
+            break;
+        case Kind::MonotonePolygon:
+            fillMonotonePolygon(context, state, vertices, command.count);
+            break;
+        case Kind::Triangle: {
+            const Vertex* corners = windowVertices.data() + command.first;
+            fillTriangle(context, state, corners[0], corners[1], corners[2]);
+            break;
+        }
+        case Kind::Circle:
+        case Kind::CircleOutline: {
+            WindowCircle circle;
+            circle.center = vertices[0];
+            circle.radius = static_cast<int>(command.count);
+            drawBresenhamCircle(context, state, circle, command.kind == Kind::Circle);
+            break;
+        }
+        case Kind::Path: {
+            const Path& path = paths[command.count];
+            fillPath(context, state, vertices, contours.data() + path.firstContour, path.contourCount, path.rule);
+            break;
+        }
+    }
+}
+
+void RasterBins::Flush(SGLContext& context, ThreadPool& pool) {
+    if (Empty()) {
+        return;
+    }
+    SGL_TRACE_SCOPE("RasterBins::Flush", "tiles", static_cast<int64_t>(usedTiles.size()));
+
+    pool.parallelFor(static_cast<int>(usedTiles.size()), [&](int i) {
+        const int tile = usedTiles[i];
+        RasterState window;
+        window.minX = (tile % tilesX) << BIN_TILE_SHIFT;
+        window.minY = (tile / tilesX) << BIN_TILE_SHIFT;
+        window.maxX = min(window.minX + BIN_TILE_SIZE, width) - 1;
+        window.maxY = min(window.minY + BIN_TILE_SIZE, height) - 1;
+        for (uint32_t index : bins[tile]) {
+            draw(context, commands[index], window);
+        }
+    });
+    Discard();
+}
+
+void submitPrimitive(SGLContext& context, const RasterState& state, PrimitiveKind kind,
+                     const ScreenVertex* vertices, size_t count) {
+    if ((kind == PrimitiveKind::Polygon || kind == PrimitiveKind::MonotonePolygon) && count > 0) {
+        SGL_STAT_ADD(context, polygonsRasterized, 1);
+    }
+    if (context.rasterBins) {
+        context.rasterBins->Add(state, kind, vertices, count);
+    }
+    else {
+        drawPrimitive(context, state, kind, vertices, count);
+    }
+}
+
+void submitTriangles(SGLContext& context, const RasterState& state, const Vertex* vertices, size_t count) {
+    SGL_STAT_ADD(context, polygonsRasterized, count / 3);
+    if (context.rasterBins) {
+        context.rasterBins->AddTriangles(state, vertices, count);
+    }
+    else {
+        fillTriangles(context, state, vertices, count);
+    }
+}
+
+void submitCircle(SGLContext& context, const RasterState& state, const WindowCircle& circle, bool filled) {
+    if (context.rasterBins) {
+        context.rasterBins->AddCircle(state, circle, filled);
+    }
+    else {
+        drawBresenhamCircle(context, state, circle, filled);
+    }
+}
+
+void submitPath(SGLContext& context, const RasterState& state, const ScreenVertex* vertices,
+                const uint32_t* contours, size_t contourCount, sglEFillRule rule) {
+    SGL_STAT_ADD(context, polygonsRasterized, contourCount);
+    if (context.rasterBins) {
+        context.rasterBins->AddPath(state, vertices, contours, contourCount, rule);
+    }
+    else {
+        fillPath(context, state, vertices, contours, contourCount, rule);
+    }
+}
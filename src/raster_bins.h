@@ -0,0 +1,143 @@
+#pragma once
+
+#include "draw_utils.h"
+#include "tile_clear.h"
+#include <cstdint>
+#include <vector>
+
+using std::vector;
+
+/**
+ * @file raster_bins.h
+ * @brief Sort-middle rasterization of the primitives in screen tiles
+ */
+
+/// Side of the square tiles the primitives are binned into, in pixels.
+/**
+  The same as the tiles of the deferred clear, so the thread drawing a tile
+  is the only one writing its clear flags.
+*/
+const int BIN_TILE_SHIFT = CLEAR_TILE_SHIFT;
+const int BIN_TILE_SIZE = 1 << BIN_TILE_SHIFT;
+
+/**
+ * @brief Primitives recorded for the binned rasterizer.
+ *
+ * The primitives of sglBegin() / sglEnd() blocks and circles are transformed
+ * when they are submitted and recorded together with the state they are drawn
+ * with. Each is split into points, segments, polygons, triangles and circles,
+ * whose bounding boxes decide the tiles they are added to.
+ *
+ * Flush() draws the tiles in parallel, every tile draws its primitives in the
+ * order of submission with the window of the state set to the tile. A pixel
+ * therefore sees the same sequence of writes and depth tests as when drawn
+ * directly, and the image is the same.
+ */
+class RasterBins {
+public:
+    RasterBins(int width, int height);
+
+    /// Adds the vertices drawn as the kind of primitive says, see drawPrimitive().
+    void Add(const RasterState& state, PrimitiveKind kind, const ScreenVertex* vertices, size_t count);
+    void AddPoints(const RasterState& state, const ScreenVertex* vertices, size_t count);
+    void AddLines(const RasterState& state, const ScreenVertex* vertices, size_t count);
+    void AddLineStrip(const RasterState& state, const ScreenVertex* vertices, size_t count);
+    void AddLineLoop(const RasterState& state, const ScreenVertex* vertices, size_t count);
+    void AddTriangleOutlines(const RasterState& state, const ScreenVertex* vertices, size_t count);
+    void AddPolygon(const RasterState& state, const ScreenVertex* vertices, size_t count);
+    /// Adds a polygon isMonotonePolygon() accepts, see fillMonotonePolygon().
+    void AddMonotonePolygon(const RasterState& state, const ScreenVertex* vertices, size_t count);
+    /// Adds a triangle list in window coordinates, see fillTriangles().
+    void AddTriangles(const RasterState& state, const Vertex* vertices, size_t count);
+    void AddCircle(const RasterState& state, const WindowCircle& circle, bool filled);
+    /// Adds the contours of a path, see fillPath().
+    void AddPath(const RasterState& state, const ScreenVertex* vertices, const uint32_t* contours,
+                 size_t contourCount, sglEFillRule rule);
+
+    bool Empty() const { return commands.empty(); }
+
+    /// Drops the recorded primitives without drawing them.
+    void Discard();
+
+    /**
+     * @brief Draws the recorded primitives into the context and drops them.
+     *
+     * The tiles are split between the threads of the pool.
+     */
+    void Flush(SGLContext& context, ThreadPool& pool);
+
+private:
+    enum class Kind : uint8_t {
+        Point,
+        Segment,
+        Polygon,
+        MonotonePolygon,
+        Triangle,
+        Circle,
+        CircleOutline,
+        Path,
+    };
+
+    // one primitive, its vertices are in one of the arenas
+    struct Command {
+        Pixel color;
+        Kind kind;
+        bool depthTest;
+        int pointSize;
+        // first vertex in the arena
+        uint32_t first;
+        // number of vertices, the radius for circles, the index in paths
+        // for paths
+        uint32_t count;
+    };
+
+    // the contours of a path, the numbers of their vertices are in contours
+    struct Path {
+        uint32_t firstContour;
+        uint32_t contourCount;
+        sglEFillRule rule;
+    };
+
+    // records the command and adds it to the tiles of the box (inclusive,
+    // in pixels), nothing is added outside of the canvas
+    void add(const RasterState& state, Kind kind, uint32_t first, uint32_t count,
+             int64_t minX, int64_t minY, int64_t maxX, int64_t maxY);
+    void addSegment(const RasterState& state, const ScreenVertex& a, const ScreenVertex& b);
+    // records a polygon drawn as the kind says with the box of its vertices
+    void addPolygon(const RasterState& state, Kind kind, const ScreenVertex* vertices, size_t count);
+
+    void draw(SGLContext& context, const Command& command, const RasterState& window) const;
+
+    int width;
+    int height;
+    int tilesX;
+    int tilesY;
+
+    vector<Command> commands;
+    vector<ScreenVertex> screenVertices;
+    vector<Vertex> windowVertices;
+    vector<Path> paths;
+    vector<uint32_t> contours;
+
+    // indices of the commands touching each tile, row by row of tiles
+    vector<vector<uint32_t>> bins;
+    // tiles with at least one command
+    vector<int> usedTiles;
+};
+
+/**
+ * @brief Draws the primitive into the context now, or records it when
+ *        SGL_BINNED_RASTER is enabled for the context.
+ */
+void submitPrimitive(SGLContext& context, const RasterState& state, PrimitiveKind kind,
+                     const ScreenVertex* vertices, size_t count);
+
+/// Fills a triangle list in window coordinates now or records it, see submitPrimitive().
+void submitTriangles(SGLContext& context, const RasterState& state, const Vertex* vertices, size_t count);
+
+/// Draws a circle now or records it, see submitPrimitive().
+void submitCircle(SGLContext& context, const RasterState& state, const WindowCircle& circle, bool filled);
+
+/// Fills the contours of a path now or records them, see submitPrimitive().
+void submitPath(SGLContext& context, const RasterState& state, const ScreenVertex* vertices,
+                const uint32_t* contours, size_t contourCount, sglEFillRule rule);
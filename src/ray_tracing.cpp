@@ -1,30 +1,40 @@
 #include "context.h"
+#include <chrono>
 
 //---------------------------------------------------------------------------
 // RayTracing oriented functions
 //---------------------------------------------------------------------------
 
 void sglBeginScene() {
-    if (contextNotInitialized() || calledWithinBeginEnd()) {
+    SGL_CAPTURE(CAPTURE_BEGIN_SCENE);
+    if (contextNotInitialized() || calledWithinBeginEnd() || calledWhileRecording()) {
         return;
     }
+    SGL_TRACE_SCOPE("sglBeginScene");
 
     sceneManager->getCurrentContext().scene.RestartScene();
     sceneManager->getCurrentContext().insideBeginScene = true;
 }
 
 void sglEndScene() {
+    SGL_CAPTURE(CAPTURE_END_SCENE);
     if (contextNotInitialized() || calledWithinBeginEnd()) {
         return;
     }
+    SGL_TRACE_SCOPE("sglEndScene");
 
-    sceneManager->getCurrentContext().insideBeginScene = false;
+    auto& context = sceneManager->getCurrentContext();
+    context.insideBeginScene = false;
+    // build the render-ready scene in the background, sglRayTraceScene()
+    // waits only for the parts that are not finished yet
+    context.scene.StartCompilation(*sceneManager->threadPool);
 }
 
 void sglSphere(const float x,
                const float y,
                const float z,
                const float radius) {
+    SGL_CAPTURE(CAPTURE_SPHERE, x, y, z, radius);
     if (contextNotInitialized() || calledWithinBeginEnd() || calledOutsideBeginSceneEndScene()) {
         return;
     }
@@ -45,6 +55,7 @@ void sglMaterial(const float r,
                  const float shine,
                  const float T,
                  const float ior) {
+    SGL_CAPTURE(CAPTURE_MATERIAL, r, g, b, kd, ks, shine, T, ior);
     if (contextNotInitialized() || calledWithinBeginEnd()) {
         return;
     }
@@ -60,6 +71,7 @@ void sglPointLight(const float x,
                    const float r,
                    const float g,
                    const float b) {
+    SGL_CAPTURE(CAPTURE_POINT_LIGHT, x, y, z, r, g, b);
     if (contextNotInitialized() || calledWithinBeginEnd() || calledOutsideBeginSceneEndScene()) {
         return;
     }
@@ -69,78 +81,147 @@ void sglPointLight(const float x,
     sceneManager->getCurrentContext().scene.lightsList->push_back(light);
 }
 
-void recalculateRaytracingVPMMatrix () {
-    SGLContext& currentContext = sceneManager->getCurrentContext();
-    Matrix projectionMatrix = currentContext.transformationStack->at(SGL_PROJECTION).back();
-    Matrix modelViewMatrix = currentContext.transformationStack->at(SGL_MODELVIEW).back();
-    currentContext.VPMmatrix = projectionMatrix * modelViewMatrix;
+void castRay(SGLContext& currentContext, int x, int y, int w, const RayCamera& camera) {
+    Ray ray = generatePrimaryRay(camera, x + 0.5f, y + 0.5f);
+    Pixel color = traceRay(currentContext, ray, 0);
+    SGL_STAT_ADD(currentContext, primaryRays, 1);
+    currentContext.colorBuffer->At(x, y) = color;
 }
 
-void castRay(int x, int y, int w, const Matrix& invVPM) {
-    auto& currentContext = sceneManager->getCurrentContext();
-    
-    Ray ray = generatePrimaryRay(x + 0.5f, y + 0.5f, invVPM);
-    Pixel color = traceRay(ray, 0);
-    currentContext.colorBuffer->at(x + y * w) = color;
-}
+// costs is nullptr for the normal render mode, otherwise receives the cost
+// of every pixel of the tile according to the render mode of the context
+void raycastTile(SGLContext& context, int tile, int w, int h, const RayCamera& camera, float* costs) {
+    const int tilesX = (w + RAYTRACING_TILE_SIZE - 1) / RAYTRACING_TILE_SIZE;
+    const int startX = (tile % tilesX) * RAYTRACING_TILE_SIZE;
+    const int startY = (tile / tilesX) * RAYTRACING_TILE_SIZE;
+    const int endX = std::min(startX + RAYTRACING_TILE_SIZE, w);
+    const int endY = std::min(startY + RAYTRACING_TILE_SIZE, h);
+    SGL_STAT_TILE_START(tileStart);
+    SGL_TRACE_SCOPE("tile", "tile", tile);
 
-void raycastSegment(int startY, int endY, int w, const Matrix& invVPM) {
     for (int y = startY; y < endY; y++) {
-        for (int x = 0; x < w; x++) {
+        for (int x = startX; x < endX; x++) {
             // here we assume that the current context will not be modified during the raycasting 
-            castRay(x, y, w, invVPM);
+            if (!costs) {
+                castRay(context, x, y, w, camera);
+                continue;
+            }
+
+            PixelCost cost;
+            pixelCost = &cost;
+            auto pixelStart = std::chrono::steady_clock::now();
+            castRay(context, x, y, w, camera);
+            std::chrono::duration<float, std::micro> pixelTime = std::chrono::steady_clock::now() - pixelStart;
+            pixelCost = nullptr;
+
+            float& pixel = costs[x + y * w];
+            switch (context.renderMode) {
+                case SGL_HEATMAP_INTERSECTION_TESTS:
+                    pixel = cost.intersectionTests;
+                    break;
+                case SGL_HEATMAP_RAYS:
+                    pixel = cost.rays;
+                    break;
+                case SGL_HEATMAP_RECURSION_DEPTH:
+                    pixel = cost.maxDepth;
+                    break;
+                default:
+                    pixel = pixelTime.count();
+                    break;
+            }
         }
     }
+    SGL_STAT_TILE_END(context, tileStart);
 }
 
 void sglRayTraceScene() {
-    if (contextNotInitialized() || calledWithinBeginEnd() || calledWithinBeginSceneEndScene()) {
+    SGL_CAPTURE(CAPTURE_RAY_TRACE_SCENE);
+    if (contextNotInitialized() || calledWithinBeginEnd() || calledWithinBeginSceneEndScene() ||
+        calledWhileRecording()) {
         return;
     }
-    recalculateRaytracingVPMMatrix();
-    const int width = sceneManager->getCurrentContext().width;
-    const int height = sceneManager->getCurrentContext().height;
-
-    Matrix invVPM = sceneManager->getCurrentContext().VPMmatrix;
-    if (invVPM.Invert()) {
+    SGL_TRACE_SCOPE("sglRayTraceScene");
+    // workers of the thread pool have no current context, it is passed explicitly
+    SGLContext& context = sceneManager->getCurrentContext();
+    // the depth of the recorded primitives is kept, only their colors are overwritten
+    flushBinnedRaster(context);
+    const int width = context.width;
+    const int height = context.height;
+
+    // kept from the previous frame unless the matrices changed
+    if (!updateRayCamera(context)) {
         std::cerr << "Unable to invert VPM matrix" << std::endl;
         return;
     }
+    const RayCamera& camera = context.rayCamera;
 
     // sequential for debugging
     /*for(int y = 0; y < height; y++) {
         for(int x = 0; x < width; x++) {
-            castRay(x, y, width, invVPM);
+            castRay(context, x, y, width, camera);
         }
     }*/
 
-    unsigned int numThreads = std::thread::hardware_concurrency();
-    std::vector<std::thread> threads;
-    
-    int rowsPerThread = height / numThreads;
-    for (unsigned int i = 0; i < numThreads; i++) {
-        int startY = i * rowsPerThread;
-        int endY = (i == numThreads - 1) ? height : (i + 1) * rowsPerThread;
-        threads.emplace_back(raycastSegment, startY, endY, width, invVPM);
+    // the scene compilation started by sglEndScene() may still be running
+    {
+        SGL_TRACE_SCOPE("wait for compilation");
+        context.scene.WaitForCompilation();
     }
-    
-    for (auto& thread : threads) {
-        thread.join();
+
+    // tiles are handed out dynamically, so expensive parts of the image
+    // do not leave the other threads idle
+    const int tilesX = (width + RAYTRACING_TILE_SIZE - 1) / RAYTRACING_TILE_SIZE;
+    const int tilesY = (height + RAYTRACING_TILE_SIZE - 1) / RAYTRACING_TILE_SIZE;
+    // the heatmap modes trace the same tiles, only record the per-pixel cost
+    vector<float> costs;
+    if (context.renderMode != SGL_RENDER_NORMAL) {
+        costs.resize(width * height);
+    }
+    float* costBuffer = costs.empty() ? nullptr : costs.data();
+    // every pixel is written by the tracer, a pending clear is never seen
+    context.colorBuffer->DiscardClear();
+    {
+        SGL_STAT_PHASE(context, traceTime);
+        sceneManager->threadPool->parallelFor(tilesX * tilesY, [&](int tile) {
+            raycastTile(context, tile, width, height, camera, costBuffer);
+        });
+    }
+
+    if (costBuffer) {
+        writeHeatmap(context, costs);
+        return;
     }
 
     if (USE_ANTIALIASING) {
-        antialiase(invVPM);
+        SGL_STAT_PHASE(context, antialiasingTime);
+        SGL_TRACE_SCOPE("antialiasing");
+        antialiase(context, camera);
+    }
+}
+
+void sglRenderMode(sglERenderMode mode) {
+    SGL_CAPTURE(CAPTURE_RENDER_MODE, mode);
+    if (contextNotInitialized() || calledWithinBeginEnd() || calledWhileRecording()) {
+        return;
+    }
+    if (mode < SGL_RENDER_NORMAL || mode > SGL_HEATMAP_TIME) {
+        setErrCode(SGL_INVALID_ENUM);
+        return;
     }
+    sceneManager->getCurrentContext().renderMode = mode;
 }
 
 void sglRasterizeScene() {
+    SGL_CAPTURE(CAPTURE_RASTERIZE_SCENE);
     // TODO: Implement
 }
 
 void sglEnvironmentMap(const int width,
                        const int height,
                        float* texels) {
-    if (!texels || contextNotInitialized() || calledWithinBeginEnd()) {
+    const uint32_t texelCount = width > 0 && height > 0 ? static_cast<uint32_t>(width * height * 3) : 0;
+    SGL_CAPTURE(CAPTURE_ENVIRONMENT_MAP, width, height, CaptureFloats{ texels, texelCount });
+    if (!texels || contextNotInitialized() || calledWithinBeginEnd() || calledWhileRecording()) {
         return;
     }
 
@@ -157,6 +238,7 @@ void sglEmissiveMaterial(const float r,
                          const float c0,
                          const float c1,
                          const float c2) {
+    SGL_CAPTURE(CAPTURE_EMISSIVE_MATERIAL, r, g, b, c0, c1, c2);
     // TODO: Test
     if (contextNotInitialized() || calledWithinBeginEnd()) {
         return;
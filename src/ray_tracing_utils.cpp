@@ -1,23 +1,18 @@
 #include "ray_tracing_utils.h"
+#include <algorithm>
 
-Vertex pixelToNDCSpace(float x, float y) {
-    int width  = sceneManager->getCurrentContext().width;
-    int height = sceneManager->getCurrentContext().height;
-    float ndcX = (2.0f * x) / width - 1.0f;
-    float ndcY = -1.0f + (2.0f * y) / height;
-    return Vertex(ndcX, ndcY, -1.0f, 1.0f);
-}
+thread_local PixelCost* pixelCost = nullptr;
 
-Ray generatePrimaryRay(float x, float y, const Matrix& invPVM) {
-    // Convert pixel to NDC without applying viewport matrix
-    Vertex ndcPoint = pixelToNDCSpace(x, y);
-    // Create near and far points in NDC
-    Vertex nearPoint = Vertex(ndcPoint.x, ndcPoint.y, -1.0f, 1.0f);
-    Vertex farPoint = Vertex(ndcPoint.x, ndcPoint.y, 1.0f, 1.0f);
-    
-    // Transform to world space
-    Vertex worldNear = invPVM * nearPoint;
-    Vertex worldFar = invPVM * farPoint;
+Ray generatePrimaryRay(const RayCamera& camera, float x, float y) {
+    // the near and far points of the pixel in world space
+    auto atPixel = [&](const Vertex& origin) {
+        return Vertex(origin.x + camera.stepX.x * x + camera.stepY.x * y,
+                      origin.y + camera.stepX.y * x + camera.stepY.y * y,
+                      origin.z + camera.stepX.z * x + camera.stepY.z * y,
+                      origin.w + camera.stepX.w * x + camera.stepY.w * y);
+    };
+    Vertex worldNear = atPixel(camera.nearOrigin);
+    Vertex worldFar = atPixel(camera.farOrigin);
     
     // Perspective divide
     worldNear /= worldNear.w;
@@ -30,46 +25,77 @@ Ray generatePrimaryRay(float x, float y, const Matrix& invPVM) {
     return Ray(worldNear, rayDirection);
 }
 
-bool checkVisibility(const Vertex& intersectionPoint, const PointLight& light) {
-    Scene& scene = sceneManager->getCurrentContext().scene;
+bool checkVisibility(const SGLContext& context, const Vertex& intersectionPoint, const PointLight& light) {
+    const CompiledScene& scene = context.scene.compiled;
 
     Vertex lightDir = light.center - intersectionPoint;
     lightDir.Normalize();
     Ray shadowRay = Ray(intersectionPoint, lightDir);
     float lightHit = shadowRay.ComputeT(light.center) - EPSILON_T;
-    for (const auto& primitive : scene.primitivesList) {
-        float tHit = 0.0f;
-        if (primitive->IntersectWithRay(shadowRay, tHit) && tHit < lightHit) {
+
+    bool visible = true;
+    int tests = 0;
+    scene.bvh.Traverse(shadowRay.center, shadowRay.direction, lightHit,
+        [&](int index, float&) {
+            float tHit = 0.0f;
+            tests++;
+            if (scene.primitives[index]->IntersectWithRay(shadowRay, tHit) && tHit < lightHit) {
+                visible = false;
+                return true;
+            }
             return false;
-        }
+        });
+
+    if (pixelCost) {
+        pixelCost->intersectionTests += tests;
+        pixelCost->rays++;
     }
-    return true;
+    SGL_STAT_ADD(context, shadowRays, 1);
+    SGL_STAT_ADD(context, primitiveTests, tests);
+    SGL_STAT_ADD(context, primitiveHits, visible ? 0 : 1);
+    return visible;
 }
 
 // TODO: add doxygen
-Primitive3D* FindClosestIntersection(const Scene& scene, const Ray& ray, float& closestT) {
+Primitive3D* FindClosestIntersection(const SGLContext& context, const Ray& ray, float& closestT) {
+    const Scene& scene = context.scene;
+    const CompiledScene& compiled = scene.compiled;
     closestT = std::numeric_limits<float>::infinity();
     Primitive3D* closestPrimitive = nullptr;
-    for (const auto& primitive : scene.primitivesList) {
-        float tHit = 0.0f;
-
-        if (primitive->IntersectWithRay(ray, tHit) && tHit < closestT) {
-            // check for back face culling
-            Vertex normal = primitive->ComputeNormal(ray.center + ray.direction * tHit);
-            float dotProduct = DotProd(normal, ray.direction);
-            
-            Material mat = scene.materialsList->at(primitive->materialID);
-            
-            // Skip backface culling for transparent objects
-            if (mat.T <= 0 && dotProduct > 0) {
-                continue;
+    int tests = 0;
+    int hits = 0;
+
+    compiled.bvh.Traverse(ray.center, ray.direction, closestT,
+        [&](int index, float& tMax) {
+            Primitive3D* primitive = compiled.primitives[index];
+            float tHit = 0.0f;
+            tests++;
+
+            if (primitive->IntersectWithRay(ray, tHit) && tHit < closestT) {
+                hits++;
+                // check for back face culling
+                Vertex normal = primitive->ComputeNormal(ray.center + ray.direction * tHit);
+                float dotProduct = DotProd(normal, ray.direction);
+
+                const Material& mat = scene.materialsList->at(primitive->materialID);
+
+                // Skip backface culling for transparent objects
+                if (mat.T <= 0 && dotProduct > 0) {
+                    return false;
+                }
+
+                closestT = tHit;
+                closestPrimitive = primitive;
+                tMax = tHit;
             }
-            
-            closestT = tHit;
-            closestPrimitive = primitive.get();
-        }
-    }
+            return false;
+        });
 
+    if (pixelCost) {
+        pixelCost->intersectionTests += tests;
+    }
+    SGL_STAT_ADD(context, primitiveTests, tests);
+    SGL_STAT_ADD(context, primitiveHits, hits);
     return closestPrimitive;
 }
 
@@ -102,15 +128,20 @@ bool RefractRay(Vertex normal, float IOR, const Ray& originalRay, Ray& refracted
     return false;
 }
 
-Pixel traceRay(const Ray& ray, int depth) {
-    Scene& scene = sceneManager->getCurrentContext().scene;
+Pixel traceRay(const SGLContext& context, const Ray& ray, int depth) {
+    const Scene& scene = context.scene;
+    if (pixelCost) {
+        pixelCost->rays++;
+        pixelCost->maxDepth = std::max(pixelCost->maxDepth, depth);
+    }
     // Closest intersection point
     float closestT;
-    Primitive3D* closestPrimitive = FindClosestIntersection(scene, ray, closestT);
+    Primitive3D* closestPrimitive = FindClosestIntersection(context, ray, closestT);
 
     if (!closestPrimitive) {
         // take color from environment map
         if (scene.envMap) {
+            SGL_STAT_ADD(context, envMapLookups, 1);
             float c = sqrt(ray.direction.x * ray.direction.x + ray.direction.y * ray.direction.y);
             float r = c > 0.f ? acos(ray.direction.z) / (2 * c * M_PI) : 0.f;
             int u = (0.5f + r * ray.direction.x) * scene.envMap->width;
@@ -118,7 +149,7 @@ Pixel traceRay(const Ray& ray, int depth) {
             int id = 3 * (u + v * scene.envMap->width);
             return Pixel(scene.envMap->texels[id], scene.envMap->texels[id + 1], scene.envMap->texels[id + 2]);
         }
-        return sceneManager->getCurrentContext().clearColor;
+        return context.clearColor;
     }
 
     Vertex intersectionPoint = ray.center + (ray.direction * closestT);
@@ -129,9 +160,9 @@ Pixel traceRay(const Ray& ray, int depth) {
     const Vertex biasedPoint = intersectionPoint + normal * INTERSECTION_BIAS;
 
     // Lighting model computation
-    for (const PointLight& light : *scene.lightsList) {
+    for (const PointLight& light : scene.compiled.lights) {
         // cast shadow rays
-        if (checkVisibility(biasedPoint, light)) {
+        if (checkVisibility(context, biasedPoint, light)) {
             color += lightingPhong(light, intersectionPoint, normal, ray.center, mat);
         }
     }
@@ -144,7 +175,8 @@ Pixel traceRay(const Ray& ray, int depth) {
             reflectedDir.Normalize();
             // Use biased point for reflection ray origin
             Ray reflectedRay(biasedPoint, reflectedDir);
-            Pixel reflectedColor = traceRay(reflectedRay, depth + 1);
+            SGL_STAT_ADD(context, reflectionRays, 1);
+            Pixel reflectedColor = traceRay(context, reflectedRay, depth + 1);
             color += reflectedColor * mat.KSpecular;
         }
         
@@ -156,7 +188,8 @@ Pixel traceRay(const Ray& ray, int depth) {
                 // Use negative bias for refraction ray origin (going into the object)
                 Vertex refractedPoint = intersectionPoint - normal * INTERSECTION_BIAS;
                 Ray refractedRay(refractedPoint, refracted.direction);
-                color += traceRay(refractedRay, depth + 1) * mat.T;
+                SGL_STAT_ADD(context, refractionRays, 1);
+                color += traceRay(context, refractedRay, depth + 1) * mat.T;
             }
         }
     }
@@ -173,69 +206,107 @@ inline bool checkDifference(const Pixel& origin, const Pixel& neighbour) {
     return true;
 }
 
-void antialiaseRay(int x, int y, int w, const Matrix& invVPM) {
-    auto& currentContext = sceneManager->getCurrentContext();
-    currentContext.colorBuffer->at(x + y * w) = currentContext.colorBuffer->at(x + y * w) * (1 - ANTIALIASING_WEIGHT);
+void antialiaseRay(SGLContext& currentContext, int x, int y, int w, const RayCamera& camera) {
+    Pixel& pixel = currentContext.colorBuffer->At(x, y);
+    pixel = pixel * (1 - ANTIALIASING_WEIGHT);
     float weight = ANTIALIASING_WEIGHT / 4;
 
     for (int i = 1; i < 3; i++)
     {
         for (int j = 1; j < 3; j++)
         {
-            Ray ray = generatePrimaryRay(x + 0.25f * j, y + 0.25f * i, invVPM);
-            Pixel color = traceRay(ray, 0);
-            currentContext.colorBuffer->at(x + y * w) += color * weight;
+            Ray ray = generatePrimaryRay(camera, x + 0.25f * j, y + 0.25f * i);
+            Pixel color = traceRay(currentContext, ray, 0);
+            SGL_STAT_ADD(currentContext, primaryRays, 1);
+            pixel += color * weight;
         }
     }
 }
 
-void antialiase(const Matrix& invPVM) {
-    auto& context = sceneManager->getCurrentContext();
-    auto& colorBuffer = *(context.colorBuffer);
+void antialiase(SGLContext& context, const RayCamera& camera) {
+    FrameBuffer& frameBuffer = *(context.colorBuffer);
     int width = context.width;
     int height = context.height;
-    Pixel* origin = &colorBuffer[1];
+    // pixels are addressed by their index in a tightly packed image, the
+    // rows of the buffer itself may be further apart
+    auto colorBuffer = [&](int index) -> const Pixel& {
+        return frameBuffer.At(index % width, index / width);
+    };
+    int origin = 1;
 
     // top border
     for (int x = 1; x < width - 1; x++, origin++) {
-        if (checkDifference(*origin, colorBuffer[x + 1]) ||
-            checkDifference(*origin, colorBuffer[x - 1]) ||
-            checkDifference(*origin, colorBuffer[x + width])) {
-            antialiaseRay(x, 0, width, invPVM);
+        if (checkDifference(colorBuffer(origin), colorBuffer(x + 1)) ||
+            checkDifference(colorBuffer(origin), colorBuffer(x - 1)) ||
+            checkDifference(colorBuffer(origin), colorBuffer(x + width))) {
+            antialiaseRay(context, x, 0, width, camera);
         }
     }
 
     for (int y = 1; y < height - 1; y++, origin++) {
-        origin = &colorBuffer[y * width];
+        origin = y * width;
         // left border
-        if (checkDifference(*origin, colorBuffer[(y + 1) * width]) ||
-            checkDifference(*origin, colorBuffer[1 + y * width]) ||
-            checkDifference(*origin, colorBuffer[(y - 1) * width])) {
-            antialiaseRay(0, y, width, invPVM);
+        if (checkDifference(colorBuffer(origin), colorBuffer((y + 1) * width)) ||
+            checkDifference(colorBuffer(origin), colorBuffer(1 + y * width)) ||
+            checkDifference(colorBuffer(origin), colorBuffer((y - 1) * width))) {
+            antialiaseRay(context, 0, y, width, camera);
         }
 
         for (int x = 1; x < width - 1; x++, origin++) {
-            if (checkDifference(*origin, colorBuffer[x + (y + 1) * width]) ||
-                checkDifference(*origin, colorBuffer[x + 1 + y * width]) ||
-                checkDifference(*origin, colorBuffer[x - 1 + y * width]) ||
-                checkDifference(*origin, colorBuffer[x + (y - 1) * width])) {
-                antialiaseRay(x, y, width, invPVM);
+            if (checkDifference(colorBuffer(origin), colorBuffer(x + (y + 1) * width)) ||
+                checkDifference(colorBuffer(origin), colorBuffer(x + 1 + y * width)) ||
+                checkDifference(colorBuffer(origin), colorBuffer(x - 1 + y * width)) ||
+                checkDifference(colorBuffer(origin), colorBuffer(x + (y - 1) * width))) {
+                antialiaseRay(context, x, y, width, camera);
             }
         }
         // right border
-        if (checkDifference(*origin, colorBuffer[(y + 1) * width]) ||
-            checkDifference(*origin, colorBuffer[-1 + y * width]) ||
-            checkDifference(*origin, colorBuffer[(y - 1) * width])) {
-            antialiaseRay(width - 1, y, width, invPVM);
+        if (checkDifference(colorBuffer(origin), colorBuffer((y + 1) * width)) ||
+            checkDifference(colorBuffer(origin), colorBuffer(-1 + y * width)) ||
+            checkDifference(colorBuffer(origin), colorBuffer((y - 1) * width))) {
+            antialiaseRay(context, width - 1, y, width, camera);
         }
     }
     // bottom border
-    origin = &colorBuffer[1 + (height - 1) * width];
+    origin = 1 + (height - 1) * width;
     for (int x = 1; x < width - 1; x++, origin++) {
-        if (checkDifference(*origin, colorBuffer[x + 1 + (height - 1) * width]) ||
-            checkDifference(*origin, colorBuffer[x - 1 + (height - 1) * width]) ||
-            checkDifference(*origin, colorBuffer[x     + (height - 2) * width])) {
-            antialiaseRay(x, height - 1, width, invPVM);
+        if (checkDifference(colorBuffer(origin), colorBuffer(x + 1 + (height - 1) * width)) ||
+            checkDifference(colorBuffer(origin), colorBuffer(x - 1 + (height - 1) * width)) ||
+            checkDifference(colorBuffer(origin), colorBuffer(x     + (height - 2) * width))) {
+            antialiaseRay(context, x, height - 1, width, camera);
+        }
+    }
+}
+
+Pixel heatmapColor(float t) {
+    t = std::min(std::max(t, 0.0f), 1.0f);
+    // blue -> cyan -> green -> yellow -> red
+    static const Pixel stops[] = {
+        Pixel(0.0f, 0.0f, 1.0f),
+        Pixel(0.0f, 1.0f, 1.0f),
+        Pixel(0.0f, 1.0f, 0.0f),
+        Pixel(1.0f, 1.0f, 0.0f),
+        Pixel(1.0f, 0.0f, 0.0f)
+    };
+    const int segments = sizeof(stops) / sizeof(stops[0]) - 1;
+    float position = t * segments;
+    int i = std::min(static_cast<int>(position), segments - 1);
+    float f = position - i;
+    return stops[i] * (1.0f - f) + stops[i + 1] * f;
+}
+
+void writeHeatmap(SGLContext& context, const vector<float>& costs) {
+    FrameBuffer& colorBuffer = *(context.colorBuffer);
+    float maxCost = 0.0f;
+    for (float cost : costs) {
+        maxCost = std::max(maxCost, cost);
+    }
+    const float scale = maxCost > 0.0f ? 1.0f / maxCost : 0.0f;
+    for (int y = 0; y < context.height; y++) {
+        Pixel* row = colorBuffer.Row(y);
+        const float* rowCosts = &costs[static_cast<size_t>(y) * context.width];
+        for (int x = 0; x < context.width; x++) {
+            row[x] = heatmapColor(rowCosts[x] * scale);
         }
     }
 }
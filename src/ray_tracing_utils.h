@@ -12,10 +12,28 @@
 using std::unique_ptr;
 using std::make_unique;
 
+// context.h includes this header, so the context may still be incomplete here
+struct SGLContext;
+
+// Cost of tracing a single pixel, gathered in the heatmap render modes
+struct PixelCost {
+    int intersectionTests;
+    int rays;
+    int maxDepth;
+
+    PixelCost() : intersectionTests(0), rays(0), maxDepth(0) {}
+};
+
+// Cost record of the pixel traced by the calling thread, nullptr unless a
+// heatmap is being rendered
+extern thread_local PixelCost* pixelCost;
+
 const bool USE_ANTIALIASING = false;
 const float ANTIALIASING_WEIGHT = 0.8f;
 const float DIFFERENCE_EPSILON = 0.1f;
 const int MAX_RECURSION_DEPTH = 8;
+// Edge length of the square image tiles distributed among the threads
+const int RAYTRACING_TILE_SIZE = 32;
 
 // Small offset to avoid self-intersection
 const float INTERSECTION_BIAS = 0.0001f;
@@ -23,46 +41,32 @@ const float INTERSECTION_BIAS = 0.0001f;
 /**
  * @brief Casts a ray into the scene for a specific pixel and updates the color buffer.
  *
- * This function generates a primary ray based on the given pixel coordinates and the
- * inverse View-Projection-Matrix (invVPM). It traces the ray through the scene, determines
+ * This function generates a primary ray of the camera for the given pixel coordinates.
+ * It traces the ray through the scene, determines
  * the color at the intersection, and stores it in the color buffer of the current rendering
  * context.
  *
+ * @param context The context being rendered.
  * @param x The x-coordinate of the pixel.
  * @param y The y-coordinate of the pixel.
  * @param w The width of the rendering surface (used for buffer indexing).
- * @param invVPM The inverse View-Projection-Matrix, used to transform screen coordinates
- *               into world space.
- */
-void castRay(int x, int y, int w, const Matrix& invVPM);
-
-/**
- * @brief Converts pixel coordinates to Normalized Device Coordinates (NDC).
- *
- * This function transforms pixel coordinates from screen space into Normalized Device
- * Coordinates (NDC) space, which ranges from -1 to 1 in both x and y dimensions.
- * The transformation considers the dimensions of the current rendering context.
- *
- * @param x The x-coordinate of the pixel in screen space.
- * @param y The y-coordinate of the pixel in screen space.
- * @return A Vertex representing the NDC coordinates, with z set to -1.0f and w set to 1.0f.
+ * @param camera The camera of the context, see updateRayCamera().
  */
-Vertex pixelToNDCSpace(float x, float y);
+void castRay(SGLContext& context, int x, int y, int w, const RayCamera& camera);
 
 /**
  * @brief Generates a primary ray for a given pixel in screen space.
  *
- * This function computes a primary ray by converting the pixel coordinates to Normalized Device
- * Coordinates (NDC), transforming the NDC near and far points into world space using the
- * inverse Projection-View-Matrix (invPVM), and calculating the ray's direction. The resulting
+ * This function steps the world space points of the camera on the near and far planes
+ * to the pixel, divides them by w and calculates the ray's direction. The resulting
  * ray originates from the near point in world space and points towards the far point.
  *
+ * @param camera The camera, built from the inverse Projection-View-Matrix.
  * @param x The x-coordinate of the pixel in screen space.
  * @param y The y-coordinate of the pixel in screen space.
- * @param invPVM The inverse Projection-View-Matrix, used to transform points from NDC to world space.
  * @return A Ray object, containing the origin (worldNear) and direction of the ray.
  */
-Ray generatePrimaryRay(float x, float y, const Matrix& invPVM);
+Ray generatePrimaryRay(const RayCamera& camera, float x, float y);
 
 /**
  * @brief Checks whether a given point on a surface is visible from a light source.
@@ -71,6 +75,7 @@ Ray generatePrimaryRay(float x, float y, const Matrix& invPVM);
  * is obstructed by any primitive in the scene. It traces a shadow ray from the intersection point
  * toward the light source and checks for intersections with other objects.
  *
+ * @param context The context whose compiled scene provides the occluders.
  * @param intersectionPoint The point of intersection on the surface.
  * @param light The light source to check visibility against.
  * @return true If the point is visible from the light source (no obstruction).
@@ -78,7 +83,7 @@ Ray generatePrimaryRay(float x, float y, const Matrix& invPVM);
  *
  * @note This function uses an EPSILON value to avoid self-shadowing due to floating-point precision errors.
  */
-bool checkVisibility(const Vertex& intersectionPoint, const PointLight& light);
+bool checkVisibility(const SGLContext& context, const Vertex& intersectionPoint, const PointLight& light);
 
 /**
  * @brief Traces a ray through the scene and computes the resulting pixel color.
@@ -87,11 +92,12 @@ bool checkVisibility(const Vertex& intersectionPoint, const PointLight& light);
  * If an intersection is found, it computes the color at the intersection point using a Phong
  * lighting model. If no intersection is found, the scene's clear color is returned.
  *
+ * @param context The context whose scene is traced.
  * @param ray The ray to be traced through the scene. Contains origin and direction.
  * @return A Pixel object representing the computed color at the intersection or the clear color
  *         if no intersection occurs.
  */
-Pixel traceRay(const Ray& ray, int depth);
+Pixel traceRay(const SGLContext& context, const Ray& ray, int depth);
 
 /**
  * @brief Applies anti-aliasing to a pixel by sampling rays at sub-pixel positions and averaging the results.
@@ -100,13 +106,13 @@ Pixel traceRay(const Ray& ray, int depth);
  * additional rays at sub-pixel offsets, computes their colors, and combines them with the original pixel color
  * using a weighted average. The weight of the additional samples is defined by `ANTIALIASING_WEIGHT`.
  *
+ * @param context The context being rendered.
  * @param x The x-coordinate of the pixel.
  * @param y The y-coordinate of the pixel.
  * @param w The width of the rendering surface (used for buffer indexing).
- * @param invVPM The inverse View-Projection-Matrix, used to transform screen coordinates
- *               into world space for ray generation.
+ * @param camera The camera used for ray generation.
  */
-void antialiaseRay(int x, int y, int w, const Matrix& invVPM);
+void antialiaseRay(SGLContext& context, int x, int y, int w, const RayCamera& camera);
 
 /**
  * @brief Applies anti-aliasing to the entire scene by detecting edge pixels and refining their colors.
@@ -116,6 +122,25 @@ void antialiaseRay(int x, int y, int w, const Matrix& invVPM);
  * to apply sub-pixel sampling and improve visual smoothness. The process is performed on the interior
  * pixels of the rendering surface, leaving the edges untouched.
  *
- * @param invPVM The inverse Projection-View-Matrix, used for ray generation in sub-pixel sampling.
+ * @param context The context being rendered.
+ * @param camera The camera used for ray generation in sub-pixel sampling.
+ */
+void antialiase(SGLContext& context, const RayCamera& camera);
+
+/**
+ * @brief Maps a normalized cost to a false colour.
+ *
+ * @param t The cost in [0, 1].
+ * @return Blue for 0 through cyan, green and yellow to red for 1.
+ */
+Pixel heatmapColor(float t);
+
+/**
+ * @brief Replaces the color buffer by the false-colour map of the per-pixel costs.
+ *
+ * The costs are normalized by the maximum of the frame.
+ *
+ * @param context The context being rendered.
+ * @param costs Cost of every pixel of the color buffer.
  */
-void antialiase(const Matrix& invPVM);
+void writeHeatmap(SGLContext& context, const vector<float>& costs);
@@ -0,0 +1,243 @@
+#include "context.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+
+namespace {
+
+// Rows converted by one task of the thread pool
+const int READ_PIXELS_ROWS_PER_TASK = 16;
+
+// Tone mapped values are quantized to 16 bits before the sRGB encoding,
+// fine enough for an exact 10-bit result except right at rounding boundaries
+const int SRGB_TABLE_SIZE = 1 << 16;
+
+/**
+ * @brief sRGB encoding of linear values in [0, 1] quantized to 8 and 10 bits.
+ */
+struct SrgbTables {
+    uint8_t srgb8[SRGB_TABLE_SIZE];
+    uint16_t srgb10[SRGB_TABLE_SIZE];
+
+    SrgbTables() {
+        for (int i = 0; i < SRGB_TABLE_SIZE; i++) {
+            const double linear = i / double(SRGB_TABLE_SIZE - 1);
+            const double encoded = linear <= 0.0031308
+                ? 12.92 * linear
+                : 1.055 * std::pow(linear, 1.0 / 2.4) - 0.055;
+            srgb8[i] = static_cast<uint8_t>(encoded * 255.0 + 0.5);
+            srgb10[i] = static_cast<uint16_t>(encoded * 1023.0 + 0.5);
+        }
+    }
+};
+
+const SrgbTables& srgbTables() {
+    static const SrgbTables tables;
+    return tables;
+}
+
+inline int srgbIndex(float value) {
+    return static_cast<int>(value * (SRGB_TABLE_SIZE - 1) + 0.5f);
+}
+
+// The operators map any input, including NaN and infinity, into [0, 1].
+// std::max(0.0f, c) turns NaN into 0 and compiles to a single SIMD max.
+template <sglEToneMapOperator OPERATOR>
+inline float toneMap(float c);
+
+template <>
+inline float toneMap<SGL_TONEMAP_CLAMP>(float c) {
+    return std::min(std::max(0.0f, c), 1.0f);
+}
+
+template <>
+inline float toneMap<SGL_TONEMAP_REINHARD>(float c) {
+    return 1.0f - 1.0f / (1.0f + std::max(0.0f, c));
+}
+
+template <>
+inline float toneMap<SGL_TONEMAP_ACES>(float c) {
+    // Narkowicz's fit, saturates well below the limit
+    c = std::min(std::max(0.0f, c), 1000.0f);
+    const float mapped = (c * (2.51f * c + 0.03f)) / (c * (2.43f * c + 0.59f) + 0.14f);
+    return toneMap<SGL_TONEMAP_CLAMP>(mapped);
+}
+
+/**
+ * @brief Converts a float to a half float, rounding to nearest even.
+ *
+ * Values too large for a half become infinity, NaN stays NaN. All cases are
+ * computed and selected, so loops over it vectorize.
+ */
+inline uint16_t floatToHalf(float value) {
+    const uint32_t infinity32 = 255u << 23;
+    const uint32_t overflow = (127u + 16) << 23;
+    const uint32_t smallestNormal = 113u << 23;
+    // 0.5f, adding it aligns the mantissa of a denormal result and rounds it
+    const uint32_t denormalMagic = ((127u - 15) + (23 - 10) + 1) << 23;
+
+    uint32_t bits;
+    memcpy(&bits, &value, 4);
+    const uint32_t sign = (bits >> 16) & 0x8000u;
+    bits &= 0x7fffffffu;
+
+    float magnitude;
+    memcpy(&magnitude, &bits, 4);
+    const float aligned = magnitude + 0.5f;
+    uint32_t alignedBits;
+    memcpy(&alignedBits, &aligned, 4);
+    const uint32_t denormal = alignedBits - denormalMagic;
+
+    const uint32_t normal = (bits + (uint32_t(15 - 127) << 23) + 0xfff + ((bits >> 13) & 1)) >> 13;
+    const uint32_t special = bits > infinity32 ? 0x7e00u : 0x7c00u;
+
+    const uint32_t half = bits >= overflow ? special : (bits < smallestNormal ? denormal : normal);
+    return static_cast<uint16_t>(half | sign);
+}
+
+const uint16_t HALF_ONE = 0x3c00;
+
+// The rows are converted as flat arrays of components
+static_assert(sizeof(Pixel) == 3 * sizeof(float), "Pixel must be tightly packed");
+
+// Pixels converted at once, small enough for the staging arrays to stay in L1
+const int CONVERT_CHUNK = 64;
+
+/**
+ * @brief Exposes and tone maps a chunk of pixels into sRGB table indices.
+ *
+ * Kept apart from the table lookups, which do not vectorize, so that this
+ * arithmetic does.
+ */
+template <sglEToneMapOperator OPERATOR>
+inline void toneMapChunk(const float* components, int count, float exposure, int32_t* indices) {
+    for (int i = 0; i < count; i++) {
+        indices[i] = srgbIndex(toneMap<OPERATOR>(components[i] * exposure));
+    }
+}
+
+inline void store32(uint8_t* dst, uint32_t value) {
+    memcpy(dst, &value, 4);
+}
+
+template <sglEToneMapOperator OPERATOR>
+void convertRowRGBA8(const Pixel* src, uint8_t* dst, int width, float exposure, const SrgbTables& tables) {
+    int32_t indices[3 * CONVERT_CHUNK];
+    for (int x0 = 0; x0 < width; x0 += CONVERT_CHUNK) {
+        const int count = std::min(CONVERT_CHUNK, width - x0);
+        toneMapChunk<OPERATOR>(&src[x0].r, 3 * count, exposure, indices);
+        for (int i = 0; i < count; i++) {
+            const uint32_t r = tables.srgb8[indices[3 * i]];
+            const uint32_t g = tables.srgb8[indices[3 * i + 1]];
+            const uint32_t b = tables.srgb8[indices[3 * i + 2]];
+            // byte order R, G, B, A in memory on little-endian hosts
+            store32(dst + 4 * (x0 + i), r | (g << 8) | (b << 16) | 0xff000000u);
+        }
+    }
+}
+
+template <sglEToneMapOperator OPERATOR>
+void convertRowRGB10A2(const Pixel* src, uint8_t* dst, int width, float exposure, const SrgbTables& tables) {
+    int32_t indices[3 * CONVERT_CHUNK];
+    for (int x0 = 0; x0 < width; x0 += CONVERT_CHUNK) {
+        const int count = std::min(CONVERT_CHUNK, width - x0);
+        toneMapChunk<OPERATOR>(&src[x0].r, 3 * count, exposure, indices);
+        for (int i = 0; i < count; i++) {
+            const uint32_t r = tables.srgb10[indices[3 * i]];
+            const uint32_t g = tables.srgb10[indices[3 * i + 1]];
+            const uint32_t b = tables.srgb10[indices[3 * i + 2]];
+            store32(dst + 4 * (x0 + i), r | (g << 10) | (b << 20) | (3u << 30));
+        }
+    }
+}
+
+void convertRowRGBA16F(const Pixel* src, uint8_t* dst, int width, float exposure) {
+    uint16_t halves[3 * CONVERT_CHUNK];
+    for (int x0 = 0; x0 < width; x0 += CONVERT_CHUNK) {
+        const int count = std::min(CONVERT_CHUNK, width - x0);
+        const float* components = &src[x0].r;
+        for (int i = 0; i < 3 * count; i++) {
+            halves[i] = floatToHalf(components[i] * exposure);
+        }
+        for (int i = 0; i < count; i++) {
+            const uint16_t rgba[4] = { halves[3 * i], halves[3 * i + 1], halves[3 * i + 2], HALF_ONE };
+            memcpy(dst + 8 * (x0 + i), rgba, 8);
+        }
+    }
+}
+
+typedef void (*ConvertRow)(const Pixel* src, uint8_t* dst, int width, float exposure, const SrgbTables& tables);
+
+template <sglEToneMapOperator OPERATOR>
+ConvertRow encodedRowConverter(sglEPixelFormat format) {
+    return format == SGL_RGBA8_SRGB ? convertRowRGBA8<OPERATOR> : convertRowRGB10A2<OPERATOR>;
+}
+
+ConvertRow encodedRowConverter(sglEToneMapOperator op, sglEPixelFormat format) {
+    switch (op) {
+        case SGL_TONEMAP_REINHARD: return encodedRowConverter<SGL_TONEMAP_REINHARD>(format);
+        case SGL_TONEMAP_ACES: return encodedRowConverter<SGL_TONEMAP_ACES>(format);
+        default: return encodedRowConverter<SGL_TONEMAP_CLAMP>(format);
+    }
+}
+
+int bytesPerPixel(sglEPixelFormat format) {
+    return format == SGL_RGBA16F ? 8 : 4;
+}
+
+}
+
+//---------------------------------------------------------------------------
+// Pixel transfer functions
+//---------------------------------------------------------------------------
+
+void sglReadPixels(sglEPixelFormat format, void *dst, int stride) {
+    SGL_CAPTURE(CAPTURE_READ_PIXELS, format, stride);
+    if (contextNotInitialized() || calledWithinBeginEnd() || calledWhileRecording()) {
+        return;
+    }
+    if (format < SGL_RGBA8_SRGB || format > SGL_RGBA16F) {
+        setErrCode(SGL_INVALID_ENUM);
+        return;
+    }
+
+    SGLContext& context = sceneManager->getCurrentContext();
+    const long rowBytes = static_cast<long>(context.width) * bytesPerPixel(format);
+    const long step = stride != 0 ? stride : rowBytes;
+    if (!dst || std::abs(step) < rowBytes) {
+        setErrCode(SGL_INVALID_VALUE);
+        return;
+    }
+    flushBinnedRaster(context);
+    SGL_TRACE_SCOPE("sglReadPixels", "format", format);
+
+    FrameBuffer& colorBuffer = *context.colorBuffer;
+    colorBuffer.Resolve(*sceneManager->threadPool);
+    uint8_t* rows = static_cast<uint8_t*>(dst);
+    const int width = context.width;
+    const int height = context.height;
+    const float exposure = context.exposure;
+    // the tables are built by the first call, not by the workers
+    const SrgbTables& tables = srgbTables();
+    const ConvertRow convertRow = encodedRowConverter(context.toneMapOperator, format);
+
+    // exposure, tone mapping, encoding and quantization happen in one pass,
+    // every row is read once and written once
+    const int tasks = (height + READ_PIXELS_ROWS_PER_TASK - 1) / READ_PIXELS_ROWS_PER_TASK;
+    sceneManager->threadPool->parallelFor(tasks, [&](int task) {
+        const int begin = task * READ_PIXELS_ROWS_PER_TASK;
+        const int end = std::min(begin + READ_PIXELS_ROWS_PER_TASK, height);
+        for (int y = begin; y < end; y++) {
+            const Pixel* src = colorBuffer.Row(y);
+            uint8_t* row = rows + y * step;
+            if (format == SGL_RGBA16F) {
+                convertRowRGBA16F(src, row, width, exposure);
+            }
+            else {
+                convertRow(src, row, width, exposure, tables);
+            }
+        }
+    });
+}
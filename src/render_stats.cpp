@@ -0,0 +1,95 @@
+#include "context.h"
+#include "render_stats.h"
+#include <algorithm>
+#include <cstring>
+
+StatCounters::StatCounters() {
+    Reset();
+}
+
+void StatCounters::Reset() {
+    primaryRays = 0;
+    shadowRays = 0;
+    reflectionRays = 0;
+    refractionRays = 0;
+    primitiveTests = 0;
+    primitiveHits = 0;
+    envMapLookups = 0;
+    pixelsFilled = 0;
+    polygonsRasterized = 0;
+    tileLatencies.clear();
+}
+
+RenderStats::RenderStats() :
+  slots(1),
+  traceTime(0),
+  antialiasingTime(0),
+  rasterTime(0),
+  clearTime(0) {
+}
+
+void RenderStats::Reset(unsigned numWorkers) {
+    slots.resize(numWorkers + 1);
+    for (StatCounters& counters : slots) {
+        counters.Reset();
+    }
+    traceTime = 0;
+    antialiasingTime = 0;
+    rasterTime = 0;
+    clearTime = 0;
+}
+
+// value below which the given fraction of the sorted samples lies
+static float percentile(const vector<float>& sorted, float fraction) {
+    size_t index = static_cast<size_t>(fraction * (sorted.size() - 1) + 0.5f);
+    return sorted[std::min(index, sorted.size() - 1)];
+}
+
+void RenderStats::Collect(SGLRenderStats& out) const {
+    memset(&out, 0, sizeof(out));
+    vector<float> latencies;
+    for (const StatCounters& counters : slots) {
+        out.primaryRays += counters.primaryRays;
+        out.shadowRays += counters.shadowRays;
+        out.reflectionRays += counters.reflectionRays;
+        out.refractionRays += counters.refractionRays;
+        out.primitiveTests += counters.primitiveTests;
+        out.primitiveHits += counters.primitiveHits;
+        out.envMapLookups += counters.envMapLookups;
+        out.pixelsFilled += counters.pixelsFilled;
+        out.polygonsRasterized += counters.polygonsRasterized;
+        latencies.insert(latencies.end(), counters.tileLatencies.begin(), counters.tileLatencies.end());
+    }
+    out.traceTime = traceTime;
+    out.antialiasingTime = antialiasingTime;
+    out.rasterTime = rasterTime;
+    out.clearTime = clearTime;
+
+    out.tiles = static_cast<unsigned>(latencies.size());
+    if (!latencies.empty()) {
+        std::sort(latencies.begin(), latencies.end());
+        out.tileLatencyP50 = percentile(latencies, 0.5f);
+        out.tileLatencyP99 = percentile(latencies, 0.99f);
+        out.tileLatencyMax = latencies.back();
+    }
+}
+
+//---------------------------------------------------------------------------
+// sglGetRenderStats()
+//---------------------------------------------------------------------------
+void sglGetRenderStats(SGLRenderStats *stats) {
+    if (contextNotInitialized() || calledWhileRecording()) {
+        return;
+    }
+    if (!stats) {
+        setErrCode(SGL_INVALID_VALUE);
+        return;
+    }
+#ifdef SGL_RENDER_STATS
+    // the recorded primitives count once drawn
+    flushBinnedRaster(sceneManager->getCurrentContext());
+    sceneManager->getCurrentContext().renderStats.Collect(*stats);
+#else
+    memset(stats, 0, sizeof(*stats));
+#endif
+}
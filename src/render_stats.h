@@ -0,0 +1,109 @@
+#pragma once
+
+#include "sgl.h"
+#include "thread_pool.h"
+#include <chrono>
+#include <cstdint>
+#include <vector>
+
+using std::vector;
+
+/**
+ * @file render_stats.h
+ * @brief Per-frame rendering statistics, see sglGetRenderStats()
+ *
+ * The statistics are compiled in only when SGL_RENDER_STATS is defined (CMake
+ * option of the same name). Otherwise the SGL_STAT_* macros expand to nothing
+ * and the counting code is removed by the compiler.
+ */
+
+// Counters written by a single thread, padded to a cache line so that the
+// threads do not contend for it
+struct alignas(64) StatCounters {
+    uint64_t primaryRays;
+    uint64_t shadowRays;
+    uint64_t reflectionRays;
+    uint64_t refractionRays;
+    uint64_t primitiveTests;
+    uint64_t primitiveHits;
+    uint64_t envMapLookups;
+    uint64_t pixelsFilled;
+    uint64_t polygonsRasterized;
+    // tracing times of the tiles processed by the thread, in milliseconds
+    vector<float> tileLatencies;
+
+    StatCounters();
+    void Reset();
+};
+
+struct RenderStats {
+    // one slot per worker of the thread pool, the last one belongs to the
+    // thread which owns the context
+    mutable vector<StatCounters> slots;
+
+    // phase times measured by the owning thread, in milliseconds
+    double traceTime;
+    double antialiasingTime;
+    double rasterTime;
+    double clearTime;
+
+    RenderStats();
+
+    /// Starts a new frame, the number of slots follows the size of the pool.
+    void Reset(unsigned numWorkers);
+
+    /// Returns the counters of the calling thread.
+    StatCounters& Local() const {
+        int worker = ThreadPool::currentWorkerIndex();
+        return worker >= 0 && worker < (int)slots.size() - 1 ? slots[worker] : slots.back();
+    }
+
+    /// Sums the counters of all the threads.
+    void Collect(SGLRenderStats& out) const;
+};
+
+// Adds the elapsed time of the enclosing scope to a phase time
+class StatPhaseTimer {
+public:
+    explicit StatPhaseTimer(double& phaseTime) :
+      phaseTime(phaseTime), start(std::chrono::steady_clock::now()) {}
+
+    ~StatPhaseTimer() {
+        phaseTime += ElapsedMs(start);
+    }
+
+    static double ElapsedMs(std::chrono::steady_clock::time_point since) {
+        return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - since).count();
+    }
+
+private:
+    double& phaseTime;
+    std::chrono::steady_clock::time_point start;
+};
+
+#define SGL_STAT_CONCAT_(a, b) a##b
+#define SGL_STAT_CONCAT(a, b) SGL_STAT_CONCAT_(a, b)
+
+#ifdef SGL_RENDER_STATS
+
+/// Starts a new frame of the context.
+#define SGL_STAT_FRAME_BEGIN(context) ((context).renderStats.Reset(sceneManager->threadPool->size()))
+/// Adds n to the counter of the calling thread.
+#define SGL_STAT_ADD(context, counter, n) ((context).renderStats.Local().counter += (n))
+/// Measures the rest of the enclosing scope into the phase time.
+#define SGL_STAT_PHASE(context, phase) \
+    StatPhaseTimer SGL_STAT_CONCAT(statPhaseTimer, __LINE__)((context).renderStats.phase)
+/// Records the tracing time of a tile started at the given time point.
+#define SGL_STAT_TILE_START(name) auto name = std::chrono::steady_clock::now()
+#define SGL_STAT_TILE_END(context, name) \
+    ((context).renderStats.Local().tileLatencies.push_back(static_cast<float>(StatPhaseTimer::ElapsedMs(name))))
+
+#else
+
+#define SGL_STAT_FRAME_BEGIN(context) ((void)0)
+#define SGL_STAT_ADD(context, counter, n) ((void)(n))
+#define SGL_STAT_PHASE(context, phase)
+#define SGL_STAT_TILE_START(name)
+#define SGL_STAT_TILE_END(context, name) ((void)0)
+
+#endif
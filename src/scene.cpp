@@ -1,7 +1,21 @@
 #include "scene.h"
+#include "thread_pool.h"
+#include "trace.h"
 
 using std::make_unique;
 
+RayCamera::RayCamera(const Matrix& invPVM, int width, int height) {
+    const float* m = invPVM.data.data();
+    auto column = [m](int j) { return Vertex(m[j], m[4 + j], m[8 + j], m[12 + j]); };
+    // the pixel (x, y) is (2x / width - 1, 2y / height - 1) in NDC, on the
+    // near plane at z = -1, on the far plane at z = 1
+    stepX = column(0) * (2.0f / width);
+    stepY = column(1) * (2.0f / height);
+    const Vertex corner = column(3) - column(0) - column(1);
+    nearOrigin = corner - column(2);
+    farOrigin = corner + column(2);
+}
+
 float Ray::ComputeT(Vertex point){ 
 	if(direction.x != 0){
 		return (point.x - center.x) / direction.x; 
@@ -20,12 +34,92 @@ Scene::Scene() {
 	materialsList = make_unique<vector<Material>>();
 }
 
+Scene::~Scene() {
+	// background compilation references the scene
+	if (geometryCompiled.valid()) {
+		WaitForCompilation();
+	}
+}
+
 void Scene::RestartScene() {
+	if (geometryCompiled.valid()) {
+		WaitForCompilation();
+	}
+	geometryCompiled = std::shared_future<void>();
+	lightsCompiled = std::shared_future<void>();
+	compiled = CompiledScene();
+
 	primitivesList.clear();
 	lightsList->clear();
 	materialsList->clear();
 }
 
+void Scene::StartCompilation(ThreadPool& pool) {
+	// the lists may have changed since the previous compilation started
+	if (geometryCompiled.valid()) {
+		WaitForCompilation();
+	}
+	geometryCompiled = pool.submit([this] { CompileGeometry(); });
+	lightsCompiled = pool.submit([this] { CompileLights(); });
+}
+
+void Scene::WaitForCompilation() {
+	if (!geometryCompiled.valid()) {
+		CompileGeometry();
+		CompileLights();
+		std::promise<void> done;
+		done.set_value();
+		geometryCompiled = lightsCompiled = done.get_future().share();
+		return;
+	}
+	geometryCompiled.wait();
+	lightsCompiled.wait();
+}
+
+void Scene::CompileGeometry() {
+	SGL_TRACE_SCOPE("compile geometry", "primitives", static_cast<int64_t>(primitivesList.size()));
+	vector<AABB> bounds;
+	bounds.reserve(primitivesList.size());
+	for (const auto& primitive : primitivesList) {
+		bounds.push_back(primitive->BoundingBox());
+	}
+	compiled.bvh.Build(bounds);
+
+	compiled.primitives.clear();
+	compiled.primitives.reserve(primitivesList.size());
+	for (int index : compiled.bvh.order) {
+		compiled.primitives.push_back(primitivesList[index].get());
+	}
+	// leaves now reference the reordered primitive array directly
+	for (size_t i = 0; i < compiled.bvh.order.size(); i++) {
+		compiled.bvh.order[i] = static_cast<int>(i);
+	}
+}
+
+void Scene::CompileLights() {
+	SGL_TRACE_SCOPE("compile lights");
+	compiled.lights.clear();
+	compiled.lights.reserve(lightsList->size());
+	for (const PointLight& light : *lightsList) {
+		if (light.color.r > 0.0f || light.color.g > 0.0f || light.color.b > 0.0f) {
+			compiled.lights.push_back(light);
+		}
+	}
+}
+
+AABB Sphere::BoundingBox() const {
+	Vertex extent(radius, radius, radius, 0.0f);
+	return AABB(center - extent, center + extent);
+}
+
+AABB Triangle::BoundingBox() const {
+	AABB box;
+	for (const Vertex& point : points) {
+		box.Extend(point);
+	}
+	return box;
+}
+
 Vertex Triangle::ComputeNormal(const Vertex& point) {
     Vertex v1 = points[1] - points[0];
     Vertex v2 = points[2] - points[0];
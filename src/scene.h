@@ -1,8 +1,12 @@
 #pragma once
+#include <future>
 #include <iostream>
 #include <vector>
 
 #include "structures.h"
+#include "bvh.h"
+
+class ThreadPool;
 
 using std::unique_ptr;
 using std::vector;
@@ -15,12 +19,34 @@ struct Ray {
     float ComputeT(Vertex point);
 };
 
+/**
+  The primary rays of a camera. The world space points a pixel maps to on the
+  near and far planes are affine in the pixel coordinates before the
+  perspective division, so they are kept as the points of pixel (0, 0) and
+  the steps to the next pixel in x and y.
+ */
+struct RayCamera {
+    Vertex nearOrigin;
+    Vertex farOrigin;
+    Vertex stepX;
+    Vertex stepY;
+
+    RayCamera() : nearOrigin(), farOrigin(), stepX(0, 0, 0, 0), stepY(0, 0, 0, 0) {}
+    /**
+      @param invPVM [in] inverse of the projection times modelview matrix
+      @param width [in] width of the image in pixels
+      @param height [in] height of the image in pixels
+     */
+    RayCamera(const Matrix& invPVM, int width, int height);
+};
+
 struct Primitive3D {
     int materialID;
     int emissiveMaterialID;
     // returns t parameter of ray
     virtual bool IntersectWithRay(const Ray &ray, float &t) = 0;
     virtual Vertex ComputeNormal(const Vertex &point) = 0;
+    virtual AABB BoundingBox() const = 0;
     virtual ~Primitive3D() = default;
     Primitive3D() : materialID(-1), emissiveMaterialID(-1) {};
 };
@@ -34,6 +60,7 @@ struct Sphere : Primitive3D {
 
     bool IntersectWithRay(const Ray &ray, float &t);
     Vertex ComputeNormal(const Vertex &point);
+    AABB BoundingBox() const;
 };
 
 struct Triangle : Primitive3D {
@@ -43,6 +70,7 @@ struct Triangle : Primitive3D {
     
     bool IntersectWithRay(const Ray &ray, float &t);
     Vertex ComputeNormal(const Vertex &point);
+    AABB BoundingBox() const;
 };
 
 struct EmissiveMaterial {
@@ -80,6 +108,16 @@ struct EnvironmentMap {
     EnvironmentMap(int w, int h) : width(w), height(h), texels(nullptr) {};
 };
 
+// Render-ready form of the scene, built from the primitive and light lists
+// when the scene description ends
+struct CompiledScene {
+    // primitives in the order of the spatial index leaves
+    vector<Primitive3D*> primitives;
+    BVH bvh;
+    // lights which can contribute to the image
+    vector<PointLight> lights;
+};
+
 struct Scene {
     vector<unique_ptr<Primitive3D>> primitivesList;
     unique_ptr<vector<PointLight>> lightsList;
@@ -87,6 +125,30 @@ struct Scene {
     unique_ptr<vector<EmissiveMaterial>> emissiveMaterialsList;
     unique_ptr<EnvironmentMap> envMap;
 
+    CompiledScene compiled;
+    // become ready once the corresponding part of the compiled scene is built
+    std::shared_future<void> geometryCompiled;
+    std::shared_future<void> lightsCompiled;
+
     Scene();
+    ~Scene();
     void RestartScene();
+
+    /// Starts building the compiled scene on the worker threads.
+    /**
+      The primitive and light lists must not be modified until the compilation
+      has finished, see WaitForCompilation().
+     */
+    void StartCompilation(ThreadPool& pool);
+
+    /// Blocks until the parts of the compiled scene still being built are done.
+    /**
+      If the compilation was never started, the scene is compiled on the
+      calling thread.
+     */
+    void WaitForCompilation();
+
+private:
+    void CompileGeometry();
+    void CompileLights();
 };
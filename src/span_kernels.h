@@ -0,0 +1,129 @@
+#pragma once
+
+#include "structures.h"
+
+#if defined(__SSE2__) || defined(_M_X64)
+#define SGL_SPAN_SIMD
+#include <emmintrin.h>
+#endif
+
+/**
+ * @file span_kernels.h
+ * @brief Inner loops of the scanline rasterizer
+ *
+ * The depth buffer holds 1/z, which is linear in screen space, so a span
+ * interpolates the stored value directly and no pixel needs a division.
+ */
+
+/// Tolerance of the depth test, in 1/z.
+constexpr float DEPTH_EPSILON = 0.000004f;
+
+/**
+ * @brief Depth test of one pixel against the stored 1/z.
+ *
+ * Passes and stores w when the pixel is nearer than the stored value or
+ * within DEPTH_EPSILON of it.
+ */
+inline bool depthTest(float& stored, float w) {
+    if (w > stored - DEPTH_EPSILON) {
+        stored = w;
+        return true;
+    }
+    return false;
+}
+
+/**
+ * @brief Sets count consecutive pixels to the color.
+ */
+inline void fillPixels(Pixel* dst, int count, const Pixel& color) {
+    int i = 0;
+#ifdef SGL_SPAN_SIMD
+    // four pixels are three vectors of the repeating r, g, b pattern
+    const __m128 c0 = _mm_setr_ps(color.r, color.g, color.b, color.r);
+    const __m128 c1 = _mm_setr_ps(color.g, color.b, color.r, color.g);
+    const __m128 c2 = _mm_setr_ps(color.b, color.r, color.g, color.b);
+    for (; i + 4 <= count; i += 4) {
+        float* out = reinterpret_cast<float*>(dst + i);
+        _mm_storeu_ps(out, c0);
+        _mm_storeu_ps(out + 4, c1);
+        _mm_storeu_ps(out + 8, c2);
+    }
+#endif
+    for (; i < count; i++) {
+        dst[i] = color;
+    }
+}
+
+/**
+ * @brief Fills count pixels of a span, specialized on the depth test.
+ *
+ * Pixel i of the span has the depth w + (first + i) * wStep (as 1/z), so the
+ * pieces of a longer span get the same depths as the whole span. With the
+ * depth test eight pixels are tested at once, the passing ones are written
+ * with a masked store.
+ *
+ * @param colors The first pixel of the span in the color buffer.
+ * @param depths The first value of the span in the depth buffer, unused
+ *               without the depth test.
+ * @param first Index of the first pixel in the span which w refers to.
+ * @return Number of pixels written.
+ */
+template <bool DEPTH_TEST>
+inline int fillSpan(Pixel* colors, float* depths, int count, const Pixel& color, float w, float wStep, int first) {
+    if (!DEPTH_TEST) {
+        fillPixels(colors, count, color);
+        return count > 0 ? count : 0;
+    }
+
+    int i = 0;
+    int filled = 0;
+#ifdef SGL_SPAN_SIMD
+    const __m128 lanes = _mm_setr_ps(0.0f, 1.0f, 2.0f, 3.0f);
+    const __m128 four = _mm_set1_ps(4.0f);
+    const __m128 base = _mm_set1_ps(w);
+    const __m128 step = _mm_set1_ps(wStep);
+    const __m128 epsilon = _mm_set1_ps(DEPTH_EPSILON);
+    const __m128 c0 = _mm_setr_ps(color.r, color.g, color.b, color.r);
+    const __m128 c1 = _mm_setr_ps(color.g, color.b, color.r, color.g);
+    const __m128 c2 = _mm_setr_ps(color.b, color.r, color.g, color.b);
+    for (; i + 8 <= count; i += 8) {
+        // the same w + i * wStep as the scalar tail, no error accumulates
+        const __m128 index = _mm_add_ps(_mm_set1_ps(static_cast<float>(first + i)), lanes);
+        const __m128 w0 = _mm_add_ps(base, _mm_mul_ps(index, step));
+        const __m128 w1 = _mm_add_ps(base, _mm_mul_ps(_mm_add_ps(index, four), step));
+        const __m128 d0 = _mm_loadu_ps(depths + i);
+        const __m128 d1 = _mm_loadu_ps(depths + i + 4);
+        const __m128 pass0 = _mm_cmpgt_ps(w0, _mm_sub_ps(d0, epsilon));
+        const __m128 pass1 = _mm_cmpgt_ps(w1, _mm_sub_ps(d1, epsilon));
+        _mm_storeu_ps(depths + i, _mm_or_ps(_mm_and_ps(pass0, w0), _mm_andnot_ps(pass0, d0)));
+        _mm_storeu_ps(depths + i + 4, _mm_or_ps(_mm_and_ps(pass1, w1), _mm_andnot_ps(pass1, d1)));
+
+        const int mask = _mm_movemask_ps(pass0) | (_mm_movemask_ps(pass1) << 4);
+        if (mask == 0xFF) {
+            float* out = reinterpret_cast<float*>(colors + i);
+            _mm_storeu_ps(out, c0);
+            _mm_storeu_ps(out + 4, c1);
+            _mm_storeu_ps(out + 8, c2);
+            _mm_storeu_ps(out + 12, c0);
+            _mm_storeu_ps(out + 16, c1);
+            _mm_storeu_ps(out + 20, c2);
+            filled += 8;
+        }
+        else if (mask != 0) {
+            for (int k = 0; k < 8; k++) {
+                if (mask & (1 << k)) {
+                    colors[i + k] = color;
+                    filled++;
+                }
+            }
+        }
+    }
+#endif
+    for (; i < count; i++) {
+        if (depthTest(depths[i], w + static_cast<float>(first + i) * wStep)) {
+            colors[i] = color;
+            filled++;
+        }
+    }
+    return filled;
+}
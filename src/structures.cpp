@@ -1,4 +1,10 @@
 #include "structures.h"
+#include <algorithm>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#define SGL_MATRIX_SIMD
+#include <emmintrin.h>
+#endif
 
 using std::initializer_list;
 using std::make_unique;
@@ -19,14 +25,14 @@ Vertex CrossProd(Vertex const& v1, Vertex const& v2) {
 // Matrix
 //---------------------------------------------------------------------------
 
-Matrix::Matrix() : data(16, 0.0f) {
+Matrix::Matrix() : data{} {
     data[0] = 1.0f;
     data[5] = 1.0f;
     data[10] = 1.0f;
     data[15] = 1.0f;
 }
 
-Matrix::Matrix(const float* matrix) : data(16) {
+Matrix::Matrix(const float* matrix) {
     const int w = 4;
     for (int i = 0; i < w; ++i) {
         for (int j = 0; j < w; ++j) {
@@ -35,12 +41,32 @@ Matrix::Matrix(const float* matrix) : data(16) {
     }
 }
 
+Matrix::Matrix(initializer_list<float> list) : data{} {
+    std::copy_n(list.begin(), std::min<size_t>(list.size(), data.size()), data.begin());
+}
+
 Matrix Matrix::operator*(Matrix const& m) const {
     Matrix result;
-    auto a = data;
-    auto b = m.data;
-    auto r = result.data.data();
+    const float* a = data.data();
+    float* r = result.data.data();
 
+#ifdef SGL_MATRIX_SIMD
+    // a row of the result is the rows of m weighted by a row of this matrix,
+    // summed in the same order as the scalar loop
+    const __m128 b0 = _mm_load_ps(&m.data[0]);
+    const __m128 b1 = _mm_load_ps(&m.data[4]);
+    const __m128 b2 = _mm_load_ps(&m.data[8]);
+    const __m128 b3 = _mm_load_ps(&m.data[12]);
+    for (int i = 0; i < 4; i++) {
+        __m128 sum = _mm_setzero_ps();
+        sum = _mm_add_ps(sum, _mm_mul_ps(_mm_set1_ps(a[i * 4]), b0));
+        sum = _mm_add_ps(sum, _mm_mul_ps(_mm_set1_ps(a[i * 4 + 1]), b1));
+        sum = _mm_add_ps(sum, _mm_mul_ps(_mm_set1_ps(a[i * 4 + 2]), b2));
+        sum = _mm_add_ps(sum, _mm_mul_ps(_mm_set1_ps(a[i * 4 + 3]), b3));
+        _mm_store_ps(r + i * 4, sum);
+    }
+#else
+    const float* b = m.data.data();
     for (int i = 0; i < 4; i++) {
         for (int j = 0; j < 4; j++) {
             float sum = 0;
@@ -50,6 +76,7 @@ Matrix Matrix::operator*(Matrix const& m) const {
             r[i * 4 + j] = sum;
         }
     }
+#endif
 
     return result;
 }
@@ -77,6 +104,96 @@ void Matrix::operator/=(float w) {
     }
 }
 
+#ifdef SGL_MATRIX_SIMD
+// The 2x2 blocks of the inverse are kept row-by-row in one register,
+// (a b / c d) as (a, b, c, d)
+namespace {
+
+template <int x, int y, int z, int w>
+inline __m128 swizzle(__m128 v) {
+    return _mm_shuffle_ps(v, v, _MM_SHUFFLE(w, z, y, x));
+}
+
+// (a[x], a[y], b[z], b[w])
+template <int x, int y, int z, int w>
+inline __m128 shuffle(__m128 a, __m128 b) {
+    return _mm_shuffle_ps(a, b, _MM_SHUFFLE(w, z, y, x));
+}
+
+// A * B
+inline __m128 mat2Mul(__m128 a, __m128 b) {
+    return _mm_add_ps(_mm_mul_ps(a, swizzle<0, 3, 0, 3>(b)),
+                      _mm_mul_ps(swizzle<1, 0, 3, 2>(a), swizzle<2, 1, 2, 1>(b)));
+}
+
+// adj(A) * B
+inline __m128 mat2AdjMul(__m128 a, __m128 b) {
+    return _mm_sub_ps(_mm_mul_ps(swizzle<3, 3, 0, 0>(a), b),
+                      _mm_mul_ps(swizzle<1, 1, 2, 2>(a), swizzle<2, 3, 0, 1>(b)));
+}
+
+// A * adj(B)
+inline __m128 mat2MulAdj(__m128 a, __m128 b) {
+    return _mm_sub_ps(_mm_mul_ps(a, swizzle<3, 0, 3, 0>(b)),
+                      _mm_mul_ps(swizzle<1, 0, 3, 2>(a), swizzle<2, 1, 2, 1>(b)));
+}
+
+} // namespace
+
+// For M = (A B / C D) the inverse is 1/|M| * (X Y / Z W) with
+//   adj(X) = |D|A - B adj(D)C,       adj(W) = |A|D - C adj(A)B,
+//   adj(Y) = |B|C - D adj(adj(A)B),  adj(Z) = |C|B - A adj(adj(D)C),
+//   |M| = |A||D| + |B||C| - tr(adj(A)B adj(D)C)
+int Matrix::Invert() {
+    const __m128 r0 = _mm_load_ps(&data[0]);
+    const __m128 r1 = _mm_load_ps(&data[4]);
+    const __m128 r2 = _mm_load_ps(&data[8]);
+    const __m128 r3 = _mm_load_ps(&data[12]);
+
+    const __m128 a = _mm_movelh_ps(r0, r1);
+    const __m128 b = _mm_movehl_ps(r1, r0);
+    const __m128 c = _mm_movelh_ps(r2, r3);
+    const __m128 d = _mm_movehl_ps(r3, r2);
+
+    // (|A|, |B|, |C|, |D|)
+    const __m128 detSub = _mm_sub_ps(
+        _mm_mul_ps(shuffle<0, 2, 0, 2>(r0, r2), shuffle<1, 3, 1, 3>(r1, r3)),
+        _mm_mul_ps(shuffle<1, 3, 1, 3>(r0, r2), shuffle<0, 2, 0, 2>(r1, r3)));
+    const __m128 detA = swizzle<0, 0, 0, 0>(detSub);
+    const __m128 detB = swizzle<1, 1, 1, 1>(detSub);
+    const __m128 detC = swizzle<2, 2, 2, 2>(detSub);
+    const __m128 detD = swizzle<3, 3, 3, 3>(detSub);
+
+    const __m128 adjDC = mat2AdjMul(d, c);
+    const __m128 adjAB = mat2AdjMul(a, b);
+    __m128 x = _mm_sub_ps(_mm_mul_ps(detD, a), mat2Mul(b, adjDC));
+    __m128 w = _mm_sub_ps(_mm_mul_ps(detA, d), mat2Mul(c, adjAB));
+    __m128 y = _mm_sub_ps(_mm_mul_ps(detB, c), mat2MulAdj(d, adjAB));
+    __m128 z = _mm_sub_ps(_mm_mul_ps(detC, b), mat2MulAdj(a, adjDC));
+
+    __m128 trace = _mm_mul_ps(adjAB, swizzle<0, 2, 1, 3>(adjDC));
+    trace = _mm_add_ps(trace, swizzle<2, 3, 0, 1>(trace));
+    trace = _mm_add_ps(trace, swizzle<1, 0, 3, 2>(trace));
+    const __m128 det = _mm_sub_ps(_mm_add_ps(_mm_mul_ps(detA, detD), _mm_mul_ps(detB, detC)), trace);
+    if (_mm_cvtss_f32(det) == 0.0f) {
+        return 1;  // singular matrix
+    }
+
+    // the signs of the adjugate, applied together with 1/|M|
+    const __m128 scale = _mm_div_ps(_mm_setr_ps(1.0f, -1.0f, -1.0f, 1.0f), det);
+    x = _mm_mul_ps(x, scale);
+    y = _mm_mul_ps(y, scale);
+    z = _mm_mul_ps(z, scale);
+    w = _mm_mul_ps(w, scale);
+
+    // the adjugates transposed back into the rows of the inverse
+    _mm_store_ps(&data[0], shuffle<3, 1, 3, 1>(x, y));
+    _mm_store_ps(&data[4], shuffle<2, 0, 2, 0>(x, y));
+    _mm_store_ps(&data[8], shuffle<3, 1, 3, 1>(z, w));
+    _mm_store_ps(&data[12], shuffle<2, 0, 2, 0>(z, w));
+    return 0;
+}
+#else
 inline int Convert2DTo1D(int x, int y) {
     return x + y * 4;
 }
@@ -160,6 +277,28 @@ int Matrix::Invert() {
 
     return 0;  // matrix is regular .. inversion has been succesfull
 }
+#endif
+
+//---------------------------------------------------------------------------
+// MatrixStack
+//---------------------------------------------------------------------------
+
+bool MatrixStack::Push() {
+    if (size == MATRIX_STACK_DEPTH) {
+        return false;
+    }
+    matrices[size] = matrices[size - 1];
+    size++;
+    return true;
+}
+
+bool MatrixStack::Pop() {
+    if (size == 1) {
+        return false;
+    }
+    size--;
+    return true;
+}
 
 //---------------------------------------------------------------------------
 // Vertex
@@ -200,6 +339,68 @@ void Vertex::Normalize() {
     }
 }
 
+//---------------------------------------------------------------------------
+// AABB
+//---------------------------------------------------------------------------
+
+AABB::AABB() :
+  min(INFINITY, INFINITY, INFINITY),
+  max(-INFINITY, -INFINITY, -INFINITY) {
+}
+
+void AABB::Extend(const Vertex& point) {
+    min = Vertex(fminf(min.x, point.x), fminf(min.y, point.y), fminf(min.z, point.z));
+    max = Vertex(fmaxf(max.x, point.x), fmaxf(max.y, point.y), fmaxf(max.z, point.z));
+}
+
+void AABB::Extend(const AABB& box) {
+    min = Vertex(fminf(min.x, box.min.x), fminf(min.y, box.min.y), fminf(min.z, box.min.z));
+    max = Vertex(fmaxf(max.x, box.max.x), fmaxf(max.y, box.max.y), fmaxf(max.z, box.max.z));
+}
+
+Vertex AABB::Center() const {
+    return Vertex((min.x + max.x) * 0.5f, (min.y + max.y) * 0.5f, (min.z + max.z) * 0.5f);
+}
+
+float AABB::SurfaceArea() const {
+    if (min.x > max.x) {
+        return 0.0f;
+    }
+    float dx = max.x - min.x;
+    float dy = max.y - min.y;
+    float dz = max.z - min.z;
+    return 2.0f * (dx * dy + dy * dz + dz * dx);
+}
+
+int AABB::LongestAxis() const {
+    float dx = max.x - min.x;
+    float dy = max.y - min.y;
+    float dz = max.z - min.z;
+    if (dx >= dy && dx >= dz) {
+        return 0;
+    }
+    return dy >= dz ? 1 : 2;
+}
+
+bool AABB::IntersectWithRay(const Vertex& origin, const Vertex& invDir, float tMax) const {
+    float t1 = (min.x - origin.x) * invDir.x;
+    float t2 = (max.x - origin.x) * invDir.x;
+    float tNear = fminf(t1, t2);
+    float tFar = fmaxf(t1, t2);
+
+    t1 = (min.y - origin.y) * invDir.y;
+    t2 = (max.y - origin.y) * invDir.y;
+    tNear = fmaxf(tNear, fminf(t1, t2));
+    tFar = fminf(tFar, fmaxf(t1, t2));
+
+    t1 = (min.z - origin.z) * invDir.z;
+    t2 = (max.z - origin.z) * invDir.z;
+    tNear = fmaxf(tNear, fminf(t1, t2));
+    tFar = fminf(tFar, fmaxf(t1, t2));
+
+    return tFar >= fmaxf(tNear, 0.0f) && tNear <= tMax;
+}
+
 //---------------------------------------------------------------------------
 // Edge
 //---------------------------------------------------------------------------
@@ -1,6 +1,8 @@
 #pragma once
 
 #include <math.h>
+#include <array>
+#include <initializer_list>
 #include <memory>
 #include <vector>
 
@@ -38,6 +40,38 @@ float DotProd(Vertex const& v1, Vertex const& v2);
 
 Vertex CrossProd(Vertex const& v1, Vertex const& v2);
 
+// Axis aligned bounding box
+struct AABB {
+    Vertex min;
+    Vertex max;
+
+    // creates an empty box, which becomes valid after the first Extend()
+    AABB();
+    AABB(const Vertex& min, const Vertex& max) : min(min), max(max) {}
+
+    void Extend(const Vertex& point);
+    void Extend(const AABB& box);
+    Vertex Center() const;
+    float SurfaceArea() const;
+    // returns the index of the longest axis (0 = x, 1 = y, 2 = z)
+    int LongestAxis() const;
+
+    /**
+      Slab test of a ray against the box.
+
+      @param origin [in] ray origin
+      @param invDir [in] componentwise inverse of the ray direction
+      @param tMax [in] the farthest accepted ray parameter
+      @returns true if the ray enters the box within [0, tMax]
+     */
+    bool IntersectWithRay(const Vertex& origin, const Vertex& invDir, float tMax) const;
+};
+
+// Access to the x, y, z coordinates of a vertex by the axis index
+inline float VertexAxis(const Vertex& v, int axis) {
+    return axis == 0 ? v.x : (axis == 1 ? v.y : v.z);
+}
+
 struct Pixel {
     float r, g, b;
     Pixel() : r(0), g(0), b(0) {}
@@ -60,8 +94,9 @@ struct Pixel {
     }
 };
 
-struct Matrix {
-    vector<float> data;
+// Row-by-row 4x4 matrix in one cache line, copied without allocations
+struct alignas(64) Matrix {
+    std::array<float, 16> data;
 
     Matrix();
     /**
@@ -72,16 +107,40 @@ struct Matrix {
       @returns Matrix in [row-by-row] definition
      */
     Matrix(const float* matrix);
-    Matrix(vector<float>& otherData) : data(otherData) {};
-    Matrix(std::initializer_list<float> list) : data(list) {}
+    // the 16 elements row-by-row
+    Matrix(std::initializer_list<float> list);
 
     Matrix operator*(Matrix const& m) const;
     Vertex operator*(Vertex const& v) const;
     Matrix operator/(float w);
     void operator/=(float w);
+    /**
+      Inverts the matrix in place from its 2x2 blocks and their adjugates.
+
+      @returns 0 on success, 1 for a singular matrix, which is left unchanged
+     */
     int Invert();
 };
 
+// Matrices a matrix stack holds, the bottom one included
+const int MATRIX_STACK_DEPTH = 32;
+
+// Matrix stack of fixed capacity, pushing and popping never allocate
+struct MatrixStack {
+    std::array<Matrix, MATRIX_STACK_DEPTH> matrices;
+    int size;
+
+    MatrixStack() : size(1) {}
+
+    Matrix& Top() { return matrices[size - 1]; }
+    const Matrix& Top() const { return matrices[size - 1]; }
+
+    // Duplicates the top matrix, returns false if the stack is full
+    bool Push();
+    // Drops the top matrix, returns false if only the bottom one is left
+    bool Pop();
+};
+
 //---------------------------------------------------------------------------
 // Filling structures
 //---------------------------------------------------------------------------
@@ -92,15 +151,24 @@ struct Edge {
     float stepX;
     float currentZ;
     float stepZ;
+    // +1 for an edge going up in the order of its contour, -1 going down
+    int winding;
 
+    Edge() = default;
     Edge(ScreenVertex c1, ScreenVertex c2);
 };
 
+// The scanline state of a polygon fill, reused by the next polygon of the thread
 struct alignas(64) FillingStruct {
-    vector<Edge> edges;
+    // the edges crossing the current row, sorted by currentX
     vector<Edge> activeEdgeList;
+    // the edges becoming active on the current row, before they are merged in
+    vector<Edge> incoming;
+    // the edge of the table to become active next, and the end of the table
+    const Edge* nextEdge;
+    const Edge* lastEdge;
     int maxY;
     int minY;
 
-    FillingStruct(int maxHeight) : maxY(0), minY(maxHeight) {}
+    FillingStruct() : nextEdge(nullptr), lastEdge(nullptr), maxY(0), minY(0) {}
 };
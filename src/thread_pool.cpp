@@ -0,0 +1,133 @@
+#include "thread_pool.h"
+#include <algorithm>
+#include <atomic>
+#include <memory>
+
+using std::make_shared;
+using std::shared_ptr;
+
+namespace {
+
+thread_local int workerIndex = -1;
+
+}
+
+ThreadPool::ThreadPool(unsigned numHelpers) : stopping(false), maxHelpers(numHelpers) {
+    const unsigned numThreads = std::max(1u, numHelpers);
+    workers.reserve(numThreads);
+    for (unsigned i = 0; i < numThreads; i++) {
+        workers.emplace_back(&ThreadPool::workerLoop, this, static_cast<int>(i));
+    }
+}
+
+int ThreadPool::currentWorkerIndex() {
+    return workerIndex;
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    condition.notify_all();
+    for (auto& worker : workers) {
+        worker.join();
+    }
+}
+
+void ThreadPool::workerLoop(int index) {
+    workerIndex = index;
+    while (true) {
+        function<void()> task;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            condition.wait(lock, [this] { return stopping || !tasks.empty(); });
+            // remaining tasks are finished before the pool shuts down
+            if (tasks.empty()) {
+                return;
+            }
+            task = std::move(tasks.front());
+            tasks.pop();
+        }
+        task();
+    }
+}
+
+shared_future<void> ThreadPool::submit(function<void()> task) {
+    auto packaged = make_shared<std::packaged_task<void()>>(std::move(task));
+    shared_future<void> result = packaged->get_future().share();
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        tasks.emplace([packaged] { (*packaged)(); });
+    }
+    condition.notify_one();
+    return result;
+}
+
+namespace {
+
+// State shared by the caller of parallelFor() and its helper tasks. Helpers
+// which get scheduled only after the caller has finished all the work must
+// not touch the body anymore, hence the closed flag.
+struct ParallelForState {
+    std::atomic<int> next;
+    int count;
+    const function<void(int)>* body;
+
+    std::mutex mutex;
+    std::condition_variable finished;
+    int active;
+    bool closed;
+
+    ParallelForState(int count, const function<void(int)>* body) :
+      next(0), count(count), body(body), active(0), closed(false) {}
+
+    void run() {
+        for (int i = next++; i < count; i = next++) {
+            (*body)(i);
+        }
+    }
+};
+
+}
+
+void ThreadPool::parallelFor(int count, const function<void(int)>& body) {
+    if (count <= 0) {
+        return;
+    }
+    if (count == 1 || maxHelpers == 0) {
+        for (int i = 0; i < count; i++) {
+            body(i);
+        }
+        return;
+    }
+
+    shared_ptr<ParallelForState> state = make_shared<ParallelForState>(count, &body);
+    const unsigned numHelpers = std::min<unsigned>(maxHelpers, count - 1);
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        for (unsigned i = 0; i < numHelpers; i++) {
+            tasks.emplace([state] {
+                {
+                    std::lock_guard<std::mutex> stateLock(state->mutex);
+                    if (state->closed) {
+                        return;
+                    }
+                    state->active++;
+                }
+                state->run();
+                std::lock_guard<std::mutex> stateLock(state->mutex);
+                if (--state->active == 0) {
+                    state->finished.notify_all();
+                }
+            });
+        }
+    }
+    condition.notify_all();
+
+    state->run();
+
+    std::unique_lock<std::mutex> lock(state->mutex);
+    state->closed = true;
+    state->finished.wait(lock, [&state] { return state->active == 0; });
+}
@@ -0,0 +1,76 @@
+#pragma once
+
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <vector>
+
+using std::function;
+using std::shared_future;
+using std::vector;
+
+/**
+ * @brief Fixed set of worker threads shared by all contexts of the library.
+ *
+ * The pool is created by sglInit() and owned by the scene manager. Tasks are
+ * executed in FIFO order. No task may block waiting for another task of the
+ * pool, otherwise the pool could deadlock when all workers are busy.
+ */
+class ThreadPool {
+public:
+    /**
+     * @param numHelpers Number of workers which help the caller of parallelFor().
+     *                   At least one worker is started even for zero, so that
+     *                   submitted tasks always make progress.
+     */
+    explicit ThreadPool(unsigned numHelpers);
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    /**
+     * @brief Enqueues a task for asynchronous execution.
+     *
+     * @param task The task to be executed by one of the workers.
+     * @return A future which becomes ready once the task has finished.
+     */
+    shared_future<void> submit(function<void()> task);
+
+    /**
+     * @brief Runs body(i) for every i in [0, count) and waits for completion.
+     *
+     * Indices are handed out dynamically, so uneven work (e.g. ray tracing tiles)
+     * is balanced between the workers. The calling thread takes part in the work
+     * as well, so the call makes progress even when all workers are busy.
+     *
+     * @param count Number of work items.
+     * @param body Function called once for each work item.
+     */
+    void parallelFor(int count, const function<void(int)>& body);
+
+    /**
+     * @brief Returns the number of worker threads.
+     */
+    unsigned size() const { return static_cast<unsigned>(workers.size()); }
+
+    /**
+     * @brief Returns the index of the calling worker thread.
+     *
+     * @return Index in [0, size()) for workers of a pool, -1 for other threads.
+     */
+    static int currentWorkerIndex();
+
+private:
+    void workerLoop(int index);
+
+    vector<std::thread> workers;
+    std::queue<function<void()>> tasks;
+    std::mutex mutex;
+    std::condition_variable condition;
+    bool stopping;
+    unsigned maxHelpers;
+};
@@ -0,0 +1,60 @@
+#include "tile_clear.h"
+
+#if defined(__SSE2__) || defined(_M_X64)
+#define SGL_STREAM_STORES
+#include <emmintrin.h>
+#endif
+
+TileClear::TileClear(int width, int height) :
+  width(width),
+  height(height),
+  tilesX((width + CLEAR_TILE_SIZE - 1) / CLEAR_TILE_SIZE),
+  tilesY((height + CLEAR_TILE_SIZE - 1) / CLEAR_TILE_SIZE),
+  pending(static_cast<size_t>(tilesX) * tilesY, 0),
+  pendingTiles(0) {
+}
+
+void TileClear::MarkAll() {
+    std::fill(pending.begin(), pending.end(), 1);
+    pendingTiles.store(pending.size(), std::memory_order_relaxed);
+}
+
+void TileClear::Discard() {
+    if (AnyPending()) {
+        std::fill(pending.begin(), pending.end(), 0);
+        pendingTiles.store(0, std::memory_order_relaxed);
+    }
+}
+
+void streamFill(float* dst, size_t count, const float* pattern, int period) {
+    size_t i = 0;
+#ifdef SGL_STREAM_STORES
+    // plain stores up to the first 16 byte boundary
+    while (i < count && (reinterpret_cast<uintptr_t>(dst + i) & 15) != 0) {
+        dst[i] = pattern[i % period];
+        i++;
+    }
+    // 12 floats are a whole number of periods, three vectors repeat
+    float lanes[12];
+    for (size_t k = 0; k < 12; k++) {
+        lanes[k] = pattern[(i + k) % period];
+    }
+    const __m128 a = _mm_loadu_ps(lanes);
+    const __m128 b = _mm_loadu_ps(lanes + 4);
+    const __m128 c = _mm_loadu_ps(lanes + 8);
+    for (; i + 12 <= count; i += 12) {
+        _mm_stream_ps(dst + i, a);
+        _mm_stream_ps(dst + i + 4, b);
+        _mm_stream_ps(dst + i + 8, c);
+    }
+#endif
+    for (; i < count; i++) {
+        dst[i] = pattern[i % period];
+    }
+}
+
+void streamFence() {
+#ifdef SGL_STREAM_STORES
+    _mm_sfence();
+#endif
+}
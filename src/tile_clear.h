@@ -0,0 +1,131 @@
+#pragma once
+
+#include "thread_pool.h"
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+using std::vector;
+
+/**
+ * @file tile_clear.h
+ * @brief Deferred clearing of buffers in tiles
+ */
+
+/// Side of the square tiles whose clear is tracked, in pixels.
+const int CLEAR_TILE_SHIFT = 6;
+const int CLEAR_TILE_SIZE = 1 << CLEAR_TILE_SHIFT;
+
+/**
+ * @brief Tiles of a buffer whose clear value has not been written yet.
+ *
+ * A clear only marks all the tiles pending, its cost grows with the number of
+ * tiles and not with the pixels. The owner of the buffer writes the clear
+ * value into a tile when the tile is first drawn into (Touch()), tiles which
+ * are never drawn into are written when the buffer is read (Resolve()).
+ *
+ * The fill functions passed in are called as fill(x0, y0, x1, y1) for the
+ * pixels x0 <= x < x1, y0 <= y < y1.
+ *
+ * Threads may touch different tiles at the same time, e.g. the workers of the
+ * binned rasterizer, each drawing its own tiles.
+ */
+class TileClear {
+public:
+    /// Starts with no pending tiles.
+    TileClear(int width, int height);
+
+    /// Marks all the tiles pending.
+    void MarkAll();
+
+    /// Forgets the pending tiles, e.g. when every pixel is about to be overwritten.
+    void Discard();
+
+    bool AnyPending() const { return pendingTiles.load(std::memory_order_relaxed) != 0; }
+
+    /**
+     * @brief Fills the pending tiles which the span [x1, x2] of row y lies in.
+     *
+     * The span must be inside the buffer. Only a check of a counter when no
+     * tile is pending.
+     */
+    template <typename Fill>
+    void Touch(int y, int x1, int x2, const Fill& fill) {
+        if (pendingTiles.load(std::memory_order_relaxed) == 0) {
+            return;
+        }
+        const int tileY = y >> CLEAR_TILE_SHIFT;
+        uint8_t* row = &pending[static_cast<size_t>(tileY) * tilesX];
+        const int last = x2 >> CLEAR_TILE_SHIFT;
+        for (int tileX = x1 >> CLEAR_TILE_SHIFT; tileX <= last; tileX++) {
+            if (row[tileX]) {
+                row[tileX] = 0;
+                pendingTiles.fetch_sub(1, std::memory_order_relaxed);
+                fillTiles(tileX, tileX + 1, tileY, fill);
+            }
+        }
+    }
+
+    /**
+     * @brief Fills all the pending tiles.
+     *
+     * The rows of tiles are split between the threads of the pool, runs of
+     * neighbouring pending tiles are filled by one call.
+     */
+    template <typename Fill>
+    void Resolve(ThreadPool& pool, const Fill& fill) {
+        if (pendingTiles.load(std::memory_order_relaxed) == 0) {
+            return;
+        }
+        pool.parallelFor(tilesY, [&](int tileY) {
+            const uint8_t* row = &pending[static_cast<size_t>(tileY) * tilesX];
+            int tileX = 0;
+            while (tileX < tilesX) {
+                if (!row[tileX]) {
+                    tileX++;
+                    continue;
+                }
+                const int first = tileX;
+                while (tileX < tilesX && row[tileX]) {
+                    tileX++;
+                }
+                fillTiles(first, tileX, tileY, fill);
+            }
+        });
+        Discard();
+    }
+
+private:
+    // fills the tiles [firstX, endX) of the row of tiles
+    template <typename Fill>
+    void fillTiles(int firstX, int endX, int tileY, const Fill& fill) const {
+        const int y0 = tileY << CLEAR_TILE_SHIFT;
+        fill(firstX << CLEAR_TILE_SHIFT, y0,
+             std::min(endX << CLEAR_TILE_SHIFT, width),
+             std::min(y0 + CLEAR_TILE_SIZE, height));
+    }
+
+    int width;
+    int height;
+    int tilesX;
+    int tilesY;
+    // one flag per tile, row by row of tiles
+    vector<uint8_t> pending;
+    // the flags are owned by the threads drawing the tiles, only the count is shared
+    std::atomic<size_t> pendingTiles;
+};
+
+/**
+ * @brief Writes count floats repeating the pattern of period floats (1 or 3).
+ *
+ * Uses non-temporal stores where available, so that large fills do not evict
+ * the working set from the caches. The stores are completed by streamFence().
+ */
+void streamFill(float* dst, size_t count, const float* pattern, int period);
+
+/**
+ * @brief Orders the preceding non-temporal stores of the thread before its later stores.
+ */
+void streamFence();
@@ -0,0 +1,130 @@
+#include "trace.h"
+#include "context.h"
+#include "thread_pool.h"
+#include <algorithm>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+using std::unique_ptr;
+using std::vector;
+
+std::atomic<bool> traceEnabled(false);
+
+namespace {
+
+// Rings of all the threads which have ever recorded a span. The rings are
+// never freed, the threads keep writing into them without any locking.
+std::mutex traceMutex;
+vector<unique_ptr<TraceRing>> traceRings;
+
+// trace file opened by sglTraceBegin(), guarded by traceMutex
+FILE* traceFile = nullptr;
+int64_t traceStart = 0;
+
+thread_local TraceRing* localRing = nullptr;
+
+// Slots at the old end of a full ring which are skipped by the export, the
+// owning thread may be overwriting them while the trace is written
+const uint64_t TRACE_RING_GUARD = 64;
+
+void writeEvent(FILE* file, const TraceRing& ring, const TraceEvent& event, bool& first) {
+    fprintf(file, "%s\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f",
+            first ? "" : ",", event.name, ring.threadId,
+            (event.start - traceStart) / 1000.0, event.duration / 1000.0);
+    if (event.argName) {
+        fprintf(file, ",\"args\":{\"%s\":%lld}", event.argName, static_cast<long long>(event.arg));
+    }
+    fputc('}', file);
+    first = false;
+}
+
+void writeThreadName(FILE* file, const TraceRing& ring, bool& first) {
+    char name[32];
+    if (ring.workerIndex >= 0) {
+        snprintf(name, sizeof(name), "worker %d", ring.workerIndex);
+    }
+    else {
+        snprintf(name, sizeof(name), "thread %d", ring.threadId);
+    }
+    fprintf(file, "%s\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":\"%s\"}}",
+            first ? "" : ",", ring.threadId, name);
+    first = false;
+}
+
+}
+
+TraceRing& localTraceRing() {
+    if (!localRing) {
+        std::lock_guard<std::mutex> lock(traceMutex);
+        traceRings.push_back(std::make_unique<TraceRing>(
+            static_cast<int>(traceRings.size()), ThreadPool::currentWorkerIndex()));
+        localRing = traceRings.back().get();
+    }
+    return *localRing;
+}
+
+//---------------------------------------------------------------------------
+// Tracing functions
+//---------------------------------------------------------------------------
+
+void sglTraceBegin(const char *path) {
+    if (!path) {
+        setErrCode(SGL_INVALID_VALUE);
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(traceMutex);
+    if (traceFile) {
+        setErrCode(SGL_INVALID_OPERATION);
+        return;
+    }
+    traceFile = fopen(path, "w");
+    if (!traceFile) {
+        setErrCode(SGL_INVALID_VALUE);
+        return;
+    }
+    // the rings are not cleared, spans recorded before this point are
+    // filtered out by their start time instead
+    traceStart = traceClockNs();
+    traceEnabled.store(true, std::memory_order_relaxed);
+}
+
+void sglTraceEnd() {
+    std::lock_guard<std::mutex> lock(traceMutex);
+    if (!traceFile) {
+        setErrCode(SGL_INVALID_OPERATION);
+        return;
+    }
+    traceEnabled.store(false, std::memory_order_relaxed);
+
+    bool first = true;
+    fputs("{\"displayTimeUnit\":\"ms\",\"traceEvents\":[", traceFile);
+    for (const auto& ring : traceRings) {
+        const uint64_t head = ring->head.load(std::memory_order_acquire);
+        uint64_t begin = 0;
+        if (head > TRACE_RING_CAPACITY) {
+            begin = head - TRACE_RING_CAPACITY + TRACE_RING_GUARD;
+        }
+
+        bool named = false;
+        for (uint64_t i = begin; i < head; i++) {
+            const TraceEvent& event = ring->events[i % TRACE_RING_CAPACITY];
+            if (event.start < traceStart) {
+                continue;
+            }
+            if (!named) {
+                writeThreadName(traceFile, *ring, first);
+                named = true;
+            }
+            writeEvent(traceFile, *ring, event, first);
+        }
+    }
+    fputs("\n]}\n", traceFile);
+
+    if (fclose(traceFile) != 0) {
+        setErrCode(SGL_INVALID_VALUE);
+    }
+    traceFile = nullptr;
+}
@@ -0,0 +1,86 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+
+/**
+ * @file trace.h
+ * @brief Optional recording of timed spans, exported as Chrome trace-event JSON
+ *
+ * Tracing is switched on and off at run time by sglTraceBegin() and
+ * sglTraceEnd(). While it is off, a span costs a single relaxed atomic load.
+ * Every thread records into its own ring buffer, so recording needs no locks;
+ * when a ring is full the oldest spans are overwritten.
+ */
+
+struct TraceEvent {
+    const char* name;
+    // optional integer argument, shown in the viewer when argName is set
+    const char* argName;
+    int64_t arg;
+    // nanoseconds of the steady clock
+    int64_t start;
+    int64_t duration;
+};
+
+// Number of spans kept per thread
+const int TRACE_RING_CAPACITY = 1 << 16;
+
+// Single-producer ring buffer of one thread
+struct TraceRing {
+    TraceEvent events[TRACE_RING_CAPACITY];
+    // number of events ever written, published after the event is complete
+    std::atomic<uint64_t> head;
+    // sequential id used as the tid of the exported events
+    int threadId;
+    // index of the pool worker owning the ring, -1 for other threads
+    int workerIndex;
+
+    TraceRing(int threadId, int workerIndex) : head(0), threadId(threadId), workerIndex(workerIndex) {}
+
+    void Push(const TraceEvent& event) {
+        uint64_t index = head.load(std::memory_order_relaxed);
+        events[index % TRACE_RING_CAPACITY] = event;
+        head.store(index + 1, std::memory_order_release);
+    }
+};
+
+extern std::atomic<bool> traceEnabled;
+
+/// Returns the ring buffer of the calling thread, registering it on first use.
+TraceRing& localTraceRing();
+
+inline int64_t traceClockNs() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// Records the lifetime of the enclosing scope as a span
+class TraceScope {
+public:
+    explicit TraceScope(const char* name, const char* argName = nullptr, int64_t arg = 0) :
+      name(name), argName(argName), arg(arg),
+      start(traceEnabled.load(std::memory_order_relaxed) ? traceClockNs() : -1) {}
+
+    ~TraceScope() {
+        if (start >= 0) {
+            localTraceRing().Push({ name, argName, arg, start, traceClockNs() - start });
+        }
+    }
+
+    TraceScope(const TraceScope&) = delete;
+    TraceScope& operator=(const TraceScope&) = delete;
+
+private:
+    const char* name;
+    const char* argName;
+    int64_t arg;
+    int64_t start;
+};
+
+#define SGL_TRACE_CONCAT_(a, b) a##b
+#define SGL_TRACE_CONCAT(a, b) SGL_TRACE_CONCAT_(a, b)
+
+/// Records the rest of the enclosing scope as a span with the given name.
+#define SGL_TRACE_SCOPE(...) TraceScope SGL_TRACE_CONCAT(traceScope, __LINE__)(__VA_ARGS__)
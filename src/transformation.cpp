@@ -10,6 +10,7 @@ using std::make_unique;
 
 
 void sglMatrixMode(sglEMatrixMode mode) {
+    SGL_CAPTURE(CAPTURE_MATRIX_MODE, mode);
     if (contextNotInitialized() || calledWithinBeginEnd() || isInvalidEnumValue(mode)) {
         return;
     }
@@ -18,68 +19,77 @@ void sglMatrixMode(sglEMatrixMode mode) {
 }
 
 void sglPushMatrix(void) {
+    SGL_CAPTURE(CAPTURE_PUSH_MATRIX);
     if (contextNotInitialized() || calledWithinBeginEnd()) {
         return;
     }
 
     auto currentMatrixMode = sceneManager->getCurrentContext().currentMatrixMode;
-    auto& currentMatrixStack = sceneManager->getCurrentContext().transformationStack->at(currentMatrixMode);
-
-    currentMatrixStack.push_back(Matrix(currentMatrixStack.back()));
+    auto& currentMatrixStack = sceneManager->getCurrentContext().transformationStack[currentMatrixMode];
+    if (!currentMatrixStack.Push()) {
+        setErrCode(SGL_STACK_OVERFLOW);
+    }
 }
 
 void sglPopMatrix(void) {
+    SGL_CAPTURE(CAPTURE_POP_MATRIX);
     if (contextNotInitialized() || calledWithinBeginEnd()) {
         return;
     }
 
     auto currentMatrixMode = sceneManager->getCurrentContext().currentMatrixMode;
-    auto& currentMatrixStack = sceneManager->getCurrentContext().transformationStack->at(currentMatrixMode);
-    if (currentMatrixStack.size() == 1) {
+    auto& currentMatrixStack = sceneManager->getCurrentContext().transformationStack[currentMatrixMode];
+    if (!currentMatrixStack.Pop()) {
         setErrCode(SGL_STACK_UNDERFLOW);
         return;
     }
-
-    currentMatrixStack.pop_back();
+    invalidateTransform(sceneManager->getCurrentContext());
 }
 
 void sglLoadIdentity(void) {
+    SGL_CAPTURE(CAPTURE_LOAD_IDENTITY);
     if (contextNotInitialized() || calledWithinBeginEnd()) {
         return;
     }
 
     auto currentMatrixMode = sceneManager->getCurrentContext().currentMatrixMode;
-    auto& currentMatrixStack = sceneManager->getCurrentContext().transformationStack->at(currentMatrixMode);
-    currentMatrixStack.back() = Matrix();
+    auto& currentMatrixStack = sceneManager->getCurrentContext().transformationStack[currentMatrixMode];
+    currentMatrixStack.Top() = Matrix();
+    invalidateTransform(sceneManager->getCurrentContext());
 }
 
 void sglLoadMatrix(const float *matrix) {
+    SGL_CAPTURE(CAPTURE_LOAD_MATRIX, CaptureFloats{ matrix, 16 });
     if (contextNotInitialized() || calledWithinBeginEnd()) {
         return;
     }
 
     auto currentMatrixMode = sceneManager->getCurrentContext().currentMatrixMode;
-    auto& currentMatrixStack = sceneManager->getCurrentContext().transformationStack->at(currentMatrixMode);
-    currentMatrixStack.back() = Matrix(matrix);
+    auto& currentMatrixStack = sceneManager->getCurrentContext().transformationStack[currentMatrixMode];
+    currentMatrixStack.Top() = Matrix(matrix);
+    invalidateTransform(sceneManager->getCurrentContext());
 }
 
-void multWithCurrentMatrix(Matrix other) {
+void multWithCurrentMatrix(const Matrix& other) {
     if (contextNotInitialized() || calledWithinBeginEnd()) {
         return;
     }
 
     auto currentMatrixMode = sceneManager->getCurrentContext().currentMatrixMode;
-    auto& currentMatrixStack = sceneManager->getCurrentContext().transformationStack->at(currentMatrixMode);
+    auto& currentMatrixStack = sceneManager->getCurrentContext().transformationStack[currentMatrixMode];
 
-    currentMatrixStack.back() = currentMatrixStack.back() * other;
+    currentMatrixStack.Top() = currentMatrixStack.Top() * other;
+    invalidateTransform(sceneManager->getCurrentContext());
 }
 
 void sglMultMatrix(const float *matrix) {
+    SGL_CAPTURE(CAPTURE_MULT_MATRIX, CaptureFloats{ matrix, 16 });
     // validity check is done in multWithCurrentMatrix
     multWithCurrentMatrix(Matrix(matrix));
 }
 
 void sglTranslate(float x, float y, float z) {
+    SGL_CAPTURE(CAPTURE_TRANSLATE, x, y, z);
     Matrix translation ({
         1, 0, 0, x,
         0, 1, 0, y,
@@ -92,6 +102,7 @@ void sglTranslate(float x, float y, float z) {
 }
 
 void sglScale(float x, float y, float z) {
+    SGL_CAPTURE(CAPTURE_SCALE, x, y, z);
     Matrix scale ({
         x, 0, 0, 0,
         0, y, 0, 0,
@@ -104,6 +115,7 @@ void sglScale(float x, float y, float z) {
 }
 
 void sglRotate2D(float angle, float centerx, float centery) {
+    SGL_CAPTURE(CAPTURE_ROTATE_2D, angle, centerx, centery);
     sglTranslate(centerx, centery, 0);
 
     float cosAngle = cosf(angle);
@@ -120,6 +132,7 @@ void sglRotate2D(float angle, float centerx, float centery) {
 }
 
 void sglRotateY(float angle) {
+    SGL_CAPTURE(CAPTURE_ROTATE_Y, angle);
     float cosAngle = cosf(angle);
     float sinAngle = sinf(angle);
     Matrix rotateY ({
@@ -134,6 +147,7 @@ void sglRotateY(float angle) {
 }
 
 void sglOrtho(float l, float r, float b, float t, float n, float f) {
+    SGL_CAPTURE(CAPTURE_ORTHO, l, r, b, t, n, f);
     if (l == r || b == t || n == f) {
         setErrCode(SGL_INVALID_VALUE);
         return;
@@ -151,6 +165,7 @@ void sglOrtho(float l, float r, float b, float t, float n, float f) {
 }
 
 void sglFrustum(float l, float r, float b, float t, float n, float f) {
+    SGL_CAPTURE(CAPTURE_FRUSTUM, l, r, b, t, n, f);
     if (l == r || b == t || n <= 0 || f <= 0) {
         setErrCode(SGL_INVALID_VALUE);
         return;
@@ -168,6 +183,7 @@ void sglFrustum(float l, float r, float b, float t, float n, float f) {
 }
 
 void sglViewport(int x, int y, int width, int height) {
+    SGL_CAPTURE(CAPTURE_VIEWPORT, x, y, width, height);
     if (width <= 0 || height <= 0) {
         setErrCode(SGL_INVALID_VALUE);
         return;
@@ -176,7 +192,8 @@ void sglViewport(int x, int y, int width, int height) {
         return;
     }
 
-    // not done clipping
+    // the primitives are clipped to the canvas (with a guard band), not to
+    // the viewport, see clip.h
     float viewportWidth = float(width) / 2.0f;
     float viewportHeight = float(height) / 2.0f;
     Matrix viewport ({
@@ -186,5 +203,7 @@ void sglViewport(int x, int y, int width, int height) {
         0,                          0, 0,                  1
     });
 
-    sceneManager->getCurrentContext().viewportMatrix = viewport;
+    SGLContext& context = sceneManager->getCurrentContext();
+    context.viewportMatrix = viewport;
+    invalidateTransform(context);
 }
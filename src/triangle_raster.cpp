@@ -0,0 +1,244 @@
+#include "triangle_raster.h"
+#include "draw_utils.h"
+#include "span_kernels.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+
+using std::max;
+using std::min;
+
+namespace {
+
+// Vertices are snapped to 1/256 of a pixel
+const int SUBPIXEL_BITS = 8;
+const int64_t SUBPIXEL_ONE = int64_t(1) << SUBPIXEL_BITS;
+const int64_t SUBPIXEL_HALF = SUBPIXEL_ONE / 2;
+
+// Side of the square blocks which are tested against the edges as a whole
+const int BLOCK_SHIFT = 3;
+const int BLOCK_SIZE = 1 << BLOCK_SHIFT;
+
+// Triangles reaching further from the origin (in pixels) are filled by
+// fillPolygon(), their edge functions could overflow 64 bits
+const float GUARD_BAND = float(1 << 20);
+
+/**
+ * @brief Edge function of a directed edge in subpixel units.
+ *
+ * E(x, y) = a * x + b * y + c is positive left of the edge, i.e. inside a
+ * counter-clockwise triangle. The fill rule is folded into c, a pixel is
+ * covered when E is not negative at its center for all three edges.
+ */
+struct EdgeFunction {
+    int64_t a;
+    int64_t b;
+    int64_t c;
+
+    EdgeFunction(int64_t x0, int64_t y0, int64_t x1, int64_t y1) :
+      a(y0 - y1),
+      b(x1 - x0),
+      c(-(a * x0 + b * y0)) {
+        // the two triangles sharing an edge see it in opposite directions,
+        // centers exactly on it are left to the one which sees it this way
+        if (!(a > 0 || (a == 0 && b > 0))) {
+            c -= 1;
+        }
+    }
+
+    // value at the center of the pixel
+    int64_t At(int x, int y) const {
+        return a * (x * SUBPIXEL_ONE + SUBPIXEL_HALF) + b * (y * SUBPIXEL_ONE + SUBPIXEL_HALF) + c;
+    }
+};
+
+/**
+ * @brief Fills the triangle of snapped vertices in counter-clockwise order.
+ *
+ * The bounding box is walked in BLOCK_SIZE aligned blocks. Blocks outside an
+ * edge are skipped, blocks inside all edges are filled without testing the
+ * pixels and runs of them are merged into longer spans. Only the blocks on
+ * the edges are tested pixel by pixel.
+ */
+template <bool DEPTH_TEST>
+void rasterize(SGLContext& context, const RasterState& state,
+               const int64_t x[3], const int64_t y[3], const float z[3]) {
+    FrameBuffer& colorBuffer = *context.colorBuffer;
+    const Pixel color = state.color;
+
+    // covered pixel centers of the bounding box, clipped to the window
+    const int minX = max(state.minX, static_cast<int>((min({ x[0], x[1], x[2] }) - SUBPIXEL_HALF + SUBPIXEL_ONE - 1) >> SUBPIXEL_BITS));
+    const int minY = max(state.minY, static_cast<int>((min({ y[0], y[1], y[2] }) - SUBPIXEL_HALF + SUBPIXEL_ONE - 1) >> SUBPIXEL_BITS));
+    const int maxX = min(state.maxX, static_cast<int>((max({ x[0], x[1], x[2] }) - SUBPIXEL_HALF) >> SUBPIXEL_BITS));
+    const int maxY = min(state.maxY, static_cast<int>((max({ y[0], y[1], y[2] }) - SUBPIXEL_HALF) >> SUBPIXEL_BITS));
+    if (minX > maxX || minY > maxY) {
+        return;
+    }
+
+    const EdgeFunction edges[3] = {
+        EdgeFunction(x[0], y[0], x[1], y[1]),
+        EdgeFunction(x[1], y[1], x[2], y[2]),
+        EdgeFunction(x[2], y[2], x[0], y[0]),
+    };
+
+    // plane of 1/z over the pixel centers, from the snapped positions
+    const float fx0 = x[0] / float(SUBPIXEL_ONE);
+    const float fy0 = y[0] / float(SUBPIXEL_ONE);
+    const float dx1 = (x[1] - x[0]) / float(SUBPIXEL_ONE);
+    const float dy1 = (y[1] - y[0]) / float(SUBPIXEL_ONE);
+    const float dx2 = (x[2] - x[0]) / float(SUBPIXEL_ONE);
+    const float dy2 = (y[2] - y[0]) / float(SUBPIXEL_ONE);
+    const float area = dx1 * dy2 - dx2 * dy1;
+    const float w0 = 1.0f / z[0];
+    const float dw1 = 1.0f / z[1] - w0;
+    const float dw2 = 1.0f / z[2] - w0;
+    const float wStepX = (dw1 * dy2 - dw2 * dy1) / area;
+    const float wStepY = (dw2 * dx1 - dw1 * dx2) / area;
+
+    int filled = 0;
+    auto fillRow = [&](int row, int first, int last) {
+        touchSpan(context, colorBuffer, row, first, last);
+        // depth of the row at column 0, the pixels do not depend on where
+        // the window cuts the row
+        const float w = w0 + wStepX * (0.5f - fx0) + wStepY * (row + 0.5f - fy0);
+        float* depths = DEPTH_TEST ? context.depthBuffer->Row(row) + first : nullptr;
+        filled += fillSpan<DEPTH_TEST>(colorBuffer.Row(row) + first, depths, last - first + 1,
+                                       color, w, wStepX, first);
+    };
+
+    // change of an edge function across a block
+    int64_t blockDX[3];
+    int64_t blockDY[3];
+    for (int k = 0; k < 3; k++) {
+        blockDX[k] = edges[k].a * SUBPIXEL_ONE * (BLOCK_SIZE - 1);
+        blockDY[k] = edges[k].b * SUBPIXEL_ONE * (BLOCK_SIZE - 1);
+    }
+
+    for (int blockY = minY & ~(BLOCK_SIZE - 1); blockY <= maxY; blockY += BLOCK_SIZE) {
+        const int rowFirst = max(blockY, minY);
+        const int rowLast = min(blockY + BLOCK_SIZE - 1, maxY);
+        // first column of the run of accepted blocks not filled yet, -1 if none
+        int runFirst = -1;
+        int runLast = -1;
+        auto flushRun = [&]() {
+            if (runFirst >= 0) {
+                for (int row = rowFirst; row <= rowLast; row++) {
+                    fillRow(row, runFirst, runLast);
+                }
+                runFirst = -1;
+            }
+        };
+
+        for (int blockX = minX & ~(BLOCK_SIZE - 1); blockX <= maxX; blockX += BLOCK_SIZE) {
+            // the extremes of a linear function over the block are at its corners
+            bool outside = false;
+            bool inside = true;
+            for (int k = 0; k < 3; k++) {
+                const int64_t corner = edges[k].At(blockX, blockY);
+                const int64_t highest = corner + max<int64_t>(blockDX[k], 0) + max<int64_t>(blockDY[k], 0);
+                const int64_t lowest = corner + min<int64_t>(blockDX[k], 0) + min<int64_t>(blockDY[k], 0);
+                outside |= highest < 0;
+                inside &= lowest >= 0;
+            }
+            const int columnFirst = max(blockX, minX);
+            const int columnLast = min(blockX + BLOCK_SIZE - 1, maxX);
+
+            if (outside) {
+                flushRun();
+                continue;
+            }
+            if (inside) {
+                if (runFirst < 0) {
+                    runFirst = columnFirst;
+                }
+                runLast = columnLast;
+                continue;
+            }
+
+            flushRun();
+            for (int row = rowFirst; row <= rowLast; row++) {
+                int64_t e0 = edges[0].At(columnFirst, row);
+                int64_t e1 = edges[1].At(columnFirst, row);
+                int64_t e2 = edges[2].At(columnFirst, row);
+                // a row of a triangle is covered in one run
+                int first = -1;
+                int last = -1;
+                for (int column = columnFirst; column <= columnLast; column++) {
+                    if ((e0 | e1 | e2) >= 0) {
+                        if (first < 0) {
+                            first = column;
+                        }
+                        last = column;
+                    }
+                    else if (first >= 0) {
+                        break;
+                    }
+                    e0 += edges[0].a * SUBPIXEL_ONE;
+                    e1 += edges[1].a * SUBPIXEL_ONE;
+                    e2 += edges[2].a * SUBPIXEL_ONE;
+                }
+                if (first >= 0) {
+                    fillRow(row, first, last);
+                }
+            }
+        }
+        flushRun();
+    }
+    SGL_STAT_ADD(context, pixelsFilled, filled);
+    (void)filled;
+}
+
+} // namespace
+
+void fillTriangle(SGLContext& context, const RasterState& state,
+                  const Vertex& v0, const Vertex& v1, const Vertex& v2) {
+    const Vertex* vertices[3] = { &v0, &v1, &v2 };
+    for (const Vertex* v : vertices) {
+        if (!(std::fabs(v->x) < GUARD_BAND && std::fabs(v->y) < GUARD_BAND)) {
+            if (std::isnan(v->x) || std::isnan(v->y)) {
+                return;
+            }
+            // far outside of the canvas, the scanline filler clips it
+            ScreenVertex corners[3];
+            for (int i = 0; i < 3; i++) {
+                corners[i] = ScreenVertex(static_cast<int>(vertices[i]->x), static_cast<int>(vertices[i]->y), vertices[i]->z);
+            }
+            fillPolygon(context, state, corners, 3);
+            return;
+        }
+    }
+
+    int64_t x[3];
+    int64_t y[3];
+    float z[3];
+    for (int i = 0; i < 3; i++) {
+        x[i] = std::llround(vertices[i]->x * SUBPIXEL_ONE);
+        y[i] = std::llround(vertices[i]->y * SUBPIXEL_ONE);
+        z[i] = vertices[i]->z;
+    }
+
+    // both windings are drawn, the rasterizer expects counter-clockwise
+    const int64_t area = (x[1] - x[0]) * (y[2] - y[0]) - (x[2] - x[0]) * (y[1] - y[0]);
+    if (area == 0) {
+        return;
+    }
+    if (area < 0) {
+        std::swap(x[1], x[2]);
+        std::swap(y[1], y[2]);
+        std::swap(z[1], z[2]);
+    }
+
+    if (state.depthTest) {
+        rasterize<true>(context, state, x, y, z);
+    }
+    else {
+        rasterize<false>(context, state, x, y, z);
+    }
+}
+
+void fillTriangles(SGLContext& context, const RasterState& state, const Vertex* vertices, size_t count) {
+    SGL_TRACE_SCOPE("fillTriangles", "triangles", static_cast<int64_t>(count / 3));
+    for (size_t i = 0; i + 2 < count; i += 3) {
+        fillTriangle(context, state, vertices[i], vertices[i + 1], vertices[i + 2]);
+    }
+}
@@ -0,0 +1,39 @@
+#pragma once
+
+#include "context.h"
+#include "draw_utils.h"
+
+/**
+ * @file triangle_raster.h
+ * @brief Half-space rasterizer of filled triangles
+ */
+
+/**
+ * @brief Fills a triangle list given in window coordinates.
+ *
+ * Every three consecutive vertices form a triangle, remaining vertices are
+ * ignored. The vertices keep their subpixel positions, unlike the screen
+ * vertices of the other primitives.
+ *
+ * @param context The context to draw into.
+ * @param state The state to draw with.
+ * @param vertices The transformed vertices.
+ * @param count The number of the vertices.
+ */
+void fillTriangles(SGLContext& context, const RasterState& state, const Vertex* vertices, size_t count);
+
+/**
+ * @brief Fills one triangle given in window coordinates.
+ *
+ * Pixels whose centers lie inside the triangle are drawn, pixels on an edge
+ * shared by two triangles belong to exactly one of them. The depth is
+ * interpolated as 1/z and tested like the spans of fillPolygon().
+ *
+ * @param context The context to draw into.
+ * @param state The state to draw with.
+ * @param v0 The first vertex, x and y in pixels and z in [0, 1].
+ * @param v1 The second vertex.
+ * @param v2 The third vertex.
+ */
+void fillTriangle(SGLContext& context, const RasterState& state,
+                  const Vertex& v0, const Vertex& v1, const Vertex& v2);
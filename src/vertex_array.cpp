@@ -0,0 +1,274 @@
+#include "vertex_array.h"
+#include "context.h"
+#include "draw_utils.h"
+#include <algorithm>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#define SGL_VERTEX_SIMD
+#include <emmintrin.h>
+#endif
+
+// The 8-wide kernel is compiled for AVX and chosen at run time, the library
+// itself is built for the SSE2 baseline
+#if defined(SGL_VERTEX_SIMD) && (defined(__GNUC__) || defined(__clang__))
+#define SGL_VERTEX_AVX
+#define SGL_AVX_TARGET __attribute__((target("avx")))
+#include <immintrin.h>
+#endif
+
+namespace {
+
+inline void storeVertex(Vertex* out, const Vertex& v) {
+    *out = v;
+}
+
+inline void storeVertex(ScreenVertex* out, const Vertex& v) {
+    *out = ScreenVertex(static_cast<int>(v.x), static_cast<int>(v.y), v.z);
+}
+
+// The vertices from the index of the block on, the scalar path of all kernels
+template <typename Out>
+void transformScalar(const SGLContext& context, const VertexArray& array, const unsigned* indices,
+                     size_t first, size_t begin, size_t count, Out* out) {
+    for (size_t i = begin; i < count; i++) {
+        const size_t index = indices ? first + indices[i] : first + i;
+        storeVertex(out + i, transformPoint(context, readVertex(array, index)));
+    }
+}
+
+#ifdef SGL_VERTEX_SIMD
+// Four vertices of the array as x, y, z and w of each, a vertex of four
+// components is loaded whole and transposed
+inline void loadBlock(const VertexArray& array, const size_t* index,
+                      __m128& x, __m128& y, __m128& z, __m128& w) {
+    if (array.size == 4) {
+        const char* base = reinterpret_cast<const char*>(array.pointer);
+        x = _mm_loadu_ps(reinterpret_cast<const float*>(base + index[0] * array.stride));
+        y = _mm_loadu_ps(reinterpret_cast<const float*>(base + index[1] * array.stride));
+        z = _mm_loadu_ps(reinterpret_cast<const float*>(base + index[2] * array.stride));
+        w = _mm_loadu_ps(reinterpret_cast<const float*>(base + index[3] * array.stride));
+        _MM_TRANSPOSE4_PS(x, y, z, w);
+        return;
+    }
+    const Vertex v0 = readVertex(array, index[0]);
+    const Vertex v1 = readVertex(array, index[1]);
+    const Vertex v2 = readVertex(array, index[2]);
+    const Vertex v3 = readVertex(array, index[3]);
+    x = _mm_setr_ps(v0.x, v1.x, v2.x, v3.x);
+    y = _mm_setr_ps(v0.y, v1.y, v2.y, v3.y);
+    z = _mm_setr_ps(v0.z, v1.z, v2.z, v3.z);
+    w = _mm_setr_ps(v0.w, v1.w, v2.w, v3.w);
+}
+
+// Transposes the four vertices back and writes them
+inline void storeBlock(Vertex* out, __m128 x, __m128 y, __m128 z, __m128 w) {
+    _MM_TRANSPOSE4_PS(x, y, z, w);
+    _mm_storeu_ps(&out[0].x, x);
+    _mm_storeu_ps(&out[1].x, y);
+    _mm_storeu_ps(&out[2].x, z);
+    _mm_storeu_ps(&out[3].x, w);
+}
+
+// The window coordinates truncated towards zero as static_cast<int> does,
+// written together with the depth and the padding of ScreenVertex
+inline void storeBlock(ScreenVertex* out, __m128 x, __m128 y, __m128 z, __m128) {
+    __m128 sx = _mm_castsi128_ps(_mm_cvttps_epi32(x));
+    __m128 sy = _mm_castsi128_ps(_mm_cvttps_epi32(y));
+    __m128 sz = z;
+    __m128 padding = _mm_setzero_ps();
+    _MM_TRANSPOSE4_PS(sx, sy, sz, padding);
+    _mm_storeu_ps(reinterpret_cast<float*>(out), sx);
+    _mm_storeu_ps(reinterpret_cast<float*>(out + 1), sy);
+    _mm_storeu_ps(reinterpret_cast<float*>(out + 2), sz);
+    _mm_storeu_ps(reinterpret_cast<float*>(out + 3), padding);
+}
+
+// Row of the matrix times the vertices, summed in the order of Matrix::operator*
+inline __m128 dotRow(const __m128* row, __m128 x, __m128 y, __m128 z, __m128 w) {
+    return _mm_add_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(row[0], x), _mm_mul_ps(row[1], y)),
+                                 _mm_mul_ps(row[2], z)),
+                      _mm_mul_ps(row[3], w));
+}
+
+inline __m128 select(__m128 mask, __m128 a, __m128 b) {
+    return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b));
+}
+
+template <typename Out>
+void transformSSE2(const SGLContext& context, const VertexArray& array, const unsigned* indices,
+                   size_t first, size_t count, Out* out) {
+    __m128 m[16];
+    for (int k = 0; k < 16; k++) {
+        m[k] = _mm_set1_ps(context.VPMmatrix.data[k]);
+    }
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 one = _mm_set1_ps(1.0f);
+    const __m128 half = _mm_set1_ps(0.5f);
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        size_t index[4];
+        for (int k = 0; k < 4; k++) {
+            index[k] = indices ? first + indices[i + k] : first + i + k;
+        }
+        __m128 x, y, z, w;
+        loadBlock(array, index, x, y, z, w);
+
+        __m128 tx = dotRow(m, x, y, z, w);
+        __m128 ty = dotRow(m + 4, x, y, z, w);
+        __m128 tz = dotRow(m + 8, x, y, z, w);
+        __m128 tw = dotRow(m + 12, x, y, z, w);
+
+        // the perspective division of transformPoint(), skipped for w = 0
+        const __m128 divide = _mm_cmpneq_ps(tw, zero);
+        const __m128 invW = _mm_div_ps(one, tw);
+        tx = select(divide, _mm_mul_ps(tx, invW), tx);
+        ty = select(divide, _mm_mul_ps(ty, invW), ty);
+        tz = select(divide, _mm_mul_ps(tz, invW), tz);
+        tw = select(divide, one, tw);
+        tz = _mm_mul_ps(_mm_add_ps(tz, one), half);
+        storeBlock(out + i, tx, ty, tz, tw);
+    }
+    transformScalar(context, array, indices, first, i, count, out);
+}
+#endif
+
+#ifdef SGL_VERTEX_AVX
+SGL_AVX_TARGET inline __m256 combine(__m128 low, __m128 high) {
+    return _mm256_insertf128_ps(_mm256_castps128_ps256(low), high, 1);
+}
+
+SGL_AVX_TARGET inline __m256 dotRow(const __m256* row, __m256 x, __m256 y, __m256 z, __m256 w) {
+    return _mm256_add_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(row[0], x), _mm256_mul_ps(row[1], y)),
+                                       _mm256_mul_ps(row[2], z)),
+                         _mm256_mul_ps(row[3], w));
+}
+
+// The SSE2 kernel eight vertices at a time, with the same results. The
+// products and sums are kept apart rather than fused, so that the window
+// coordinates do not depend on the processor.
+template <typename Out>
+SGL_AVX_TARGET void transformAVX(const SGLContext& context, const VertexArray& array,
+                                 const unsigned* indices, size_t first, size_t count, Out* out) {
+    __m256 m[16];
+    for (int k = 0; k < 16; k++) {
+        m[k] = _mm256_set1_ps(context.VPMmatrix.data[k]);
+    }
+    const __m256 zero = _mm256_setzero_ps();
+    const __m256 one = _mm256_set1_ps(1.0f);
+    const __m256 half = _mm256_set1_ps(0.5f);
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        size_t index[8];
+        for (int k = 0; k < 8; k++) {
+            index[k] = indices ? first + indices[i + k] : first + i + k;
+        }
+        __m128 x0, y0, z0, w0, x1, y1, z1, w1;
+        loadBlock(array, index, x0, y0, z0, w0);
+        loadBlock(array, index + 4, x1, y1, z1, w1);
+        const __m256 x = combine(x0, x1);
+        const __m256 y = combine(y0, y1);
+        const __m256 z = combine(z0, z1);
+        const __m256 w = combine(w0, w1);
+
+        __m256 tx = dotRow(m, x, y, z, w);
+        __m256 ty = dotRow(m + 4, x, y, z, w);
+        __m256 tz = dotRow(m + 8, x, y, z, w);
+        __m256 tw = dotRow(m + 12, x, y, z, w);
+
+        const __m256 divide = _mm256_cmp_ps(tw, zero, _CMP_NEQ_UQ);
+        const __m256 invW = _mm256_div_ps(one, tw);
+        tx = _mm256_blendv_ps(tx, _mm256_mul_ps(tx, invW), divide);
+        ty = _mm256_blendv_ps(ty, _mm256_mul_ps(ty, invW), divide);
+        tz = _mm256_blendv_ps(tz, _mm256_mul_ps(tz, invW), divide);
+        tw = _mm256_blendv_ps(tw, one, divide);
+        tz = _mm256_mul_ps(_mm256_add_ps(tz, one), half);
+
+        storeBlock(out + i, _mm256_castps256_ps128(tx), _mm256_castps256_ps128(ty),
+                   _mm256_castps256_ps128(tz), _mm256_castps256_ps128(tw));
+        storeBlock(out + i + 4, _mm256_extractf128_ps(tx, 1), _mm256_extractf128_ps(ty, 1),
+                   _mm256_extractf128_ps(tz, 1), _mm256_extractf128_ps(tw, 1));
+    }
+    transformScalar(context, array, indices, first, i, count, out);
+}
+#endif
+
+enum class Kernel {
+    Scalar,
+    SSE2,
+    AVX,
+};
+
+// Chosen once, by what the processor supports
+Kernel selectKernel() {
+#ifdef SGL_VERTEX_AVX
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx")) {
+        return Kernel::AVX;
+    }
+#endif
+#ifdef SGL_VERTEX_SIMD
+    return Kernel::SSE2;
+#else
+    return Kernel::Scalar;
+#endif
+}
+
+template <typename Out>
+void transformArray(const SGLContext& context, const VertexArray& array, const unsigned* indices,
+                    size_t first, size_t count, Out* out) {
+    static const Kernel kernel = selectKernel();
+    switch (kernel) {
+#ifdef SGL_VERTEX_AVX
+        case Kernel::AVX:
+            transformAVX(context, array, indices, first, count, out);
+            return;
+#endif
+#ifdef SGL_VERTEX_SIMD
+        case Kernel::SSE2:
+            transformSSE2(context, array, indices, first, count, out);
+            return;
+#endif
+        default:
+            transformScalar(context, array, indices, first, 0, count, out);
+            return;
+    }
+}
+
+} // namespace
+
+void boundVertexArray(const VertexArray& array, const unsigned* indices, size_t first, size_t count,
+                      Vertex& lower, Vertex& upper) {
+#ifdef SGL_VERTEX_SIMD
+    if (array.size == 4) {
+        const char* base = reinterpret_cast<const char*>(array.pointer);
+        const float* v = reinterpret_cast<const float*>(base + (indices ? first + indices[0] : first) * array.stride);
+        __m128 low = _mm_loadu_ps(v);
+        __m128 high = low;
+        for (size_t i = 1; i < count; i++) {
+            const size_t index = indices ? first + indices[i] : first + i;
+            const __m128 vertex = _mm_loadu_ps(reinterpret_cast<const float*>(base + index * array.stride));
+            low = _mm_min_ps(low, vertex);
+            high = _mm_max_ps(high, vertex);
+        }
+        _mm_storeu_ps(&lower.x, low);
+        _mm_storeu_ps(&upper.x, high);
+        return;
+    }
+#endif
+    lower = upper = readVertex(array, indices ? first + indices[0] : first);
+    for (size_t i = 1; i < count; i++) {
+        const Vertex v = readVertex(array, indices ? first + indices[i] : first + i);
+        lower = Vertex(std::min(lower.x, v.x), std::min(lower.y, v.y), std::min(lower.z, v.z), std::min(lower.w, v.w));
+        upper = Vertex(std::max(upper.x, v.x), std::max(upper.y, v.y), std::max(upper.z, v.z), std::max(upper.w, v.w));
+    }
+}
+
+void transformVertexArray(const SGLContext& context, const VertexArray& array, const unsigned* indices,
+                          size_t first, size_t count, Vertex* out) {
+    transformArray(context, array, indices, first, count, out);
+}
+
+void transformVertexArray(const SGLContext& context, const VertexArray& array, const unsigned* indices,
+                          size_t first, size_t count, ScreenVertex* out) {
+    transformArray(context, array, indices, first, count, out);
+}
@@ -0,0 +1,73 @@
+#pragma once
+
+#include "structures.h"
+#include <cstddef>
+
+struct SGLContext;
+
+/**
+ * @file vertex_array.h
+ * @brief Vertices read from arrays of the application, see sglVertexPointer()
+ */
+
+/**
+ * @brief An array of vertices with 2 to 4 float components.
+ *
+ * A missing z is 0, a missing w is 1.
+ */
+struct VertexArray {
+    const float* pointer;
+    int size;
+    // distance between the starts of consecutive vertices in bytes
+    size_t stride;
+};
+
+/**
+ * @brief Reads one vertex of the array.
+ */
+inline Vertex readVertex(const VertexArray& array, size_t index) {
+    const float* v = reinterpret_cast<const float*>(
+        reinterpret_cast<const char*>(array.pointer) + index * array.stride);
+    return Vertex(v[0], v[1], array.size > 2 ? v[2] : 0.0f, array.size > 3 ? v[3] : 1.0f);
+}
+
+/**
+ * @brief The bounding box of vertices of the array, in object coordinates.
+ *
+ * The parameters are the same as of transformVertexArray(), count must not
+ * be 0.
+ *
+ * @param lower Set to the minimal x, y, z and w.
+ * @param upper Set to the maximal x, y, z and w.
+ */
+void boundVertexArray(const VertexArray& array, const unsigned* indices, size_t first, size_t count,
+                      Vertex& lower, Vertex& upper);
+
+/**
+ * @brief Transforms vertices of the array into window coordinates, with the
+ *        same results as transformPoint().
+ *
+ * The vertices are transposed into blocks of their x, y, z and w and
+ * transformed eight at a time with AVX or four at a time with SSE2, as the
+ * processor supports, the rest one by one.
+ *
+ * @param context The context whose VPM matrix is used.
+ * @param array The vertices.
+ * @param indices The indices of the vertices to transform, nullptr for the
+ *                consecutive vertices from first.
+ * @param first The first index used when indices is nullptr, added to the
+ *              indices otherwise.
+ * @param count The number of the vertices.
+ * @param out Receives count vertices.
+ */
+void transformVertexArray(const SGLContext& context, const VertexArray& array, const unsigned* indices,
+                          size_t first, size_t count, Vertex* out);
+
+/**
+ * @brief Transforms vertices of the array into screen vertices, the window
+ *        coordinates truncated as sglEnd() does.
+ *
+ * The parameters are the same as of the other overload.
+ */
+void transformVertexArray(const SGLContext& context, const VertexArray& array, const unsigned* indices,
+                          size_t first, size_t count, ScreenVertex* out);
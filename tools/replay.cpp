@@ -0,0 +1,534 @@
+/*
+  ---------------------------------------------------------------------------
+  replay.cpp
+  Replays an API capture recorded by sglCaptureBegin() / sglCaptureEnd().
+
+  Usage: sgl_replay <capture> [--paced | --fps n] [--loops n] [--dump] [--out <file>]
+
+  By default the calls are replayed as fast as possible. --paced starts every
+  frame at the time it started during the capture, --fps n starts the frames
+  at a fixed rate. A frame starts with sglClear() of the color buffer, the
+  same as for sglGetRenderStats(). Per-frame wall-clock times are reported as
+  JSON; --dump prints the decoded calls instead of replaying them.
+
+  Calls recorded from several application threads are replayed in their
+  recorded order, each on a replay thread of its own (the calls of the
+  thread which started the capture on the main thread), so that the context
+  selection and the command buffers of the recording threads are kept.
+  ---------------------------------------------------------------------------
+*/
+#include "sgl.h"
+#include "capture.h"
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+using std::string;
+using std::vector;
+
+namespace {
+
+struct Record {
+    CaptureOpcode opcode;
+    // microseconds since the start of the capture
+    uint64_t time;
+    // first scalar argument in Capture::scalars
+    uint32_t scalars;
+    // float array argument in Capture::arrays, if the signature has one
+    uint32_t array;
+    uint32_t arrayCount;
+};
+
+union Scalar {
+    int32_t i;
+    uint32_t u;
+    float f;
+};
+
+struct Capture {
+    vector<Record> records;
+    vector<Scalar> scalars;
+    vector<float> arrays;
+};
+
+bool readVarint(const vector<uint8_t>& bytes, size_t& pos, uint64_t& value) {
+    value = 0;
+    for (int shift = 0; pos < bytes.size() && shift < 64; shift += 7) {
+        const uint8_t byte = bytes[pos++];
+        value |= uint64_t(byte & 0x7f) << shift;
+        if (!(byte & 0x80)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Decodes the whole capture up front, so that replaying does no parsing
+bool loadCapture(const string& path, Capture& capture, string& error) {
+    std::ifstream file(path, std::ios::binary);
+    if (!file) {
+        error = "cannot open " + path;
+        return false;
+    }
+    const vector<uint8_t> bytes((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    if (bytes.size() < sizeof(CAPTURE_MAGIC) || memcmp(bytes.data(), CAPTURE_MAGIC, sizeof(CAPTURE_MAGIC)) != 0) {
+        error = path + " is not an SGL capture";
+        return false;
+    }
+
+    size_t pos = sizeof(CAPTURE_MAGIC);
+    uint64_t time = 0;
+    while (pos < bytes.size()) {
+        Record record = {};
+        const uint8_t opcode = bytes[pos++];
+        uint64_t delta = 0;
+        if (opcode >= CAPTURE_OPCODE_COUNT || !readVarint(bytes, pos, delta)) {
+            error = "corrupted record at offset " + std::to_string(pos);
+            return false;
+        }
+        time += delta;
+        record.opcode = static_cast<CaptureOpcode>(opcode);
+        record.time = time;
+        record.scalars = static_cast<uint32_t>(capture.scalars.size());
+
+        for (const char* type = CAPTURE_CALLS[opcode].signature; *type; type++) {
+            uint32_t word = 0;
+            if (pos + 4 > bytes.size()) {
+                error = "truncated record at offset " + std::to_string(pos);
+                return false;
+            }
+            memcpy(&word, &bytes[pos], 4);
+            pos += 4;
+            if (*type != 'F') {
+                Scalar scalar;
+                scalar.u = word;
+                capture.scalars.push_back(scalar);
+                continue;
+            }
+            if (pos + size_t(word) * 4 > bytes.size()) {
+                error = "truncated array at offset " + std::to_string(pos);
+                return false;
+            }
+            record.array = static_cast<uint32_t>(capture.arrays.size());
+            record.arrayCount = word;
+            capture.arrays.resize(capture.arrays.size() + word);
+            memcpy(&capture.arrays[record.array], &bytes[pos], size_t(word) * 4);
+            pos += size_t(word) * 4;
+        }
+        capture.records.push_back(record);
+    }
+    return true;
+}
+
+void dumpCapture(const Capture& capture) {
+    for (const Record& record : capture.records) {
+        const Scalar* s = &capture.scalars[record.scalars];
+        printf("%10.3f ms  %s(", record.time / 1000.0, CAPTURE_CALLS[record.opcode].name);
+        const char* separator = "";
+        for (const char* type = CAPTURE_CALLS[record.opcode].signature; *type; type++, separator = ", ") {
+            switch (*type) {
+                case 'i': printf("%s%d", separator, (s++)->i); break;
+                case 'u': printf("%s%u", separator, (s++)->u); break;
+                case 'f': printf("%s%g", separator, (s++)->f); break;
+                case 'F': printf("%s[%u floats]", separator, record.arrayCount); break;
+            }
+        }
+        printf(")\n");
+    }
+}
+
+// Sizes of the replayed contexts, sglReadPixels() needs a large enough destination
+std::map<int, std::pair<int, int>> contextSizes;
+// color buffers of contexts recorded with sglCreateContextWithBuffer()
+std::map<int, vector<float>> contextBuffers;
+vector<uint8_t> readPixelsBuffer;
+
+void replayReadPixels(sglEPixelFormat format, int stride) {
+    const auto size = contextSizes.find(sglGetContext());
+    if (size == contextSizes.end()) {
+        // no context selected, let the call report the error
+        sglReadPixels(format, nullptr, stride);
+        return;
+    }
+    const long rowBytes = static_cast<long>(size->second.first) * (format == SGL_RGBA16F ? 8 : 4);
+    const long step = std::max(std::labs(stride), rowBytes);
+    const int height = size->second.second;
+    readPixelsBuffer.resize(static_cast<size_t>(step) * height);
+    // a negative stride writes the rows upwards from the last one
+    uint8_t* dst = readPixelsBuffer.data() + (stride < 0 ? step * (height - 1) : 0);
+    sglReadPixels(format, dst, stride);
+}
+
+// The buffer has the recorded stride, so that the rows are as far apart as
+// during the capture
+void replayCreateContextWithBuffer(int width, int height, uint32_t stride) {
+    const size_t rowFloats = std::max<size_t>(stride, size_t(std::max(width, 0)) * 12) / 4;
+    vector<float> buffer(rowFloats * std::max(height, 0));
+    const int id = sglCreateContextWithBuffer(width, height, buffer.data(), stride);
+    if (id >= 0) {
+        contextSizes[id] = std::make_pair(width, height);
+        contextBuffers[id] = std::move(buffer);
+    }
+}
+
+// The vertices of sglDrawArrays() and sglDrawElements() are recorded as
+// four floats each, drawn from the record with the same errors as captured
+const float replayVertexDummy[4] = { 0, 0, 0, 1 };
+
+const float* replayVertexPointer(const float* array, int first, int count) {
+    if (array || first < 0 || count <= 0) {
+        return array ? array : replayVertexDummy;
+    }
+    // the captured call had no vertices to read
+    return nullptr;
+}
+
+void replayDrawArrays(sglEElementType mode, int first, int count, const float* array) {
+    sglVertexPointer(4, 0, replayVertexPointer(array, first, count));
+    sglDrawArrays(mode, array ? 0 : first, count);
+}
+
+void replayDrawElements(sglEElementType mode, int count, const float* array) {
+    sglVertexPointer(4, 0, replayVertexPointer(array, 0, count));
+    vector<unsigned> indices(std::max(count, 0));
+    for (size_t i = 0; i < indices.size(); i++) {
+        indices[i] = static_cast<unsigned>(i);
+    }
+    sglDrawElements(mode, count, array || count <= 0 ? indices.data() : nullptr);
+}
+
+void execute(const Capture& capture, const Record& record) {
+    const Scalar* s = &capture.scalars[record.scalars];
+    const float* array = record.arrayCount ? &capture.arrays[record.array] : nullptr;
+    switch (record.opcode) {
+        case CAPTURE_THREAD: break;
+        case CAPTURE_INIT: sglInit(); break;
+        case CAPTURE_FINISH: sglFinish(); break;
+        case CAPTURE_CREATE_CONTEXT:
+            contextSizes[sglCreateContext(s[0].i, s[1].i)] = std::make_pair(s[0].i, s[1].i);
+            break;
+        case CAPTURE_DESTROY_CONTEXT: sglDestroyContext(s[0].i); break;
+        case CAPTURE_SET_CONTEXT: sglSetContext(s[0].i); break;
+        case CAPTURE_CLEAR: sglClear(s[0].u); break;
+        case CAPTURE_BEGIN: sglBegin(static_cast<sglEElementType>(s[0].i)); break;
+        case CAPTURE_END: sglEnd(); break;
+        case CAPTURE_VERTEX4F: sglVertex4f(s[0].f, s[1].f, s[2].f, s[3].f); break;
+        case CAPTURE_VERTEX3F: sglVertex3f(s[0].f, s[1].f, s[2].f); break;
+        case CAPTURE_VERTEX2F: sglVertex2f(s[0].f, s[1].f); break;
+        case CAPTURE_CIRCLE: sglCircle(s[0].f, s[1].f, s[2].f, s[3].f); break;
+        case CAPTURE_ELLIPSE: sglEllipse(s[0].f, s[1].f, s[2].f, s[3].f, s[4].f); break;
+        case CAPTURE_ARC: sglArc(s[0].f, s[1].f, s[2].f, s[3].f, s[4].f, s[5].f); break;
+        case CAPTURE_MATRIX_MODE: sglMatrixMode(static_cast<sglEMatrixMode>(s[0].i)); break;
+        case CAPTURE_PUSH_MATRIX: sglPushMatrix(); break;
+        case CAPTURE_POP_MATRIX: sglPopMatrix(); break;
+        case CAPTURE_LOAD_IDENTITY: sglLoadIdentity(); break;
+        case CAPTURE_LOAD_MATRIX: sglLoadMatrix(array); break;
+        case CAPTURE_MULT_MATRIX: sglMultMatrix(array); break;
+        case CAPTURE_TRANSLATE: sglTranslate(s[0].f, s[1].f, s[2].f); break;
+        case CAPTURE_SCALE: sglScale(s[0].f, s[1].f, s[2].f); break;
+        case CAPTURE_ROTATE_2D: sglRotate2D(s[0].f, s[1].f, s[2].f); break;
+        case CAPTURE_ROTATE_Y: sglRotateY(s[0].f); break;
+        case CAPTURE_ORTHO: sglOrtho(s[0].f, s[1].f, s[2].f, s[3].f, s[4].f, s[5].f); break;
+        case CAPTURE_FRUSTUM: sglFrustum(s[0].f, s[1].f, s[2].f, s[3].f, s[4].f, s[5].f); break;
+        case CAPTURE_VIEWPORT: sglViewport(s[0].i, s[1].i, s[2].i, s[3].i); break;
+        case CAPTURE_CLEAR_COLOR: sglClearColor(s[0].f, s[1].f, s[2].f, s[3].f); break;
+        case CAPTURE_COLOR3F: sglColor3f(s[0].f, s[1].f, s[2].f); break;
+        case CAPTURE_AREA_MODE: sglAreaMode(static_cast<sglEAreaMode>(s[0].i)); break;
+        case CAPTURE_POINT_SIZE: sglPointSize(s[0].f); break;
+        case CAPTURE_ENABLE: sglEnable(static_cast<sglEEnableFlags>(s[0].i)); break;
+        case CAPTURE_DISABLE: sglDisable(static_cast<sglEEnableFlags>(s[0].i)); break;
+        case CAPTURE_BEGIN_SCENE: sglBeginScene(); break;
+        case CAPTURE_END_SCENE: sglEndScene(); break;
+        case CAPTURE_SPHERE: sglSphere(s[0].f, s[1].f, s[2].f, s[3].f); break;
+        case CAPTURE_MATERIAL: sglMaterial(s[0].f, s[1].f, s[2].f, s[3].f, s[4].f, s[5].f, s[6].f, s[7].f); break;
+        case CAPTURE_POINT_LIGHT: sglPointLight(s[0].f, s[1].f, s[2].f, s[3].f, s[4].f, s[5].f); break;
+        case CAPTURE_RAY_TRACE_SCENE: sglRayTraceScene(); break;
+        case CAPTURE_RENDER_MODE: sglRenderMode(static_cast<sglERenderMode>(s[0].i)); break;
+        case CAPTURE_RASTERIZE_SCENE: sglRasterizeScene(); break;
+        case CAPTURE_EMISSIVE_MATERIAL: sglEmissiveMaterial(s[0].f, s[1].f, s[2].f, s[3].f, s[4].f, s[5].f); break;
+        case CAPTURE_ENVIRONMENT_MAP:
+            sglEnvironmentMap(s[0].i, s[1].i, const_cast<float*>(array));
+            break;
+        case CAPTURE_TONE_MAP: sglToneMap(static_cast<sglEToneMapOperator>(s[0].i), s[1].f); break;
+        case CAPTURE_READ_PIXELS: replayReadPixels(static_cast<sglEPixelFormat>(s[0].i), s[1].i); break;
+        case CAPTURE_CREATE_CONTEXT_WITH_BUFFER: replayCreateContextWithBuffer(s[0].i, s[1].i, s[2].u); break;
+        case CAPTURE_CREATE_SHARED_CONTEXT:
+            // the segment name is not recorded, a replay must not disturb the readers anyway
+            contextSizes[sglCreateContext(s[0].i, s[1].i)] = std::make_pair(s[0].i, s[1].i);
+            break;
+        case CAPTURE_PUBLISH_FRAME: sglPublishFrame(); break;
+        case CAPTURE_BEGIN_COMMAND_BUFFER: sglBeginCommandBuffer(s[0].u); break;
+        case CAPTURE_END_COMMAND_BUFFER: sglEndCommandBuffer(); break;
+        case CAPTURE_FLUSH: sglFlush(); break;
+        case CAPTURE_NEW_LIST: sglNewList(s[0].u); break;
+        case CAPTURE_END_LIST: sglEndList(); break;
+        case CAPTURE_CALL_LIST: sglCallList(s[0].u); break;
+        case CAPTURE_VERTEX_POINTER: sglVertexPointer(s[0].i, s[1].i, replayVertexDummy); break;
+        case CAPTURE_DRAW_ARRAYS:
+            replayDrawArrays(static_cast<sglEElementType>(s[0].i), s[1].i, s[2].i, array);
+            break;
+        case CAPTURE_DRAW_ELEMENTS:
+            replayDrawElements(static_cast<sglEElementType>(s[0].i), s[1].i, array);
+            break;
+        case CAPTURE_BEGIN_PATH: sglBeginPath(static_cast<sglEFillRule>(s[0].i)); break;
+        case CAPTURE_END_PATH: sglEndPath(); break;
+        case CAPTURE_OPCODE_COUNT: break;
+    }
+}
+
+// Executes the calls of one recorded thread on a thread of its own, one at
+// a time while the main thread waits
+class ReplayThread {
+public:
+    ReplayThread() : worker([this] { run(); }) {}
+
+    ~ReplayThread() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stop = true;
+        }
+        wake.notify_all();
+        worker.join();
+    }
+
+    // Returns true if the call set an error
+    bool Execute(const Capture& capture, const Record& record) {
+        std::unique_lock<std::mutex> lock(mutex);
+        pending = &record;
+        this->capture = &capture;
+        wake.notify_all();
+        wake.wait(lock, [this] { return !pending; });
+        return failed;
+    }
+
+private:
+    void run() {
+        std::unique_lock<std::mutex> lock(mutex);
+        while (true) {
+            wake.wait(lock, [this] { return pending || stop; });
+            if (!pending) {
+                return;
+            }
+            execute(*capture, *pending);
+            failed = sglGetError() != SGL_NO_ERROR;
+            pending = nullptr;
+            wake.notify_all();
+        }
+    }
+
+    std::mutex mutex;
+    std::condition_variable wake;
+    const Capture* capture = nullptr;
+    const Record* pending = nullptr;
+    bool failed = false;
+    bool stop = false;
+    // started last, the members above are ready for it
+    std::thread worker;
+};
+
+bool isFrameStart(const Capture& capture, const Record& record) {
+    return record.opcode == CAPTURE_CLEAR && (capture.scalars[record.scalars].u & SGL_COLOR_BUFFER_BIT);
+}
+
+struct ReplayOptions {
+    bool paced = false;
+    double fps = 0.0;
+    int loops = 1;
+};
+
+struct Frame {
+    double time;
+    uint64_t calls;
+};
+
+typedef std::chrono::steady_clock Clock;
+
+double elapsedMs(Clock::time_point from, Clock::time_point to) {
+    return std::chrono::duration<double, std::milli>(to - from).count();
+}
+
+// Replays the capture once and appends the frames, calls before the first
+// frame start (setup) are not part of any frame
+void replay(const Capture& capture, const ReplayOptions& options, vector<Frame>& frames, uint64_t& errors) {
+    // the recorded threads other than the first one
+    std::map<uint32_t, std::unique_ptr<ReplayThread>> threads;
+    ReplayThread* thread = nullptr;
+
+    if (capture.records.front().opcode != CAPTURE_INIT) {
+        // the capture started after sglInit(), the setup it missed cannot be replayed
+        sglInit();
+    }
+
+    const Clock::time_point replayStart = Clock::now();
+    Clock::time_point frameStart;
+    int frameIndex = -1;
+    uint64_t calls = 0;
+    for (const Record& record : capture.records) {
+        if (record.opcode == CAPTURE_THREAD) {
+            const uint32_t index = capture.scalars[record.scalars].u;
+            if (index == 0) {
+                thread = nullptr;
+                continue;
+            }
+            std::unique_ptr<ReplayThread>& replayThread = threads[index];
+            if (!replayThread) {
+                replayThread = std::make_unique<ReplayThread>();
+            }
+            thread = replayThread.get();
+            continue;
+        }
+
+        if (isFrameStart(capture, record)) {
+            Clock::time_point start = Clock::now();
+            if (frameIndex >= 0) {
+                frames.push_back({ elapsedMs(frameStart, start), calls });
+            }
+            frameIndex++;
+            calls = 0;
+            Clock::time_point target = start;
+            if (options.paced) {
+                target = replayStart + std::chrono::microseconds(record.time - capture.records.front().time);
+            }
+            else if (options.fps > 0) {
+                target = replayStart + std::chrono::microseconds(static_cast<int64_t>(frameIndex * 1e6 / options.fps));
+            }
+            if (target > start) {
+                std::this_thread::sleep_until(target);
+                start = Clock::now();
+            }
+            frameStart = start;
+        }
+
+        bool failed = false;
+        if (thread) {
+            failed = thread->Execute(capture, record);
+        }
+        else {
+            execute(capture, record);
+            failed = sglGetError() != SGL_NO_ERROR;
+        }
+        calls++;
+        if (failed) {
+            errors++;
+        }
+    }
+    if (frameIndex >= 0) {
+        frames.push_back({ elapsedMs(frameStart, Clock::now()), calls });
+    }
+    // the threads release their contexts before the library goes away
+    threads.clear();
+    sglFinish();
+}
+
+double percentile(const vector<double>& sorted, double fraction) {
+    size_t index = static_cast<size_t>(fraction * (sorted.size() - 1) + 0.5);
+    return sorted[std::min(index, sorted.size() - 1)];
+}
+
+void writeReport(FILE* out, const string& path, const Capture& capture, const vector<Frame>& frames, uint64_t errors) {
+    vector<double> times;
+    double total = 0.0;
+    for (const Frame& frame : frames) {
+        times.push_back(frame.time);
+        total += frame.time;
+    }
+    std::sort(times.begin(), times.end());
+
+    fprintf(out, "{\n  \"capture\": \"%s\", \"records\": %zu, \"frames\": %zu, \"errors\": %llu,\n",
+            path.c_str(), capture.records.size(), frames.size(), static_cast<unsigned long long>(errors));
+    if (!times.empty()) {
+        fprintf(out, "  \"frame_ms\": {\"mean\": %.3f, \"min\": %.3f, \"p50\": %.3f, \"p99\": %.3f, \"max\": %.3f},\n",
+                total / times.size(), times.front(), percentile(times, 0.5), percentile(times, 0.99), times.back());
+    }
+    fprintf(out, "  \"per_frame\": [");
+    for (size_t i = 0; i < frames.size(); i++) {
+        fprintf(out, "%s\n    {\"ms\": %.3f, \"calls\": %llu}", i ? "," : "", frames[i].time,
+                static_cast<unsigned long long>(frames[i].calls));
+    }
+    fprintf(out, "\n  ]\n}\n");
+    if (!times.empty()) {
+        fprintf(stderr, "%zu frames, mean %.3f ms, p50 %.3f ms, p99 %.3f ms, max %.3f ms\n",
+                frames.size(), total / times.size(), percentile(times, 0.5), percentile(times, 0.99), times.back());
+    }
+}
+
+}
+
+int main(int argc, char** argv) {
+    ReplayOptions options;
+    const char* capturePath = nullptr;
+    const char* outPath = nullptr;
+    bool dump = false;
+    for (int i = 1; i < argc; i++) {
+        const bool hasValue = i + 1 < argc;
+        if (!strcmp(argv[i], "--paced")) {
+            options.paced = true;
+        }
+        else if (!strcmp(argv[i], "--fps") && hasValue) {
+            options.fps = atof(argv[++i]);
+        }
+        else if (!strcmp(argv[i], "--loops") && hasValue) {
+            options.loops = std::max(1, atoi(argv[++i]));
+        }
+        else if (!strcmp(argv[i], "--dump")) {
+            dump = true;
+        }
+        else if (!strcmp(argv[i], "--out") && hasValue) {
+            outPath = argv[++i];
+        }
+        else if (argv[i][0] != '-' && !capturePath) {
+            capturePath = argv[i];
+        }
+        else {
+            capturePath = nullptr;
+            break;
+        }
+    }
+    if (!capturePath) {
+        fprintf(stderr, "usage: %s <capture> [--paced | --fps n] [--loops n] [--dump] [--out <file>]\n", argv[0]);
+        return 1;
+    }
+
+    Capture capture;
+    string error;
+    if (!loadCapture(capturePath, capture, error)) {
+        fprintf(stderr, "%s\n", error.c_str());
+        return 1;
+    }
+    if (dump) {
+        dumpCapture(capture);
+        return 0;
+    }
+    if (capture.records.empty()) {
+        fprintf(stderr, "%s contains no calls\n", capturePath);
+        return 1;
+    }
+
+    vector<Frame> frames;
+    uint64_t errors = 0;
+    for (int loop = 0; loop < options.loops; loop++) {
+        replay(capture, options, frames, errors);
+    }
+
+    FILE* out = outPath ? fopen(outPath, "w") : stdout;
+    if (!out) {
+        fprintf(stderr, "cannot open %s\n", outPath);
+        return 1;
+    }
+    writeReport(out, capturePath, capture, frames, errors);
+    if (outPath) {
+        fclose(out);
+    }
+    return 0;
+}